@@ -0,0 +1,1000 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2023 Intel Corporation
+ */
+/*
+ * Microbenchmarks of the library API.
+ * By default the in-process loopback transport is used, so the numbers
+ * are the host-side overhead only. With --device and --client the same
+ * benchmarks run against a real or emulated (metee-cuse) device,
+ * the round trip needs a client that answers every request, e.g. the
+ * echo client of the emulator or MKHI for 4 byte requests.
+ * Google Benchmark flags apply, e.g. --benchmark_format=json.
+ * allocs_per_op and syscalls_per_op are counted by interposition of
+ * the C library (metee_bench_counters.c), the results are tagged with
+ * commit, compiler and CPU for metee-benchcmp.
+ */
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <malloc.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <benchmark/benchmark.h>
+
+#include "metee.h"
+#include "metee_amthi.h"
+#include "metee_fwu.h"
+#include "metee_bundle.h"
+#include "metee_mkhi.h"
+#include "metee_bench_counters.h"
+#include "mkhi_schema.h"
+#include "amthi_schema.h"
+#include "metee_bench_commit.h"
+
+/* 2b2a7c1e-6b3c-4f3e-9d6a-1f0c5e8a4b71 */
+DEFINE_GUID(GUID_BENCH_ECHO_CLIENT,
+	0x2b2a7c1e, 0x6b3c, 0x4f3e, 0x9d, 0x6a, 0x1f, 0x0c, 0x5e, 0x8a, 0x4b, 0x71);
+
+#define BENCH_MAX_MSG_LEN 4096
+#define BENCH_TIMEOUT 1000
+
+static const char *g_device = TEE_LOOPBACK_DEVICE;
+static GUID g_client = GUID_BENCH_ECHO_CLIENT;
+
+static TEESTATUS EchoResponder(void *ctx, const GUID *guid,
+			       const void *request, size_t request_size,
+			       void *response, size_t *response_size)
+{
+	(void)ctx;
+	(void)guid;
+
+	if (request_size > *response_size)
+		return TEE_INSUFFICIENT_BUFFER;
+	memcpy(response, request, request_size);
+	*response_size = request_size;
+	return TEE_SUCCESS;
+}
+
+static bool ParseGuid(const char *str, GUID *guid)
+{
+	unsigned int l, w1, w2, b[8];
+	int n = 0;
+
+	if (sscanf(str, "%8x-%4x-%4x-%2x%2x-%2x%2x%2x%2x%2x%2x%n",
+		   &l, &w1, &w2, &b[0], &b[1], &b[2], &b[3],
+		   &b[4], &b[5], &b[6], &b[7], &n) != 11 || str[n] != '\0')
+		return false;
+
+	guid->b[0] = l & 0xFF;
+	guid->b[1] = (l >> 8) & 0xFF;
+	guid->b[2] = (l >> 16) & 0xFF;
+	guid->b[3] = (l >> 24) & 0xFF;
+	guid->b[4] = w1 & 0xFF;
+	guid->b[5] = (w1 >> 8) & 0xFF;
+	guid->b[6] = w2 & 0xFF;
+	guid->b[7] = (w2 >> 8) & 0xFF;
+	for (int i = 0; i < 8; i++)
+		guid->b[8 + i] = b[i];
+	return true;
+}
+
+static TEESTATUS OpenClient(PTEEHANDLE handle)
+{
+	TEESTATUS status;
+
+	status = TeeInit(handle, &g_client, g_device);
+	if (status != TEE_SUCCESS)
+		return status;
+	status = TeeConnect(handle);
+	if (status != TEE_SUCCESS)
+		TeeDisconnect(handle);
+	return status;
+}
+
+/* MKHI GetVersion header in front, so MKHI answers the 4 byte request */
+static void FillRequest(std::vector<unsigned char> &req)
+{
+	static const unsigned char mkhi_get_version[] = { 0xFF, 0x02, 0x00, 0x00 };
+
+	for (size_t i = 0; i < req.size(); i++)
+		req[i] = (i < sizeof(mkhi_get_version)) ? mkhi_get_version[i] : (unsigned char)i;
+}
+
+/* allocations and system calls of the benchmark thread per iteration */
+class OpCounters {
+public:
+	OpCounters() { bench_counters_get(&start_); }
+
+	void Report(benchmark::State &state)
+	{
+		struct bench_counters end;
+
+		bench_counters_get(&end);
+		state.counters["allocs_per_op"] =
+			benchmark::Counter((double)(end.allocs - start_.allocs),
+					   benchmark::Counter::kAvgIterations);
+		state.counters["syscalls_per_op"] =
+			benchmark::Counter((double)(end.syscalls - start_.syscalls),
+					   benchmark::Counter::kAvgIterations);
+	}
+
+private:
+	struct bench_counters start_;
+};
+
+static void BM_InitConnectDisconnect(benchmark::State &state)
+{
+	TEEHANDLE handle = TEEHANDLE_ZERO;
+	TEESTATUS status;
+
+	OpCounters counters;
+	for (auto _ : state) {
+		status = OpenClient(&handle);
+		if (status != TEE_SUCCESS) {
+			state.SkipWithError("cannot connect to the client");
+			break;
+		}
+		TeeDisconnect(&handle);
+	}
+	counters.Report(state);
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_InitConnectDisconnect);
+
+/* args: message size, timeout of TeeWrite/TeeRead (0 - blocking) */
+static void BM_RoundTrip(benchmark::State &state)
+{
+	TEEHANDLE handle = TEEHANDLE_ZERO;
+	size_t size = state.range(0);
+	uint32_t timeout = (uint32_t)state.range(1);
+	std::vector<unsigned char> req(size);
+	std::vector<unsigned char> resp;
+	size_t written, read;
+
+	if (OpenClient(&handle) != TEE_SUCCESS) {
+		state.SkipWithError("cannot connect to the client");
+		return;
+	}
+	if (size > handle.maxMsgLen) {
+		TeeDisconnect(&handle);
+		state.SkipWithError("message is bigger than the client MTU");
+		return;
+	}
+	FillRequest(req);
+	resp.resize(handle.maxMsgLen);
+
+	OpCounters counters;
+	for (auto _ : state) {
+		if (TeeWrite(&handle, req.data(), req.size(), &written, timeout) != TEE_SUCCESS) {
+			state.SkipWithError("write failed");
+			break;
+		}
+		if (TeeRead(&handle, resp.data(), resp.size(), &read, timeout) != TEE_SUCCESS) {
+			state.SkipWithError("read failed");
+			break;
+		}
+	}
+	counters.Report(state);
+	state.SetItemsProcessed(state.iterations());
+	state.SetBytesProcessed(state.iterations() * (int64_t)size);
+	TeeDisconnect(&handle);
+}
+BENCHMARK(BM_RoundTrip)
+	->ArgNames({"size", "timeout"})
+	->ArgsProduct({benchmark::CreateRange(4, BENCH_MAX_MSG_LEN, 4), {0, BENCH_TIMEOUT}});
+
+static void BM_FWStatus(benchmark::State &state)
+{
+	TEEHANDLE handle = TEEHANDLE_ZERO;
+	uint32_t fwsts;
+
+	if (TeeInit(&handle, &g_client, g_device) != TEE_SUCCESS) {
+		state.SkipWithError("cannot open the device");
+		return;
+	}
+
+	OpCounters counters;
+	for (auto _ : state) {
+		if (TeeFWStatus(&handle, 0, &fwsts) != TEE_SUCCESS) {
+			state.SkipWithError("fw status failed");
+			break;
+		}
+		benchmark::DoNotOptimize(fwsts);
+	}
+	counters.Report(state);
+	state.SetItemsProcessed(state.iterations());
+	TeeDisconnect(&handle);
+}
+BENCHMARK(BM_FWStatus);
+
+/* hand written bit-field header checks, as in the samples */
+#pragma pack(push, 1)
+struct bench_mkhi_hdr {
+	uint32_t group : 8;
+	uint32_t command : 7;
+	uint32_t is_response : 1;
+	uint32_t reserved : 8;
+	uint32_t result : 8;
+};
+#pragma pack(pop)
+
+static int bench_mkhi_fw_version_rsp_valid(const void *buf, size_t len)
+{
+	const struct bench_mkhi_hdr *hdr = (const struct bench_mkhi_hdr *)buf;
+
+	if (len < MKHI_GEN_GET_FW_VERSION_RSP_MIN_LEN)
+		return 0;
+	if (len > MKHI_GEN_GET_FW_VERSION_RSP_MAX_LEN)
+		return 0;
+	if (hdr->group != MKHI_GROUP_GEN)
+		return 0;
+	if (hdr->command != MKHI_GEN_GET_FW_VERSION)
+		return 0;
+	return hdr->is_response == 1;
+}
+
+/* validation of unpredictable responses: 0 - hand written, 1 - generated */
+static void BM_MkhiValidate(benchmark::State &state)
+{
+	static const size_t count = 256;
+	std::vector<struct mkhi_gen_get_fw_version_rsp> rsps(count);
+	std::vector<size_t> lens(count);
+	uint32_t seed = 1;
+	size_t i = 0;
+	int valid = 0;
+
+	for (size_t n = 0; n < count; n++) {
+		seed = seed * 1103515245 + 12345;
+		mkhi_gen_get_fw_version_rsp_init(&rsps[n]);
+		lens[n] = MKHI_GEN_GET_FW_VERSION_RSP_MIN_LEN;
+		switch ((seed >> 16) % 4) {
+		case 1:
+			lens[n]--;
+			break;
+		case 2:
+			rsps[n].header.word = mkhi_hdr_word_set_is_response(rsps[n].header.word, 0);
+			break;
+		case 3:
+			rsps[n].header.word = mkhi_hdr_word_set_command(rsps[n].header.word, 1);
+			break;
+		}
+	}
+
+	for (auto _ : state) {
+		if (state.range(0))
+			valid += mkhi_gen_get_fw_version_rsp_valid(&rsps[i], lens[i]);
+		else
+			valid += bench_mkhi_fw_version_rsp_valid(&rsps[i], lens[i]);
+		i = (i + 1) % count;
+	}
+	benchmark::DoNotOptimize(valid);
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_MkhiValidate)->Arg(0)->Arg(1);
+
+/* loopback GSC firmware update client, acknowledges every request */
+DEFINE_GUID(GUID_BENCH_FWU_CLIENT,
+	0x87d90ca5, 0x3495, 0x4559, 0x81, 0x05, 0x3f, 0xbf, 0xa3, 0x7b, 0x8b, 0x79);
+
+static TEESTATUS FwuResponder(void *ctx, const GUID *guid,
+			      const void *request, size_t request_size,
+			      void *response, size_t *response_size)
+{
+	struct tee_fwu_rsp rsp;
+
+	(void)ctx;
+	(void)guid;
+	if (request_size < sizeof(rsp.header) || *response_size < sizeof(rsp))
+		return TEE_INVALID_PARAMETER;
+	memset(&rsp, 0, sizeof(rsp));
+	memcpy(&rsp.header, request, sizeof(rsp.header));
+	rsp.header.flags = TEE_FWU_RESPONSE;
+	memcpy(response, &rsp, sizeof(rsp));
+	*response_size = sizeof(rsp);
+	return TEE_SUCCESS;
+}
+
+/* chunk by chunk update from a read() buffer, as the updaters did */
+static TEESTATUS FwuUpdateRead(PTEEHANDLE handle, int fd, size_t size)
+{
+	size_t chunk = handle->maxMsgLen - sizeof(struct tee_fwu_data_req);
+	std::vector<uint8_t> slice(chunk);
+	std::vector<uint8_t> msg(handle->maxMsgLen);
+	struct tee_fwu_start_req start;
+	struct tee_fwu_data_req data;
+	struct tee_fwu_end_req end;
+	struct tee_fwu_rsp rsp;
+	size_t done;
+	ssize_t len;
+
+	memset(&start, 0, sizeof(start));
+	start.header.command_id = TEE_FWU_START;
+	start.update_img_length = (uint32_t)size;
+	start.payload_type = TEE_FWU_PAYLOAD_GFX_FW;
+	if (TeeWrite(handle, &start, sizeof(start), &done, 0) ||
+	    TeeRead(handle, &rsp, sizeof(rsp), &done, 0) || rsp.status)
+		return TEE_UNABLE_TO_COMPLETE_OPERATION;
+
+	lseek(fd, 0, SEEK_SET);
+	while ((len = read(fd, slice.data(), slice.size())) > 0) {
+		memset(&data, 0, sizeof(data));
+		data.header.command_id = TEE_FWU_DATA;
+		data.data_length = (uint32_t)len;
+		memcpy(msg.data(), &data, sizeof(data));
+		memcpy(msg.data() + sizeof(data), slice.data(), len);
+		if (TeeWrite(handle, msg.data(), sizeof(data) + len, &done, 0) ||
+		    TeeRead(handle, &rsp, sizeof(rsp), &done, 0) || rsp.status)
+			return TEE_UNABLE_TO_COMPLETE_OPERATION;
+	}
+
+	memset(&end, 0, sizeof(end));
+	end.header.command_id = TEE_FWU_END;
+	if (TeeWrite(handle, &end, sizeof(end), &done, 0) ||
+	    TeeRead(handle, &rsp, sizeof(rsp), &done, 0) || rsp.status)
+		return TEE_UNABLE_TO_COMPLETE_OPERATION;
+	return TEE_SUCCESS;
+}
+
+/*
+ * args: image size in KiB, 0 - read() per chunk, 1 - TeeFwuUpdateFile
+ * Host-side cost of pushing an image through the loopback FWU client.
+ */
+static void BM_FwuUpdate(benchmark::State &state)
+{
+	TEEHANDLE handle = TEEHANDLE_ZERO;
+	size_t size = state.range(0) * 1024;
+	std::vector<uint8_t> image(size, 0x5A);
+	char path[] = "/tmp/metee_bench_fwu_XXXXXX";
+	TEESTATUS status = TEE_SUCCESS;
+	int fd;
+
+	fd = mkstemp(path);
+	if (fd < 0 || write(fd, image.data(), size) != (ssize_t)size) {
+		state.SkipWithError("cannot create the image");
+		goto out;
+	}
+	if (TeeLoopbackRegister(&GUID_BENCH_FWU_CLIENT, BENCH_MAX_MSG_LEN, 1, FwuResponder, NULL) != TEE_SUCCESS ||
+	    TeeInit(&handle, &GUID_BENCH_FWU_CLIENT, TEE_LOOPBACK_DEVICE) != TEE_SUCCESS ||
+	    TeeConnect(&handle) != TEE_SUCCESS) {
+		state.SkipWithError("cannot connect to the loopback client");
+		goto out;
+	}
+
+	{
+		OpCounters counters;
+		for (auto _ : state) {
+			if (state.range(1))
+				status = TeeFwuUpdateFile(&handle, TEE_FWU_PAYLOAD_GFX_FW, path,
+							  NULL, 0, NULL, NULL, NULL, 0);
+			else
+				status = FwuUpdateRead(&handle, fd, size);
+			if (status != TEE_SUCCESS) {
+				state.SkipWithError("update failed");
+				break;
+			}
+		}
+		counters.Report(state);
+	}
+	state.SetBytesProcessed(state.iterations() * size);
+
+out:
+	TeeDisconnect(&handle);
+	TeeLoopbackUnregister(&GUID_BENCH_FWU_CLIENT);
+	if (fd >= 0) {
+		close(fd);
+		unlink(path);
+	}
+}
+BENCHMARK(BM_FwuUpdate)->ArgsProduct({{1024, 8192}, {0, 1}});
+
+/*
+ * args: number of devices, concurrency
+ * 256 KiB image to loopback devices acknowledging after 20us,
+ * wall time of the node update against the number of devices at once.
+ */
+static void BM_FwuUpdateDevices(benchmark::State &state)
+{
+	size_t count = state.range(0);
+	size_t size = 256 * 1024;
+	std::vector<uint8_t> image(size, 0x5A);
+	std::vector<struct tee_fwu_device> devices(count);
+	std::vector<std::string> names(count);
+	char path[] = "/tmp/metee_bench_fwu_XXXXXX";
+	int fd;
+
+	fd = mkstemp(path);
+	if (fd < 0 || write(fd, image.data(), size) != (ssize_t)size) {
+		state.SkipWithError("cannot create the image");
+		goto out;
+	}
+	if (TeeLoopbackRegister(&GUID_BENCH_FWU_CLIENT, BENCH_MAX_MSG_LEN, 1,
+				FwuResponder, NULL) != TEE_SUCCESS ||
+	    TeeLoopbackSetLatency(&GUID_BENCH_FWU_CLIENT, 20000) != TEE_SUCCESS) {
+		state.SkipWithError("cannot register the loopback client");
+		goto out;
+	}
+	for (size_t i = 0; i < count; i++) {
+		names[i] = std::string(TEE_LOOPBACK_DEVICE ":gpu") + std::to_string(i);
+		devices[i].device = names[i].c_str();
+	}
+
+	for (auto _ : state) {
+		if (TeeFwuUpdateDevices(&GUID_BENCH_FWU_CLIENT, TEE_FWU_PAYLOAD_GFX_FW, path,
+					NULL, 0, devices.data(), count,
+					(unsigned int)state.range(1),
+					NULL, NULL, 0) != TEE_SUCCESS) {
+			state.SkipWithError("update failed");
+			break;
+		}
+	}
+	state.SetBytesProcessed(state.iterations() * size * count);
+
+out:
+	TeeLoopbackUnregister(&GUID_BENCH_FWU_CLIENT);
+	if (fd >= 0) {
+		close(fd);
+		unlink(path);
+	}
+}
+BENCHMARK(BM_FwuUpdateDevices)
+	->Args({8, 1})->Args({8, 2})->Args({8, 8})
+	->UseRealTime()->Unit(benchmark::kMillisecond);
+
+/*
+ * args: mode, threads
+ * 64 MiB bundle with one partition, open and verify:
+ * 0 - read the whole file into memory and hash it, 1 - map the bundle
+ * and verify the partition on the worker threads.
+ */
+static void BM_BundleVerify(benchmark::State &state)
+{
+	size_t size = 64 * 1024 * 1024;
+	std::vector<uint8_t> pkg(sizeof(struct tee_bundle_hdr) +
+				 sizeof(struct tee_bundle_entry) + size);
+	struct tee_bundle_hdr *hdr = (struct tee_bundle_hdr *)pkg.data();
+	struct tee_bundle_entry *entry = (struct tee_bundle_entry *)(hdr + 1);
+	uint8_t *part = (uint8_t *)(entry + 1);
+	char path[] = "/tmp/metee_bench_bundle_XXXXXX";
+	int fd;
+
+	for (size_t i = 0; i < size; i++)
+		part[i] = (uint8_t)(i * 31 + i / 4096);
+	hdr->magic = TEE_BUNDLE_MAGIC;
+	hdr->version = TEE_BUNDLE_VERSION;
+	hdr->header_length = sizeof(*hdr);
+	hdr->partitions = 1;
+	hdr->entry_length = sizeof(*entry);
+	entry->payload_type = TEE_FWU_PAYLOAD_GFX_FW;
+	entry->offset = sizeof(*hdr) + sizeof(*entry);
+	entry->length = (uint32_t)size;
+	entry->hash = TeeFwuImageHash(part, size);
+
+	fd = mkstemp(path);
+	if (fd < 0 || write(fd, pkg.data(), pkg.size()) != (ssize_t)pkg.size()) {
+		state.SkipWithError("cannot create the bundle");
+		goto out;
+	}
+
+	for (auto _ : state) {
+		if (state.range(0) == 0) {
+			std::vector<uint8_t> buf(pkg.size());
+			int in = open(path, O_RDONLY);
+
+			if (in < 0 || read(in, buf.data(), buf.size()) != (ssize_t)buf.size()) {
+				state.SkipWithError("cannot read the bundle");
+				if (in >= 0)
+					close(in);
+				break;
+			}
+			close(in);
+			if (TeeFwuImageHash(buf.data() + entry->offset, size) != entry->hash) {
+				state.SkipWithError("hash mismatch");
+				break;
+			}
+		} else {
+			struct tee_bundle *bundle;
+
+			if (TeeBundleOpen(path, &bundle) != TEE_SUCCESS ||
+			    TeeBundleVerifyStart(bundle, 0,
+						 (unsigned int)state.range(1)) != TEE_SUCCESS ||
+			    TeeBundleVerifyWait(bundle) != TEE_SUCCESS) {
+				state.SkipWithError("verification failed");
+				break;
+			}
+			TeeBundleClose(bundle);
+		}
+	}
+	state.SetBytesProcessed(state.iterations() * size);
+
+out:
+	if (fd >= 0) {
+		close(fd);
+		unlink(path);
+	}
+}
+BENCHMARK(BM_BundleVerify)
+	->Args({0, 1})->Args({1, 1})->Args({1, 2})->Args({1, 4})->Args({1, 8})
+	->UseRealTime()->Unit(benchmark::kMillisecond);
+
+/*
+ * One version string out of a full code versions response:
+ * 0 - copy the response and convert all entries, as the inventory agents do,
+ * 1 - view of the response and lookup by description.
+ */
+static void BM_AmthiCodeVersionLookup(benchmark::State &state)
+{
+	struct amthi_get_code_versions_rsp rsp;
+	struct tee_amthi_code_versions versions;
+	struct tee_amthi_string_view view;
+	std::string version;
+
+	memset(&rsp, 0, sizeof(rsp));
+	rsp.versions_count = AMTHI_VERSIONS_NUMBER;
+	for (uint32_t i = 0; i < AMTHI_VERSIONS_NUMBER; i++) {
+		std::string desc = (i == AMTHI_VERSIONS_NUMBER / 2) ? "AMT" : "Component" + std::to_string(i);
+
+		rsp.versions[i].description.length = (uint16_t)desc.size();
+		memcpy(rsp.versions[i].description.string, desc.data(), desc.size());
+		rsp.versions[i].version.length = 12;
+		memcpy(rsp.versions[i].version.string, "16.1.25.2049", 12);
+	}
+	versions.rsp = &rsp;
+	versions.count = rsp.versions_count;
+
+	for (auto _ : state) {
+		if (state.range(0) == 0) {
+			struct amthi_get_code_versions_rsp copy = rsp;
+			std::vector<std::pair<std::string, std::string>> all;
+
+			benchmark::DoNotOptimize(&copy);
+			for (uint32_t i = 0; i < copy.versions_count; i++)
+				all.emplace_back(std::string((const char *)copy.versions[i].description.string,
+							     copy.versions[i].description.length),
+						 std::string((const char *)copy.versions[i].version.string,
+							     copy.versions[i].version.length));
+			for (const auto &entry : all)
+				if (entry.first == "AMT")
+					version = entry.second;
+		} else {
+			if (TeeAmthiCodeVersionsFind(&versions, "AMT", &view) != TEE_SUCCESS) {
+				state.SkipWithError("lookup failed");
+				break;
+			}
+			version.assign(view.data, view.length);
+		}
+		benchmark::DoNotOptimize(version);
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_AmthiCodeVersionLookup)->Arg(0)->Arg(1);
+
+/* loopback MKHI client, answers every request with the firmware version */
+DEFINE_GUID(GUID_BENCH_MKHI_CLIENT,
+	0x5c7a6b1d, 0x0e2f, 0x4b8a, 0x9c, 0x31, 0x7d, 0x42, 0xa6, 0x0b, 0x58, 0xe3);
+
+static TEESTATUS MkhiVersionResponder(void *ctx, const GUID *guid,
+				      const void *request, size_t request_size,
+				      void *response, size_t *response_size)
+{
+	struct {
+		struct tee_mkhi_hdr hdr;
+		struct tee_mkhi_fw_version version;
+	} rsp;
+
+	(void)ctx;
+	(void)guid;
+	if (request_size < sizeof(rsp.hdr) || *response_size < sizeof(rsp))
+		return TEE_INVALID_PARAMETER;
+	memset(&rsp, 0, sizeof(rsp));
+	memcpy(&rsp.hdr, request, sizeof(rsp.hdr));
+	rsp.hdr.command |= TEE_MKHI_RESPONSE;
+	rsp.version.code.major = 16;
+	rsp.version.code.minor = 1;
+	memcpy(response, &rsp, sizeof(rsp));
+	*response_size = sizeof(rsp);
+	return TEE_SUCCESS;
+}
+
+/*
+ * Firmware version at process startup, from init to disconnect, with
+ * MKHI answering in 500us: 0 - connect and query, 1 - through the
+ * process shared cache, filled by the first iteration.
+ */
+static void BM_MkhiFwVersionStartup(benchmark::State &state)
+{
+	char path[] = "/tmp/metee_bench_fwcache_XXXXXX";
+	struct tee_mkhi_fw_version version;
+	TEESTATUS status;
+	int fd;
+
+	fd = mkstemp(path);
+	if (fd < 0 ||
+	    TeeLoopbackRegister(&GUID_BENCH_MKHI_CLIENT, BENCH_MAX_MSG_LEN, 1,
+				MkhiVersionResponder, NULL) != TEE_SUCCESS ||
+	    TeeLoopbackSetLatency(&GUID_BENCH_MKHI_CLIENT, 500000) != TEE_SUCCESS) {
+		state.SkipWithError("cannot register the loopback client");
+		goto out;
+	}
+	setenv("METEE_FWCACHE", path, 1);
+
+	{
+		OpCounters counters;
+		for (auto _ : state) {
+			TEEHANDLE handle = TEEHANDLE_ZERO;
+
+			status = TeeInit(&handle, &GUID_BENCH_MKHI_CLIENT, TEE_LOOPBACK_DEVICE);
+			if (status == TEE_SUCCESS) {
+				if (state.range(0))
+					status = TeeMkhiGetFwVersionCached(&handle, &version, BENCH_TIMEOUT);
+				else if ((status = TeeConnect(&handle)) == TEE_SUCCESS)
+					status = TeeMkhiGetFwVersion(&handle, &version, BENCH_TIMEOUT);
+				TeeDisconnect(&handle);
+			}
+			if (status != TEE_SUCCESS) {
+				state.SkipWithError("cannot obtain the version");
+				break;
+			}
+			benchmark::DoNotOptimize(version);
+		}
+		counters.Report(state);
+	}
+	state.SetItemsProcessed(state.iterations());
+	unsetenv("METEE_FWCACHE");
+
+out:
+	TeeLoopbackUnregister(&GUID_BENCH_MKHI_CLIENT);
+	if (fd >= 0) {
+		close(fd);
+		unlink(path);
+	}
+}
+BENCHMARK(BM_MkhiFwVersionStartup)->Arg(0)->Arg(1)
+	->UseRealTime()->Unit(benchmark::kMicrosecond);
+
+/* every thread has own connection to the same client */
+static void BM_SharedClientContention(benchmark::State &state)
+{
+	TEEHANDLE handle = TEEHANDLE_ZERO;
+	std::vector<unsigned char> req(state.range(0));
+	std::vector<unsigned char> resp;
+	size_t written, read;
+
+	if (OpenClient(&handle) != TEE_SUCCESS) {
+		state.SkipWithError("cannot connect to the client");
+		return;
+	}
+	FillRequest(req);
+	resp.resize(handle.maxMsgLen);
+
+	OpCounters counters;
+	for (auto _ : state) {
+		if (TeeWrite(&handle, req.data(), req.size(), &written, 0) != TEE_SUCCESS ||
+		    TeeRead(&handle, resp.data(), resp.size(), &read, 0) != TEE_SUCCESS) {
+			state.SkipWithError("round trip failed");
+			break;
+		}
+	}
+	counters.Report(state);
+	state.SetItemsProcessed(state.iterations());
+	TeeDisconnect(&handle);
+}
+BENCHMARK(BM_SharedClientContention)
+	->ArgName("size")->Arg(64)
+	->ThreadRange(1, 8)->UseRealTime();
+
+/* schedules of TeeFaultInjectSet, the first one is the baseline */
+static const char *const fault_mixes[] = {
+	"",
+	"connect:ebusy%2,read:enodev@0.001",
+	"write:short@0.01",
+	"read:etime@0.01",
+	"write:eintr@0.005,read:eintr@0.005",
+	"connect:ebusy%3,read:enodev@0.001,write:short@0.002,read:etime@0.002,read:eintr@0.002",
+};
+
+/* reconnect until the client answers, busy is retried */
+static TEESTATUS Reconnect(PTEEHANDLE handle)
+{
+	TEESTATUS status;
+
+	TeeDisconnect(handle);
+	do {
+		status = OpenClient(handle);
+	} while (status == TEE_BUSY);
+	return status;
+}
+
+/*
+ * Round trip with the recovery policy of a typical application:
+ * disconnected - reconnect and resend, short write - drop the response
+ * to the truncated request and resend, other failure - retry the operation.
+ * Returns the number of failed operations, first_failure is the start of the first one.
+ */
+static int RecoveringRoundTrip(PTEEHANDLE handle, const std::vector<unsigned char> &req,
+			       std::vector<unsigned char> &resp, TEESTATUS *status,
+			       std::chrono::steady_clock::time_point *first_failure)
+{
+	std::chrono::steady_clock::time_point call;
+	size_t written, read;
+	int failures = 0;
+	auto failed = [&]() {
+		if (!failures++)
+			*first_failure = call;
+	};
+
+	for (;;) {
+		call = std::chrono::steady_clock::now();
+		*status = TeeWrite(handle, req.data(), req.size(), &written, BENCH_TIMEOUT);
+		if (*status == TEE_SUCCESS && written != req.size()) {
+			failed();
+			TeeRead(handle, resp.data(), resp.size(), &read, BENCH_TIMEOUT);
+			continue;
+		}
+		while (*status == TEE_SUCCESS) {
+			call = std::chrono::steady_clock::now();
+			*status = TeeRead(handle, resp.data(), resp.size(), &read, BENCH_TIMEOUT);
+			if (*status == TEE_SUCCESS)
+				return failures;
+			if (*status != TEE_DISCONNECTED) {
+				failed();
+				*status = TEE_SUCCESS;
+			}
+		}
+		failed();
+		if (*status == TEE_DISCONNECTED && (*status = Reconnect(handle)) != TEE_SUCCESS)
+			return failures;
+	}
+}
+
+/*
+ * args: index of the fault mix, message size
+ * recover_us - mean time from the first failure to the completed round trip
+ */
+static void BM_FaultRecovery(benchmark::State &state)
+{
+	TEEHANDLE handle = TEEHANDLE_ZERO;
+	std::vector<unsigned char> req(state.range(1));
+	std::vector<unsigned char> resp;
+	uint64_t recoveries = 0, faults = 0;
+	double recover_ns = 0;
+	TEESTATUS status;
+	int failures;
+
+	if (TeeFaultInjectSet(fault_mixes[state.range(0)]) != TEE_SUCCESS) {
+		state.SkipWithError("fault injection is not supported");
+		return;
+	}
+	state.SetLabel(fault_mixes[state.range(0)]);
+	if (Reconnect(&handle) != TEE_SUCCESS) {
+		TeeFaultInjectSet(NULL);
+		state.SkipWithError("cannot connect to the client");
+		return;
+	}
+	FillRequest(req);
+	resp.resize(handle.maxMsgLen);
+
+	for (auto _ : state) {
+		std::chrono::steady_clock::time_point first_failure;
+
+		failures = RecoveringRoundTrip(&handle, req, resp, &status, &first_failure);
+		if (status != TEE_SUCCESS) {
+			state.SkipWithError("cannot recover");
+			break;
+		}
+		if (failures) {
+			recover_ns += std::chrono::duration<double, std::nano>(
+				std::chrono::steady_clock::now() - first_failure).count();
+			recoveries++;
+			faults += failures;
+		}
+	}
+	state.SetItemsProcessed(state.iterations());
+	state.SetBytesProcessed(state.iterations() * (int64_t)req.size());
+	state.counters["faults"] = benchmark::Counter((double)faults, benchmark::Counter::kIsRate);
+	state.counters["recover_us"] = recoveries ? recover_ns / recoveries / 1000 : 0;
+	TeeDisconnect(&handle);
+	TeeFaultInjectSet(NULL);
+}
+BENCHMARK(BM_FaultRecovery)
+	->ArgNames({"mix", "size"})
+	->ArgsProduct({benchmark::CreateDenseRange(0, sizeof(fault_mixes) / sizeof(fault_mixes[0]) - 1, 1),
+		       {64}});
+
+/* heap bytes in use, zero when the C library cannot tell */
+static size_t HeapInUse()
+{
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+	return mallinfo2().uordblks;
+#else
+	return 0;
+#endif
+}
+
+static size_t ResidentBytes()
+{
+	unsigned long size = 0, resident = 0;
+	FILE *fp = fopen("/proc/self/statm", "r");
+
+	if (!fp)
+		return 0;
+	if (fscanf(fp, "%lu %lu", &size, &resident) != 2)
+		resident = 0;
+	fclose(fp);
+	return resident * sysconf(_SC_PAGESIZE);
+}
+
+/* every session holds a descriptor, the mei device node or the loopback eventfd */
+static bool RaiseFileLimit(size_t n)
+{
+	struct rlimit limit;
+
+	if (getrlimit(RLIMIT_NOFILE, &limit))
+		return false;
+	if (limit.rlim_cur >= n)
+		return true;
+	if (limit.rlim_max < n)
+		return false;
+	limit.rlim_cur = n;
+	return setrlimit(RLIMIT_NOFILE, &limit) == 0;
+}
+
+/*
+ * arg: number of handles open at once
+ * Reports init+connect and teardown rates, the heap and resident memory
+ * per idle connected session and the round trip latency measured on
+ * up to 1000 of the open sessions spread over all of them.
+ * The first write of a session allocates its response buffer,
+ * not counted in the idle footprint.
+ */
+static void BM_HandleScaling(benchmark::State &state)
+{
+	size_t n = state.range(0);
+	size_t probes = (n < 1000) ? n : 1000;
+	std::vector<TEEHANDLE> handles(n);
+	std::vector<unsigned char> req(64);
+	std::vector<unsigned char> resp;
+	double connect_s = 0, teardown_s = 0, rtt_ns = 0;
+	size_t heap = 0, rss = 0, written, read;
+	bool first = true;
+
+	if (!RaiseFileLimit(n + 64)) {
+		state.SkipWithError("RLIMIT_NOFILE hard limit is below the number of handles");
+		return;
+	}
+	FillRequest(req);
+
+	for (auto _ : state) {
+		size_t heap0 = HeapInUse(), rss0 = ResidentBytes();
+		size_t opened = 0;
+		auto t0 = std::chrono::steady_clock::now();
+
+		for (; opened < n; opened++) {
+			handles[opened] = TEEHANDLE_ZERO;
+			if (OpenClient(&handles[opened]) != TEE_SUCCESS)
+				break;
+		}
+		auto t1 = std::chrono::steady_clock::now();
+		if (first) {
+			heap = HeapInUse() - heap0;
+			rss = ResidentBytes() - rss0;
+			first = false;
+		}
+
+		/* the first pass allocates the response buffers, the second is timed */
+		auto t2 = t1;
+		for (int pass = 0; pass < 2 && opened == n; pass++) {
+			t2 = std::chrono::steady_clock::now();
+			resp.resize(handles[0].maxMsgLen);
+			for (size_t i = 0; i < probes; i++) {
+				PTEEHANDLE h = &handles[i * n / probes];
+
+				if (TeeWrite(h, req.data(), req.size(), &written, 0) != TEE_SUCCESS ||
+				    TeeRead(h, resp.data(), resp.size(), &read, 0) != TEE_SUCCESS) {
+					opened = 0;
+					break;
+				}
+			}
+		}
+		auto t3 = std::chrono::steady_clock::now();
+
+		for (size_t i = 0; i < n; i++)
+			TeeDisconnect(&handles[i]);
+		auto t4 = std::chrono::steady_clock::now();
+
+		if (opened != n) {
+			state.SkipWithError("cannot open and use all the sessions");
+			break;
+		}
+		connect_s += std::chrono::duration<double>(t1 - t0).count();
+		rtt_ns += std::chrono::duration<double, std::nano>(t3 - t2).count() / probes;
+		teardown_s += std::chrono::duration<double>(t4 - t3).count();
+	}
+
+	state.SetComplexityN(n);
+	state.counters["connect_per_s"] = connect_s ? n * state.iterations() / connect_s : 0;
+	state.counters["teardown_per_s"] = teardown_s ? n * state.iterations() / teardown_s : 0;
+	state.counters["rtt_ns"] = state.iterations() ? rtt_ns / state.iterations() : 0;
+	state.counters["heap_per_handle"] = (double)heap / n;
+	state.counters["rss_per_handle"] = (double)rss / n;
+}
+BENCHMARK(BM_HandleScaling)
+	->ArgName("handles")
+	->RangeMultiplier(10)->Range(1000, 100000)
+	->Unit(benchmark::kMillisecond)
+	->Complexity(benchmark::oN);
+
+static void usage(const char *p)
+{
+	fprintf(stdout, "%s: [--device=<device>] [--client=<uuid>] [benchmark flags]\n", p);
+	fprintf(stdout, "    default device is %s with in-process echo client\n",
+		TEE_LOOPBACK_DEVICE);
+}
+
+static std::string CpuModel()
+{
+	std::ifstream cpuinfo("/proc/cpuinfo");
+	std::string line;
+
+	while (std::getline(cpuinfo, line)) {
+		if (line.compare(0, 10, "model name") != 0)
+			continue;
+		size_t pos = line.find(": ");
+		if (pos != std::string::npos)
+			return line.substr(pos + 2);
+	}
+	return "unknown";
+}
+
+int main(int argc, char *argv[])
+{
+	std::vector<char *> args;
+	bool loopback;
+
+	for (int i = 0; i < argc; i++) {
+		std::string arg = argv[i];
+
+		if (arg.compare(0, 9, "--device=") == 0) {
+			g_device = argv[i] + 9;
+		} else if (arg.compare(0, 9, "--client=") == 0) {
+			if (!ParseGuid(argv[i] + 9, &g_client)) {
+				usage(argv[0]);
+				return 1;
+			}
+		} else {
+			if (arg == "--help")
+				usage(argv[0]);
+			args.push_back(argv[i]);
+		}
+	}
+	argc = (int)args.size();
+
+	loopback = !strncmp(g_device, TEE_LOOPBACK_DEVICE, strlen(TEE_LOOPBACK_DEVICE));
+	if (loopback &&
+	    TeeLoopbackRegister(&g_client, BENCH_MAX_MSG_LEN, 1, EchoResponder, NULL) != TEE_SUCCESS) {
+		fprintf(stderr, "cannot register the loopback client\n");
+		return 1;
+	}
+	benchmark::AddCustomContext("device", g_device);
+	benchmark::AddCustomContext("commit", METEE_BENCH_COMMIT);
+#ifdef __clang__
+	benchmark::AddCustomContext("compiler", "clang " __clang_version__);
+#else
+	benchmark::AddCustomContext("compiler", "gcc " __VERSION__);
+#endif
+	benchmark::AddCustomContext("cpu_model", CpuModel());
+
+	benchmark::Initialize(&argc, args.data());
+	if (benchmark::ReportUnrecognizedArguments(argc, args.data()))
+		return 1;
+	benchmark::RunSpecifiedBenchmarks();
+	benchmark::Shutdown();
+
+	if (loopback)
+		TeeLoopbackUnregister(&g_client);
+	return 0;
+}
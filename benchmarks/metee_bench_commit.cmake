@@ -0,0 +1,13 @@
+# Writes the commit of the tree to OUTPUT, run on every build;
+# configure_file leaves the header alone while the commit is the same
+find_package(Git QUIET)
+if(GIT_FOUND)
+  execute_process(COMMAND ${GIT_EXECUTABLE} describe --always --dirty
+                  WORKING_DIRECTORY ${SOURCE_DIR}
+                  OUTPUT_VARIABLE METEE_BENCH_COMMIT
+                  OUTPUT_STRIP_TRAILING_WHITESPACE ERROR_QUIET)
+endif()
+if(NOT METEE_BENCH_COMMIT)
+  set(METEE_BENCH_COMMIT unknown)
+endif()
+configure_file(${INPUT} ${OUTPUT} @ONLY)
@@ -0,0 +1,199 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2023 Intel Corporation
+ */
+/*
+ * Counting of allocations and system calls by symbol interposition:
+ * the definitions below take precedence over the C library for the
+ * library under test, static or shared, and forward to the real functions.
+ * The counters are per thread, so concurrent benchmarks do not mix.
+ * glibc only, the allocator is reached through its __libc_* entry points
+ * because dlsym itself may allocate.
+ */
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/file.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "metee_bench_counters.h"
+
+static __thread uint64_t bench_allocs;
+static __thread uint64_t bench_syscalls;
+
+void bench_counters_get(struct bench_counters *counters)
+{
+	counters->allocs = bench_allocs;
+	counters->syscalls = bench_syscalls;
+}
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size)
+{
+	bench_allocs++;
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	bench_allocs++;
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	bench_allocs++;
+	return __libc_realloc(ptr, size);
+}
+
+char *strdup(const char *s)
+{
+	size_t len = strlen(s) + 1;
+	char *d;
+
+	bench_allocs++;
+	d = __libc_malloc(len);
+	if (d)
+		memcpy(d, s, len);
+	return d;
+}
+
+/* the real function, resolved on the first call */
+#define BENCH_REAL(name)                                                       \
+	static __typeof__(&name) real;                                         \
+	if (!__atomic_load_n(&real, __ATOMIC_RELAXED))                         \
+		__atomic_store_n(&real, (__typeof__(&name))dlsym(RTLD_NEXT, #name), \
+				 __ATOMIC_RELAXED);                            \
+	bench_syscalls++
+
+ssize_t read(int fd, void *buf, size_t count)
+{
+	BENCH_REAL(read);
+	return real(fd, buf, count);
+}
+
+ssize_t write(int fd, const void *buf, size_t count)
+{
+	BENCH_REAL(write);
+	return real(fd, buf, count);
+}
+
+ssize_t pread(int fd, void *buf, size_t count, off_t offset)
+{
+	BENCH_REAL(pread);
+	return real(fd, buf, count, offset);
+}
+
+int poll(struct pollfd *fds, nfds_t nfds, int timeout)
+{
+	BENCH_REAL(poll);
+	return real(fds, nfds, timeout);
+}
+
+int ioctl(int fd, unsigned long request, ...)
+{
+	va_list args;
+	void *arg;
+
+	BENCH_REAL(ioctl);
+	va_start(args, request);
+	arg = va_arg(args, void *);
+	va_end(args);
+	return real(fd, request, arg);
+}
+
+int open(const char *path, int flags, ...)
+{
+	va_list args;
+	mode_t mode;
+
+	BENCH_REAL(open);
+	va_start(args, flags);
+	mode = va_arg(args, mode_t);
+	va_end(args);
+	return real(path, flags, mode);
+}
+
+int close(int fd)
+{
+	BENCH_REAL(close);
+	return real(fd);
+}
+
+int fcntl(int fd, int cmd, ...)
+{
+	va_list args;
+	void *arg;
+
+	BENCH_REAL(fcntl);
+	va_start(args, cmd);
+	arg = va_arg(args, void *);
+	va_end(args);
+	return real(fd, cmd, arg);
+}
+
+int dup3(int oldfd, int newfd, int flags)
+{
+	BENCH_REAL(dup3);
+	return real(oldfd, newfd, flags);
+}
+
+int flock(int fd, int operation)
+{
+	BENCH_REAL(flock);
+	return real(fd, operation);
+}
+
+int fstat(int fd, struct stat *st)
+{
+	BENCH_REAL(fstat);
+	return real(fd, st);
+}
+
+int ftruncate(int fd, off_t length)
+{
+	BENCH_REAL(ftruncate);
+	return real(fd, length);
+}
+
+void *mmap(void *addr, size_t length, int prot, int flags, int fd, off_t offset)
+{
+	BENCH_REAL(mmap);
+	return real(addr, length, prot, flags, fd, offset);
+}
+
+int munmap(void *addr, size_t length)
+{
+	BENCH_REAL(munmap);
+	return real(addr, length);
+}
+
+int eventfd(unsigned int initval, int flags)
+{
+	BENCH_REAL(eventfd);
+	return real(initval, flags);
+}
+
+int nanosleep(const struct timespec *req, struct timespec *rem)
+{
+	BENCH_REAL(nanosleep);
+	return real(req, rem);
+}
+
+int clock_nanosleep(clockid_t clockid, int flags,
+		    const struct timespec *request, struct timespec *remain)
+{
+	BENCH_REAL(clock_nanosleep);
+	return real(clockid, flags, request, remain);
+}
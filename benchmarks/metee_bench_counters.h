@@ -0,0 +1,26 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2023 Intel Corporation
+ */
+#ifndef __METEE_BENCH_COUNTERS_H
+#define __METEE_BENCH_COUNTERS_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* calls made by the calling thread since it started */
+struct bench_counters {
+	uint64_t allocs;   /**< malloc, calloc, realloc and strdup */
+	uint64_t syscalls; /**< libc wrappers of the system calls the library uses */
+};
+
+void bench_counters_get(struct bench_counters *counters);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __METEE_BENCH_COUNTERS_H */
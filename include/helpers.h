@@ -42,15 +42,14 @@
 			#define TEE_DEFAULT_LOG_LEVEL TEE_LOG_LEVEL_QUIET
 		#endif
 	#else /* LINUX */
-		#ifdef SYSLOG
-			#include <syslog.h>
-			#define DebugPrint(fmt, ...) syslog(LOG_DEBUG, fmt, ##__VA_ARGS__)
-			#define ErrorPrint(fmt, ...) syslog(LOG_ERR, fmt, ##__VA_ARGS__)
-		#else
-			#include <stdlib.h>
-			#define DebugPrint(fmt, ...) fprintf(stderr, fmt, ##__VA_ARGS__)
-			#define ErrorPrint(fmt, ...) fprintf(stderr, fmt, ##__VA_ARGS__)
-		#endif /* SYSLOG */
+		#include <stdlib.h>
+		#include "metee.h"
+
+		/* messages are routed to the callback or syslog/stderr */
+		#define TEE_LOG_SINK
+		void __tee_log(enum tee_log_level level, const char *file, int line,
+			       const char *func, const char *fmt, ...)
+			__attribute__((format(printf, 5, 6)));
 
 		#ifdef DEBUG
 			#define TEE_DEFAULT_LOG_LEVEL TEE_LOG_LEVEL_VERBOSE
@@ -68,6 +67,15 @@
 #endif /* _WIN32 */
 
 
+#ifdef TEE_LOG_SINK
+#define DBGPRINT(h, _x_, ...) \
+	if (h && h->log_level >= TEE_LOG_LEVEL_VERBOSE) \
+		__tee_log(TEE_LOG_LEVEL_VERBOSE, __FILE__, __LINE__, __FUNCTION__, _x_, ##__VA_ARGS__);
+
+#define ERRPRINT(h, _x_, ...) \
+	if (h && h->log_level >= TEE_LOG_LEVEL_ERROR) \
+		__tee_log(TEE_LOG_LEVEL_ERROR, __FILE__, __LINE__, __FUNCTION__, _x_, ##__VA_ARGS__);
+#else /* TEE_LOG_SINK */
 #define DBGPRINT(h, _x_, ...) \
 	if (h && h->log_level >= TEE_LOG_LEVEL_VERBOSE) \
 		DebugPrint("TEELIB: (%s:%s():%d) " _x_,__FILE__,__FUNCTION__,__LINE__, ##__VA_ARGS__);
@@ -75,9 +83,10 @@
 #define ERRPRINT(h, _x_, ...) \
 	if (h && h->log_level >= TEE_LOG_LEVEL_ERROR) \
 		ErrorPrint("TEELIB: (%s:%s():%d) " _x_,__FILE__,__FUNCTION__,__LINE__, ##__VA_ARGS__);
+#endif /* TEE_LOG_SINK */
 
-#define FUNC_ENTRY(h)         ERRPRINT(h, "Entry\n")
-#define FUNC_EXIT(h, status)  ERRPRINT(h, "Exit with status: %d\n", status)
+#define FUNC_ENTRY(h)         DBGPRINT(h, "Entry\n")
+#define FUNC_EXIT(h, status)  DBGPRINT(h, "Exit with status: %d\n", status)
 
 static inline void __tee_init_handle(PTEEHANDLE handle) { memset(handle, 0, sizeof(TEEHANDLE));}
 
@@ -12,6 +12,7 @@
 extern "C" {
 #endif
 
+#include <stdarg.h>
 #include <stddef.h>
 #include <stdint.h>
 //! @cond suppress_warnings
@@ -91,6 +92,19 @@ typedef TEEHANDLE *PTEEHANDLE;
 /** ZERO/NULL device handle */
 #define TEEHANDLE_ZERO {0}
 
+/** Size of the caller-provided storage for TeeInitInPlace */
+#define TEE_HANDLE_STORAGE_SIZE 512
+/** Required alignment of the caller-provided storage for TeeInitInPlace */
+#define TEE_HANDLE_STORAGE_ALIGN 8
+
+/*!
+ * Storage of suitable size and alignment for TeeInitInPlace
+ */
+typedef union _TEE_HANDLE_STORAGE {
+	uint8_t  data[TEE_HANDLE_STORAGE_SIZE]; /**< storage bytes */
+	uint64_t align;                         /**< alignment enforcement */
+} TEE_HANDLE_STORAGE;
+
 typedef uint16_t TEESTATUS; /**< return status for API functions */
 /** METEE ERROR BASE */
 #define TEE_ERROR_BASE                    0x0000U
@@ -135,6 +149,23 @@ typedef uint16_t TEESTATUS; /**< return status for API functions */
 TEESTATUS TEEAPI TeeInit(IN OUT PTEEHANDLE handle, IN const GUID *guid,
 			 IN OPTIONAL const char *device);
 
+/*! Initializes a TEE connection using caller-provided storage
+ *  The library does not allocate memory for the session,
+ *  the storage must stay valid until TeeDisconnect is called.
+ *  Not implemented on Windows
+ *  \param handle A handle to the TEE device. All subsequent calls to the lib's functions
+ *         must be with this handle
+ *  \param guid GUID of the FW client that want to start a session
+ *  \param device optional device path, set NULL to use default
+ *  \param storage memory for the internal structure,
+ *         aligned to TEE_HANDLE_STORAGE_ALIGN
+ *  \param storage_size size of the storage, at least TEE_HANDLE_STORAGE_SIZE
+ *  \return 0 if successful, otherwise error code
+ */
+TEESTATUS TEEAPI TeeInitInPlace(IN OUT PTEEHANDLE handle, IN const GUID *guid,
+				IN OPTIONAL const char *device,
+				IN void *storage, IN size_t storage_size);
+
 #ifdef _WIN32
 /*! Initializes a TEE connection
  *  \param handle A handle to the TEE device. All subsequent calls to the lib's functions
@@ -243,6 +274,349 @@ uint32_t TEEAPI TeeSetLogLevel(IN PTEEHANDLE handle, IN uint32_t log_level);
  */
 uint32_t TEEAPI TeeGetLogLevel(IN const PTEEHANDLE handle);
 
+/*! Log callback
+ *  Called only for messages that pass the session log level,
+ *  the message is not formatted by the library.
+ *
+ *  \param ctx context provided to TeeSetLogCallback
+ *  \param level message level
+ *  \param file source file of the message
+ *  \param line source line of the message
+ *  \param func function that issued the message
+ *  \param fmt printf-style format
+ *  \param args format arguments
+ */
+typedef void (*TeeLogCallback)(void *ctx, enum tee_log_level level,
+			       const char *file, int line, const char *func,
+			       const char *fmt, va_list args);
+
+/*! Set process-wide log callback
+ *  Replaces syslog/stderr output of the library and of libmei.
+ *  Set the callback before sessions are in use.
+ *  Not implemented on Windows
+ *
+ *  \param callback log callback, NULL to restore the default output
+ *  \param ctx context to pass to the callback
+ *  \return 0 if successful, otherwise error code
+ */
+TEESTATUS TEEAPI TeeSetLogCallback(IN OPTIONAL TeeLogCallback callback,
+				   IN OPTIONAL void *ctx);
+
+/*! Start or stop recording of binary trace events
+ *  Events are stored in per-thread ring buffers and formatted only on dump.
+ *  Not implemented on Windows
+ *
+ *  \param enable non-zero to start recording, zero to stop
+ *  \return previous state
+ */
+uint32_t TEEAPI TeeTraceEnable(IN uint32_t enable);
+
+/*! Write recorded trace events as text to the file descriptor
+ *  Not implemented on Windows
+ *
+ *  \param fd file descriptor open for writing
+ *  \return 0 if successful, otherwise error code
+ */
+TEESTATUS TEEAPI TeeTraceDump(IN int fd);
+
+/** Number of error counters, one per TEESTATUS value */
+#define TEE_STATS_STATUS_NUM (TEE_PERMISSION_DENIED + 1)
+/** Number of latency histogram buckets */
+#define TEE_STATS_HIST_BUCKETS 96
+/** Maximal device path length in the statistics */
+#define TEE_STATS_DEVICE_LEN 128
+
+/*! Operation counters
+ */
+struct tee_stats_counters {
+	uint64_t connects;      /**< connect attempts */
+	uint64_t reconnects;    /**< connect attempts after the first one */
+	uint64_t writes;        /**< write operations */
+	uint64_t reads;         /**< read operations */
+	uint64_t fwstatus;      /**< FW status queries */
+	uint64_t bytes_written; /**< bytes successfully written */
+	uint64_t bytes_read;    /**< bytes successfully read */
+	uint64_t errors[TEE_STATS_STATUS_NUM]; /**< failures by TEESTATUS, errors[TEE_TIMEOUT] counts timeouts */
+};
+
+/*! Latency histograms
+ */
+enum tee_stats_hist {
+	TEE_STATS_HIST_WRITE = 0,  /**< duration of TeeWrite */
+	TEE_STATS_HIST_READ_WAIT,  /**< duration of TeeRead, including the wait for data */
+	TEE_STATS_HIST_TRANSACT,   /**< from TeeWrite start to TeeRead completion */
+	TEE_STATS_HIST_POLL_WAIT,  /**< wait for the device in TeeRead and TeeWrite with timeout */
+	TEE_STATS_HIST_NUM
+};
+
+/*! Log-linear latency histogram
+ *  Bucket i counts latencies below TeeStatsBucketBound(i) nanoseconds
+ *  and not below the bound of bucket i - 1.
+ */
+struct tee_stats_histogram {
+	uint64_t count;  /**< number of samples */
+	uint64_t sum_ns; /**< sum of the samples in nanoseconds */
+	uint64_t buckets[TEE_STATS_HIST_BUCKETS]; /**< samples per bucket */
+};
+
+/*! Counters and latency histograms
+ */
+struct tee_stats {
+	struct tee_stats_counters counters;                /**< counters */
+	struct tee_stats_histogram hist[TEE_STATS_HIST_NUM]; /**< histograms */
+};
+
+/*! Statistics aggregated over all sessions with the same device and GUID
+ */
+struct tee_stats_client {
+	char device[TEE_STATS_DEVICE_LEN]; /**< device path */
+	GUID guid;                         /**< client GUID */
+	struct tee_stats stats;            /**< counters and histograms */
+};
+
+/*! Obtain statistics of the session
+ *  Not implemented on Windows
+ *
+ *  \param handle The handle of the session
+ *  \param session counters of this session
+ *  \param client counters and histograms of all sessions
+ *         to the same device and GUID, including this one
+ *  \return 0 if successful, otherwise error code
+ */
+TEESTATUS TEEAPI TeeGetStats(IN PTEEHANDLE handle,
+			     OUT OPTIONAL struct tee_stats_counters *session,
+			     OUT OPTIONAL struct tee_stats *client);
+
+/*! Obtain aggregated statistics by index
+ *  Enumerate from index 0 until TEE_CLIENT_NOT_FOUND is returned.
+ *  Not implemented on Windows
+ *
+ *  \param index index of the (device, GUID) entry
+ *  \param client entry statistics
+ *  \return 0 if successful, TEE_CLIENT_NOT_FOUND past the last entry,
+ *          otherwise error code
+ */
+TEESTATUS TEEAPI TeeGetStatsClient(IN uint32_t index,
+				   OUT struct tee_stats_client *client);
+
+/*! Upper bound of the latency histogram bucket
+ *  Not implemented on Windows
+ *
+ *  \param bucket bucket index
+ *  \return exclusive upper bound in nanoseconds, UINT64_MAX for the last bucket
+ */
+uint64_t TEEAPI TeeStatsBucketBound(IN uint32_t bucket);
+
+/*! Format aggregated statistics in OpenMetrics text format
+ *  Counters and histograms of all (device, GUID) entries are copied
+ *  before formatting, so all metric families describe the same snapshot
+ *  and histogram counts match their buckets.
+ *  Does not allocate memory.
+ *  Not implemented on Windows
+ *
+ *  \param buf output buffer, the text is NUL terminated
+ *  \param len size of the buffer
+ *  \param written optional, number of characters written,
+ *         excluding the terminating NUL
+ *  \return 0 if successful, TEE_INSUFFICIENT_BUFFER if the output
+ *          does not fit, otherwise error code
+ */
+TEESTATUS TEEAPI TeeStatsFormatOpenMetrics(OUT char *buf, IN size_t len,
+					   OUT OPTIONAL size_t *written);
+
+/** pcapng link type of the recorded traffic (LINKTYPE_USER0) */
+#define TEE_CAPTURE_LINKTYPE 147
+/** Version of the record header */
+#define TEE_CAPTURE_VERSION 1
+/** Maximal captured payload length, longer payloads are truncated */
+#define TEE_CAPTURE_SNAPLEN 4096
+
+/*! Direction of the recorded message
+ */
+enum tee_capture_dir {
+	TEE_CAPTURE_DIR_WRITE = 0, /**< host to firmware */
+	TEE_CAPTURE_DIR_READ = 1,  /**< firmware to host */
+	TEE_CAPTURE_DIR_CONNECT = 2, /**< session connected, no payload */
+};
+
+#pragma pack(push, 1)
+/*! Header preceding the payload in every recorded packet,
+ *  fields are in the byte order of the pcapng section
+ */
+struct tee_capture_hdr {
+	uint8_t version;    /**< TEE_CAPTURE_VERSION */
+	uint8_t direction;  /**< enum tee_capture_dir */
+	uint16_t reserved;  /**< zero */
+	uint32_t length;    /**< original payload length */
+	uint64_t handle;    /**< session handle */
+	uint8_t guid[16];   /**< client GUID */
+};
+#pragma pack(pop)
+
+/*! Start recording of TeeWrite/TeeRead payloads into a pcapng file
+ *  Payloads are copied into a preallocated ring and written to the file
+ *  by a background thread, messages are dropped when the ring is full.
+ *  Not implemented on Windows
+ *
+ *  \param path output file
+ *  \param max_file_size rotate the file when it grows above this size,
+ *         zero for no limit
+ *  \param max_files number of files to keep, the rotated files are
+ *         named path.1 ... path.<max_files - 1>
+ *  \return 0 if successful, TEE_BUSY if the recorder already runs,
+ *          otherwise error code
+ */
+TEESTATUS TEEAPI TeeCaptureStart(IN const char *path, IN size_t max_file_size,
+				 IN uint32_t max_files);
+
+/*! Stop recording, flush and close the file
+ *  Not implemented on Windows
+ *
+ *  \param dropped optional, number of messages dropped because the ring was full
+ *  \return 0 if successful, otherwise error code
+ */
+TEESTATUS TEEAPI TeeCaptureStop(OUT OPTIONAL uint64_t *dropped);
+
+/** Device name prefix selecting the in-process loopback transport in TeeInit,
+ *  "loopback" or "loopback:<name>", the name only labels the statistics */
+#define TEE_LOOPBACK_DEVICE "loopback"
+/** Number of responses a loopback session queues; a write to a full queue
+ *  times out when TeeWrite has a timeout, otherwise it fails with TEE_BUSY */
+#define TEE_LOOPBACK_QUEUE_LEN 51
+
+/*! Firmware client emulated by the loopback transport
+ *  Called from TeeWrite with the request, the response is queued for
+ *  TeeRead. Called concurrently for different sessions.
+ *
+ *  \param ctx context provided at registration
+ *  \param guid client GUID
+ *  \param request request data
+ *  \param request_size request length
+ *  \param response buffer of the maximal message length of the client
+ *  \param response_size in: size of the response buffer,
+ *         out: response length, zero when no response is queued
+ *  \return 0 if successful, otherwise error code returned from TeeWrite
+ */
+typedef TEESTATUS (*TeeLoopbackResponder)(void *ctx, const GUID *guid,
+					  const void *request, size_t request_size,
+					  void *response, size_t *response_size);
+
+/*! Register a firmware client in the loopback transport
+ *  Registration of an existing GUID replaces the responder and resets the latency,
+ *  sessions to an unregistered GUID fail in TeeConnect with TEE_CLIENT_NOT_FOUND.
+ *  Not implemented on Windows
+ *
+ *  \param guid client GUID
+ *  \param maxMsgLen maximal message length reported by TeeConnect
+ *  \param protocolVersion protocol version reported by TeeConnect
+ *  \param responder function producing the responses
+ *  \param ctx optional, context passed to the responder
+ *  \return 0 if successful, otherwise error code
+ */
+TEESTATUS TEEAPI TeeLoopbackRegister(IN const GUID *guid, IN uint32_t maxMsgLen,
+				     IN uint8_t protocolVersion,
+				     IN TeeLoopbackResponder responder,
+				     IN OPTIONAL void *ctx);
+
+/*! Remove a firmware client from the loopback transport
+ *  Connected sessions of the client get TEE_DISCONNECTED on the next write.
+ *  Not implemented on Windows
+ *
+ *  \param guid client GUID
+ *  \return 0 if successful, TEE_CLIENT_NOT_FOUND if not registered,
+ *          otherwise error code
+ */
+TEESTATUS TEEAPI TeeLoopbackUnregister(IN const GUID *guid);
+
+/*! Set the response latency of a loopback client
+ *  A response becomes ready for TeeRead the latency after its TeeWrite,
+ *  measured on the library clock, see TeeClockVirtualStart.
+ *  The device handle is signaled when the response is queued.
+ *  Not implemented on Windows
+ *
+ *  \param guid client GUID
+ *  \param latency latency in nanoseconds
+ *  \return 0 if successful, TEE_CLIENT_NOT_FOUND if not registered,
+ *          otherwise error code
+ */
+TEESTATUS TEEAPI TeeLoopbackSetLatency(IN const GUID *guid, IN uint64_t latency);
+
+/*! Set the value returned by TeeFWStatus on loopback sessions
+ *  Not implemented on Windows
+ *
+ *  \param fwStatusNum FW status register number (0-5)
+ *  \param fwStatus register value
+ *  \return 0 if successful, otherwise error code
+ */
+TEESTATUS TEEAPI TeeLoopbackSetFWStatus(IN uint32_t fwStatusNum, IN uint32_t fwStatus);
+
+/*! Set the fault injection schedule of the transport
+ *  Connect, read and write of the handles initialized while a schedule is set
+ *  fail as the schedule says, handles initialized before are not affected.
+ *  At the first TeeInit the schedule is taken from the METEE_FAULTS
+ *  environment variable, an invalid schedule there is ignored.
+ *  The schedule is a comma separated list of rules <op>:<fault>[<trigger>]
+ *   op: connect, read or write
+ *   fault: ebusy, etime, eintr - the operation fails with the error,
+ *          enodev - firmware reset, the session is dropped and TeeConnect reconnects it,
+ *                   not injected on a descriptor given to TeeInitHandle,
+ *          short - write on the loopback device only, the first half of the message is sent
+ *   trigger: @<probability 0..1>, %<n> every n-th call, #<n> the n-th call only,
+ *            every call when omitted
+ *  and an optional seed=<n> of the random generator, the first matching rule wins.
+ *  Example: "connect:ebusy#1,read:enodev@0.001,write:short%100,seed=7"
+ *  Not implemented on Windows
+ *
+ *  \param schedule schedule, NULL or empty string stops the injection
+ *  \return 0 if successful, TEE_INVALID_PARAMETER if the schedule is invalid,
+ *          otherwise error code
+ */
+TEESTATUS TEEAPI TeeFaultInjectSet(IN OPTIONAL const char *schedule);
+
+/*! Number of faults injected since the schedule was set
+ *  Not implemented on Windows
+ *
+ *  \param count number of faults
+ *  \return 0 if successful, otherwise error code
+ */
+TEESTATUS TEEAPI TeeFaultInjectCount(OUT uint64_t *count);
+
+/*! Replace the library clock with a virtual clock
+ *  The library clock stamps the statistics and paces the loopback
+ *  transport. The virtual clock stands still until moved by
+ *  TeeClockVirtualAdvance or by a wait in the loopback transport, which
+ *  advances it to the deadline instead of sleeping, so the latency and
+ *  timeout paths complete instantly. Waits on the real devices still
+ *  take real time. Switch the clock while no operation is in progress.
+ *  Not implemented on Windows
+ *
+ *  \param start initial time in nanoseconds, zero for the current CLOCK_MONOTONIC time
+ *  \return 0 if successful, TEE_BUSY if the virtual clock already runs,
+ *          otherwise error code
+ */
+TEESTATUS TEEAPI TeeClockVirtualStart(IN uint64_t start);
+
+/*! Return the library clock to CLOCK_MONOTONIC
+ *  Not implemented on Windows
+ */
+void TEEAPI TeeClockVirtualStop(void);
+
+/*! Move the virtual clock forward
+ *  Not implemented on Windows
+ *
+ *  \param ns nanoseconds to add
+ *  \return 0 if successful, TEE_NOTSUPPORTED if the virtual clock does not run,
+ *          otherwise error code
+ */
+TEESTATUS TEEAPI TeeClockVirtualAdvance(IN uint64_t ns);
+
+/*! Current time of the library clock
+ *  Not implemented on Windows
+ *
+ *  \return time in nanoseconds, zero on Windows
+ */
+uint64_t TEEAPI TeeClockNow(void);
+
 #ifdef __cplusplus
 }
 #endif
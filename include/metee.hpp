@@ -0,0 +1,206 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2023 Intel Corporation
+ */
+/*! \file metee.hpp
+ *  \brief C++ session wrapper of the metee library
+ */
+#ifndef __METEE_HPP
+#define __METEE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <vector>
+#include "metee.h"
+
+namespace intel {
+namespace security {
+
+/*! Error category of TEESTATUS values
+ */
+class metee_category_impl : public std::error_category {
+public:
+	const char *name() const noexcept override { return "metee"; }
+
+	std::string message(int ev) const override
+	{
+		switch (ev) {
+		case TEE_SUCCESS: return "success";
+		case TEE_INTERNAL_ERROR: return "internal error";
+		case TEE_DEVICE_NOT_FOUND: return "device not found";
+		case TEE_DEVICE_NOT_READY: return "device not ready";
+		case TEE_INVALID_PARAMETER: return "invalid parameter";
+		case TEE_UNABLE_TO_COMPLETE_OPERATION: return "unable to complete operation";
+		case TEE_TIMEOUT: return "timeout";
+		case TEE_NOTSUPPORTED: return "not supported";
+		case TEE_CLIENT_NOT_FOUND: return "client not found";
+		case TEE_BUSY: return "device busy";
+		case TEE_DISCONNECTED: return "disconnected";
+		case TEE_INSUFFICIENT_BUFFER: return "insufficient buffer";
+		case TEE_PERMISSION_DENIED: return "permission denied";
+		default: return "unknown error";
+		}
+	}
+};
+
+/*! The TEESTATUS error category
+ */
+inline const std::error_category &metee_category()
+{
+	static metee_category_impl category;
+	return category;
+}
+
+/*! Failure of a library call, code() holds the TEESTATUS
+ */
+class metee_exception : public std::system_error {
+public:
+	metee_exception(TEESTATUS status, const std::string &what)
+		: std::system_error(status, metee_category(), what) {}
+};
+
+/*! Message type usable with basic_metee::transact: trivially copyable,
+ *  packed (alignment 1, so no padding) and not longer than the MTU
+ */
+template <typename T, size_t Mtu>
+struct is_tee_message
+	: std::integral_constant<bool,
+				 std::is_trivially_copyable<T>::value &&
+				 alignof(T) == 1 && sizeof(T) <= Mtu> {};
+
+/*! Session with a firmware client
+ *  The session is disconnected on destruction.
+ *  The handle may keep its state in place, so the session is neither
+ *  copyable nor movable.
+ *
+ *  \tparam Mtu declared maximal message length of the client, bounds the
+ *          message types of transact at compile time
+ */
+template <size_t Mtu = 4096>
+class basic_metee {
+public:
+	/*! Declared maximal message length */
+	static const size_t mtu = Mtu;
+
+	/*! Open the device
+	 *  \param guid client GUID
+	 *  \param device optional device path, TEE_LOOPBACK_DEVICE for the emulation
+	 */
+	explicit basic_metee(const GUID &guid, const char *device = nullptr)
+	{
+		check(TeeInit(&handle_, &guid, device), "init");
+	}
+
+	~basic_metee() { TeeDisconnect(&handle_); }
+
+	basic_metee(const basic_metee &) = delete;
+	basic_metee &operator=(const basic_metee &) = delete;
+
+	/*! Connect to the client */
+	void connect() { check(TeeConnect(&handle_), "connect"); }
+
+	/*! Write a message
+	 *  \return number of bytes written
+	 */
+	size_t write(const std::vector<uint8_t> &buffer, uint32_t timeout = 0)
+	{
+		size_t written = 0;
+
+		check(TeeWrite(&handle_, buffer.data(), buffer.size(), &written, timeout), "write");
+		return written;
+	}
+
+	/*! Read a message of any length up to the client maximum */
+	std::vector<uint8_t> read(uint32_t timeout = 0)
+	{
+		std::vector<uint8_t> buffer(handle_.maxMsgLen);
+		size_t received = 0;
+
+		check(TeeRead(&handle_, buffer.data(), buffer.size(), &received, timeout), "read");
+		buffer.resize(received);
+		return buffer;
+	}
+
+	/*! Write a request and read a response of exactly the response type size
+	 *  The response is read into a buffer of the client maximal message length,
+	 *  the device truncates a longer message to the read buffer and keeps the
+	 *  rest queued, so a response longer than the type is consumed whole
+	 *  and rejected rather than cut. Both types are checked at compile time
+	 *  with is_tee_message, the request against the maximal message length of
+	 *  the connected client at run time.
+	 *
+	 *  \param req request
+	 *  \param timeout timeout of the write and of the read in milliseconds, 0 - blocking
+	 *  \return response
+	 *  \throws metee_exception on failure, TEE_INVALID_PARAMETER if the request is
+	 *          longer than the client accepts, TEE_UNABLE_TO_COMPLETE_OPERATION if the
+	 *          write was short or the response size differs
+	 */
+	template <typename Req, typename Rsp>
+	Rsp transact(const Req &req, uint32_t timeout = 0)
+	{
+		static_assert(is_tee_message<Req, Mtu>::value,
+			      "request must be trivially copyable, packed and fit the MTU");
+		static_assert(is_tee_message<Rsp, Mtu>::value,
+			      "response must be trivially copyable, packed and fit the MTU");
+		static_assert(std::is_default_constructible<Rsp>::value,
+			      "response must be default constructible");
+
+		if (sizeof(req) > handle_.maxMsgLen)
+			throw metee_exception(TEE_INVALID_PARAMETER,
+					      "request exceeds the client maximal message length");
+
+		std::vector<uint8_t> buffer(handle_.maxMsgLen);
+		Rsp rsp;
+		size_t done = 0;
+
+		check(TeeWrite(&handle_, &req, sizeof(req), &done, timeout), "write");
+		if (done != sizeof(req))
+			throw metee_exception(TEE_UNABLE_TO_COMPLETE_OPERATION, "short write");
+		check(TeeRead(&handle_, buffer.data(), buffer.size(), &done, timeout), "read");
+		if (done != sizeof(rsp))
+			throw metee_exception(TEE_UNABLE_TO_COMPLETE_OPERATION,
+					      "unexpected response size");
+		std::memcpy(&rsp, buffer.data(), sizeof(rsp));
+		return rsp;
+	}
+
+	/*! Read a FW status register */
+	uint32_t fw_status(uint32_t fwStatusNum)
+	{
+		uint32_t value = 0;
+
+		check(TeeFWStatus(&handle_, fwStatusNum, &value), "fw status");
+		return value;
+	}
+
+	/*! Maximal message length reported by the client */
+	size_t max_msg_len() const { return handle_.maxMsgLen; }
+
+	/*! Protocol version reported by the client */
+	uint8_t protocol_ver() const { return handle_.protcolVer; }
+
+	/*! The underlying handle for the C API */
+	PTEEHANDLE handle() { return &handle_; }
+
+private:
+	static void check(TEESTATUS status, const char *what)
+	{
+		if (!TEE_IS_SUCCESS(status))
+			throw metee_exception(status, what);
+	}
+
+	TEEHANDLE handle_ = TEEHANDLE_ZERO;
+};
+
+/*! Session with the default MTU */
+typedef basic_metee<> metee;
+
+} // namespace security
+} // namespace intel
+
+#endif /* __METEE_HPP */
@@ -0,0 +1,155 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2023 Intel Corporation
+ */
+/*! \file metee_amthi.h
+ *  \brief AMTHI (PTHI) client over metee sessions
+ */
+#ifndef __METEE_AMTHI_H
+#define __METEE_AMTHI_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "metee.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Commands, class in the high byte and the operation in the low bits */
+#define TEE_AMTHI_CODE_VERSIONS 0x0400001A
+
+/** Command bit set in the responses */
+#define TEE_AMTHI_RESPONSE 0x00800000
+
+/** Interface version of the requests */
+#define TEE_AMTHI_VERSION_MAJOR 1
+#define TEE_AMTHI_VERSION_MINOR 1
+
+/** Length of the TEE_AMTHI_CODE_VERSIONS response, storage of TeeAmthiGetCodeVersions */
+#define TEE_AMTHI_CODE_VERSIONS_LEN 2285
+
+#pragma pack(push, 1)
+/*! AMTHI message header
+ */
+struct tee_amthi_hdr {
+	uint8_t major;     /**< interface major version */
+	uint8_t minor;     /**< interface minor version */
+	uint16_t reserved; /**< zero */
+	uint32_t command;  /**< command, TEE_AMTHI_RESPONSE in responses */
+	uint32_t length;   /**< length of the message following the header */
+};
+
+/*! Response header, the status follows the message header in all responses
+ */
+struct tee_amthi_rsp_hdr {
+	struct tee_amthi_hdr hdr;
+	uint32_t status; /**< zero on success */
+};
+#pragma pack(pop)
+
+/*! String inside a response buffer
+ */
+struct tee_amthi_string_view {
+	const char *data; /**< characters, not NUL terminated */
+	size_t length;    /**< number of characters */
+};
+
+/*! Code versions inside a response buffer, see TeeAmthiGetCodeVersions
+ */
+struct tee_amthi_code_versions {
+	const void *rsp; /**< the response in the caller buffer */
+	size_t count;    /**< number of entries */
+};
+
+/*! Send an AMTHI request and receive the validated response
+ *  The response is read into the caller storage and validated in place:
+ *  it has to be at least a response header long, with the command of the
+ *  request and TEE_AMTHI_RESPONSE set, and the length in the header has
+ *  to match the received length. The device truncates a message longer
+ *  than the buffer, reports success and keeps the rest queued for the
+ *  next read; a response filling the buffer with a longer length in the
+ *  header is taken as truncated. The buffer has to fit the whole response,
+ *  after a truncation the session has to be reconnected.
+ *
+ *  \param handle The handle of the connected session
+ *  \param request request starting with struct tee_amthi_hdr
+ *  \param requestSize request size in bytes
+ *  \param buffer storage of the response
+ *  \param bufferSize size of the storage
+ *  \param response set to the response header in the buffer
+ *  \param responseSize response size in bytes
+ *  \param timeout timeout of the write and of the read in milliseconds, 0 - blocking
+ *  \return 0 if successful, TEE_INTERNAL_ERROR if the response is malformed,
+ *          TEE_INSUFFICIENT_BUFFER if the response was truncated,
+ *          TEE_UNABLE_TO_COMPLETE_OPERATION if the write was short or the status
+ *          in the response is not zero, otherwise error code
+ */
+TEESTATUS TEEAPI TeeAmthiTransact(IN PTEEHANDLE handle,
+				  IN const void *request, IN size_t requestSize,
+				  OUT void *buffer, IN size_t bufferSize,
+				  OUT const struct tee_amthi_rsp_hdr **response,
+				  OUT size_t *responseSize, IN uint32_t timeout);
+
+/*! Obtain the code versions
+ *  The response stays in the caller buffer, the view points into it and
+ *  is valid as long as the buffer is. Only the entry count is checked
+ *  here, the entries are decoded on access.
+ *  Does not allocate memory.
+ *
+ *  \param handle The handle of the connected session
+ *  \param buffer storage of the response,
+ *         at least TEE_AMTHI_CODE_VERSIONS_LEN bytes
+ *  \param bufferSize size of the storage
+ *  \param versions view of the response
+ *  \param timeout timeout in milliseconds, 0 - blocking
+ *  \return 0 if successful, TEE_INSUFFICIENT_BUFFER if the buffer is too small,
+ *          otherwise error code as in TeeAmthiTransact
+ */
+TEESTATUS TEEAPI TeeAmthiGetCodeVersions(IN PTEEHANDLE handle,
+					 OUT void *buffer, IN size_t bufferSize,
+					 OUT struct tee_amthi_code_versions *versions,
+					 IN uint32_t timeout);
+
+/*! BIOS version of the code versions
+ *
+ *  \param versions code versions
+ *  \param bios BIOS version up to the first NUL
+ *  \return 0 if successful, TEE_INVALID_PARAMETER if a parameter is NULL
+ */
+TEESTATUS TEEAPI TeeAmthiCodeVersionsBios(IN const struct tee_amthi_code_versions *versions,
+					  OUT struct tee_amthi_string_view *bios);
+
+/*! Entry of the code versions
+ *
+ *  \param versions code versions
+ *  \param index entry index, less than versions->count
+ *  \param description optional, component name
+ *  \param version optional, component version
+ *  \return 0 if successful, TEE_INVALID_PARAMETER if the index is out of range,
+ *          TEE_INTERNAL_ERROR if a string length of the entry is malformed
+ */
+TEESTATUS TEEAPI TeeAmthiCodeVersionsAt(IN const struct tee_amthi_code_versions *versions,
+					IN size_t index,
+					OUT OPTIONAL struct tee_amthi_string_view *description,
+					OUT OPTIONAL struct tee_amthi_string_view *version);
+
+/*! Find the version of a component in the code versions
+ *  Compares the descriptions in place, entries with a malformed
+ *  description are skipped.
+ *
+ *  \param versions code versions
+ *  \param description component name, e.g. "AMT"
+ *  \param version version of the first entry with the description
+ *  \return 0 if successful, TEE_NOTSUPPORTED if there is no such component,
+ *          TEE_INTERNAL_ERROR if the version string length is malformed
+ */
+TEESTATUS TEEAPI TeeAmthiCodeVersionsFind(IN const struct tee_amthi_code_versions *versions,
+					  IN const char *description,
+					  OUT struct tee_amthi_string_view *version);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __METEE_AMTHI_H */
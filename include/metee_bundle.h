@@ -0,0 +1,192 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2023 Intel Corporation
+ */
+/*! \file metee_bundle.h
+ *  \brief metee firmware bundle
+ *
+ *  A bundle is a container defined by metee only, it is not a firmware
+ *  image format: a header, a directory of partitions and the partition
+ *  images, each partition an image as accepted by TeeFwuUpdate, with its
+ *  TeeFwuImageHash. The partition images are the GSC update images
+ *  (graphics firmware, oprom data, oprom code) unchanged, TeeBundleCreate
+ *  puts several of them and their hashes into one file.
+ */
+#ifndef __METEE_BUNDLE_H
+#define __METEE_BUNDLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "metee.h"
+#include "metee_fwu.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Magic of the bundle header, "MTBN" */
+#define TEE_BUNDLE_MAGIC   0x4E42544D
+/** Version of the bundle layout */
+#define TEE_BUNDLE_VERSION 1
+
+#pragma pack(push, 1)
+/*! Header of a bundle, the partition directory follows
+ */
+struct tee_bundle_hdr {
+	uint32_t magic;         /**< TEE_BUNDLE_MAGIC */
+	uint16_t version;       /**< TEE_BUNDLE_VERSION */
+	uint16_t header_length; /**< length of the header, the directory starts here */
+	uint32_t partitions;    /**< number of entries in the directory */
+	uint32_t entry_length;  /**< length of a directory entry */
+};
+
+/*! Directory entry of a bundle
+ */
+struct tee_bundle_entry {
+	uint32_t payload_type; /**< TEE_FWU_PAYLOAD_* */
+	uint32_t offset;       /**< offset of the partition from the bundle start */
+	uint32_t length;       /**< partition length in bytes */
+	uint32_t reserved;     /**< zero */
+	uint64_t hash;         /**< TeeFwuImageHash of the partition */
+};
+#pragma pack(pop)
+
+/*! Partition of an open bundle
+ */
+struct tee_bundle_partition {
+	uint32_t payload_type; /**< TEE_FWU_PAYLOAD_* */
+	const uint8_t *data;   /**< partition data inside the bundle mapping */
+	size_t size;           /**< partition length in bytes */
+	uint64_t hash;         /**< expected hash from the directory */
+};
+
+/*! Open bundle, see TeeBundleOpen
+ */
+struct tee_bundle;
+
+/*! Partition image of a bundle to create
+ */
+struct tee_bundle_source {
+	uint32_t payload_type; /**< TEE_FWU_PAYLOAD_* */
+	const char *path;      /**< image file path */
+};
+
+/*! Create a bundle file from partition image files
+ *  The images are written in the order of the sources, each after
+ *  the directory entry carrying its payload type and hash.
+ *
+ *  \param path bundle file path, an existing file is replaced
+ *  \param sources partition images
+ *  \param count number of partition images
+ *  \return 0 if successful, TEE_INVALID_PARAMETER if an image cannot be opened,
+ *          is empty or the bundle would exceed 4GB,
+ *          TEE_PERMISSION_DENIED if the bundle cannot be created,
+ *          TEE_INTERNAL_ERROR if out of memory or the bundle cannot be written
+ */
+TEESTATUS TEEAPI TeeBundleCreate(IN const char *path,
+				 IN const struct tee_bundle_source *sources,
+				 IN size_t count);
+
+/*! Open a bundle file
+ *  The file is mapped into memory and the partition directory is indexed,
+ *  the partitions point into the mapping, nothing is read or copied.
+ *  The partition data is not verified, see TeeBundleVerifyStart.
+ *
+ *  \param path bundle file path
+ *  \param bundle open bundle, free with TeeBundleClose
+ *  \return 0 if successful, TEE_INVALID_PARAMETER if the file cannot be opened,
+ *          has a wrong header or a partition is out of the file,
+ *          TEE_INTERNAL_ERROR if it cannot be mapped
+ */
+TEESTATUS TEEAPI TeeBundleOpen(IN const char *path,
+			       OUT struct tee_bundle **bundle);
+
+/*! Close a bundle
+ *  Waits for a verification in progress.
+ *
+ *  \param bundle bundle to close, may be NULL
+ */
+void TEEAPI TeeBundleClose(IN struct tee_bundle *bundle);
+
+/*! Partitions of a bundle
+ *
+ *  \param bundle open bundle
+ *  \param partitions partitions in the directory order, valid until the bundle is closed
+ *  \param count number of partitions
+ *  \return 0 if successful, TEE_INVALID_PARAMETER if a parameter is NULL
+ */
+TEESTATUS TEEAPI TeeBundlePartitions(IN const struct tee_bundle *bundle,
+				     OUT const struct tee_bundle_partition **partitions,
+				     OUT size_t *count);
+
+/*! Find a partition of a bundle
+ *
+ *  \param bundle open bundle
+ *  \param payloadType TEE_FWU_PAYLOAD_*
+ *  \param partition the first partition of the payload type,
+ *         valid until the bundle is closed
+ *  \return 0 if successful, TEE_INVALID_PARAMETER if a parameter is NULL,
+ *          TEE_NOTSUPPORTED if the bundle has no partition of the payload type
+ */
+TEESTATUS TEEAPI TeeBundleFind(IN const struct tee_bundle *bundle,
+			       IN uint32_t payloadType,
+			       OUT const struct tee_bundle_partition **partition);
+
+/*! Start the verification of the bundle partitions
+ *  The partitions are split into 1MB blocks, worker threads take the
+ *  blocks one at a time and hash them, the block hashes are combined
+ *  by TeeBundleVerifyWait. The caller is free to do other work,
+ *  e.g. connect to the device, meanwhile.
+ *
+ *  \param bundle open bundle
+ *  \param payloadType TEE_FWU_PAYLOAD_* of the partition to verify, 0 - all
+ *  \param threads number of worker threads, 0 - one per processor
+ *  \return 0 if successful, TEE_BUSY if a verification is in progress,
+ *          TEE_NOTSUPPORTED if there is no such partition,
+ *          TEE_INTERNAL_ERROR if out of memory
+ */
+TEESTATUS TEEAPI TeeBundleVerifyStart(IN struct tee_bundle *bundle,
+				      IN uint32_t payloadType,
+				      IN unsigned int threads);
+
+/*! Wait for the verification of the bundle partitions
+ *  The calling thread joins the workers until all blocks are hashed.
+ *
+ *  \param bundle open bundle
+ *  \return 0 if the partitions match their hashes, TEE_INVALID_PARAMETER if
+ *          a partition is corrupted or the verification was not started
+ */
+TEESTATUS TEEAPI TeeBundleVerifyWait(IN struct tee_bundle *bundle);
+
+/*! Update the firmware from a partition of a bundle
+ *  The partition is verified by worker threads while the calling thread
+ *  connects the session, the first chunk is sent as soon as both are done.
+ *
+ *  \param handle The handle of the session, initialized and not connected,
+ *         or connected
+ *  \param bundle open bundle
+ *  \param payloadType TEE_FWU_PAYLOAD_* of the partition to update
+ *  \param metadata optional, metadata sent with the start request
+ *  \param metadataSize metadata length in bytes
+ *  \param progress optional, progress callback
+ *  \param ctx optional, context passed to the callback
+ *  \param stats optional, final progress
+ *  \param timeout timeout of every write and read in milliseconds, 0 - blocking
+ *  \return 0 if successful, TEE_NOTSUPPORTED if there is no such partition,
+ *          TEE_INVALID_PARAMETER if it is corrupted, otherwise error code of
+ *          TeeConnect or as in TeeFwuUpdate
+ */
+TEESTATUS TEEAPI TeeBundleUpdate(IN PTEEHANDLE handle,
+				 IN struct tee_bundle *bundle,
+				 IN uint32_t payloadType,
+				 IN OPTIONAL const void *metadata, IN size_t metadataSize,
+				 IN OPTIONAL TeeFwuProgressCallback progress,
+				 IN OPTIONAL void *ctx,
+				 OUT OPTIONAL struct tee_fwu_stats *stats,
+				 IN uint32_t timeout);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __METEE_BUNDLE_H */
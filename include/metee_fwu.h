@@ -0,0 +1,218 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2023 Intel Corporation
+ */
+/*! \file metee_fwu.h
+ *  \brief GSC firmware update pipeline over metee sessions
+ */
+#ifndef __METEE_FWU_H
+#define __METEE_FWU_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "metee.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** GSC firmware update commands */
+#define TEE_FWU_START          0x01
+#define TEE_FWU_DATA           0x02
+#define TEE_FWU_END            0x03
+#define TEE_FWU_GET_IP_VERSION 0x06
+
+/** Response bit in the flags of the header */
+#define TEE_FWU_RESPONSE 0x01
+
+/** Payload types of TEE_FWU_START */
+#define TEE_FWU_PAYLOAD_GFX_FW     1 /**< graphics firmware */
+#define TEE_FWU_PAYLOAD_OPROM_DATA 2 /**< oprom data partition */
+#define TEE_FWU_PAYLOAD_OPROM_CODE 3 /**< oprom code partition */
+
+#pragma pack(push, 1)
+/*! GSC firmware update message header
+ */
+struct tee_fwu_hdr {
+	uint8_t command_id;  /**< command */
+	uint8_t flags;       /**< TEE_FWU_RESPONSE in responses */
+	uint8_t reserved[2]; /**< zero */
+};
+
+/*! Start of the update, the image metadata follows
+ */
+struct tee_fwu_start_req {
+	struct tee_fwu_hdr header;
+	uint32_t update_img_length; /**< image length in bytes */
+	uint32_t payload_type;      /**< TEE_FWU_PAYLOAD_* */
+	uint32_t flags;             /**< zero, bit 0 forces the update */
+	uint32_t reserved[8];       /**< zero */
+};
+
+/*! Chunk of the image, the image slice follows
+ */
+struct tee_fwu_data_req {
+	struct tee_fwu_hdr header;
+	uint32_t data_length; /**< chunk length in bytes */
+	uint32_t reserved;    /**< zero */
+};
+
+/*! End of the update
+ */
+struct tee_fwu_end_req {
+	struct tee_fwu_hdr header;
+	uint32_t reserved; /**< zero */
+};
+
+/*! Acknowledge of the requests
+ */
+struct tee_fwu_rsp {
+	struct tee_fwu_hdr header;
+	uint32_t status;   /**< zero on success */
+	uint32_t reserved; /**< zero */
+};
+#pragma pack(pop)
+
+/*! Progress of an update
+ */
+struct tee_fwu_stats {
+	uint64_t total;      /**< image length in bytes */
+	uint64_t sent;       /**< image bytes acknowledged by the firmware */
+	uint32_t chunks;     /**< data messages acknowledged by the firmware */
+	uint32_t chunk_size; /**< image bytes in a data message */
+	uint64_t elapsed;    /**< nanoseconds since the start request */
+	uint64_t wait;       /**< nanoseconds spent waiting for acknowledges */
+	uint64_t throughput; /**< image bytes per second */
+};
+
+/*! Progress callback of the update
+ *  Called after every acknowledged data message, from the updating thread.
+ *
+ *  \param ctx context provided to the update
+ *  \param stats progress so far
+ */
+typedef void (*TeeFwuProgressCallback)(void *ctx, const struct tee_fwu_stats *stats);
+
+/*! Push a firmware image through the connected GSC firmware update client
+ *  The image is sent as start, data and end requests, every request is
+ *  acknowledged before the next one is sent. A data message is built in
+ *  one of two buffers of the client maximal message length from the
+ *  header and an image slice; the next one is built while the firmware
+ *  processes the previous, so it is ready when the acknowledge arrives.
+ *
+ *  \param handle The handle of the connected session
+ *  \param payloadType TEE_FWU_PAYLOAD_*
+ *  \param image image data
+ *  \param imageSize image length in bytes
+ *  \param metadata optional, metadata sent with the start request
+ *  \param metadataSize metadata length in bytes
+ *  \param progress optional, progress callback
+ *  \param ctx optional, context passed to the callback
+ *  \param stats optional, final progress
+ *  \param timeout timeout of every write and read in milliseconds, 0 - blocking
+ *  \return 0 if successful, TEE_INVALID_PARAMETER if the image is empty or
+ *          longer than 4GB or the metadata does not fit the start request,
+ *          TEE_INTERNAL_ERROR if a response is malformed,
+ *          TEE_UNABLE_TO_COMPLETE_OPERATION if a write was short or the
+ *          firmware returned non-zero status, otherwise error code
+ */
+TEESTATUS TEEAPI TeeFwuUpdate(IN PTEEHANDLE handle, IN uint32_t payloadType,
+			      IN const void *image, IN size_t imageSize,
+			      IN OPTIONAL const void *metadata, IN size_t metadataSize,
+			      IN OPTIONAL TeeFwuProgressCallback progress,
+			      IN OPTIONAL void *ctx,
+			      OUT OPTIONAL struct tee_fwu_stats *stats,
+			      IN uint32_t timeout);
+
+/*! Push a firmware image file through the connected GSC firmware update client
+ *  The file is mapped into memory and read ahead sequentially,
+ *  the slices are copied into the data messages straight from the mapping.
+ *
+ *  \param handle The handle of the connected session
+ *  \param payloadType TEE_FWU_PAYLOAD_*
+ *  \param path image file path
+ *  \param metadata optional, metadata sent with the start request
+ *  \param metadataSize metadata length in bytes
+ *  \param progress optional, progress callback
+ *  \param ctx optional, context passed to the callback
+ *  \param stats optional, final progress
+ *  \param timeout timeout of every write and read in milliseconds, 0 - blocking
+ *  \return 0 if successful, TEE_INVALID_PARAMETER if the file cannot be opened
+ *          or is empty, TEE_INTERNAL_ERROR if it cannot be mapped,
+ *          otherwise error code as in TeeFwuUpdate
+ */
+TEESTATUS TEEAPI TeeFwuUpdateFile(IN PTEEHANDLE handle, IN uint32_t payloadType,
+				  IN const char *path,
+				  IN OPTIONAL const void *metadata, IN size_t metadataSize,
+				  IN OPTIONAL TeeFwuProgressCallback progress,
+				  IN OPTIONAL void *ctx,
+				  OUT OPTIONAL struct tee_fwu_stats *stats,
+				  IN uint32_t timeout);
+
+/*! Device of a fan-out update
+ */
+struct tee_fwu_device {
+	const char *device;         /**< device path, NULL for the default device */
+#ifdef _WIN32
+	const GUID *device_class;   /**< device interface GUID opened with TeeInitGUID
+				         when device is NULL, NULL for the default device */
+#endif /* _WIN32 */
+	TEESTATUS status;           /**< result of the update on the device */
+	struct tee_fwu_stats stats; /**< final progress on the device */
+};
+
+/*! Progress callback of a fan-out update
+ *  Called after every acknowledged data message, concurrently from the
+ *  updating threads of different devices.
+ *
+ *  \param ctx context provided to the update
+ *  \param index index of the device in the devices array
+ *  \param stats progress of the device so far
+ */
+typedef void (*TeeFwuDeviceProgressCallback)(void *ctx, size_t index,
+					     const struct tee_fwu_stats *stats);
+
+/*! Update several devices from one firmware image file
+ *  The file is mapped once and shared by independent sessions, one per
+ *  device, each running TeeFwuUpdate in its own thread. At most
+ *  concurrency devices are updated at once, the next device starts
+ *  when one finishes. The result of every device is stored in its
+ *  status and stats, a failure does not stop the other devices.
+ *
+ *  \param guid GUID of the firmware update client
+ *  \param payloadType TEE_FWU_PAYLOAD_*
+ *  \param path image file path
+ *  \param metadata optional, metadata sent with the start request
+ *  \param metadataSize metadata length in bytes
+ *  \param devices devices to update
+ *  \param count number of devices
+ *  \param concurrency maximal number of devices updated at once, 0 - all
+ *  \param progress optional, progress callback
+ *  \param ctx optional, context passed to the callback
+ *  \param timeout timeout of every write and read in milliseconds, 0 - blocking
+ *  \return 0 if all devices are updated, TEE_UNABLE_TO_COMPLETE_OPERATION
+ *          if any device failed, otherwise error code as in TeeFwuUpdateFile
+ */
+TEESTATUS TEEAPI TeeFwuUpdateDevices(IN const GUID *guid, IN uint32_t payloadType,
+				     IN const char *path,
+				     IN OPTIONAL const void *metadata, IN size_t metadataSize,
+				     IN OUT struct tee_fwu_device *devices, IN size_t count,
+				     IN unsigned int concurrency,
+				     IN OPTIONAL TeeFwuDeviceProgressCallback progress,
+				     IN OPTIONAL void *ctx, IN uint32_t timeout);
+
+/*! Hash of an image as stored in the bundle directory
+ *  64-bit xxHash64 of every 1MB block, the block hashes are combined
+ *  into one hash seeded with the image length.
+ *
+ *  \param data image data
+ *  \param size image length in bytes
+ *  \return image hash
+ */
+uint64_t TEEAPI TeeFwuImageHash(IN const void *data, IN size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __METEE_FWU_H */
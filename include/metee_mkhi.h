@@ -0,0 +1,196 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2023 Intel Corporation
+ */
+/*! \file metee_mkhi.h
+ *  \brief MKHI client over metee sessions
+ */
+#ifndef __METEE_MKHI_H
+#define __METEE_MKHI_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "metee.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** MKHI groups */
+#define TEE_MKHI_GROUP_CBM      0x00 /**< core boot management */
+#define TEE_MKHI_GROUP_FWCAPS   0x03 /**< firmware capabilities */
+#define TEE_MKHI_GROUP_FWUPDATE 0x05 /**< firmware update (flash protection override) */
+#define TEE_MKHI_GROUP_GEN      0xFF /**< generic */
+
+/** Commands of TEE_MKHI_GROUP_GEN */
+#define TEE_MKHI_GEN_GET_MKHI_VERSION 0x01
+#define TEE_MKHI_GEN_GET_FW_VERSION   0x02
+
+/** Commands of TEE_MKHI_GROUP_FWCAPS */
+#define TEE_MKHI_FWCAPS_GET_RULE 0x02
+
+/** Commands of TEE_MKHI_GROUP_FWUPDATE */
+#define TEE_MKHI_FWUPDATE_GET_STATUS 0x03
+
+/** Rules of TEE_MKHI_FWCAPS_GET_RULE */
+#define TEE_MKHI_RULE_FW_CAPS        0x00
+#define TEE_MKHI_RULE_PLATFORM_TYPE  0x1D
+#define TEE_MKHI_RULE_FEATURE_STATE  0x20
+
+/** States of TEE_MKHI_FWUPDATE_GET_STATUS */
+#define TEE_MKHI_FWUPDATE_DISABLED 0x00
+#define TEE_MKHI_FWUPDATE_LOCKED   0x01
+#define TEE_MKHI_FWUPDATE_ENABLED  0x02
+
+/** Command bit set in the responses */
+#define TEE_MKHI_RESPONSE 0x80
+
+/** Maximal length of the rule data */
+#define TEE_MKHI_RULE_DATA_MAX 255
+
+#pragma pack(push, 1)
+/*! MKHI message header
+ */
+struct tee_mkhi_hdr {
+	uint8_t group;    /**< group id */
+	uint8_t command;  /**< command, TEE_MKHI_RESPONSE in responses */
+	uint8_t reserved; /**< zero */
+	uint8_t result;   /**< status of the response, zero on success */
+};
+
+/*! Version of a firmware component
+ */
+struct tee_mkhi_version {
+	uint16_t minor;   /**< minor version */
+	uint16_t major;   /**< major version */
+	uint16_t buildNo; /**< build number */
+	uint16_t hotFix;  /**< hot fix number */
+};
+
+/*! Firmware version, TEE_MKHI_GEN_GET_FW_VERSION
+ */
+struct tee_mkhi_fw_version {
+	struct tee_mkhi_version code; /**< running firmware */
+	struct tee_mkhi_version nftp; /**< recovery firmware */
+	struct tee_mkhi_version fitc; /**< firmware of the image, zero if not reported */
+};
+
+/*! MKHI interface version, TEE_MKHI_GEN_GET_MKHI_VERSION
+ */
+struct tee_mkhi_if_version {
+	uint16_t minor; /**< minor version */
+	uint16_t major; /**< major version */
+};
+#pragma pack(pop)
+
+/*! Send an MKHI request and receive the validated response
+ *  The response is read into the caller storage and validated in place:
+ *  it has to be at least a header long, with group and command of the
+ *  request and TEE_MKHI_RESPONSE set. The device truncates a message
+ *  longer than the buffer, reports success and keeps the rest queued for
+ *  the next read, so a response filling a buffer shorter than the maximal
+ *  message length of the client is taken as truncated. The buffer has to
+ *  be longer than the longest expected response, after a truncation the
+ *  session has to be reconnected.
+ *
+ *  \param handle The handle of the connected session
+ *  \param request request starting with struct tee_mkhi_hdr
+ *  \param requestSize request size in bytes
+ *  \param buffer storage of the response
+ *  \param bufferSize size of the storage
+ *  \param response set to the response header in the buffer
+ *  \param responseSize response size in bytes
+ *  \param timeout timeout of the write and of the read in milliseconds, 0 - blocking
+ *  \return 0 if successful, TEE_INTERNAL_ERROR if the response is malformed,
+ *          TEE_INSUFFICIENT_BUFFER if the response may be truncated,
+ *          TEE_UNABLE_TO_COMPLETE_OPERATION if the write was short or the result
+ *          in the response header is not zero, otherwise error code
+ */
+TEESTATUS TEEAPI TeeMkhiTransact(IN PTEEHANDLE handle,
+				 IN const void *request, IN size_t requestSize,
+				 OUT void *buffer, IN size_t bufferSize,
+				 OUT const struct tee_mkhi_hdr **response,
+				 OUT size_t *responseSize, IN uint32_t timeout);
+
+/*! Obtain the firmware version
+ *  Does not allocate memory.
+ *
+ *  \param handle The handle of the connected session
+ *  \param version firmware version
+ *  \param timeout timeout in milliseconds, 0 - blocking
+ *  \return 0 if successful, otherwise error code as in TeeMkhiTransact
+ */
+TEESTATUS TEEAPI TeeMkhiGetFwVersion(IN PTEEHANDLE handle,
+				     OUT struct tee_mkhi_fw_version *version,
+				     IN uint32_t timeout);
+
+/*! Obtain the firmware version through the process shared cache
+ *  Meant for the many processes that only need the version at startup:
+ *  a hit is read without a lock and without connecting, it never waits.
+ *  On a miss the device is locked, looked up again, and the firmware is
+ *  queried and the result stored before the lock is dropped, so processes
+ *  missing together wait for one query. A caller waits for the query of
+ *  another one at most timeout (one second when timeout is 0), then
+ *  queries the firmware itself. The result is keyed by the device,
+ *  the boot, the fw_ver attribute and the operation mode and reset count
+ *  of the first firmware status register, so a device reset or a firmware
+ *  update invalidates it; nothing is cached while the device is not enabled.
+ *  The cache is the file /run/metee-fwcache, METEE_FWCACHE replaces the
+ *  path; a process that cannot open it queries the firmware every time.
+ *  Windows does not cache and always queries the firmware.
+ *
+ *  \param handle The handle of the session, connected here on a miss
+ *         if it is not connected yet
+ *  \param version firmware version
+ *  \param timeout timeout in milliseconds, 0 - blocking
+ *  \return 0 if successful, otherwise error code as in TeeConnect
+ *          or TeeMkhiGetFwVersion
+ */
+TEESTATUS TEEAPI TeeMkhiGetFwVersionCached(IN PTEEHANDLE handle,
+					   OUT struct tee_mkhi_fw_version *version,
+					   IN uint32_t timeout);
+
+/*! Obtain the MKHI interface version
+ *  Does not allocate memory.
+ *
+ *  \param handle The handle of the connected session
+ *  \param version interface version
+ *  \param timeout timeout in milliseconds, 0 - blocking
+ *  \return 0 if successful, otherwise error code as in TeeMkhiTransact
+ */
+TEESTATUS TEEAPI TeeMkhiGetMkhiVersion(IN PTEEHANDLE handle,
+				       OUT struct tee_mkhi_if_version *version,
+				       IN uint32_t timeout);
+
+/*! Obtain a firmware capabilities rule
+ *  Does not allocate memory.
+ *
+ *  \param handle The handle of the connected session
+ *  \param ruleId rule, e.g. TEE_MKHI_RULE_FEATURE_STATE
+ *  \param data rule data
+ *  \param dataSize in: size of the data buffer, out: length of the rule data
+ *  \param timeout timeout in milliseconds, 0 - blocking
+ *  \return 0 if successful, TEE_INSUFFICIENT_BUFFER if the rule data
+ *          does not fit, dataSize is set to the required size,
+ *          otherwise error code as in TeeMkhiTransact
+ */
+TEESTATUS TEEAPI TeeMkhiGetRule(IN PTEEHANDLE handle, IN uint32_t ruleId,
+				OUT void *data, IN OUT size_t *dataSize,
+				IN uint32_t timeout);
+
+/*! Obtain the state of the firmware update protection override
+ *  Does not allocate memory.
+ *
+ *  \param handle The handle of the connected session
+ *  \param state TEE_MKHI_FWUPDATE_DISABLED, _LOCKED or _ENABLED
+ *  \param timeout timeout in milliseconds, 0 - blocking
+ *  \return 0 if successful, otherwise error code as in TeeMkhiTransact
+ */
+TEESTATUS TEEAPI TeeMkhiGetFwUpdateState(IN PTEEHANDLE handle,
+					 OUT uint8_t *state, IN uint32_t timeout);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __METEE_MKHI_H */
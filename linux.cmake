@@ -1,10 +1,20 @@
 # SPDX-License-Identifier: Apache-2.0
 # Copyright (C) 2014-2022 Intel Corporation
-set(TEE_SOURCES src/linux/metee_linux.c src/linux/mei.c)
+set(TEE_SOURCES src/linux/metee_linux.c src/linux/mei.c src/linux/metee_trace.c
+                src/linux/metee_stats.c src/linux/metee_capture.c
+                src/linux/metee_transport_mei.c src/linux/metee_transport_loopback.c
+                src/linux/metee_transport_fault.c src/linux/metee_clock.c
+                src/linux/metee_fwcache.c
+                src/metee_mkhi.c src/metee_amthi.c src/metee_fwu.c
+                src/metee_bundle.c)
 
 add_library(${PROJECT_NAME} ${TEE_SOURCES})
 
 target_include_directories(${PROJECT_NAME} PRIVATE src/linux)
+
+set(THREADS_PREFER_PTHREAD_FLAG ON)
+find_package(Threads REQUIRED)
+target_link_libraries(${PROJECT_NAME} Threads::Threads)
 target_compile_definitions(${PROJECT_NAME} PRIVATE
 			   $<$<BOOL:BUILD_SHARED_LIBS>:METEE_DLL>
 			   $<$<BOOL:BUILD_SHARED_LIBS>:METEE_DLL_EXPORT>
@@ -17,6 +27,13 @@ if(NOT HAVE_VTAG)
   include_directories(BEFORE "src/linux/include")
 endif()
 
+# USDT probes
+include(CheckIncludeFile)
+check_include_file(sys/sdt.h HAVE_SYS_SDT_H)
+if(HAVE_SYS_SDT_H)
+  target_compile_definitions(${PROJECT_NAME} PRIVATE HAVE_SYS_SDT_H)
+endif()
+
 # More warnings and warning-as-error
 target_compile_options(
   ${PROJECT_NAME}
@@ -39,4 +56,8 @@ if(NOT CONSOLE_OUTPUT)
   target_compile_definitions(${PROJECT_NAME} PRIVATE -DSYSLOG)
 endif()
 
+target_compile_definitions(${PROJECT_NAME} PRIVATE
+                           METEE_TRACE_LEVEL=${METEE_TRACE_LEVEL}
+)
+
 target_compile_definitions(${PROJECT_NAME} PRIVATE -D_GNU_SOURCE)
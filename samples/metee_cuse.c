@@ -0,0 +1,679 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2023 Intel Corporation
+ */
+/*
+ * Emulate the mei character device with CUSE, so the library and the
+ * tests run through the real syscall path without the hardware:
+ *   metee-cuse -f --name=mei0 --sysfs=/tmp/mei-sysfs
+ *   METEE_SYSFS_ROOT=/tmp/mei-sysfs metee_test
+ * Clients are given as --client=<uuid>[,len=<max_msg_length>][,ver=<protocol>]
+ *   [,single][,vtag][,notify][,echo|,mkhi]
+ * single:  only one connection at a time, others get EBUSY
+ * vtag:    IOCTL_MEI_CONNECT_CLIENT_VTAG is accepted
+ * notify:  every request raises a notification event
+ * echo:    the response repeats the request (default)
+ * mkhi:    answers MKHI GetFWVersion
+ * Without --client the MKHI client is emulated.
+ */
+#define FUSE_USE_VERSION 31
+
+#include <cuse_lowlevel.h>
+#include <fuse_opt.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/mei.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include "meiuuid.h"
+
+#define EMU_MAX_CLIENTS 16
+/* responses queued per open file, as TEE_LOOPBACK_QUEUE_LEN and the mei driver */
+#define EMU_TX_QUEUE_LIMIT 51
+#define EMU_FW_STATUS_NUM 6
+#define EMU_DEFAULT_NAME "mei0"
+#define EMU_DEFAULT_MAX_MSG_LEN 2048
+#define EMU_MKHI_UUID "8e6a6715-9abc-4043-88ef-9e39c6f63e0f"
+
+#define MKHI_GEN_GROUP_ID 0xFF
+#define GEN_GET_FW_VERSION_CMD 0x02
+
+enum emu_responder {
+	EMU_RESPONDER_ECHO,
+	EMU_RESPONDER_MKHI,
+};
+
+struct emu_client {
+	uuid_le uuid;
+	uint32_t max_msg_len;
+	uint8_t prot_ver;
+	bool single;
+	bool vtag;
+	bool notify;
+	enum emu_responder responder;
+	unsigned int connections;
+};
+
+struct emu_msg {
+	struct emu_msg *next;
+	size_t len;
+	unsigned char data[];
+};
+
+struct emu_file {
+	struct emu_client *client;  /* NULL when not connected */
+	uint8_t vtag;
+	bool notify_en;
+	bool notify_event;
+	struct emu_msg *head;
+	struct emu_msg *tail;
+	unsigned int count;
+	fuse_req_t read_req;        /* blocked read */
+	size_t read_size;
+	struct fuse_pollhandle *ph;
+};
+
+struct params {
+	char *name;
+	char *sysfs;
+	char *fwsts;
+	bool help;
+};
+
+static struct emu_client clients[EMU_MAX_CLIENTS];
+static unsigned int clients_num;
+static uint32_t fw_status[EMU_FW_STATUS_NUM] = { 0x90000255, 0x89110126 };
+static pthread_mutex_t emu_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct emu_file *to_file(struct fuse_file_info *fi)
+{
+	return (struct emu_file *)(uintptr_t)fi->fh;
+}
+
+static struct emu_client *emu_find_client(const uuid_le *uuid)
+{
+	unsigned int i;
+
+	for (i = 0; i < clients_num; i++) {
+		if (!memcmp(&clients[i].uuid, uuid, sizeof(*uuid)))
+			return &clients[i];
+	}
+	return NULL;
+}
+
+/* called with emu_lock held */
+static void emu_notify_poll(struct emu_file *f)
+{
+	if (f->ph) {
+		fuse_lowlevel_notify_poll(f->ph);
+		fuse_pollhandle_destroy(f->ph);
+		f->ph = NULL;
+	}
+}
+
+/* called with emu_lock held, the message is consumed */
+static void emu_reply_read(fuse_req_t req, size_t size, struct emu_file *f)
+{
+	struct emu_msg *msg = f->head;
+
+	f->head = msg->next;
+	if (!f->head)
+		f->tail = NULL;
+	f->count--;
+
+	if (size < msg->len)
+		fuse_reply_err(req, EMSGSIZE);
+	else
+		fuse_reply_buf(req, (const char *)msg->data, msg->len);
+	free(msg);
+}
+
+static void emu_flush(struct emu_file *f)
+{
+	struct emu_msg *msg;
+
+	while (f->head) {
+		msg = f->head;
+		f->head = msg->next;
+		free(msg);
+	}
+	f->tail = NULL;
+	f->count = 0;
+}
+
+static size_t emu_respond(const struct emu_client *cl, const char *req, size_t len,
+			  unsigned char *resp)
+{
+	uint32_t hdr;
+
+	if (cl->responder == EMU_RESPONDER_ECHO) {
+		memcpy(resp, req, len);
+		return len;
+	}
+
+	/* MKHI header: group 8 bits, command 7 bits, response 1 bit, reserved, result */
+	if (len < sizeof(hdr))
+		return 0;
+	memcpy(&hdr, req, sizeof(hdr));
+	memset(resp, 0, 20);
+	hdr = (hdr & 0x7FFF) | 0x8000;
+	if ((hdr & 0xFF) == MKHI_GEN_GROUP_ID &&
+	    ((hdr >> 8) & 0x7F) == GEN_GET_FW_VERSION_CMD) {
+		/* code minor, major, build, hotfix */
+		const uint16_t ver[] = { 1, 16, 1000, 10 };
+
+		memcpy(resp + sizeof(hdr), ver, sizeof(ver));
+	} else {
+		hdr |= 1U << 24;
+	}
+	memcpy(resp, &hdr, sizeof(hdr));
+	return 20;
+}
+
+static void emu_open(fuse_req_t req, struct fuse_file_info *fi)
+{
+	struct emu_file *f;
+
+	f = calloc(1, sizeof(*f));
+	if (!f) {
+		fuse_reply_err(req, ENOMEM);
+		return;
+	}
+	fi->fh = (uintptr_t)f;
+	fi->nonseekable = 1;
+	fi->direct_io = 1;
+	fuse_reply_open(req, fi);
+}
+
+static void emu_release(fuse_req_t req, struct fuse_file_info *fi)
+{
+	struct emu_file *f = to_file(fi);
+
+	pthread_mutex_lock(&emu_lock);
+	if (f->client)
+		f->client->connections--;
+	emu_flush(f);
+	if (f->ph)
+		fuse_pollhandle_destroy(f->ph);
+	pthread_mutex_unlock(&emu_lock);
+	free(f);
+	fuse_reply_err(req, 0);
+}
+
+static void emu_read_interrupt(fuse_req_t req, void *data)
+{
+	struct emu_file *f = data;
+	bool pending;
+
+	pthread_mutex_lock(&emu_lock);
+	pending = (f->read_req == req);
+	if (pending)
+		f->read_req = NULL;
+	pthread_mutex_unlock(&emu_lock);
+	if (pending)
+		fuse_reply_err(req, EINTR);
+}
+
+static void emu_read(fuse_req_t req, size_t size, off_t off,
+		     struct fuse_file_info *fi)
+{
+	struct emu_file *f = to_file(fi);
+
+	(void)off;
+
+	/* registered before the lock, the callback runs at once when interrupted */
+	if (!(fi->flags & O_NONBLOCK))
+		fuse_req_interrupt_func(req, emu_read_interrupt, f);
+
+	pthread_mutex_lock(&emu_lock);
+	if (!f->client)
+		fuse_reply_err(req, ENODEV);
+	else if (f->head)
+		emu_reply_read(req, size, f);
+	else if (fi->flags & O_NONBLOCK)
+		fuse_reply_err(req, EAGAIN);
+	else if (f->read_req)
+		fuse_reply_err(req, EBUSY);
+	else if (fuse_req_interrupted(req))
+		fuse_reply_err(req, EINTR);
+	else {
+		f->read_req = req;
+		f->read_size = size;
+	}
+	pthread_mutex_unlock(&emu_lock);
+}
+
+static void emu_write(fuse_req_t req, const char *buf, size_t size, off_t off,
+		      struct fuse_file_info *fi)
+{
+	struct emu_file *f = to_file(fi);
+	struct emu_client *cl;
+	struct emu_msg *msg;
+	fuse_req_t read_req;
+
+	(void)off;
+
+	pthread_mutex_lock(&emu_lock);
+	cl = f->client;
+	if (!cl) {
+		pthread_mutex_unlock(&emu_lock);
+		fuse_reply_err(req, ENODEV);
+		return;
+	}
+	if (size > cl->max_msg_len) {
+		pthread_mutex_unlock(&emu_lock);
+		fuse_reply_err(req, EFBIG);
+		return;
+	}
+	if (f->count >= EMU_TX_QUEUE_LIMIT) {
+		pthread_mutex_unlock(&emu_lock);
+		fuse_reply_err(req, EAGAIN);
+		return;
+	}
+
+	msg = malloc(sizeof(*msg) + cl->max_msg_len);
+	if (!msg) {
+		pthread_mutex_unlock(&emu_lock);
+		fuse_reply_err(req, ENOMEM);
+		return;
+	}
+	msg->next = NULL;
+	msg->len = emu_respond(cl, buf, size, msg->data);
+	if (msg->len) {
+		if (f->tail)
+			f->tail->next = msg;
+		else
+			f->head = msg;
+		f->tail = msg;
+		f->count++;
+	} else {
+		free(msg);
+	}
+	if (cl->notify && f->notify_en)
+		f->notify_event = true;
+
+	fuse_reply_write(req, size);
+
+	if (f->read_req && f->head) {
+		read_req = f->read_req;
+		f->read_req = NULL;
+		emu_reply_read(read_req, f->read_size, f);
+	}
+	emu_notify_poll(f);
+	pthread_mutex_unlock(&emu_lock);
+}
+
+static int emu_connect(struct emu_file *f, const uuid_le *uuid, uint8_t vtag,
+		       bool with_vtag, struct mei_client *props)
+{
+	struct emu_client *cl;
+
+	if (f->client)
+		return EBUSY;
+	cl = emu_find_client(uuid);
+	if (!cl)
+		return ENOTTY;
+	if (with_vtag && !cl->vtag)
+		return EOPNOTSUPP;
+	if (with_vtag && !vtag)
+		return EINVAL;
+	if (cl->single && cl->connections)
+		return EBUSY;
+
+	cl->connections++;
+	f->client = cl;
+	f->vtag = vtag;
+	memset(props, 0, sizeof(*props));
+	props->max_msg_length = cl->max_msg_len;
+	props->protocol_version = cl->prot_ver;
+	return 0;
+}
+
+/* CUSE passes the ioctl argument only after the sizes are requested */
+static bool emu_ioctl_retry(fuse_req_t req, void *arg, size_t in_size,
+			    size_t in_bufsz, size_t out_size, size_t out_bufsz)
+{
+	struct iovec in_iov = { arg, in_size };
+	struct iovec out_iov = { arg, out_size };
+
+	if (in_bufsz >= in_size && out_bufsz >= out_size)
+		return false;
+	fuse_reply_ioctl_retry(req, in_size ? &in_iov : NULL, in_size ? 1 : 0,
+			       out_size ? &out_iov : NULL, out_size ? 1 : 0);
+	return true;
+}
+
+static void emu_ioctl(fuse_req_t req, int cmd, void *arg,
+		      struct fuse_file_info *fi, unsigned int flags,
+		      const void *in_buf, size_t in_bufsz, size_t out_bufsz)
+{
+	struct emu_file *f = to_file(fi);
+	struct mei_connect_client_data data;
+	struct mei_connect_client_data_vtag data_v;
+	uint32_t val;
+	int err;
+
+	(void)flags;
+
+	switch ((unsigned int)cmd) {
+	case IOCTL_MEI_CONNECT_CLIENT:
+		if (emu_ioctl_retry(req, arg, sizeof(data), in_bufsz,
+				    sizeof(data), out_bufsz))
+			return;
+		memcpy(&data, in_buf, sizeof(data));
+		pthread_mutex_lock(&emu_lock);
+		err = emu_connect(f, &data.in_client_uuid, 0, false,
+				  &data.out_client_properties);
+		pthread_mutex_unlock(&emu_lock);
+		if (err)
+			fuse_reply_err(req, err);
+		else
+			fuse_reply_ioctl(req, 0, &data, sizeof(data));
+		break;
+	case IOCTL_MEI_CONNECT_CLIENT_VTAG:
+		if (emu_ioctl_retry(req, arg, sizeof(data_v), in_bufsz,
+				    sizeof(data_v), out_bufsz))
+			return;
+		memcpy(&data_v, in_buf, sizeof(data_v));
+		pthread_mutex_lock(&emu_lock);
+		err = emu_connect(f, &data_v.connect.in_client_uuid,
+				  data_v.connect.vtag, true,
+				  &data_v.out_client_properties);
+		pthread_mutex_unlock(&emu_lock);
+		if (err)
+			fuse_reply_err(req, err);
+		else
+			fuse_reply_ioctl(req, 0, &data_v, sizeof(data_v));
+		break;
+	case IOCTL_MEI_NOTIFY_SET:
+		if (emu_ioctl_retry(req, arg, sizeof(val), in_bufsz, 0, out_bufsz))
+			return;
+		memcpy(&val, in_buf, sizeof(val));
+		pthread_mutex_lock(&emu_lock);
+		if (!f->client) {
+			err = ENODEV;
+		} else if (!f->client->notify) {
+			err = EOPNOTSUPP;
+		} else {
+			f->notify_en = !!val;
+			f->notify_event = false;
+			err = 0;
+		}
+		pthread_mutex_unlock(&emu_lock);
+		if (err)
+			fuse_reply_err(req, err);
+		else
+			fuse_reply_ioctl(req, 0, NULL, 0);
+		break;
+	case IOCTL_MEI_NOTIFY_GET:
+		if (emu_ioctl_retry(req, arg, 0, in_bufsz, sizeof(val), out_bufsz))
+			return;
+		pthread_mutex_lock(&emu_lock);
+		if (!f->client) {
+			err = ENODEV;
+		} else if (!f->notify_en) {
+			err = EOPNOTSUPP;
+		} else {
+			/* the driver blocks here, the emulator reports the current state */
+			val = f->notify_event;
+			f->notify_event = false;
+			err = 0;
+		}
+		pthread_mutex_unlock(&emu_lock);
+		if (err)
+			fuse_reply_err(req, err);
+		else
+			fuse_reply_ioctl(req, 0, &val, sizeof(val));
+		break;
+	default:
+		fuse_reply_err(req, ENOTTY);
+		break;
+	}
+}
+
+static void emu_poll(fuse_req_t req, struct fuse_file_info *fi,
+		     struct fuse_pollhandle *ph)
+{
+	struct emu_file *f = to_file(fi);
+	unsigned int revents = 0;
+
+	pthread_mutex_lock(&emu_lock);
+	if (ph) {
+		if (f->ph)
+			fuse_pollhandle_destroy(f->ph);
+		f->ph = ph;
+	}
+	if (!f->client) {
+		revents = POLLERR | POLLHUP;
+	} else {
+		if (f->head)
+			revents |= POLLIN | POLLRDNORM;
+		if (f->count < EMU_TX_QUEUE_LIMIT)
+			revents |= POLLOUT | POLLWRNORM;
+		if (f->notify_event)
+			revents |= POLLPRI;
+	}
+	pthread_mutex_unlock(&emu_lock);
+	fuse_reply_poll(req, revents);
+}
+
+static const struct cuse_lowlevel_ops emu_ops = {
+	.open = emu_open,
+	.read = emu_read,
+	.write = emu_write,
+	.release = emu_release,
+	.ioctl = emu_ioctl,
+	.poll = emu_poll,
+};
+
+static int write_file(const char *dir, const char *name, const char *text)
+{
+	char path[PATH_MAX];
+	FILE *fp;
+
+	if (snprintf(path, sizeof(path), "%s/%s", dir, name) >= (int)sizeof(path))
+		return -1;
+	fp = fopen(path, "w");
+	if (!fp)
+		return -1;
+	fputs(text, fp);
+	return fclose(fp);
+}
+
+static int mkdir_p(char *path)
+{
+	char *p;
+
+	for (p = path + 1; *p; p++) {
+		if (*p != '/')
+			continue;
+		*p = '\0';
+		if (mkdir(path, 0755) && errno != EEXIST)
+			return -1;
+		*p = '/';
+	}
+	if (mkdir(path, 0755) && errno != EEXIST)
+		return -1;
+	return 0;
+}
+
+/* <root>/class/mei/<name>/fw_status as read by the library */
+static int create_sysfs(const char *root, const char *name)
+{
+	char dir[PATH_MAX];
+	char fwsts[EMU_FW_STATUS_NUM * 9 + 1];
+	unsigned int i;
+
+	if (snprintf(dir, sizeof(dir), "%s/class/mei/%s", root, name) >= (int)sizeof(dir))
+		return -1;
+	if (mkdir_p(dir))
+		return -1;
+
+	for (i = 0; i < EMU_FW_STATUS_NUM; i++)
+		snprintf(fwsts + i * 9, 10, "%08X\n", fw_status[i]);
+	if (write_file(dir, "fw_status", fwsts))
+		return -1;
+	if (write_file(dir, "kind", "mei\n"))
+		return -1;
+	return write_file(dir, "dev_state", "ENABLED\n");
+}
+
+static int parse_client(const char *arg)
+{
+	struct emu_client *cl;
+	char *spec, *tok, *save = NULL;
+	int rc = 0;
+
+	if (clients_num == EMU_MAX_CLIENTS)
+		return -1;
+	cl = &clients[clients_num];
+	memset(cl, 0, sizeof(*cl));
+	cl->max_msg_len = EMU_DEFAULT_MAX_MSG_LEN;
+	cl->prot_ver = 1;
+
+	spec = strdup(arg);
+	if (!spec)
+		return -1;
+	tok = strtok_r(spec, ",", &save);
+	if (!tok || mei_uuid_parse(tok, &cl->uuid) < 0)
+		rc = -1;
+	while (!rc && (tok = strtok_r(NULL, ",", &save))) {
+		if (!strncmp(tok, "len=", 4))
+			cl->max_msg_len = strtoul(tok + 4, NULL, 0);
+		else if (!strncmp(tok, "ver=", 4))
+			cl->prot_ver = strtoul(tok + 4, NULL, 0);
+		else if (!strcmp(tok, "single"))
+			cl->single = true;
+		else if (!strcmp(tok, "vtag"))
+			cl->vtag = true;
+		else if (!strcmp(tok, "notify"))
+			cl->notify = true;
+		else if (!strcmp(tok, "echo"))
+			cl->responder = EMU_RESPONDER_ECHO;
+		else if (!strcmp(tok, "mkhi"))
+			cl->responder = EMU_RESPONDER_MKHI;
+		else
+			rc = -1;
+	}
+	free(spec);
+	/* the MKHI response does not fit smaller buffers */
+	if (!rc && cl->max_msg_len < 20)
+		rc = -1;
+	if (rc)
+		fprintf(stderr, "bad client specification: %s\n", arg);
+	else
+		clients_num++;
+	return rc;
+}
+
+static int parse_fwsts(const char *arg)
+{
+	char *end;
+	unsigned int i;
+
+	for (i = 0; i < EMU_FW_STATUS_NUM && *arg; i++) {
+		fw_status[i] = strtoul(arg, &end, 16);
+		if (end == arg || (*end && *end != ','))
+			return -1;
+		arg = *end ? end + 1 : end;
+	}
+	return 0;
+}
+
+enum {
+	KEY_CLIENT,
+	KEY_HELP,
+};
+
+#define EMU_OPT(t, p) { t, offsetof(struct params, p), 1 }
+
+static const struct fuse_opt emu_opts[] = {
+	EMU_OPT("-n %s", name),
+	EMU_OPT("--name=%s", name),
+	EMU_OPT("--sysfs=%s", sysfs),
+	EMU_OPT("--fwsts=%s", fwsts),
+	FUSE_OPT_KEY("--client=", KEY_CLIENT),
+	FUSE_OPT_KEY("-h", KEY_HELP),
+	FUSE_OPT_KEY("--help", KEY_HELP),
+	FUSE_OPT_END
+};
+
+static int emu_process_arg(void *data, const char *arg, int key,
+			   struct fuse_args *outargs)
+{
+	struct params *p = data;
+
+	switch (key) {
+	case KEY_CLIENT:
+		return parse_client(arg + strlen("--client=")) ? -1 : 0;
+	case KEY_HELP:
+		p->help = true;
+		return fuse_opt_add_arg(outargs, "-ho");
+	default:
+		return 1;
+	}
+}
+
+static void usage(const char *p)
+{
+	fprintf(stdout,
+		"%s: [--name=<device>] [--sysfs=<dir>] [--fwsts=<hex>,...]\n"
+		"\t[--client=<uuid>[,len=<n>][,ver=<n>][,single][,vtag][,notify][,echo|,mkhi]]...\n"
+		"\t[-f] [-s] [-d]\n", p);
+}
+
+int main(int argc, char *argv[])
+{
+	struct fuse_args args = FUSE_ARGS_INIT(argc, argv);
+	struct params p;
+	struct cuse_info ci;
+	char dev_name[128];
+	const char *dev_info_argv[] = { dev_name };
+	int rc;
+
+	memset(&p, 0, sizeof(p));
+	if (fuse_opt_parse(&args, &p, emu_opts, emu_process_arg)) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+	if (p.help)
+		usage(argv[0]);
+
+	if (!p.name)
+		p.name = strdup(EMU_DEFAULT_NAME);
+	if (!clients_num && parse_client(EMU_MKHI_UUID ",single,mkhi"))
+		return EXIT_FAILURE;
+	if (p.fwsts && parse_fwsts(p.fwsts)) {
+		fprintf(stderr, "bad fw status list: %s\n", p.fwsts);
+		return EXIT_FAILURE;
+	}
+	if (p.sysfs && create_sysfs(p.sysfs, p.name)) {
+		perror(p.sysfs);
+		return EXIT_FAILURE;
+	}
+
+	snprintf(dev_name, sizeof(dev_name), "DEVNAME=%s", p.name);
+	memset(&ci, 0, sizeof(ci));
+	ci.dev_info_argc = 1;
+	ci.dev_info_argv = dev_info_argv;
+	ci.flags = CUSE_UNRESTRICTED_IOCTL;
+
+	rc = cuse_lowlevel_main(args.argc, args.argv, &ci, &emu_ops, NULL);
+
+	fuse_opt_free_args(&args);
+	free(p.name);
+	free(p.sysfs);
+	free(p.fwsts);
+	return rc;
+}
@@ -9,6 +9,8 @@
 #include <errno.h>
 #include <stdint.h>
 #include <metee.h>
+#include <metee_fwu.h>
+#include <metee_bundle.h>
 
 #ifndef BIT
 #define BIT(n) 1 << (n)
@@ -24,47 +26,7 @@ typedef BOOL bool;
 #include <unistd.h>
 #endif /* _WIN32 */
 
-#pragma pack(1)
-struct gsc_fwu_heci_header {
-	uint8_t command_id;
-	uint8_t is_response :1;
-	uint8_t reserved    :7;
-	uint8_t reserved2[2];
-};
-
-struct gsc_fwu_heci_version_req {
-	struct gsc_fwu_heci_header header;
-	uint32_t                   partition;
-};
-
-struct gsc_fwu_heci_response {
-	struct gsc_fwu_heci_header header;
-	uint32_t                   status;
-	uint32_t                   reserved;
-};
-
-struct gsc_fwu_heci_version_resp {
-	struct gsc_fwu_heci_response response;
-	uint32_t                     partition;
-	uint32_t                     version_length;
-	uint8_t                      version[];
-};
-
-struct gsc_fwu_external_version {
-	char     project[4];
-	uint16_t hotfix;
-	uint16_t build;
-};
-#pragma pack()
-
-#define GSC_FWU_HECI_COMMAND_ID_GET_IP_VERSION 6
-
-enum gsc_fwu_heci_payload_type {
-	gsc_fwu_heci_payload_type_invalid    = 0, /**< lower sentinel */
-	gsc_fwu_heci_payload_type_gfx_fw     = 1, /**< graphics firmware */
-	gsc_fwu_heci_payload_type_oprom_data = 2, /**< oprom data partition */
-	gsc_fwu_heci_payload_type_oprom_code = 3, /**< oprom code partition */
-};
+#include "gsc_fwu_schema.h"
 
 /** GSC firmware update status SUCCESS */
 #define GSC_FWU_STATUS_SUCCESS                        0x0
@@ -133,32 +95,13 @@ static void mk_host_if_deinit(struct mk_host_if *acmd)
 	TeeDisconnect(&acmd->mei_cl);
 }
 
-static uint32_t mkhi_verify_response_header(struct gsc_fwu_heci_header *msg, struct gsc_fwu_heci_header *resp)
-{
-	bool match = true;
-	if (msg->command_id != resp->command_id) {
-		printf("Mismatch Command; Req-Command = %d , Resp-Command = %d\n",
-		       msg->command_id, resp->command_id);
-		match = false;
-	}
-	if (resp->is_response != 1) {
-		printf("Wrong IsResponse; Resp-IsResponse = %d\n", resp->is_response);
-		match = false;
-	}
-
-	return match ? GSC_FWU_STATUS_SUCCESS : GSC_FWU_STATUS_FAILURE;
-}
-
 static uint32_t mk_host_if_call(struct mk_host_if *acmd,
                                 const unsigned char *command, ssize_t command_sz,
-                                uint8_t **read_buf, uint32_t rcmd,
-                                unsigned int expected_sz)
+                                uint8_t **read_buf, size_t *read_sz)
 {
 	uint32_t in_buf_sz;
-	size_t out_buf_sz;
 	size_t written;
 	TEESTATUS status;
-	struct gsc_fwu_heci_response *msg_hdr;
 	int count = 0;
 
 	in_buf_sz = (unsigned int)acmd->mei_cl.maxMsgLen;
@@ -166,7 +109,6 @@ static uint32_t mk_host_if_call(struct mk_host_if *acmd,
 	if (*read_buf == NULL)
 		return GSC_FWU_STATUS_FAILURE;
 	memset(*read_buf, 0, in_buf_sz);
-	msg_hdr = (struct gsc_fwu_heci_response *)*read_buf;
 
 	while (count++ < 2) {
 		status = TeeWrite(&acmd->mei_cl, command, command_sz, &written, 0);
@@ -178,25 +120,14 @@ static uint32_t mk_host_if_call(struct mk_host_if *acmd,
 		break;
 	}
 
-	status = TeeRead(&acmd->mei_cl, *read_buf, in_buf_sz, &out_buf_sz, MKHI_READ_TIMEOUT);
+	status = TeeRead(&acmd->mei_cl, *read_buf, in_buf_sz, read_sz, MKHI_READ_TIMEOUT);
 	if (status)
 		return GSC_FWU_STATUS_FAILURE;
 
-	status = msg_hdr->status;
-	if (acmd->verbose)
-		fprintf(stderr, "mkhif: message header read status = %d\n", status);
-
-	status = mkhi_verify_response_header((struct gsc_fwu_heci_header *)command, &msg_hdr->header);
-	if (status != GSC_FWU_STATUS_SUCCESS)
-		return status;
-
-	if (expected_sz && expected_sz != out_buf_sz) {
-		return GSC_FWU_STATUS_FAILURE;
-	}
 	return GSC_FWU_STATUS_SUCCESS;
 }
 
-static void printf_if_fw_version(struct gsc_fwu_external_version *version)
+static void printf_if_fw_version(const struct gsc_fwu_external_version *version)
 {
 	printf("Firmware Version %c%c%c%c.%d.%d\n",
 	       version->project[0], version->project[1],
@@ -208,46 +139,46 @@ static void printf_if_fw_version(struct gsc_fwu_external_version *version)
 static uint32_t mk_host_if_fw_version(struct mk_host_if *cmd,
                                       struct gsc_fwu_external_version *version)
 {
-	struct gsc_fwu_heci_version_req req;
-	struct gsc_fwu_heci_version_resp *response = NULL;
+	struct gsc_fwu_version_req req;
+	struct gsc_fwu_version_rsp *response = NULL;
+	size_t size = 0;
 	uint32_t status;
-	size_t size = sizeof(struct gsc_fwu_heci_version_resp) + sizeof(struct gsc_fwu_external_version);
 
-	req.header.command_id = GSC_FWU_HECI_COMMAND_ID_GET_IP_VERSION; /* GET FW Version */
-	req.header.is_response = 0;
-	req.header.reserved = 0;
-	req.header.reserved2[0] = 0;
-	req.header.reserved2[1] = 0;
-	req.partition = gsc_fwu_heci_payload_type_gfx_fw;
+	gsc_fwu_version_req_init(&req);
+	req.partition = GSC_FWU_PAYLOAD_GFX_FW;
 
 	status = mk_host_if_call(cmd,
 	                         (const unsigned char *)&req, sizeof(req),
-	                         (uint8_t **)&response,
-	                         0, (unsigned int)size);
+	                         (uint8_t **)&response, &size);
+	if (status != GSC_FWU_STATUS_SUCCESS)
+		goto out;
+
+	if (cmd->verbose)
+		fprintf(stderr, "mkhif: message header read status = %d\n", response->status);
 
-	if (status != GSC_FWU_STATUS_SUCCESS) {
-		return status;
+	if (!gsc_fwu_version_rsp_valid(response, size)) {
+		printf("Malformed response; Resp-Command = %d, Resp-Flags = 0x%02X, Size = %zu\n",
+		       response->header.command_id, response->header.flags, size);
+		status = GSC_FWU_STATUS_FAILURE;
+		goto out;
 	}
-	memcpy(version, response->version, sizeof(struct gsc_fwu_external_version));
+	*version = response->version;
 
+out:
+	free(response);
 	return status;
 }
 
 static uint32_t mk_host_if_fw_version_req(struct mk_host_if *acmd)
 {
-	struct gsc_fwu_heci_version_req req;
-	unsigned char *buf = (unsigned char *)&req;
+	struct gsc_fwu_version_req req;
 	size_t written;
 	TEESTATUS status;
 
-	req.header.command_id = GSC_FWU_HECI_COMMAND_ID_GET_IP_VERSION; /* GET FW Version */
-	req.header.is_response = 0;
-	req.header.reserved = 0;
-	req.header.reserved2[0] = 0;
-	req.header.reserved2[1] = 0;
-	req.partition = gsc_fwu_heci_payload_type_gfx_fw;
+	gsc_fwu_version_req_init(&req);
+	req.partition = GSC_FWU_PAYLOAD_GFX_FW;
 
-	status = TeeWrite(&acmd->mei_cl, buf, sizeof(req), &written, 0);
+	status = TeeWrite(&acmd->mei_cl, &req, sizeof(req), &written, 0);
 	if (status || written != sizeof(req))
 		return GSC_FWU_STATUS_FAILURE;
 
@@ -258,25 +189,170 @@ static uint32_t mk_host_if_fw_version_resp(struct mk_host_if *acmd)
 {
 	size_t recvd;
 	TEESTATUS status;
-	unsigned char rec_msg[100];
-	struct gsc_fwu_heci_version_resp *response = (struct gsc_fwu_heci_version_resp *)rec_msg;
-	size_t size = sizeof(struct gsc_fwu_heci_version_resp) + sizeof(struct gsc_fwu_external_version);
+	struct gsc_fwu_version_rsp response;
+
+	status = TeeRead(&acmd->mei_cl, &response, sizeof(response), &recvd, MKHI_READ_TIMEOUT);
+	if (status || !gsc_fwu_version_rsp_valid(&response, recvd))
+		return GSC_FWU_STATUS_FAILURE;
+	printf_if_fw_version(&response.version);
+	return GSC_FWU_STATUS_SUCCESS;
+}
+
+static void mk_host_if_fw_update_progress(void *ctx, const struct tee_fwu_stats *stats)
+{
+	(void)ctx;
+	printf("\rUpdating: %3u%% %8llu KiB/s",
+	       (unsigned int)(stats->sent * 100 / stats->total),
+	       (unsigned long long)(stats->throughput / 1024));
+	if (stats->sent == stats->total)
+		printf("\n");
+	fflush(stdout);
+}
+
+static uint32_t mk_host_if_fw_update(struct mk_host_if *acmd, const char *image)
+{
+	struct tee_fwu_stats stats;
+	TEESTATUS status;
+
+	status = TeeFwuUpdateFile(&acmd->mei_cl, GSC_FWU_PAYLOAD_GFX_FW, image, NULL, 0,
+				  mk_host_if_fw_update_progress, NULL, &stats,
+				  MKHI_READ_TIMEOUT);
+	if (acmd->verbose)
+		fprintf(stderr, "fwu: %u chunks of %u bytes, %llu ms, %llu ms waiting for firmware\n",
+			stats.chunks, stats.chunk_size,
+			(unsigned long long)(stats.elapsed / 1000000),
+			(unsigned long long)(stats.wait / 1000000));
+	if (status != TEE_SUCCESS) {
+		fprintf(stderr, "fwu: update failed with status %d\n", status);
+		return GSC_FWU_STATUS_FAILURE;
+	}
+	return GSC_FWU_STATUS_SUCCESS;
+}
+
+static uint32_t fw_update_bundle(const GUID *guid, const char *path, bool verbose)
+{
+	struct tee_bundle *bundle;
+	const struct tee_bundle_partition *parts;
+	struct tee_fwu_stats stats;
+	TEEHANDLE handle = TEEHANDLE_ZERO;
+	size_t count, i;
+	TEESTATUS status;
+
+	status = TeeBundleOpen(path, &bundle);
+	if (status != TEE_SUCCESS) {
+		fprintf(stderr, "fwu: cannot open the bundle, status %d\n", status);
+		return GSC_FWU_STATUS_FAILURE;
+	}
+	if (verbose && TeeBundlePartitions(bundle, &parts, &count) == TEE_SUCCESS)
+		for (i = 0; i < count; i++)
+			fprintf(stderr, "fwu: partition %u, %zu bytes\n",
+				parts[i].payload_type, parts[i].size);
+
+	/* the session connects while the partition is verified */
+#ifdef WIN32
+	status = TeeInitGUID(&handle, guid, &GUID_DEVINTERFACE_HECI_GSC_CHILD);
+#else
+	status = TeeInit(&handle, guid, NULL);
+#endif /* WIN32 */
+	if (status == TEE_SUCCESS)
+		status = TeeBundleUpdate(&handle, bundle, GSC_FWU_PAYLOAD_GFX_FW, NULL, 0,
+					 mk_host_if_fw_update_progress, NULL, &stats,
+					 MKHI_READ_TIMEOUT);
+	TeeDisconnect(&handle);
+	TeeBundleClose(bundle);
+	if (status != TEE_SUCCESS) {
+		fprintf(stderr, "fwu: update failed with status %d\n", status);
+		return GSC_FWU_STATUS_FAILURE;
+	}
+	return GSC_FWU_STATUS_SUCCESS;
+}
+
+static uint32_t fw_write_bundle(const char *path, const char *gfx,
+				const char *oprom_data, const char *oprom_code)
+{
+	struct tee_bundle_source sources[3];
+	size_t count = 0;
+	TEESTATUS status;
+
+	if (gfx) {
+		sources[count].payload_type = GSC_FWU_PAYLOAD_GFX_FW;
+		sources[count++].path = gfx;
+	}
+	if (oprom_data) {
+		sources[count].payload_type = TEE_FWU_PAYLOAD_OPROM_DATA;
+		sources[count++].path = oprom_data;
+	}
+	if (oprom_code) {
+		sources[count].payload_type = TEE_FWU_PAYLOAD_OPROM_CODE;
+		sources[count++].path = oprom_code;
+	}
+
+	status = TeeBundleCreate(path, sources, count);
+	if (status != TEE_SUCCESS) {
+		fprintf(stderr, "fwu: cannot create the bundle, status %d\n", status);
+		return GSC_FWU_STATUS_FAILURE;
+	}
+	return GSC_FWU_STATUS_SUCCESS;
+}
+
+#define FWU_MAX_DEVICES 16
+
+struct fw_update_devices_ctx {
+	struct tee_fwu_device *devices;
+	unsigned int reported[FWU_MAX_DEVICES];
+};
+
+/* per device progress in steps of 10%, every device is updated by one thread */
+static void fw_update_devices_progress(void *ctx, size_t index, const struct tee_fwu_stats *stats)
+{
+	struct fw_update_devices_ctx *c = ctx;
+	unsigned int percent = (unsigned int)(stats->sent * 100 / stats->total);
+
+	if (percent < c->reported[index] + 10 && percent != 100)
+		return;
+	c->reported[index] = percent;
+	printf("%s: %3u%% %8llu KiB/s\n", c->devices[index].device, percent,
+	       (unsigned long long)(stats->throughput / 1024));
+}
 
-	status = TeeRead(&acmd->mei_cl, rec_msg, size, &recvd, MKHI_READ_TIMEOUT);
-	if (status || recvd <= 0)
+static uint32_t fw_update_devices(const GUID *guid, const char *image,
+				  struct tee_fwu_device *devices, size_t count,
+				  unsigned int concurrency)
+{
+	struct fw_update_devices_ctx ctx;
+	TEESTATUS status;
+	size_t i;
+
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.devices = devices;
+	status = TeeFwuUpdateDevices(guid, GSC_FWU_PAYLOAD_GFX_FW, image, NULL, 0,
+				     devices, count, concurrency,
+				     fw_update_devices_progress, &ctx, MKHI_READ_TIMEOUT);
+	for (i = 0; i < count; i++)
+		printf("%s: %s, %llu ms\n", devices[i].device,
+		       (devices[i].status == TEE_SUCCESS) ? "updated" : "failed",
+		       (unsigned long long)(devices[i].stats.elapsed / 1000000));
+	if (status != TEE_SUCCESS) {
+		fprintf(stderr, "fwu: update failed with status %d\n", status);
 		return GSC_FWU_STATUS_FAILURE;
-	printf_if_fw_version((struct gsc_fwu_external_version *)response->version);
+	}
 	return GSC_FWU_STATUS_SUCCESS;
 }
 
 static void usage(const char *p)
 {
-	fprintf(stderr, "Usage: %s [-hv] [-e <l> ] [-i <n> ] [-b M.m.f.b] [-r] [-s <seq>] [-k <n>]\n", p);
+	fprintf(stderr, "Usage: %s [-hv] [-e <l> ] [-i <n> ] [-b M.m.f.b] [-r] [-s <seq>] [-k <n>] [-f <image> [-d <device>]... [-j <n>]] [-p <bundle>] [-w <bundle> [-f <image>] [-D <image>] [-C <image>]]\n", p);
 	fprintf(stderr, "        -h                help\n");
 	fprintf(stderr, "        -v                verbose\n");
 	fprintf(stderr, "        -i <n>            iterate n times\n");
 	fprintf(stderr, "        -r                reconnect if failed to write\n");
 	fprintf(stderr, "        -k <n>            timeout between iterations in microseconds (default: 0)\n");
+	fprintf(stderr, "        -f <image>        update the graphics firmware from the image\n");
+	fprintf(stderr, "        -d <device>       update the device, repeat for concurrent update of several devices\n");
+	fprintf(stderr, "        -j <n>            update at most n devices at once (default: all)\n");
+	fprintf(stderr, "        -p <bundle>       update the graphics firmware from the partition of the metee bundle\n");
+	fprintf(stderr, "        -w <bundle>       write a metee bundle of the graphics firmware (-f), oprom data (-D)\n");
+	fprintf(stderr, "                          and oprom code (-C) images\n");
 }
 
 int main(int argc, char *argv[])
@@ -290,6 +366,14 @@ int main(int argc, char *argv[])
 	unsigned int i, iterations = 1;
 	const GUID *guid = &GUID_METEE_FWU;
 	char *sequence = NULL;
+	char *image = NULL;
+	char *bundle = NULL;
+	char *write_bundle = NULL;
+	char *oprom_data = NULL;
+	char *oprom_code = NULL;
+	struct tee_fwu_device devices[FWU_MAX_DEVICES];
+	size_t device_count = 0;
+	unsigned int concurrency = 0;
 
 	bool verbose = false;
 	int ret = 0;
@@ -304,7 +388,7 @@ int main(int argc, char *argv[])
 	extern char *optarg;
 	int opt;
 
-	while ((opt = getopt(argc, argv, "hv:i:s:rk:")) != -1) {
+	while ((opt = getopt(argc, argv, "hv:i:s:rk:f:d:j:p:w:D:C:")) != -1) {
 		switch (opt) {
 		case 'v':
 			verbose = true;
@@ -319,6 +403,36 @@ int main(int argc, char *argv[])
 		case 's':
 			sequence = optarg;
 			break;
+		case 'f':
+			image = optarg;
+			break;
+		case 'p':
+			bundle = optarg;
+			break;
+		case 'w':
+			write_bundle = optarg;
+			break;
+		case 'D':
+			oprom_data = optarg;
+			break;
+		case 'C':
+			oprom_code = optarg;
+			break;
+		case 'd':
+			if (device_count == FWU_MAX_DEVICES) {
+				fprintf(stderr, "at most %d devices\n", FWU_MAX_DEVICES);
+				exit(EXIT_FAILURE);
+			}
+			memset(&devices[device_count], 0, sizeof(devices[device_count]));
+			devices[device_count++].device = optarg;
+			break;
+		case 'j':
+			ret = sscanf(optarg,"%u", &concurrency);
+			if (ret != 1) {
+				usage(argv[0]);
+				exit(1);
+			}
+			break;
 		case 'r':
 			reconnect = true;
 			break;
@@ -340,12 +454,34 @@ int main(int argc, char *argv[])
 	}
 #endif /* _WIN32 */
 
+	if (write_bundle) {
+		ret = fw_write_bundle(write_bundle, image, oprom_data, oprom_code);
+		printf("STATUS %s\n", mkhi_status(ret));
+		return ret;
+	}
+
+	if (image && device_count) {
+		ret = fw_update_devices(guid, image, devices, device_count, concurrency);
+		printf("STATUS %s\n", mkhi_status(ret));
+		return ret;
+	}
+
+	if (bundle) {
+		ret = fw_update_bundle(guid, bundle, verbose);
+		printf("STATUS %s\n", mkhi_status(ret));
+		return ret;
+	}
 
 	if (!mk_host_if_init(&acmd, guid, reconnect, verbose)) {
 		ret = 1;
 		goto out;
 	}
 
+	if (image) {
+		ret = mk_host_if_fw_update(&acmd, image);
+		goto out;
+	}
+
 	if (sequence) {
 		for (i = 0; i < strlen(sequence); i++) {
 			if (sequence[i] == 's')
@@ -0,0 +1,252 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2023 Intel Corporation
+ */
+/*
+ * Serve library statistics in OpenMetrics text format on a Unix socket.
+ * Every connection gets a minimal HTTP/1.0 response and is closed:
+ *   curl --unix-socket /run/metee-metrics.sock http://localhost/metrics
+ * With -u the daemon connects to the client periodically, so
+ * the connect latency and availability of the client are exported.
+ */
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#include <metee.h>
+#include "meiuuid.h"
+
+#define DEFAULT_SOCKET "/run/metee-metrics.sock"
+#define DEFAULT_INTERVAL 10
+#define INITIAL_BUF_SIZE (64 * 1024)
+#define MAX_BUF_SIZE (16 * 1024 * 1024)
+
+struct params {
+	const char *socket;
+	const char *device;
+	uuid_le uuid;
+	bool check;
+	unsigned int interval;
+};
+
+static volatile sig_atomic_t stop;
+
+static void on_signal(int sig)
+{
+	(void)sig;
+	stop = 1;
+}
+
+static uint64_t now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void check_client(struct params *p)
+{
+	TEEHANDLE cl = TEEHANDLE_ZERO;
+
+	if (TeeInit(&cl, &p->uuid, p->device) != TEE_SUCCESS)
+		return;
+	TeeConnect(&cl);
+	TeeDisconnect(&cl);
+}
+
+static int write_all(int fd, const char *data, size_t len)
+{
+	ssize_t rc;
+
+	while (len) {
+		rc = write(fd, data, len);
+		if (rc < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		data += rc;
+		len -= rc;
+	}
+	return 0;
+}
+
+static void serve(int fd, char **buf, size_t *buf_size)
+{
+	char header[128];
+	char req[512];
+	size_t req_len = 0;
+	size_t len = 0;
+	struct timeval timeout = { 1, 0 };
+	ssize_t rc;
+	TEESTATUS status;
+	char *nbuf;
+
+	/* the request is not interpreted, every path returns the metrics */
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	while (req_len < sizeof(req) - 1) {
+		rc = recv(fd, req + req_len, sizeof(req) - 1 - req_len, 0);
+		if (rc <= 0)
+			break;
+		req_len += rc;
+		req[req_len] = '\0';
+		if (strstr(req, "\r\n\r\n"))
+			break;
+	}
+
+	while ((status = TeeStatsFormatOpenMetrics(*buf, *buf_size, &len)) ==
+	       TEE_INSUFFICIENT_BUFFER && *buf_size < MAX_BUF_SIZE) {
+		nbuf = realloc(*buf, *buf_size * 2);
+		if (!nbuf)
+			break;
+		*buf = nbuf;
+		*buf_size *= 2;
+	}
+	if (status != TEE_SUCCESS) {
+		fprintf(stderr, "metrics formatting failed: %u\n", status);
+		return;
+	}
+
+	snprintf(header, sizeof(header),
+		 "HTTP/1.0 200 OK\r\n"
+		 "Content-Type: application/openmetrics-text; version=1.0.0; charset=utf-8\r\n"
+		 "Content-Length: %zu\r\n\r\n", len);
+	if (write_all(fd, header, strlen(header)))
+		return;
+	write_all(fd, *buf, len);
+}
+
+static int run(struct params *p)
+{
+	struct sockaddr_un addr;
+	struct pollfd pfd;
+	size_t buf_size = INITIAL_BUF_SIZE;
+	uint64_t next_check = 0;
+	uint64_t now;
+	char *buf;
+	int sock, conn, rc;
+	int timeout;
+
+	if (strlen(p->socket) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "socket path is too long\n");
+		return EXIT_FAILURE;
+	}
+
+	buf = malloc(buf_size);
+	if (!buf)
+		return EXIT_FAILURE;
+
+	sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (sock < 0) {
+		perror("socket");
+		free(buf);
+		return EXIT_FAILURE;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, p->socket, sizeof(addr.sun_path) - 1);
+	unlink(p->socket);
+	if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) || listen(sock, 8)) {
+		perror(p->socket);
+		close(sock);
+		free(buf);
+		return EXIT_FAILURE;
+	}
+
+	pfd.fd = sock;
+	pfd.events = POLLIN;
+	while (!stop) {
+		/* checked on every pass, so a steady scrape load does not starve it */
+		timeout = -1;
+		if (p->check) {
+			now = now_ms();
+			if (now >= next_check) {
+				check_client(p);
+				now = now_ms();
+				next_check = now + (uint64_t)p->interval * 1000;
+			}
+			timeout = (int)(next_check - now);
+		}
+		rc = poll(&pfd, 1, timeout);
+		if (rc < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("poll");
+			break;
+		}
+		if (rc == 0)
+			continue;
+		conn = accept4(sock, NULL, NULL, SOCK_CLOEXEC);
+		if (conn < 0)
+			continue;
+		serve(conn, &buf, &buf_size);
+		close(conn);
+	}
+
+	close(sock);
+	unlink(p->socket);
+	free(buf);
+	return EXIT_SUCCESS;
+}
+
+static void usage(const char *p)
+{
+	fprintf(stdout, "%s: [-s <socket>] [-u <uuid> [-d <device>] [-i <seconds>]] [-h]\n", p);
+}
+
+int main(int argc, char *argv[])
+{
+	struct params p;
+	int opt;
+
+	p.socket = DEFAULT_SOCKET;
+	p.device = NULL;
+	p.uuid = NULL_UUID_LE;
+	p.check = false;
+	p.interval = DEFAULT_INTERVAL;
+
+	while ((opt = getopt(argc, argv, "hs:u:d:i:")) != -1) {
+		switch (opt) {
+		case 's':
+			p.socket = optarg;
+			break;
+		case 'u':
+			if (mei_uuid_parse(optarg, &p.uuid) < 0) {
+				usage(argv[0]);
+				exit(EXIT_FAILURE);
+			}
+			p.check = true;
+			break;
+		case 'd':
+			p.device = optarg;
+			break;
+		case 'i':
+			p.interval = strtoul(optarg, NULL, 10);
+			if (!p.interval)
+				p.interval = DEFAULT_INTERVAL;
+			break;
+		case 'h':
+		case '?':
+		default:
+			usage(argv[0]);
+			exit(opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE);
+		}
+	}
+
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+	signal(SIGPIPE, SIG_IGN);
+
+	exit(run(&p));
+}
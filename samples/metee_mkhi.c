@@ -9,6 +9,7 @@
 #include <errno.h>
 #include <stdint.h>
 #include <metee.h>
+#include <metee_mkhi.h>
 
 #ifndef BIT
 #define BIT(n) 1 << (n)
@@ -315,28 +316,21 @@ static void printf_if_fw_version(struct mei_firmware_version *version)
 static uint32_t mk_host_if_fw_version(struct mk_host_if *cmd,
                                       struct mei_firmware_version *version)
 {
-	struct mkhi_msg_hdr hdr;
-	struct mk_host_if_msg *response = NULL;
-	uint32_t status;
-	size_t size = sizeof(struct mkhi_msg_hdr) + sizeof(struct mei_firmware_version);
-
-	hdr.data = 0; /* Reset */
-	hdr.GroupId = 0xFF; /* MKHI */
-	hdr.Command = 0x02; /* GET FW Version */
-	hdr.IsResponse = 0;
-	hdr.Reserved = 0;
-
-	status = mk_host_if_call(cmd,
-	                         (const unsigned char *)&hdr, sizeof(hdr),
-	                         (uint8_t **)&response,
-	                         0, (unsigned int)size);
+	struct tee_mkhi_fw_version ver;
+	TEESTATUS status;
 
-	if (status != MKHI_STATUS_SUCCESS) {
-		return status;
-	}
-	memcpy(version, response->data, sizeof(struct mei_firmware_version));
+	status = TeeMkhiGetFwVersion(&cmd->mei_cl, &ver, MKHI_READ_TIMEOUT);
+	if (status == TEE_DISCONNECTED && cmd->reconnect && mk_host_if_connect(cmd))
+		status = TeeMkhiGetFwVersion(&cmd->mei_cl, &ver, MKHI_READ_TIMEOUT);
+	if (cmd->verbose)
+		fprintf(stderr, "mkhif: get version status = %d\n", status);
+	if (status == TEE_TIMEOUT)
+		return MKHI_STATUS_HOST_IF_EMPTY_RESPONSE;
+	if (status != TEE_SUCCESS)
+		return MKHI_STATUS_INTERNAL_ERROR;
 
-	return status;
+	memcpy(version, &ver, sizeof(*version));
+	return MKHI_STATUS_SUCCESS;
 }
 
 static uint32_t mk_host_if_fw_version_req(struct mk_host_if *acmd)
@@ -0,0 +1,583 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2023 Intel Corporation
+ */
+/*
+ * Load generator: N threads with M connections each send requests
+ * to a client and wait for the responses.
+ * Closed loop (default): the next request is sent when the response arrives.
+ * Open loop (-r): requests are scheduled at a fixed total rate and the
+ * latency is measured from the scheduled time, so a stalled response
+ * is charged to all requests queued behind it (coordinated omission).
+ * In closed loop the stalls are corrected with the expected interval
+ * (-e, by default the mean latency of the warmup).
+ * The library statistics split the latency into the write and the
+ * wait for the firmware, to tell firmware saturation from host problems.
+ */
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <time.h>
+#include <unistd.h>
+#include <metee.h>
+#include "meiuuid.h"
+
+#define NSEC_IN_SEC 1000000000ULL
+#define NSEC_IN_USEC 1000ULL
+
+/*
+ * Latency histogram: values below 2^HIST_SUB_BITS ns are exact,
+ * above that every power of two is split into 2^HIST_SUB_BITS buckets,
+ * the relative error is below 1/2^HIST_SUB_BITS.
+ */
+#define HIST_SUB_BITS 6
+#define HIST_SUB (1U << HIST_SUB_BITS)
+#define HIST_MAX_BITS 42 /* ~73 minutes */
+#define HIST_BUCKETS ((HIST_MAX_BITS - HIST_SUB_BITS + 1) * HIST_SUB)
+
+struct hist {
+	uint64_t count;
+	uint64_t sum;
+	uint64_t max;
+	uint64_t buckets[HIST_BUCKETS];
+};
+
+struct params {
+	uuid_le uuid;
+	const char *device;
+	unsigned int threads;
+	unsigned int handles;
+	size_t size;
+	const char *file;
+	double rate;
+	unsigned int duration;
+	unsigned int warmup;
+	uint32_t timeout;
+	uint64_t expected_interval;
+};
+
+struct worker {
+	pthread_t thread;
+	const struct params *p;
+	unsigned int id;
+	TEEHANDLE *cl;
+	unsigned char *resp;
+	size_t resp_len;
+	struct hist warm;
+	struct hist hist;
+	uint64_t ops;
+	uint64_t bytes;
+	uint64_t errors;
+	uint64_t late;
+	uint64_t end;
+	TEESTATUS status;
+};
+
+static unsigned char *payload;
+static size_t payload_len;
+static uint64_t start_time;
+static uint64_t measure_time;
+static bool stop;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * NSEC_IN_SEC + ts.tv_nsec;
+}
+
+static void sleep_until(uint64_t t)
+{
+	struct timespec ts;
+
+	ts.tv_sec = t / NSEC_IN_SEC;
+	ts.tv_nsec = t % NSEC_IN_SEC;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+		;
+}
+
+static unsigned int hist_index(uint64_t v)
+{
+	unsigned int msb;
+
+	if (v < HIST_SUB)
+		return (unsigned int)v;
+	msb = 63 - __builtin_clzll(v);
+	if (msb > HIST_MAX_BITS)
+		return HIST_BUCKETS - 1;
+	return (msb - HIST_SUB_BITS + 1) * HIST_SUB +
+	       (unsigned int)((v >> (msb - HIST_SUB_BITS)) & (HIST_SUB - 1));
+}
+
+/* upper bound of the bucket */
+static uint64_t hist_value(unsigned int idx)
+{
+	unsigned int shift;
+
+	if (idx < HIST_SUB)
+		return idx;
+	shift = idx / HIST_SUB - 1;
+	return ((uint64_t)(HIST_SUB + idx % HIST_SUB + 1) << shift) - 1;
+}
+
+static void hist_add_n(struct hist *h, uint64_t v, uint64_t n)
+{
+	h->buckets[hist_index(v)] += n;
+	h->count += n;
+	h->sum += v * n;
+	if (v > h->max)
+		h->max = v;
+}
+
+static void hist_add(struct hist *h, uint64_t v)
+{
+	hist_add_n(h, v, 1);
+}
+
+/*
+ * Closed loop correction: a request that took longer than the expected
+ * interval delayed the requests that would have been sent meanwhile,
+ * add the samples they would have seen.
+ */
+static void hist_correct(struct hist *dst, const struct hist *src, uint64_t interval)
+{
+	uint64_t v, missed;
+	unsigned int i;
+
+	for (i = 0; i < HIST_BUCKETS; i++) {
+		if (!src->buckets[i])
+			continue;
+		v = hist_value(i) < src->max ? hist_value(i) : src->max;
+		hist_add_n(dst, v, src->buckets[i]);
+		for (missed = v - interval; interval && missed >= interval && missed < v;
+		     missed -= interval)
+			hist_add_n(dst, missed, src->buckets[i]);
+	}
+	if (src->max > dst->max)
+		dst->max = src->max;
+}
+
+static void hist_merge(struct hist *dst, const struct hist *src)
+{
+	unsigned int i;
+
+	for (i = 0; i < HIST_BUCKETS; i++)
+		dst->buckets[i] += src->buckets[i];
+	dst->count += src->count;
+	dst->sum += src->sum;
+	if (src->max > dst->max)
+		dst->max = src->max;
+}
+
+static uint64_t hist_percentile(const struct hist *h, double pct)
+{
+	uint64_t rank, seen = 0;
+	unsigned int i;
+
+	if (!h->count)
+		return 0;
+	rank = (uint64_t)(pct / 100.0 * h->count + 0.5);
+	if (rank < 1)
+		rank = 1;
+	for (i = 0; i < HIST_BUCKETS; i++) {
+		seen += h->buckets[i];
+		if (seen >= rank)
+			return hist_value(i) < h->max ? hist_value(i) : h->max;
+	}
+	return h->max;
+}
+
+static TEESTATUS transact(struct worker *w, TEEHANDLE *cl)
+{
+	TEESTATUS status;
+	size_t written = 0, read = 0;
+
+	status = TeeWrite(cl, payload, payload_len, &written, w->p->timeout);
+	if (status != TEE_SUCCESS)
+		return status;
+	status = TeeRead(cl, w->resp, w->resp_len, &read, w->p->timeout);
+	if (status != TEE_SUCCESS)
+		return status;
+	w->bytes += written + read;
+	return TEE_SUCCESS;
+}
+
+static void *worker_run(void *arg)
+{
+	struct worker *w = arg;
+	const struct params *p = w->p;
+	uint64_t interval = 0;
+	uint64_t next, begin, end, lat;
+	bool measuring = false;
+	unsigned int h = 0;
+	uint64_t i = 0;
+
+	if (p->rate > 0) {
+		/* default 50us slack of the sleep would be charged to the latency */
+		prctl(PR_SET_TIMERSLACK, 1UL);
+		interval = (uint64_t)(NSEC_IN_SEC * p->threads / p->rate);
+		/* spread the threads over the interval */
+		next = start_time + interval * w->id / p->threads;
+	} else {
+		next = start_time;
+	}
+	sleep_until(next);
+
+	while (!__atomic_load_n(&stop, __ATOMIC_RELAXED)) {
+		if (interval) {
+			next = start_time + interval * w->id / p->threads + interval * i++;
+			begin = now_ns();
+			if (begin < next)
+				sleep_until(next);
+			else if (begin - next > interval)
+				w->late++;
+			begin = next;
+		} else {
+			begin = now_ns();
+		}
+
+		/* reset before the transaction, its bytes belong to the measurement */
+		if (!measuring && begin >= measure_time) {
+			measuring = true;
+			w->ops = 0;
+			w->bytes = 0;
+			w->errors = 0;
+			w->late = 0;
+		}
+
+		if (transact(w, &w->cl[h]) != TEE_SUCCESS) {
+			w->errors++;
+			/* a broken connection is reopened */
+			TeeDisconnect(&w->cl[h]);
+			if (TeeInit(&w->cl[h], &p->uuid, p->device) == TEE_SUCCESS)
+				TeeConnect(&w->cl[h]);
+		}
+		end = now_ns();
+		lat = end - begin;
+		h = (h + 1) % p->handles;
+
+		if (measuring) {
+			hist_add(&w->hist, lat);
+			w->ops++;
+			w->end = end;
+		} else {
+			hist_add(&w->warm, lat);
+		}
+	}
+	return NULL;
+}
+
+static TEESTATUS echo_responder(void *ctx, const GUID *guid,
+				const void *request, size_t request_size,
+				void *response, size_t *response_size)
+{
+	(void)ctx;
+	(void)guid;
+
+	if (request_size > *response_size)
+		return TEE_INSUFFICIENT_BUFFER;
+	memcpy(response, request, request_size);
+	*response_size = request_size;
+	return TEE_SUCCESS;
+}
+
+static int load_payload(const struct params *p)
+{
+	/* MKHI GetFWVersion header, the rest of the payload is a pattern */
+	static const unsigned char mkhi_get_version[] = { 0xFF, 0x02, 0x00, 0x00 };
+	FILE *fp;
+	long len;
+	size_t i;
+
+	if (!p->file) {
+		payload_len = p->size;
+		payload = malloc(payload_len);
+		if (!payload)
+			return -1;
+		for (i = 0; i < payload_len; i++)
+			payload[i] = (i < sizeof(mkhi_get_version)) ?
+				     mkhi_get_version[i] : (unsigned char)i;
+		return 0;
+	}
+
+	fp = fopen(p->file, "rb");
+	if (!fp) {
+		perror(p->file);
+		return -1;
+	}
+	if (fseek(fp, 0, SEEK_END) || (len = ftell(fp)) <= 0 || fseek(fp, 0, SEEK_SET)) {
+		fprintf(stderr, "%s: empty or unreadable\n", p->file);
+		fclose(fp);
+		return -1;
+	}
+	payload_len = len;
+	payload = malloc(payload_len);
+	if (!payload || fread(payload, 1, payload_len, fp) != payload_len) {
+		fprintf(stderr, "%s: read failed\n", p->file);
+		fclose(fp);
+		return -1;
+	}
+	fclose(fp);
+	return 0;
+}
+
+static int open_handles(struct worker *w)
+{
+	const struct params *p = w->p;
+	unsigned int i;
+	TEESTATUS status;
+
+	w->cl = calloc(p->handles, sizeof(*w->cl));
+	if (!w->cl)
+		return -1;
+	for (i = 0; i < p->handles; i++) {
+		status = TeeInit(&w->cl[i], &p->uuid, p->device);
+		if (status == TEE_SUCCESS)
+			status = TeeConnect(&w->cl[i]);
+		if (status != TEE_SUCCESS) {
+			fprintf(stderr, "thread %u handle %u: connect failed %u\n",
+				w->id, i, status);
+			return -1;
+		}
+		if (payload_len > w->cl[i].maxMsgLen) {
+			fprintf(stderr, "payload %zu is bigger than the client MTU %u\n",
+				payload_len, w->cl[i].maxMsgLen);
+			return -1;
+		}
+		if (w->cl[i].maxMsgLen > w->resp_len)
+			w->resp_len = w->cl[i].maxMsgLen;
+	}
+	w->resp = malloc(w->resp_len);
+	return w->resp ? 0 : -1;
+}
+
+static void close_handles(struct worker *w)
+{
+	unsigned int i;
+
+	if (w->cl) {
+		for (i = 0; i < w->p->handles; i++)
+			TeeDisconnect(&w->cl[i]);
+	}
+	free(w->cl);
+	free(w->resp);
+}
+
+static double hist_mean_us(const struct tee_stats_histogram *h)
+{
+	return h->count ? (double)h->sum_ns / h->count / NSEC_IN_USEC : 0.0;
+}
+
+static void report(const struct params *p, struct worker *w)
+{
+	struct hist *total;
+	struct tee_stats stats;
+	uint64_t ops = 0, bytes = 0, errors = 0, late = 0, end = 0;
+	double secs;
+	unsigned int i;
+
+	total = calloc(1, sizeof(*total));
+	if (!total)
+		return;
+	for (i = 0; i < p->threads; i++) {
+		if (p->rate <= 0 && p->expected_interval)
+			hist_correct(total, &w[i].hist, p->expected_interval);
+		else
+			hist_merge(total, &w[i].hist);
+		ops += w[i].ops;
+		bytes += w[i].bytes;
+		errors += w[i].errors;
+		late += w[i].late;
+		if (w[i].end > end)
+			end = w[i].end;
+	}
+	/* the last transactions complete after the duration */
+	secs = (end > measure_time) ? (double)(end - measure_time) / NSEC_IN_SEC :
+				      p->duration;
+
+	printf("mode:       %s", p->rate > 0 ? "open loop" : "closed loop");
+	if (p->rate > 0)
+		printf(", target %.0f ops/s", p->rate);
+	else if (p->expected_interval)
+		printf(", expected interval %.1f us",
+		       (double)p->expected_interval / NSEC_IN_USEC);
+	printf("\nthreads:    %u x %u handles, payload %zu bytes\n",
+	       p->threads, p->handles, payload_len);
+	printf("operations: %llu (%.1f ops/s), errors %llu\n",
+	       (unsigned long long)ops, ops / secs, (unsigned long long)errors);
+	printf("throughput: %.1f bytes/s\n", bytes / secs);
+	if (p->rate > 0)
+		printf("late:       %llu requests sent more than one interval late\n",
+		       (unsigned long long)late);
+	printf("latency us: mean %.1f p50 %.1f p90 %.1f p99 %.1f p99.9 %.1f max %.1f\n",
+	       total->count ? (double)total->sum / total->count / NSEC_IN_USEC : 0.0,
+	       (double)hist_percentile(total, 50.0) / NSEC_IN_USEC,
+	       (double)hist_percentile(total, 90.0) / NSEC_IN_USEC,
+	       (double)hist_percentile(total, 99.0) / NSEC_IN_USEC,
+	       (double)hist_percentile(total, 99.9) / NSEC_IN_USEC,
+	       (double)total->max / NSEC_IN_USEC);
+
+	/* includes the warmup, all handles share the client entry */
+	if (TeeGetStats(&w[0].cl[0], NULL, &stats) == TEE_SUCCESS)
+		printf("library us: write mean %.1f, read wait mean %.1f, poll wait mean %.1f\n",
+		       hist_mean_us(&stats.hist[TEE_STATS_HIST_WRITE]),
+		       hist_mean_us(&stats.hist[TEE_STATS_HIST_READ_WAIT]),
+		       hist_mean_us(&stats.hist[TEE_STATS_HIST_POLL_WAIT]));
+	free(total);
+}
+
+static int run(struct params *p)
+{
+	struct worker *w;
+	struct hist *warm;
+	unsigned int i, started = 0;
+	int rc = EXIT_FAILURE;
+
+	if (load_payload(p))
+		return EXIT_FAILURE;
+
+	w = calloc(p->threads, sizeof(*w));
+	warm = calloc(1, sizeof(*warm));
+	if (!w || !warm)
+		goto out;
+
+	for (i = 0; i < p->threads; i++) {
+		w[i].p = p;
+		w[i].id = i;
+		if (open_handles(&w[i]))
+			goto close;
+	}
+
+	start_time = now_ns() + NSEC_IN_SEC / 100;
+	measure_time = start_time + (uint64_t)p->warmup * NSEC_IN_SEC;
+	for (i = 0; i < p->threads; i++) {
+		if (pthread_create(&w[i].thread, NULL, worker_run, &w[i]))
+			break;
+		started++;
+	}
+	if (started == p->threads) {
+		sleep_until(measure_time);
+		sleep_until(measure_time + (uint64_t)p->duration * NSEC_IN_SEC);
+	}
+	__atomic_store_n(&stop, true, __ATOMIC_RELAXED);
+	for (i = 0; i < started; i++)
+		pthread_join(w[i].thread, NULL);
+	if (started != p->threads) {
+		fprintf(stderr, "cannot start the threads\n");
+		goto close;
+	}
+
+	/* open loop latency already includes the queueing */
+	if (p->rate <= 0) {
+		for (i = 0; i < p->threads; i++)
+			hist_merge(warm, &w[i].warm);
+		if (!p->expected_interval && warm->count)
+			p->expected_interval = warm->sum / warm->count;
+	}
+
+	report(p, w);
+	rc = EXIT_SUCCESS;
+close:
+	for (i = 0; i < p->threads; i++)
+		close_handles(&w[i]);
+out:
+	free(warm);
+	free(w);
+	free(payload);
+	return rc;
+}
+
+static void usage(const char *p)
+{
+	fprintf(stdout,
+		"%s: [-u <uuid>] [-d <device>] [-t <threads>] [-n <handles per thread>]\n"
+		"\t[-s <payload size> | -f <payload file>] [-r <ops/s>] [-e <expected interval us>]\n"
+		"\t[-D <duration s>] [-w <warmup s>] [-T <timeout ms>] [-h]\n"
+		"    default client is MKHI, with -d %s an echo client is emulated\n",
+		p, TEE_LOOPBACK_DEVICE);
+}
+
+int main(int argc, char *argv[])
+{
+	struct params p;
+	bool loopback;
+	int opt, rc;
+
+	memset(&p, 0, sizeof(p));
+	mei_uuid_parse("8e6a6715-9abc-4043-88ef-9e39c6f63e0f", &p.uuid);
+	p.threads = 1;
+	p.handles = 1;
+	p.size = 4;
+	p.duration = 10;
+	p.warmup = 1;
+
+	while ((opt = getopt(argc, argv, "hu:d:t:n:s:f:r:e:D:w:T:")) != -1) {
+		switch (opt) {
+		case 'u':
+			if (mei_uuid_parse(optarg, &p.uuid) < 0) {
+				usage(argv[0]);
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'd':
+			p.device = optarg;
+			break;
+		case 't':
+			p.threads = strtoul(optarg, NULL, 10);
+			break;
+		case 'n':
+			p.handles = strtoul(optarg, NULL, 10);
+			break;
+		case 's':
+			p.size = strtoul(optarg, NULL, 10);
+			break;
+		case 'f':
+			p.file = optarg;
+			break;
+		case 'r':
+			p.rate = strtod(optarg, NULL);
+			break;
+		case 'e':
+			p.expected_interval = strtoull(optarg, NULL, 10) * NSEC_IN_USEC;
+			break;
+		case 'D':
+			p.duration = strtoul(optarg, NULL, 10);
+			break;
+		case 'w':
+			p.warmup = strtoul(optarg, NULL, 10);
+			break;
+		case 'T':
+			p.timeout = strtoul(optarg, NULL, 10);
+			break;
+		case 'h':
+		case '?':
+		default:
+			usage(argv[0]);
+			exit(opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE);
+		}
+	}
+	if (!p.threads || !p.handles || !p.size || !p.duration) {
+		usage(argv[0]);
+		exit(EXIT_FAILURE);
+	}
+
+	loopback = p.device && !strncmp(p.device, TEE_LOOPBACK_DEVICE,
+					strlen(TEE_LOOPBACK_DEVICE));
+	if (loopback &&
+	    TeeLoopbackRegister(&p.uuid, 4096, 1, echo_responder, NULL) != TEE_SUCCESS) {
+		fprintf(stderr, "cannot register the loopback client\n");
+		exit(EXIT_FAILURE);
+	}
+
+	rc = run(&p);
+
+	if (loopback)
+		TeeLoopbackUnregister(&p.uuid);
+	exit(rc);
+}
@@ -0,0 +1,644 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2023 Intel Corporation
+ */
+/*
+ * Replay HECI sessions recorded by TeeCaptureStart() through the metee API.
+ * Every recorded session is replayed in its own thread, so the sessions
+ * interleave as recorded. A session starts at a connect record of its
+ * handle, a handle reused by a later TeeInit/TeeConnect starts a new one. Writes are sent at the recorded
+ * time (scaled by the speed factor) counted from one common start, so a
+ * slow read delays only the next write of its own session; in fast mode
+ * every session runs back to back. The latency from a write to the
+ * following read is reported per client GUID and per command header
+ * (first 4 bytes of the request).
+ * With the loopback device every recorded client is an echo responder,
+ * which measures the host side of the replay alone.
+ */
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <metee.h>
+
+#define PCAPNG_SHB 0x0A0D0D0AU
+#define PCAPNG_IDB 0x00000001U
+#define PCAPNG_EPB 0x00000006U
+#define PCAPNG_BYTE_ORDER_MAGIC 0x1A2B3C4DU
+#define PCAPNG_OPT_IF_TSRESOL 9
+
+#define READ_TIMEOUT_MS 10000
+/* above the MTU of every HECI client, longer records are malformed */
+#define MAX_PAYLOAD_LEN (64 * 1024)
+#define MAX_BLOCK_LEN (MAX_PAYLOAD_LEN + 256)
+#define NSEC_IN_SEC 1000000000ULL
+
+struct record {
+	uint64_t ns;            /**< capture time */
+	size_t index;           /**< position in the capture */
+	struct tee_capture_hdr hdr; /**< record header */
+	uint32_t caplen;        /**< captured payload length */
+	uint8_t *data;          /**< payload */
+};
+
+struct session {
+	uint64_t handle;        /**< recorded handle */
+	TEEHANDLE cl;           /**< replay handle */
+	bool connected;         /**< session is connected */
+	uint8_t *buf;           /**< read buffer */
+	struct record **recs;   /**< records of the session in time order */
+	size_t nrecs, recs_cap; /**< number and capacity of records */
+	uint64_t transactions;  /**< completed transactions */
+	pthread_t thread;       /**< replay thread */
+	bool started;           /**< thread is running */
+};
+
+struct series {
+	uint8_t guid[16];       /**< client GUID */
+	uint32_t cmd;           /**< command header */
+	uint64_t *lat;          /**< latencies in ns */
+	size_t n, cap;          /**< number and capacity of latencies */
+	uint64_t errors;        /**< failed transactions */
+};
+
+struct params {
+	const char *file;
+	const char *device;
+	bool fast;
+	double speed;
+	bool loopback;
+};
+
+static struct record *records;
+static size_t nrecords, records_cap;
+static struct session *sessions;
+static size_t nsessions;
+static struct series *series;
+static size_t nseries;
+static pthread_mutex_t series_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct params *params;
+static uint64_t replay_start, replay_first;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * NSEC_IN_SEC + ts.tv_nsec;
+}
+
+static void sleep_until(uint64_t deadline)
+{
+	struct timespec ts;
+	uint64_t now = now_ns();
+
+	if (deadline <= now)
+		return;
+	ts.tv_sec = (deadline - now) / NSEC_IN_SEC;
+	ts.tv_nsec = (deadline - now) % NSEC_IN_SEC;
+	nanosleep(&ts, NULL);
+}
+
+static int add_record(uint64_t ns, const uint8_t *pkt, uint32_t caplen)
+{
+	struct record *r;
+
+	if (caplen < sizeof(struct tee_capture_hdr))
+		return 0;
+	if (caplen - sizeof(struct tee_capture_hdr) > MAX_PAYLOAD_LEN)
+		return -EINVAL;
+
+	if (nrecords == records_cap) {
+		records_cap = records_cap ? records_cap * 2 : 1024;
+		r = realloc(records, records_cap * sizeof(*records));
+		if (!r)
+			return -ENOMEM;
+		records = r;
+	}
+	r = &records[nrecords];
+	memcpy(&r->hdr, pkt, sizeof(r->hdr));
+	if (r->hdr.version != TEE_CAPTURE_VERSION)
+		return 0;
+	r->ns = ns;
+	r->index = nrecords;
+	r->caplen = caplen - sizeof(r->hdr);
+	if (r->caplen < r->hdr.length)
+		fprintf(stderr, "warning: payload of %u bytes was truncated to %u\n",
+			r->hdr.length, r->caplen);
+	r->data = malloc(r->caplen ? r->caplen : 1);
+	if (!r->data)
+		return -ENOMEM;
+	memcpy(r->data, pkt + sizeof(r->hdr), r->caplen);
+	nrecords++;
+	return 0;
+}
+
+/* timestamp units per second from if_tsresol option */
+static uint64_t idb_resolution(const uint8_t *body, uint32_t len)
+{
+	uint32_t off = 8;
+	uint16_t code, olen;
+	uint64_t res = 1000000;
+	uint8_t v;
+
+	while (off + 4 <= len) {
+		memcpy(&code, body + off, 2);
+		memcpy(&olen, body + off + 2, 2);
+		if (code == 0)
+			break;
+		if (code == PCAPNG_OPT_IF_TSRESOL && olen == 1 && off + 5 <= len) {
+			v = body[off + 4];
+			res = 1;
+			if (v & 0x80)
+				res <<= (v & 0x7F);
+			else
+				while (v--)
+					res *= 10;
+		}
+		off += 4 + ((olen + 3) & ~3U);
+	}
+	return res;
+}
+
+static int load_capture(const char *file)
+{
+	uint32_t hdr[2], magic, caplen, tsh, tsl;
+	uint16_t linktype = 0;
+	uint64_t res = 1000000, ts;
+	uint8_t *body = NULL;
+	size_t body_len;
+	FILE *fp;
+	int rc = -EINVAL;
+
+	fp = fopen(file, "rb");
+	if (!fp)
+		return -errno;
+
+	while (fread(hdr, sizeof(hdr), 1, fp) == 1) {
+		if (hdr[1] < 12 || hdr[1] % 4 || hdr[1] > MAX_BLOCK_LEN)
+			goto out;
+		body_len = hdr[1] - 8;
+		free(body);
+		body = malloc(body_len);
+		if (!body) {
+			rc = -ENOMEM;
+			goto out;
+		}
+		if (fread(body, body_len, 1, fp) != 1)
+			goto out;
+		body_len -= 4; /* trailing block length */
+
+		switch (hdr[0]) {
+		case PCAPNG_SHB:
+			memcpy(&magic, body, 4);
+			if (magic != PCAPNG_BYTE_ORDER_MAGIC) {
+				fprintf(stderr, "%s: foreign byte order is not supported\n", file);
+				goto out;
+			}
+			break;
+		case PCAPNG_IDB:
+			memcpy(&linktype, body, 2);
+			res = idb_resolution(body, body_len);
+			break;
+		case PCAPNG_EPB:
+			if (linktype != TEE_CAPTURE_LINKTYPE || body_len < 20)
+				break;
+			memcpy(&tsh, body + 4, 4);
+			memcpy(&tsl, body + 8, 4);
+			memcpy(&caplen, body + 12, 4);
+			if (caplen > body_len - 20)
+				goto out;
+			ts = ((uint64_t)tsh << 32) | tsl;
+			ts = (res == NSEC_IN_SEC) ? ts : ts * (NSEC_IN_SEC / res);
+			rc = add_record(ts, body + 20, caplen);
+			if (rc)
+				goto out;
+			break;
+		default:
+			break;
+		}
+	}
+	rc = 0;
+out:
+	free(body);
+	fclose(fp);
+	return rc;
+}
+
+static int record_cmp(const void *a, const void *b)
+{
+	const struct record *ra = a, *rb = b;
+
+	if (ra->ns != rb->ns)
+		return (ra->ns > rb->ns) - (ra->ns < rb->ns);
+	return (ra->index > rb->index) - (ra->index < rb->index);
+}
+
+/* first 4 bytes of the request in wire order */
+static uint32_t command_header(const struct record *r)
+{
+	uint32_t cmd = 0;
+	uint32_t i;
+
+	for (i = 0; i < 4; i++)
+		cmd = (cmd << 8) | (i < r->caplen ? r->data[i] : 0);
+	return cmd;
+}
+
+/* the latest session of the handle, a connect record opens a new one */
+static struct session *get_session(const struct record *r)
+{
+	struct session *s;
+	size_t i;
+
+	if (r->hdr.direction != TEE_CAPTURE_DIR_CONNECT)
+		for (i = nsessions; i > 0; i--)
+			if (sessions[i - 1].handle == r->hdr.handle)
+				return &sessions[i - 1];
+
+	s = realloc(sessions, (nsessions + 1) * sizeof(*sessions));
+	if (!s)
+		return NULL;
+	sessions = s;
+	s = &sessions[nsessions++];
+	memset(s, 0, sizeof(*s));
+	s->handle = r->hdr.handle;
+	return s;
+}
+
+static int add_to_session(struct record *r)
+{
+	struct session *s = get_session(r);
+	struct record **recs;
+
+	if (!s)
+		return -ENOMEM;
+	if (s->nrecs == s->recs_cap) {
+		s->recs_cap = s->recs_cap ? s->recs_cap * 2 : 64;
+		recs = realloc(s->recs, s->recs_cap * sizeof(*recs));
+		if (!recs)
+			return -ENOMEM;
+		s->recs = recs;
+	}
+	s->recs[s->nrecs++] = r;
+	return 0;
+}
+
+static TEESTATUS echo_responder(void *ctx, const GUID *guid,
+				const void *request, size_t request_size,
+				void *response, size_t *response_size)
+{
+	(void)ctx;
+	(void)guid;
+
+	if (request_size > *response_size)
+		return TEE_INSUFFICIENT_BUFFER;
+	memcpy(response, request, request_size);
+	*response_size = request_size;
+	return TEE_SUCCESS;
+}
+
+/* a registration replaces the client, so every GUID is registered once */
+static bool first_of_guid(const struct session *s)
+{
+	const struct session *o;
+
+	for (o = sessions; o < s; o++)
+		if (!memcmp(o->recs[0]->hdr.guid, s->recs[0]->hdr.guid, 16))
+			return false;
+	return true;
+}
+
+static void open_session(struct params *p, struct session *s)
+{
+	GUID guid;
+
+	memcpy(&guid, s->recs[0]->hdr.guid, sizeof(guid));
+	if (p->loopback && first_of_guid(s) &&
+	    TeeLoopbackRegister(&guid, MAX_PAYLOAD_LEN, 1, echo_responder, NULL) != TEE_SUCCESS)
+		return;
+	if (TeeInit(&s->cl, &guid, p->device) != TEE_SUCCESS)
+		return;
+	if (TeeConnect(&s->cl) != TEE_SUCCESS) {
+		TeeDisconnect(&s->cl);
+		return;
+	}
+	s->buf = malloc(s->cl.maxMsgLen);
+	if (!s->buf) {
+		TeeDisconnect(&s->cl);
+		return;
+	}
+	s->connected = true;
+}
+
+static struct series *get_series(const uint8_t *guid, uint32_t cmd)
+{
+	struct series *s;
+	size_t i;
+
+	for (i = 0; i < nseries; i++)
+		if (series[i].cmd == cmd && !memcmp(series[i].guid, guid, 16))
+			return &series[i];
+
+	s = realloc(series, (nseries + 1) * sizeof(*series));
+	if (!s)
+		return NULL;
+	series = s;
+	s = &series[nseries++];
+	memset(s, 0, sizeof(*s));
+	memcpy(s->guid, guid, 16);
+	s->cmd = cmd;
+	return s;
+}
+
+static void add_sample(const uint8_t *guid, uint32_t cmd, uint64_t lat, bool ok)
+{
+	struct series *s;
+	uint64_t *l;
+
+	pthread_mutex_lock(&series_lock);
+	s = get_series(guid, cmd);
+	if (!s)
+		goto out;
+	if (!ok) {
+		s->errors++;
+		goto out;
+	}
+	if (s->n == s->cap) {
+		s->cap = s->cap ? s->cap * 2 : 64;
+		l = realloc(s->lat, s->cap * sizeof(*l));
+		if (!l)
+			goto out;
+		s->lat = l;
+	}
+	s->lat[s->n++] = lat;
+out:
+	pthread_mutex_unlock(&series_lock);
+}
+
+static void *replay_session(void *arg)
+{
+	struct session *s = arg;
+	struct record *r;
+	bool pending = false;
+	uint64_t write_ns = 0;
+	uint32_t cmd = 0;
+	size_t i, n;
+	TEESTATUS status;
+
+	for (i = 0; i < s->nrecs; i++) {
+		r = s->recs[i];
+		if (r->hdr.direction == TEE_CAPTURE_DIR_CONNECT)
+			continue;
+		if (r->hdr.direction == TEE_CAPTURE_DIR_WRITE) {
+			if (pending)
+				add_sample(r->hdr.guid, cmd, 0, false);
+			cmd = command_header(r);
+			/* absolute deadline, a late read does not shift the later writes */
+			if (!params->fast)
+				sleep_until(replay_start +
+					    (uint64_t)((r->ns - replay_first) / params->speed));
+			if (!s->connected || r->caplen > s->cl.maxMsgLen) {
+				pending = false;
+				add_sample(r->hdr.guid, cmd, 0, false);
+				continue;
+			}
+			write_ns = now_ns();
+			status = TeeWrite(&s->cl, r->data, r->caplen, NULL, 0);
+			pending = (status == TEE_SUCCESS);
+			if (!pending)
+				add_sample(r->hdr.guid, cmd, 0, false);
+		} else {
+			if (!pending)
+				continue;
+			pending = false;
+			status = TeeRead(&s->cl, s->buf, s->cl.maxMsgLen, &n, READ_TIMEOUT_MS);
+			add_sample(r->hdr.guid, cmd, now_ns() - write_ns,
+				   status == TEE_SUCCESS);
+			if (status == TEE_SUCCESS)
+				s->transactions++;
+		}
+	}
+	return NULL;
+}
+
+static int replay(struct params *p, uint64_t *elapsed, uint64_t *transactions)
+{
+	size_t i;
+	int rc;
+
+	for (i = 0; i < nrecords; i++) {
+		rc = add_to_session(&records[i]);
+		if (rc)
+			return rc;
+	}
+	/* connect up front, so the connect time does not delay the first writes */
+	for (i = 0; i < nsessions; i++)
+		open_session(p, &sessions[i]);
+
+	params = p;
+	replay_first = records[0].ns;
+	replay_start = now_ns();
+	for (i = 0; i < nsessions; i++) {
+		rc = pthread_create(&sessions[i].thread, NULL, replay_session, &sessions[i]);
+		if (rc) {
+			fprintf(stderr, "cannot start the session thread: %s\n", strerror(rc));
+			break;
+		}
+		sessions[i].started = true;
+	}
+
+	*transactions = 0;
+	for (i = 0; i < nsessions; i++) {
+		if (!sessions[i].started)
+			continue;
+		pthread_join(sessions[i].thread, NULL);
+		*transactions += sessions[i].transactions;
+	}
+	*elapsed = now_ns() - replay_start;
+	return 0;
+}
+
+static int u64_cmp(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+/* nearest-rank percentile of sorted samples */
+static double pct_us(const uint64_t *lat, size_t n, unsigned int pct)
+{
+	size_t rank = (n * pct + 99) / 100;
+
+	if (!n)
+		return 0;
+	return lat[rank ? rank - 1 : 0] / 1000.0;
+}
+
+static void print_row(const uint8_t *g, const char *cmd, const uint64_t *lat,
+		      size_t n, uint64_t errors)
+{
+	printf("%02x%02x%02x%02x-%02x%02x-%02x%02x-%02x%02x-%02x%02x%02x%02x%02x%02x "
+	       "%-8s %8zu %6" PRIu64 " %10.1f %10.1f %10.1f %10.1f\n",
+	       g[3], g[2], g[1], g[0], g[5], g[4], g[7], g[6],
+	       g[8], g[9], g[10], g[11], g[12], g[13], g[14], g[15],
+	       cmd, n, errors,
+	       pct_us(lat, n, 50), pct_us(lat, n, 90),
+	       pct_us(lat, n, 99), pct_us(lat, n, 100));
+}
+
+static void report(uint64_t elapsed, uint64_t transactions)
+{
+	struct series *s;
+	uint64_t *all = NULL, *l;
+	uint64_t errors;
+	size_t i, j, n;
+	bool seen;
+	char cmd[9];
+
+	printf("transactions: %" PRIu64 " in %.3f s, %.1f per second\n",
+	       transactions, elapsed / 1e9,
+	       elapsed ? transactions * 1e9 / elapsed : 0.0);
+	printf("%-36s %-8s %8s %6s %10s %10s %10s %10s\n",
+	       "guid", "command", "count", "errors",
+	       "p50 us", "p90 us", "p99 us", "max us");
+
+	for (i = 0; i < nseries; i++) {
+		s = &series[i];
+		qsort(s->lat, s->n, sizeof(*s->lat), u64_cmp);
+		snprintf(cmd, sizeof(cmd), "%08x", s->cmd);
+		print_row(s->guid, cmd, s->lat, s->n, s->errors);
+	}
+
+	/* summary per GUID over all commands */
+	for (i = 0; i < nseries; i++) {
+		seen = false;
+		for (j = 0; j < i && !seen; j++)
+			seen = !memcmp(series[j].guid, series[i].guid, 16);
+		if (seen)
+			continue;
+
+		n = 0;
+		errors = 0;
+		for (j = i; j < nseries; j++) {
+			s = &series[j];
+			if (memcmp(s->guid, series[i].guid, 16))
+				continue;
+			l = realloc(all, (n + s->n + 1) * sizeof(*all));
+			if (!l)
+				break;
+			all = l;
+			memcpy(all + n, s->lat, s->n * sizeof(*all));
+			n += s->n;
+			errors += s->errors;
+		}
+		qsort(all, n, sizeof(*all), u64_cmp);
+		print_row(series[i].guid, "all", all, n, errors);
+	}
+	free(all);
+}
+
+static void cleanup(void)
+{
+	size_t i;
+
+	for (i = 0; i < nsessions; i++) {
+		if (sessions[i].connected)
+			TeeDisconnect(&sessions[i].cl);
+		free(sessions[i].buf);
+		free(sessions[i].recs);
+	}
+	for (i = 0; i < nrecords; i++)
+		free(records[i].data);
+	for (i = 0; i < nseries; i++)
+		free(series[i].lat);
+	free(sessions);
+	free(records);
+	free(series);
+}
+
+static void usage(const char *p)
+{
+	fprintf(stdout, "%s: [-d <device>] [-m original|fast] [-x <speed>] [-h] <capture.pcapng>\n", p);
+}
+
+int main(int argc, char *argv[])
+{
+	struct params p;
+	uint64_t elapsed, transactions;
+	int opt, rc;
+
+	p.device = NULL;
+	p.fast = false;
+	p.speed = 1.0;
+	p.loopback = false;
+
+	while ((opt = getopt(argc, argv, "hd:m:x:")) != -1) {
+		switch (opt) {
+		case 'd':
+			p.device = optarg;
+			break;
+		case 'm':
+			if (!strcmp(optarg, "fast")) {
+				p.fast = true;
+			} else if (!strcmp(optarg, "original")) {
+				p.fast = false;
+			} else {
+				usage(argv[0]);
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'x':
+			p.speed = strtod(optarg, NULL);
+			if (p.speed <= 0) {
+				usage(argv[0]);
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'h':
+		case '?':
+		default:
+			usage(argv[0]);
+			exit(opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE);
+		}
+	}
+	if (optind != argc - 1) {
+		usage(argv[0]);
+		exit(EXIT_FAILURE);
+	}
+	p.file = argv[optind];
+	p.loopback = p.device && !strncmp(p.device, TEE_LOOPBACK_DEVICE, strlen(TEE_LOOPBACK_DEVICE)) &&
+		     (p.device[strlen(TEE_LOOPBACK_DEVICE)] == '\0' ||
+		      p.device[strlen(TEE_LOOPBACK_DEVICE)] == ':');
+
+	rc = load_capture(p.file);
+	if (rc) {
+		fprintf(stderr, "%s: cannot load capture: %s\n", p.file, strerror(-rc));
+		cleanup();
+		exit(EXIT_FAILURE);
+	}
+	if (!nrecords) {
+		fprintf(stderr, "%s: no HECI records\n", p.file);
+		cleanup();
+		exit(EXIT_FAILURE);
+	}
+	qsort(records, nrecords, sizeof(*records), record_cmp);
+
+	rc = replay(&p, &elapsed, &transactions);
+	if (rc) {
+		fprintf(stderr, "%s: cannot replay: %s\n", p.file, strerror(-rc));
+		cleanup();
+		exit(EXIT_FAILURE);
+	}
+	report(elapsed, transactions);
+	cleanup();
+
+	exit(EXIT_SUCCESS);
+}
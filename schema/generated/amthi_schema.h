@@ -0,0 +1,219 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2023 Intel Corporation
+ */
+/* Generated by heci-schemac from amthi.heci, do not edit */
+#ifndef __AMTHI_SCHEMA_H
+#define __AMTHI_SCHEMA_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifndef HECI_SCHEMA_CONSTEXPR
+#ifdef __cplusplus
+#define HECI_SCHEMA_CONSTEXPR constexpr
+#define HECI_SCHEMA_STATIC_ASSERT(e, m) static_assert(e, m)
+#elif defined(_MSC_VER) && !defined(__clang__) && \
+      (!defined(__STDC_VERSION__) || __STDC_VERSION__ < 201112L)
+/* C of MSVC before /std:c11 has no _Static_assert */
+#define HECI_SCHEMA_CONSTEXPR
+#define HECI_SCHEMA_CAT_(a, b) a##b
+#define HECI_SCHEMA_CAT(a, b) HECI_SCHEMA_CAT_(a, b)
+#define HECI_SCHEMA_STATIC_ASSERT(e, m) \
+	typedef char HECI_SCHEMA_CAT(heci_schema_assert_, __LINE__)[(e) ? 1 : -1]
+#else
+#define HECI_SCHEMA_CONSTEXPR
+#define HECI_SCHEMA_STATIC_ASSERT(e, m) _Static_assert(e, m)
+#endif
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define AMTHI_CODE_VERSIONS 0x1A
+#define AMTHI_CLASS_CFG 0x4
+#define AMTHI_BIOS_VERSION_LEN 0x41
+#define AMTHI_VERSIONS_NUMBER 0x32
+#define AMTHI_UNICODE_STRING_LEN 0x14
+
+#pragma pack(push, 1)
+struct amthi_version {
+	uint8_t major;
+	uint8_t minor;
+};
+
+struct amthi_command {
+	uint32_t val;
+};
+
+struct amthi_hdr {
+	struct amthi_version version;
+	uint16_t reserved;
+	struct amthi_command command;
+	uint32_t length;
+};
+
+struct amthi_unicode_string {
+	uint16_t length;
+	uint8_t string[20];
+};
+
+struct amthi_version_type {
+	struct amthi_unicode_string description;
+	struct amthi_unicode_string version;
+};
+
+struct amthi_get_code_versions_req {
+	struct amthi_hdr header;
+};
+
+struct amthi_get_code_versions_rsp {
+	struct amthi_hdr header;
+	uint32_t status;
+	uint8_t bios_version[65];
+	uint32_t versions_count;
+	struct amthi_version_type versions[50];
+};
+
+#pragma pack(pop)
+
+HECI_SCHEMA_STATIC_ASSERT(sizeof(struct amthi_version) == 2, "version size");
+HECI_SCHEMA_STATIC_ASSERT(offsetof(struct amthi_version, major) == 0, "version.major offset");
+HECI_SCHEMA_STATIC_ASSERT(offsetof(struct amthi_version, minor) == 1, "version.minor offset");
+
+HECI_SCHEMA_STATIC_ASSERT(sizeof(struct amthi_command) == 4, "command size");
+HECI_SCHEMA_STATIC_ASSERT(offsetof(struct amthi_command, val) == 0, "command.val offset");
+#define AMTHI_COMMAND_VAL_OPERATION_SHIFT 0
+#define AMTHI_COMMAND_VAL_OPERATION_MASK 0x007FFFFFu
+static HECI_SCHEMA_CONSTEXPR inline uint32_t amthi_command_val_operation(uint32_t word)
+{
+	return (uint32_t)((word >> 0) & 0x007FFFFFu);
+}
+static HECI_SCHEMA_CONSTEXPR inline uint32_t amthi_command_val_set_operation(uint32_t word, uint32_t value)
+{
+	return (uint32_t)((word & ~((uint32_t)0x007FFFFFu << 0)) | ((value & 0x007FFFFFu) << 0));
+}
+#define AMTHI_COMMAND_VAL_IS_RESPONSE_SHIFT 23
+#define AMTHI_COMMAND_VAL_IS_RESPONSE_MASK 0x00000001u
+static HECI_SCHEMA_CONSTEXPR inline uint32_t amthi_command_val_is_response(uint32_t word)
+{
+	return (uint32_t)((word >> 23) & 0x00000001u);
+}
+static HECI_SCHEMA_CONSTEXPR inline uint32_t amthi_command_val_set_is_response(uint32_t word, uint32_t value)
+{
+	return (uint32_t)((word & ~((uint32_t)0x00000001u << 23)) | ((value & 0x00000001u) << 23));
+}
+#define AMTHI_COMMAND_VAL_CMD_CLASS_SHIFT 24
+#define AMTHI_COMMAND_VAL_CMD_CLASS_MASK 0x000000FFu
+static HECI_SCHEMA_CONSTEXPR inline uint32_t amthi_command_val_cmd_class(uint32_t word)
+{
+	return (uint32_t)((word >> 24) & 0x000000FFu);
+}
+static HECI_SCHEMA_CONSTEXPR inline uint32_t amthi_command_val_set_cmd_class(uint32_t word, uint32_t value)
+{
+	return (uint32_t)((word & ~((uint32_t)0x000000FFu << 24)) | ((value & 0x000000FFu) << 24));
+}
+#define AMTHI_COMMAND_VAL_ENCODE(operation, is_response, cmd_class) \
+	((uint32_t)((((uint32_t)(operation) & 0x007FFFFFu) << 0) | (((uint32_t)(is_response) & 0x00000001u) << 23) | (((uint32_t)(cmd_class) & 0x000000FFu) << 24)))
+
+HECI_SCHEMA_STATIC_ASSERT(sizeof(struct amthi_hdr) == 12, "hdr size");
+HECI_SCHEMA_STATIC_ASSERT(offsetof(struct amthi_hdr, version) == 0, "hdr.version offset");
+HECI_SCHEMA_STATIC_ASSERT(offsetof(struct amthi_hdr, reserved) == 2, "hdr.reserved offset");
+HECI_SCHEMA_STATIC_ASSERT(offsetof(struct amthi_hdr, command) == 4, "hdr.command offset");
+HECI_SCHEMA_STATIC_ASSERT(offsetof(struct amthi_hdr, length) == 8, "hdr.length offset");
+
+HECI_SCHEMA_STATIC_ASSERT(sizeof(struct amthi_unicode_string) == 22, "unicode_string size");
+HECI_SCHEMA_STATIC_ASSERT(offsetof(struct amthi_unicode_string, length) == 0, "unicode_string.length offset");
+HECI_SCHEMA_STATIC_ASSERT(offsetof(struct amthi_unicode_string, string) == 2, "unicode_string.string offset");
+
+HECI_SCHEMA_STATIC_ASSERT(sizeof(struct amthi_version_type) == 44, "version_type size");
+HECI_SCHEMA_STATIC_ASSERT(offsetof(struct amthi_version_type, description) == 0, "version_type.description offset");
+HECI_SCHEMA_STATIC_ASSERT(offsetof(struct amthi_version_type, version) == 22, "version_type.version offset");
+
+HECI_SCHEMA_STATIC_ASSERT(sizeof(struct amthi_get_code_versions_req) == 12, "get_code_versions_req size");
+HECI_SCHEMA_STATIC_ASSERT(offsetof(struct amthi_get_code_versions_req, header) == 0, "get_code_versions_req.header offset");
+
+HECI_SCHEMA_STATIC_ASSERT(sizeof(struct amthi_get_code_versions_rsp) == 2285, "get_code_versions_rsp size");
+HECI_SCHEMA_STATIC_ASSERT(offsetof(struct amthi_get_code_versions_rsp, header) == 0, "get_code_versions_rsp.header offset");
+HECI_SCHEMA_STATIC_ASSERT(offsetof(struct amthi_get_code_versions_rsp, status) == 12, "get_code_versions_rsp.status offset");
+HECI_SCHEMA_STATIC_ASSERT(offsetof(struct amthi_get_code_versions_rsp, bios_version) == 16, "get_code_versions_rsp.bios_version offset");
+HECI_SCHEMA_STATIC_ASSERT(offsetof(struct amthi_get_code_versions_rsp, versions_count) == 81, "get_code_versions_rsp.versions_count offset");
+HECI_SCHEMA_STATIC_ASSERT(offsetof(struct amthi_get_code_versions_rsp, versions) == 85, "get_code_versions_rsp.versions offset");
+
+#define AMTHI_GET_CODE_VERSIONS_REQ_MIN_LEN 12
+#define AMTHI_GET_CODE_VERSIONS_REQ_MAX_LEN 12
+#define AMTHI_GET_CODE_VERSIONS_REQ_HEADER_VERSION_MAJOR 0x01u
+#define AMTHI_GET_CODE_VERSIONS_REQ_HEADER_VERSION_MAJOR_CHECK 0xFFu
+#define AMTHI_GET_CODE_VERSIONS_REQ_HEADER_VERSION_MINOR 0x01u
+#define AMTHI_GET_CODE_VERSIONS_REQ_HEADER_VERSION_MINOR_CHECK 0xFFu
+#define AMTHI_GET_CODE_VERSIONS_REQ_HEADER_COMMAND_VAL 0x0400001Au
+#define AMTHI_GET_CODE_VERSIONS_REQ_HEADER_COMMAND_VAL_CHECK 0xFFFFFFFFu
+
+static inline void amthi_get_code_versions_req_init(struct amthi_get_code_versions_req *msg)
+{
+	memset(msg, 0, sizeof(*msg));
+	msg->header.version.major = AMTHI_GET_CODE_VERSIONS_REQ_HEADER_VERSION_MAJOR;
+	msg->header.version.minor = AMTHI_GET_CODE_VERSIONS_REQ_HEADER_VERSION_MINOR;
+	msg->header.command.val = AMTHI_GET_CODE_VERSIONS_REQ_HEADER_COMMAND_VAL;
+}
+
+/* buf holds at least MAX_LEN (MIN_LEN for flexible messages) bytes,
+ * len is the received length */
+static inline int amthi_get_code_versions_req_valid(const void *buf, size_t len)
+{
+	uint8_t w0;
+	uint8_t w1;
+	uint32_t w2;
+
+	memcpy(&w0, (const uint8_t *)buf + 0, sizeof(w0));
+	memcpy(&w1, (const uint8_t *)buf + 1, sizeof(w1));
+	memcpy(&w2, (const uint8_t *)buf + 4, sizeof(w2));
+	return (len >= AMTHI_GET_CODE_VERSIONS_REQ_MIN_LEN) &
+	       (len <= AMTHI_GET_CODE_VERSIONS_REQ_MAX_LEN) &
+	       ((w0 & AMTHI_GET_CODE_VERSIONS_REQ_HEADER_VERSION_MAJOR_CHECK) == AMTHI_GET_CODE_VERSIONS_REQ_HEADER_VERSION_MAJOR) &
+	       ((w1 & AMTHI_GET_CODE_VERSIONS_REQ_HEADER_VERSION_MINOR_CHECK) == AMTHI_GET_CODE_VERSIONS_REQ_HEADER_VERSION_MINOR) &
+	       ((w2 & AMTHI_GET_CODE_VERSIONS_REQ_HEADER_COMMAND_VAL_CHECK) == AMTHI_GET_CODE_VERSIONS_REQ_HEADER_COMMAND_VAL);
+}
+
+#define AMTHI_GET_CODE_VERSIONS_RSP_MIN_LEN 2285
+#define AMTHI_GET_CODE_VERSIONS_RSP_MAX_LEN 2285
+#define AMTHI_GET_CODE_VERSIONS_RSP_HEADER_VERSION_MAJOR 0x01u
+#define AMTHI_GET_CODE_VERSIONS_RSP_HEADER_VERSION_MAJOR_CHECK 0xFFu
+#define AMTHI_GET_CODE_VERSIONS_RSP_HEADER_VERSION_MINOR 0x01u
+#define AMTHI_GET_CODE_VERSIONS_RSP_HEADER_VERSION_MINOR_CHECK 0xFFu
+#define AMTHI_GET_CODE_VERSIONS_RSP_HEADER_COMMAND_VAL 0x0480001Au
+#define AMTHI_GET_CODE_VERSIONS_RSP_HEADER_COMMAND_VAL_CHECK 0xFFFFFFFFu
+
+static inline void amthi_get_code_versions_rsp_init(struct amthi_get_code_versions_rsp *msg)
+{
+	memset(msg, 0, sizeof(*msg));
+	msg->header.version.major = AMTHI_GET_CODE_VERSIONS_RSP_HEADER_VERSION_MAJOR;
+	msg->header.version.minor = AMTHI_GET_CODE_VERSIONS_RSP_HEADER_VERSION_MINOR;
+	msg->header.command.val = AMTHI_GET_CODE_VERSIONS_RSP_HEADER_COMMAND_VAL;
+}
+
+/* buf holds at least MAX_LEN (MIN_LEN for flexible messages) bytes,
+ * len is the received length */
+static inline int amthi_get_code_versions_rsp_valid(const void *buf, size_t len)
+{
+	uint8_t w0;
+	uint8_t w1;
+	uint32_t w2;
+
+	memcpy(&w0, (const uint8_t *)buf + 0, sizeof(w0));
+	memcpy(&w1, (const uint8_t *)buf + 1, sizeof(w1));
+	memcpy(&w2, (const uint8_t *)buf + 4, sizeof(w2));
+	return (len >= AMTHI_GET_CODE_VERSIONS_RSP_MIN_LEN) &
+	       (len <= AMTHI_GET_CODE_VERSIONS_RSP_MAX_LEN) &
+	       ((w0 & AMTHI_GET_CODE_VERSIONS_RSP_HEADER_VERSION_MAJOR_CHECK) == AMTHI_GET_CODE_VERSIONS_RSP_HEADER_VERSION_MAJOR) &
+	       ((w1 & AMTHI_GET_CODE_VERSIONS_RSP_HEADER_VERSION_MINOR_CHECK) == AMTHI_GET_CODE_VERSIONS_RSP_HEADER_VERSION_MINOR) &
+	       ((w2 & AMTHI_GET_CODE_VERSIONS_RSP_HEADER_COMMAND_VAL_CHECK) == AMTHI_GET_CODE_VERSIONS_RSP_HEADER_COMMAND_VAL);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __AMTHI_SCHEMA_H */
@@ -0,0 +1,175 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2023 Intel Corporation
+ */
+/* Generated by heci-schemac from gsc_fwu.heci, do not edit */
+#ifndef __GSC_FWU_SCHEMA_H
+#define __GSC_FWU_SCHEMA_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifndef HECI_SCHEMA_CONSTEXPR
+#ifdef __cplusplus
+#define HECI_SCHEMA_CONSTEXPR constexpr
+#define HECI_SCHEMA_STATIC_ASSERT(e, m) static_assert(e, m)
+#elif defined(_MSC_VER) && !defined(__clang__) && \
+      (!defined(__STDC_VERSION__) || __STDC_VERSION__ < 201112L)
+/* C of MSVC before /std:c11 has no _Static_assert */
+#define HECI_SCHEMA_CONSTEXPR
+#define HECI_SCHEMA_CAT_(a, b) a##b
+#define HECI_SCHEMA_CAT(a, b) HECI_SCHEMA_CAT_(a, b)
+#define HECI_SCHEMA_STATIC_ASSERT(e, m) \
+	typedef char HECI_SCHEMA_CAT(heci_schema_assert_, __LINE__)[(e) ? 1 : -1]
+#else
+#define HECI_SCHEMA_CONSTEXPR
+#define HECI_SCHEMA_STATIC_ASSERT(e, m) _Static_assert(e, m)
+#endif
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define GSC_FWU_GET_IP_VERSION 0x6
+#define GSC_FWU_PAYLOAD_GFX_FW 0x1
+#define GSC_FWU_PAYLOAD_OPROM_DATA 0x2
+#define GSC_FWU_PAYLOAD_OPROM_CODE 0x3
+
+#pragma pack(push, 1)
+struct gsc_fwu_hdr {
+	uint8_t command_id;
+	uint8_t flags;
+	uint8_t reserved2[2];
+};
+
+struct gsc_fwu_external_version {
+	uint8_t project[4];
+	uint16_t hotfix;
+	uint16_t build;
+};
+
+struct gsc_fwu_version_req {
+	struct gsc_fwu_hdr header;
+	uint32_t partition;
+};
+
+struct gsc_fwu_version_rsp {
+	struct gsc_fwu_hdr header;
+	uint32_t status;
+	uint32_t reserved;
+	uint32_t partition;
+	uint32_t version_length;
+	struct gsc_fwu_external_version version;
+};
+
+#pragma pack(pop)
+
+HECI_SCHEMA_STATIC_ASSERT(sizeof(struct gsc_fwu_hdr) == 4, "hdr size");
+HECI_SCHEMA_STATIC_ASSERT(offsetof(struct gsc_fwu_hdr, command_id) == 0, "hdr.command_id offset");
+HECI_SCHEMA_STATIC_ASSERT(offsetof(struct gsc_fwu_hdr, flags) == 1, "hdr.flags offset");
+HECI_SCHEMA_STATIC_ASSERT(offsetof(struct gsc_fwu_hdr, reserved2) == 2, "hdr.reserved2 offset");
+#define GSC_FWU_HDR_FLAGS_IS_RESPONSE_SHIFT 0
+#define GSC_FWU_HDR_FLAGS_IS_RESPONSE_MASK 0x01u
+static HECI_SCHEMA_CONSTEXPR inline uint8_t gsc_fwu_hdr_flags_is_response(uint8_t word)
+{
+	return (uint8_t)((word >> 0) & 0x01u);
+}
+static HECI_SCHEMA_CONSTEXPR inline uint8_t gsc_fwu_hdr_flags_set_is_response(uint8_t word, uint8_t value)
+{
+	return (uint8_t)((word & ~((uint8_t)0x01u << 0)) | ((value & 0x01u) << 0));
+}
+#define GSC_FWU_HDR_FLAGS_RESERVED_SHIFT 1
+#define GSC_FWU_HDR_FLAGS_RESERVED_MASK 0x7Fu
+static HECI_SCHEMA_CONSTEXPR inline uint8_t gsc_fwu_hdr_flags_reserved(uint8_t word)
+{
+	return (uint8_t)((word >> 1) & 0x7Fu);
+}
+static HECI_SCHEMA_CONSTEXPR inline uint8_t gsc_fwu_hdr_flags_set_reserved(uint8_t word, uint8_t value)
+{
+	return (uint8_t)((word & ~((uint8_t)0x7Fu << 1)) | ((value & 0x7Fu) << 1));
+}
+#define GSC_FWU_HDR_FLAGS_ENCODE(is_response, reserved) \
+	((uint8_t)((((uint8_t)(is_response) & 0x01u) << 0) | (((uint8_t)(reserved) & 0x7Fu) << 1)))
+
+HECI_SCHEMA_STATIC_ASSERT(sizeof(struct gsc_fwu_external_version) == 8, "external_version size");
+HECI_SCHEMA_STATIC_ASSERT(offsetof(struct gsc_fwu_external_version, project) == 0, "external_version.project offset");
+HECI_SCHEMA_STATIC_ASSERT(offsetof(struct gsc_fwu_external_version, hotfix) == 4, "external_version.hotfix offset");
+HECI_SCHEMA_STATIC_ASSERT(offsetof(struct gsc_fwu_external_version, build) == 6, "external_version.build offset");
+
+HECI_SCHEMA_STATIC_ASSERT(sizeof(struct gsc_fwu_version_req) == 8, "version_req size");
+HECI_SCHEMA_STATIC_ASSERT(offsetof(struct gsc_fwu_version_req, header) == 0, "version_req.header offset");
+HECI_SCHEMA_STATIC_ASSERT(offsetof(struct gsc_fwu_version_req, partition) == 4, "version_req.partition offset");
+
+HECI_SCHEMA_STATIC_ASSERT(sizeof(struct gsc_fwu_version_rsp) == 28, "version_rsp size");
+HECI_SCHEMA_STATIC_ASSERT(offsetof(struct gsc_fwu_version_rsp, header) == 0, "version_rsp.header offset");
+HECI_SCHEMA_STATIC_ASSERT(offsetof(struct gsc_fwu_version_rsp, status) == 4, "version_rsp.status offset");
+HECI_SCHEMA_STATIC_ASSERT(offsetof(struct gsc_fwu_version_rsp, reserved) == 8, "version_rsp.reserved offset");
+HECI_SCHEMA_STATIC_ASSERT(offsetof(struct gsc_fwu_version_rsp, partition) == 12, "version_rsp.partition offset");
+HECI_SCHEMA_STATIC_ASSERT(offsetof(struct gsc_fwu_version_rsp, version_length) == 16, "version_rsp.version_length offset");
+HECI_SCHEMA_STATIC_ASSERT(offsetof(struct gsc_fwu_version_rsp, version) == 20, "version_rsp.version offset");
+
+#define GSC_FWU_VERSION_REQ_MIN_LEN 8
+#define GSC_FWU_VERSION_REQ_MAX_LEN 8
+#define GSC_FWU_VERSION_REQ_HEADER_COMMAND_ID 0x06u
+#define GSC_FWU_VERSION_REQ_HEADER_COMMAND_ID_CHECK 0xFFu
+#define GSC_FWU_VERSION_REQ_HEADER_FLAGS 0x00u
+#define GSC_FWU_VERSION_REQ_HEADER_FLAGS_CHECK 0x01u
+
+static inline void gsc_fwu_version_req_init(struct gsc_fwu_version_req *msg)
+{
+	memset(msg, 0, sizeof(*msg));
+	msg->header.command_id = GSC_FWU_VERSION_REQ_HEADER_COMMAND_ID;
+	msg->header.flags = GSC_FWU_VERSION_REQ_HEADER_FLAGS;
+}
+
+/* buf holds at least MAX_LEN (MIN_LEN for flexible messages) bytes,
+ * len is the received length */
+static inline int gsc_fwu_version_req_valid(const void *buf, size_t len)
+{
+	uint8_t w0;
+	uint8_t w1;
+
+	memcpy(&w0, (const uint8_t *)buf + 0, sizeof(w0));
+	memcpy(&w1, (const uint8_t *)buf + 1, sizeof(w1));
+	return (len >= GSC_FWU_VERSION_REQ_MIN_LEN) &
+	       (len <= GSC_FWU_VERSION_REQ_MAX_LEN) &
+	       ((w0 & GSC_FWU_VERSION_REQ_HEADER_COMMAND_ID_CHECK) == GSC_FWU_VERSION_REQ_HEADER_COMMAND_ID) &
+	       ((w1 & GSC_FWU_VERSION_REQ_HEADER_FLAGS_CHECK) == GSC_FWU_VERSION_REQ_HEADER_FLAGS);
+}
+
+#define GSC_FWU_VERSION_RSP_MIN_LEN 28
+#define GSC_FWU_VERSION_RSP_MAX_LEN 28
+#define GSC_FWU_VERSION_RSP_HEADER_COMMAND_ID 0x06u
+#define GSC_FWU_VERSION_RSP_HEADER_COMMAND_ID_CHECK 0xFFu
+#define GSC_FWU_VERSION_RSP_HEADER_FLAGS 0x01u
+#define GSC_FWU_VERSION_RSP_HEADER_FLAGS_CHECK 0x01u
+
+static inline void gsc_fwu_version_rsp_init(struct gsc_fwu_version_rsp *msg)
+{
+	memset(msg, 0, sizeof(*msg));
+	msg->header.command_id = GSC_FWU_VERSION_RSP_HEADER_COMMAND_ID;
+	msg->header.flags = GSC_FWU_VERSION_RSP_HEADER_FLAGS;
+}
+
+/* buf holds at least MAX_LEN (MIN_LEN for flexible messages) bytes,
+ * len is the received length */
+static inline int gsc_fwu_version_rsp_valid(const void *buf, size_t len)
+{
+	uint8_t w0;
+	uint8_t w1;
+
+	memcpy(&w0, (const uint8_t *)buf + 0, sizeof(w0));
+	memcpy(&w1, (const uint8_t *)buf + 1, sizeof(w1));
+	return (len >= GSC_FWU_VERSION_RSP_MIN_LEN) &
+	       (len <= GSC_FWU_VERSION_RSP_MAX_LEN) &
+	       ((w0 & GSC_FWU_VERSION_RSP_HEADER_COMMAND_ID_CHECK) == GSC_FWU_VERSION_RSP_HEADER_COMMAND_ID) &
+	       ((w1 & GSC_FWU_VERSION_RSP_HEADER_FLAGS_CHECK) == GSC_FWU_VERSION_RSP_HEADER_FLAGS);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __GSC_FWU_SCHEMA_H */
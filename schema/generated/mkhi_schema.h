@@ -0,0 +1,383 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2023 Intel Corporation
+ */
+/* Generated by heci-schemac from mkhi.heci, do not edit */
+#ifndef __MKHI_SCHEMA_H
+#define __MKHI_SCHEMA_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifndef HECI_SCHEMA_CONSTEXPR
+#ifdef __cplusplus
+#define HECI_SCHEMA_CONSTEXPR constexpr
+#define HECI_SCHEMA_STATIC_ASSERT(e, m) static_assert(e, m)
+#elif defined(_MSC_VER) && !defined(__clang__) && \
+      (!defined(__STDC_VERSION__) || __STDC_VERSION__ < 201112L)
+/* C of MSVC before /std:c11 has no _Static_assert */
+#define HECI_SCHEMA_CONSTEXPR
+#define HECI_SCHEMA_CAT_(a, b) a##b
+#define HECI_SCHEMA_CAT(a, b) HECI_SCHEMA_CAT_(a, b)
+#define HECI_SCHEMA_STATIC_ASSERT(e, m) \
+	typedef char HECI_SCHEMA_CAT(heci_schema_assert_, __LINE__)[(e) ? 1 : -1]
+#else
+#define HECI_SCHEMA_CONSTEXPR
+#define HECI_SCHEMA_STATIC_ASSERT(e, m) _Static_assert(e, m)
+#endif
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MKHI_GROUP_CBM 0x0
+#define MKHI_GROUP_FWCAPS 0x3
+#define MKHI_GROUP_FWUPDATE 0x5
+#define MKHI_GROUP_GEN 0xFF
+#define MKHI_GEN_GET_MKHI_VERSION 0x1
+#define MKHI_GEN_GET_FW_VERSION 0x2
+#define MKHI_FWCAPS_GET_RULE 0x2
+#define MKHI_FWUPDATE_GET_STATUS 0x3
+
+#pragma pack(push, 1)
+struct mkhi_hdr {
+	uint32_t word;
+};
+
+struct mkhi_version {
+	uint16_t minor;
+	uint16_t major;
+	uint16_t build_no;
+	uint16_t hot_fix;
+};
+
+struct mkhi_gen_get_mkhi_version_req {
+	struct mkhi_hdr header;
+};
+
+struct mkhi_gen_get_mkhi_version_rsp {
+	struct mkhi_hdr header;
+	uint16_t minor;
+	uint16_t major;
+};
+
+struct mkhi_gen_get_fw_version_req {
+	struct mkhi_hdr header;
+};
+
+struct mkhi_gen_get_fw_version_rsp {
+	struct mkhi_hdr header;
+	struct mkhi_version code;
+	struct mkhi_version nftp;
+	struct mkhi_version fitc;
+};
+
+struct mkhi_fwcaps_get_rule_req {
+	struct mkhi_hdr header;
+	uint32_t rule_id;
+};
+
+struct mkhi_fwcaps_get_rule_rsp {
+	struct mkhi_hdr header;
+	uint32_t rule_id;
+	uint8_t length;
+	uint8_t data[];
+};
+
+struct mkhi_fwupdate_get_status_req {
+	struct mkhi_hdr header;
+};
+
+struct mkhi_fwupdate_get_status_rsp {
+	struct mkhi_hdr header;
+	uint8_t state;
+	uint8_t reserved[3];
+};
+
+#pragma pack(pop)
+
+HECI_SCHEMA_STATIC_ASSERT(sizeof(struct mkhi_hdr) == 4, "hdr size");
+HECI_SCHEMA_STATIC_ASSERT(offsetof(struct mkhi_hdr, word) == 0, "hdr.word offset");
+#define MKHI_HDR_WORD_GROUP_SHIFT 0
+#define MKHI_HDR_WORD_GROUP_MASK 0x000000FFu
+static HECI_SCHEMA_CONSTEXPR inline uint32_t mkhi_hdr_word_group(uint32_t word)
+{
+	return (uint32_t)((word >> 0) & 0x000000FFu);
+}
+static HECI_SCHEMA_CONSTEXPR inline uint32_t mkhi_hdr_word_set_group(uint32_t word, uint32_t value)
+{
+	return (uint32_t)((word & ~((uint32_t)0x000000FFu << 0)) | ((value & 0x000000FFu) << 0));
+}
+#define MKHI_HDR_WORD_COMMAND_SHIFT 8
+#define MKHI_HDR_WORD_COMMAND_MASK 0x0000007Fu
+static HECI_SCHEMA_CONSTEXPR inline uint32_t mkhi_hdr_word_command(uint32_t word)
+{
+	return (uint32_t)((word >> 8) & 0x0000007Fu);
+}
+static HECI_SCHEMA_CONSTEXPR inline uint32_t mkhi_hdr_word_set_command(uint32_t word, uint32_t value)
+{
+	return (uint32_t)((word & ~((uint32_t)0x0000007Fu << 8)) | ((value & 0x0000007Fu) << 8));
+}
+#define MKHI_HDR_WORD_IS_RESPONSE_SHIFT 15
+#define MKHI_HDR_WORD_IS_RESPONSE_MASK 0x00000001u
+static HECI_SCHEMA_CONSTEXPR inline uint32_t mkhi_hdr_word_is_response(uint32_t word)
+{
+	return (uint32_t)((word >> 15) & 0x00000001u);
+}
+static HECI_SCHEMA_CONSTEXPR inline uint32_t mkhi_hdr_word_set_is_response(uint32_t word, uint32_t value)
+{
+	return (uint32_t)((word & ~((uint32_t)0x00000001u << 15)) | ((value & 0x00000001u) << 15));
+}
+#define MKHI_HDR_WORD_RESERVED_SHIFT 16
+#define MKHI_HDR_WORD_RESERVED_MASK 0x000000FFu
+static HECI_SCHEMA_CONSTEXPR inline uint32_t mkhi_hdr_word_reserved(uint32_t word)
+{
+	return (uint32_t)((word >> 16) & 0x000000FFu);
+}
+static HECI_SCHEMA_CONSTEXPR inline uint32_t mkhi_hdr_word_set_reserved(uint32_t word, uint32_t value)
+{
+	return (uint32_t)((word & ~((uint32_t)0x000000FFu << 16)) | ((value & 0x000000FFu) << 16));
+}
+#define MKHI_HDR_WORD_RESULT_SHIFT 24
+#define MKHI_HDR_WORD_RESULT_MASK 0x000000FFu
+static HECI_SCHEMA_CONSTEXPR inline uint32_t mkhi_hdr_word_result(uint32_t word)
+{
+	return (uint32_t)((word >> 24) & 0x000000FFu);
+}
+static HECI_SCHEMA_CONSTEXPR inline uint32_t mkhi_hdr_word_set_result(uint32_t word, uint32_t value)
+{
+	return (uint32_t)((word & ~((uint32_t)0x000000FFu << 24)) | ((value & 0x000000FFu) << 24));
+}
+#define MKHI_HDR_WORD_ENCODE(group, command, is_response, reserved, result) \
+	((uint32_t)((((uint32_t)(group) & 0x000000FFu) << 0) | (((uint32_t)(command) & 0x0000007Fu) << 8) | (((uint32_t)(is_response) & 0x00000001u) << 15) | (((uint32_t)(reserved) & 0x000000FFu) << 16) | (((uint32_t)(result) & 0x000000FFu) << 24)))
+
+HECI_SCHEMA_STATIC_ASSERT(sizeof(struct mkhi_version) == 8, "version size");
+HECI_SCHEMA_STATIC_ASSERT(offsetof(struct mkhi_version, minor) == 0, "version.minor offset");
+HECI_SCHEMA_STATIC_ASSERT(offsetof(struct mkhi_version, major) == 2, "version.major offset");
+HECI_SCHEMA_STATIC_ASSERT(offsetof(struct mkhi_version, build_no) == 4, "version.build_no offset");
+HECI_SCHEMA_STATIC_ASSERT(offsetof(struct mkhi_version, hot_fix) == 6, "version.hot_fix offset");
+
+HECI_SCHEMA_STATIC_ASSERT(sizeof(struct mkhi_gen_get_mkhi_version_req) == 4, "gen_get_mkhi_version_req size");
+HECI_SCHEMA_STATIC_ASSERT(offsetof(struct mkhi_gen_get_mkhi_version_req, header) == 0, "gen_get_mkhi_version_req.header offset");
+
+HECI_SCHEMA_STATIC_ASSERT(sizeof(struct mkhi_gen_get_mkhi_version_rsp) == 8, "gen_get_mkhi_version_rsp size");
+HECI_SCHEMA_STATIC_ASSERT(offsetof(struct mkhi_gen_get_mkhi_version_rsp, header) == 0, "gen_get_mkhi_version_rsp.header offset");
+HECI_SCHEMA_STATIC_ASSERT(offsetof(struct mkhi_gen_get_mkhi_version_rsp, minor) == 4, "gen_get_mkhi_version_rsp.minor offset");
+HECI_SCHEMA_STATIC_ASSERT(offsetof(struct mkhi_gen_get_mkhi_version_rsp, major) == 6, "gen_get_mkhi_version_rsp.major offset");
+
+HECI_SCHEMA_STATIC_ASSERT(sizeof(struct mkhi_gen_get_fw_version_req) == 4, "gen_get_fw_version_req size");
+HECI_SCHEMA_STATIC_ASSERT(offsetof(struct mkhi_gen_get_fw_version_req, header) == 0, "gen_get_fw_version_req.header offset");
+
+HECI_SCHEMA_STATIC_ASSERT(sizeof(struct mkhi_gen_get_fw_version_rsp) == 28, "gen_get_fw_version_rsp size");
+HECI_SCHEMA_STATIC_ASSERT(offsetof(struct mkhi_gen_get_fw_version_rsp, header) == 0, "gen_get_fw_version_rsp.header offset");
+HECI_SCHEMA_STATIC_ASSERT(offsetof(struct mkhi_gen_get_fw_version_rsp, code) == 4, "gen_get_fw_version_rsp.code offset");
+HECI_SCHEMA_STATIC_ASSERT(offsetof(struct mkhi_gen_get_fw_version_rsp, nftp) == 12, "gen_get_fw_version_rsp.nftp offset");
+HECI_SCHEMA_STATIC_ASSERT(offsetof(struct mkhi_gen_get_fw_version_rsp, fitc) == 20, "gen_get_fw_version_rsp.fitc offset");
+
+HECI_SCHEMA_STATIC_ASSERT(sizeof(struct mkhi_fwcaps_get_rule_req) == 8, "fwcaps_get_rule_req size");
+HECI_SCHEMA_STATIC_ASSERT(offsetof(struct mkhi_fwcaps_get_rule_req, header) == 0, "fwcaps_get_rule_req.header offset");
+HECI_SCHEMA_STATIC_ASSERT(offsetof(struct mkhi_fwcaps_get_rule_req, rule_id) == 4, "fwcaps_get_rule_req.rule_id offset");
+
+HECI_SCHEMA_STATIC_ASSERT(sizeof(struct mkhi_fwcaps_get_rule_rsp) == 9, "fwcaps_get_rule_rsp size");
+HECI_SCHEMA_STATIC_ASSERT(offsetof(struct mkhi_fwcaps_get_rule_rsp, header) == 0, "fwcaps_get_rule_rsp.header offset");
+HECI_SCHEMA_STATIC_ASSERT(offsetof(struct mkhi_fwcaps_get_rule_rsp, rule_id) == 4, "fwcaps_get_rule_rsp.rule_id offset");
+HECI_SCHEMA_STATIC_ASSERT(offsetof(struct mkhi_fwcaps_get_rule_rsp, length) == 8, "fwcaps_get_rule_rsp.length offset");
+HECI_SCHEMA_STATIC_ASSERT(offsetof(struct mkhi_fwcaps_get_rule_rsp, data) == 9, "fwcaps_get_rule_rsp.data offset");
+
+HECI_SCHEMA_STATIC_ASSERT(sizeof(struct mkhi_fwupdate_get_status_req) == 4, "fwupdate_get_status_req size");
+HECI_SCHEMA_STATIC_ASSERT(offsetof(struct mkhi_fwupdate_get_status_req, header) == 0, "fwupdate_get_status_req.header offset");
+
+HECI_SCHEMA_STATIC_ASSERT(sizeof(struct mkhi_fwupdate_get_status_rsp) == 8, "fwupdate_get_status_rsp size");
+HECI_SCHEMA_STATIC_ASSERT(offsetof(struct mkhi_fwupdate_get_status_rsp, header) == 0, "fwupdate_get_status_rsp.header offset");
+HECI_SCHEMA_STATIC_ASSERT(offsetof(struct mkhi_fwupdate_get_status_rsp, state) == 4, "fwupdate_get_status_rsp.state offset");
+HECI_SCHEMA_STATIC_ASSERT(offsetof(struct mkhi_fwupdate_get_status_rsp, reserved) == 5, "fwupdate_get_status_rsp.reserved offset");
+
+#define MKHI_GEN_GET_MKHI_VERSION_REQ_MIN_LEN 4
+#define MKHI_GEN_GET_MKHI_VERSION_REQ_MAX_LEN 4
+#define MKHI_GEN_GET_MKHI_VERSION_REQ_HEADER_WORD 0x000001FFu
+#define MKHI_GEN_GET_MKHI_VERSION_REQ_HEADER_WORD_CHECK 0x0000FFFFu
+
+static inline void mkhi_gen_get_mkhi_version_req_init(struct mkhi_gen_get_mkhi_version_req *msg)
+{
+	memset(msg, 0, sizeof(*msg));
+	msg->header.word = MKHI_GEN_GET_MKHI_VERSION_REQ_HEADER_WORD;
+}
+
+/* buf holds at least MAX_LEN (MIN_LEN for flexible messages) bytes,
+ * len is the received length */
+static inline int mkhi_gen_get_mkhi_version_req_valid(const void *buf, size_t len)
+{
+	uint32_t w0;
+
+	memcpy(&w0, (const uint8_t *)buf + 0, sizeof(w0));
+	return (len >= MKHI_GEN_GET_MKHI_VERSION_REQ_MIN_LEN) &
+	       (len <= MKHI_GEN_GET_MKHI_VERSION_REQ_MAX_LEN) &
+	       ((w0 & MKHI_GEN_GET_MKHI_VERSION_REQ_HEADER_WORD_CHECK) == MKHI_GEN_GET_MKHI_VERSION_REQ_HEADER_WORD);
+}
+
+#define MKHI_GEN_GET_MKHI_VERSION_RSP_MIN_LEN 8
+#define MKHI_GEN_GET_MKHI_VERSION_RSP_MAX_LEN 8
+#define MKHI_GEN_GET_MKHI_VERSION_RSP_HEADER_WORD 0x000081FFu
+#define MKHI_GEN_GET_MKHI_VERSION_RSP_HEADER_WORD_CHECK 0x0000FFFFu
+
+static inline void mkhi_gen_get_mkhi_version_rsp_init(struct mkhi_gen_get_mkhi_version_rsp *msg)
+{
+	memset(msg, 0, sizeof(*msg));
+	msg->header.word = MKHI_GEN_GET_MKHI_VERSION_RSP_HEADER_WORD;
+}
+
+/* buf holds at least MAX_LEN (MIN_LEN for flexible messages) bytes,
+ * len is the received length */
+static inline int mkhi_gen_get_mkhi_version_rsp_valid(const void *buf, size_t len)
+{
+	uint32_t w0;
+
+	memcpy(&w0, (const uint8_t *)buf + 0, sizeof(w0));
+	return (len >= MKHI_GEN_GET_MKHI_VERSION_RSP_MIN_LEN) &
+	       (len <= MKHI_GEN_GET_MKHI_VERSION_RSP_MAX_LEN) &
+	       ((w0 & MKHI_GEN_GET_MKHI_VERSION_RSP_HEADER_WORD_CHECK) == MKHI_GEN_GET_MKHI_VERSION_RSP_HEADER_WORD);
+}
+
+#define MKHI_GEN_GET_FW_VERSION_REQ_MIN_LEN 4
+#define MKHI_GEN_GET_FW_VERSION_REQ_MAX_LEN 4
+#define MKHI_GEN_GET_FW_VERSION_REQ_HEADER_WORD 0x000002FFu
+#define MKHI_GEN_GET_FW_VERSION_REQ_HEADER_WORD_CHECK 0x0000FFFFu
+
+static inline void mkhi_gen_get_fw_version_req_init(struct mkhi_gen_get_fw_version_req *msg)
+{
+	memset(msg, 0, sizeof(*msg));
+	msg->header.word = MKHI_GEN_GET_FW_VERSION_REQ_HEADER_WORD;
+}
+
+/* buf holds at least MAX_LEN (MIN_LEN for flexible messages) bytes,
+ * len is the received length */
+static inline int mkhi_gen_get_fw_version_req_valid(const void *buf, size_t len)
+{
+	uint32_t w0;
+
+	memcpy(&w0, (const uint8_t *)buf + 0, sizeof(w0));
+	return (len >= MKHI_GEN_GET_FW_VERSION_REQ_MIN_LEN) &
+	       (len <= MKHI_GEN_GET_FW_VERSION_REQ_MAX_LEN) &
+	       ((w0 & MKHI_GEN_GET_FW_VERSION_REQ_HEADER_WORD_CHECK) == MKHI_GEN_GET_FW_VERSION_REQ_HEADER_WORD);
+}
+
+#define MKHI_GEN_GET_FW_VERSION_RSP_MIN_LEN 20
+#define MKHI_GEN_GET_FW_VERSION_RSP_MAX_LEN 28
+#define MKHI_GEN_GET_FW_VERSION_RSP_HEADER_WORD 0x000082FFu
+#define MKHI_GEN_GET_FW_VERSION_RSP_HEADER_WORD_CHECK 0x0000FFFFu
+
+static inline void mkhi_gen_get_fw_version_rsp_init(struct mkhi_gen_get_fw_version_rsp *msg)
+{
+	memset(msg, 0, sizeof(*msg));
+	msg->header.word = MKHI_GEN_GET_FW_VERSION_RSP_HEADER_WORD;
+}
+
+/* buf holds at least MAX_LEN (MIN_LEN for flexible messages) bytes,
+ * len is the received length */
+static inline int mkhi_gen_get_fw_version_rsp_valid(const void *buf, size_t len)
+{
+	uint32_t w0;
+
+	memcpy(&w0, (const uint8_t *)buf + 0, sizeof(w0));
+	return (len >= MKHI_GEN_GET_FW_VERSION_RSP_MIN_LEN) &
+	       (len <= MKHI_GEN_GET_FW_VERSION_RSP_MAX_LEN) &
+	       ((w0 & MKHI_GEN_GET_FW_VERSION_RSP_HEADER_WORD_CHECK) == MKHI_GEN_GET_FW_VERSION_RSP_HEADER_WORD);
+}
+
+#define MKHI_FWCAPS_GET_RULE_REQ_MIN_LEN 8
+#define MKHI_FWCAPS_GET_RULE_REQ_MAX_LEN 8
+#define MKHI_FWCAPS_GET_RULE_REQ_HEADER_WORD 0x00000203u
+#define MKHI_FWCAPS_GET_RULE_REQ_HEADER_WORD_CHECK 0x0000FFFFu
+
+static inline void mkhi_fwcaps_get_rule_req_init(struct mkhi_fwcaps_get_rule_req *msg)
+{
+	memset(msg, 0, sizeof(*msg));
+	msg->header.word = MKHI_FWCAPS_GET_RULE_REQ_HEADER_WORD;
+}
+
+/* buf holds at least MAX_LEN (MIN_LEN for flexible messages) bytes,
+ * len is the received length */
+static inline int mkhi_fwcaps_get_rule_req_valid(const void *buf, size_t len)
+{
+	uint32_t w0;
+
+	memcpy(&w0, (const uint8_t *)buf + 0, sizeof(w0));
+	return (len >= MKHI_FWCAPS_GET_RULE_REQ_MIN_LEN) &
+	       (len <= MKHI_FWCAPS_GET_RULE_REQ_MAX_LEN) &
+	       ((w0 & MKHI_FWCAPS_GET_RULE_REQ_HEADER_WORD_CHECK) == MKHI_FWCAPS_GET_RULE_REQ_HEADER_WORD);
+}
+
+#define MKHI_FWCAPS_GET_RULE_RSP_MIN_LEN 9
+#define MKHI_FWCAPS_GET_RULE_RSP_HEADER_WORD 0x00008203u
+#define MKHI_FWCAPS_GET_RULE_RSP_HEADER_WORD_CHECK 0x0000FFFFu
+
+static inline void mkhi_fwcaps_get_rule_rsp_init(struct mkhi_fwcaps_get_rule_rsp *msg)
+{
+	memset(msg, 0, sizeof(*msg));
+	msg->header.word = MKHI_FWCAPS_GET_RULE_RSP_HEADER_WORD;
+}
+
+/* buf holds at least MAX_LEN (MIN_LEN for flexible messages) bytes,
+ * len is the received length */
+static inline int mkhi_fwcaps_get_rule_rsp_valid(const void *buf, size_t len)
+{
+	uint32_t w0;
+
+	memcpy(&w0, (const uint8_t *)buf + 0, sizeof(w0));
+	return (len >= MKHI_FWCAPS_GET_RULE_RSP_MIN_LEN) &
+	       ((w0 & MKHI_FWCAPS_GET_RULE_RSP_HEADER_WORD_CHECK) == MKHI_FWCAPS_GET_RULE_RSP_HEADER_WORD);
+}
+
+#define MKHI_FWUPDATE_GET_STATUS_REQ_MIN_LEN 4
+#define MKHI_FWUPDATE_GET_STATUS_REQ_MAX_LEN 4
+#define MKHI_FWUPDATE_GET_STATUS_REQ_HEADER_WORD 0x00000305u
+#define MKHI_FWUPDATE_GET_STATUS_REQ_HEADER_WORD_CHECK 0x0000FFFFu
+
+static inline void mkhi_fwupdate_get_status_req_init(struct mkhi_fwupdate_get_status_req *msg)
+{
+	memset(msg, 0, sizeof(*msg));
+	msg->header.word = MKHI_FWUPDATE_GET_STATUS_REQ_HEADER_WORD;
+}
+
+/* buf holds at least MAX_LEN (MIN_LEN for flexible messages) bytes,
+ * len is the received length */
+static inline int mkhi_fwupdate_get_status_req_valid(const void *buf, size_t len)
+{
+	uint32_t w0;
+
+	memcpy(&w0, (const uint8_t *)buf + 0, sizeof(w0));
+	return (len >= MKHI_FWUPDATE_GET_STATUS_REQ_MIN_LEN) &
+	       (len <= MKHI_FWUPDATE_GET_STATUS_REQ_MAX_LEN) &
+	       ((w0 & MKHI_FWUPDATE_GET_STATUS_REQ_HEADER_WORD_CHECK) == MKHI_FWUPDATE_GET_STATUS_REQ_HEADER_WORD);
+}
+
+#define MKHI_FWUPDATE_GET_STATUS_RSP_MIN_LEN 8
+#define MKHI_FWUPDATE_GET_STATUS_RSP_MAX_LEN 8
+#define MKHI_FWUPDATE_GET_STATUS_RSP_HEADER_WORD 0x00008305u
+#define MKHI_FWUPDATE_GET_STATUS_RSP_HEADER_WORD_CHECK 0x0000FFFFu
+
+static inline void mkhi_fwupdate_get_status_rsp_init(struct mkhi_fwupdate_get_status_rsp *msg)
+{
+	memset(msg, 0, sizeof(*msg));
+	msg->header.word = MKHI_FWUPDATE_GET_STATUS_RSP_HEADER_WORD;
+}
+
+/* buf holds at least MAX_LEN (MIN_LEN for flexible messages) bytes,
+ * len is the received length */
+static inline int mkhi_fwupdate_get_status_rsp_valid(const void *buf, size_t len)
+{
+	uint32_t w0;
+
+	memcpy(&w0, (const uint8_t *)buf + 0, sizeof(w0));
+	return (len >= MKHI_FWUPDATE_GET_STATUS_RSP_MIN_LEN) &
+	       (len <= MKHI_FWUPDATE_GET_STATUS_RSP_MAX_LEN) &
+	       ((w0 & MKHI_FWUPDATE_GET_STATUS_RSP_HEADER_WORD_CHECK) == MKHI_FWUPDATE_GET_STATUS_RSP_HEADER_WORD);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __MKHI_SCHEMA_H */
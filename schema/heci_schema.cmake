@@ -0,0 +1,62 @@
+# SPDX-License-Identifier: Apache-2.0
+# Copyright (C) 2023 Intel Corporation
+
+set(HECI_SCHEMA_DIR ${CMAKE_CURRENT_LIST_DIR})
+
+if(CMAKE_VERSION VERSION_LESS 3.12)
+  find_package(PythonInterp 3 QUIET)
+  set(HECI_SCHEMA_PYTHON ${PYTHON_EXECUTABLE})
+  set(HECI_SCHEMA_PYTHON_FOUND ${PYTHONINTERP_FOUND})
+else()
+  find_package(Python3 COMPONENTS Interpreter QUIET)
+  set(HECI_SCHEMA_PYTHON ${Python3_EXECUTABLE})
+  set(HECI_SCHEMA_PYTHON_FOUND ${Python3_Interpreter_FOUND})
+endif()
+
+if(HECI_SCHEMA_PYTHON_FOUND)
+  # Refresh the checked-in copies in schema/generated after a schema change
+  if(NOT TARGET heci-schema-update)
+    file(GLOB schemas ${HECI_SCHEMA_DIR}/*.heci)
+    set(commands)
+    foreach(src ${schemas})
+      get_filename_component(name ${src} NAME_WE)
+      list(APPEND commands
+           COMMAND ${HECI_SCHEMA_PYTHON} ${HECI_SCHEMA_DIR}/heci-schemac ${src}
+                   -o ${HECI_SCHEMA_DIR}/generated/${name}_schema.h)
+    endforeach()
+    add_custom_target(heci-schema-update ${commands}
+                      COMMENT "Updating schema/generated"
+                      VERBATIM)
+  endif()
+else()
+  message(STATUS "Python 3 not found, using the checked-in schema headers")
+endif()
+
+# heci_schema_generate(<target> <name>...)
+# Generate <name>_schema.h from schema/<name>.heci at build time
+# and add it to the include path of the target.
+# Without Python the copy checked in to schema/generated is used.
+function(heci_schema_generate target)
+  if(NOT HECI_SCHEMA_PYTHON_FOUND)
+    target_include_directories(${target} PRIVATE ${HECI_SCHEMA_DIR}/generated)
+    return()
+  endif()
+
+  set(outdir ${CMAKE_CURRENT_BINARY_DIR}/schema)
+  set(headers)
+  foreach(name ${ARGN})
+    set(src ${HECI_SCHEMA_DIR}/${name}.heci)
+    set(out ${outdir}/${name}_schema.h)
+    add_custom_command(
+      OUTPUT ${out}
+      COMMAND ${CMAKE_COMMAND} -E make_directory ${outdir}
+      COMMAND ${HECI_SCHEMA_PYTHON} ${HECI_SCHEMA_DIR}/heci-schemac ${src} -o ${out}
+      DEPENDS ${src} ${HECI_SCHEMA_DIR}/heci-schemac
+      COMMENT "Generating ${name}_schema.h"
+      VERBATIM
+    )
+    list(APPEND headers ${out})
+  endforeach()
+  target_sources(${target} PRIVATE ${headers})
+  target_include_directories(${target} PRIVATE ${outdir})
+endfunction()
@@ -171,6 +171,20 @@ TEESTATUS TEEAPI TeeInitGUID(IN OUT PTEEHANDLE handle, IN const GUID *guid,
 	return status;
 }
 
+TEESTATUS TEEAPI TeeInitInPlace(IN OUT PTEEHANDLE handle, IN const GUID *guid,
+				IN OPTIONAL const char *device,
+				IN void *storage, IN size_t storage_size)
+{
+	UNREFERENCED_PARAMETER(device);
+	UNREFERENCED_PARAMETER(storage_size);
+
+	if (NULL == guid || NULL == handle || NULL == storage) {
+		return TEE_INVALID_PARAMETER;
+	}
+
+	return TEE_NOTSUPPORTED;
+}
+
 TEESTATUS TEEAPI TeeInitHandle(IN OUT PTEEHANDLE handle, IN const GUID *guid,
 			       IN const TEE_DEVICE_HANDLE device_handle)
 {
@@ -578,3 +592,154 @@ uint32_t TEEAPI TeeGetLogLevel(IN const PTEEHANDLE handle)
 
         return prev_log_level;
 }
+
+TEESTATUS TEEAPI TeeSetLogCallback(IN OPTIONAL TeeLogCallback callback,
+				   IN OPTIONAL void *ctx)
+{
+	UNREFERENCED_PARAMETER(callback);
+	UNREFERENCED_PARAMETER(ctx);
+
+	return TEE_NOTSUPPORTED;
+}
+
+uint32_t TEEAPI TeeTraceEnable(IN uint32_t enable)
+{
+	UNREFERENCED_PARAMETER(enable);
+
+	return 0;
+}
+
+TEESTATUS TEEAPI TeeTraceDump(IN int fd)
+{
+	UNREFERENCED_PARAMETER(fd);
+
+	return TEE_NOTSUPPORTED;
+}
+
+TEESTATUS TEEAPI TeeGetStats(IN PTEEHANDLE handle,
+			     OUT OPTIONAL struct tee_stats_counters *session,
+			     OUT OPTIONAL struct tee_stats *client)
+{
+	UNREFERENCED_PARAMETER(handle);
+	UNREFERENCED_PARAMETER(session);
+	UNREFERENCED_PARAMETER(client);
+
+	return TEE_NOTSUPPORTED;
+}
+
+TEESTATUS TEEAPI TeeGetStatsClient(IN uint32_t index,
+				   OUT struct tee_stats_client *client)
+{
+	UNREFERENCED_PARAMETER(index);
+	UNREFERENCED_PARAMETER(client);
+
+	return TEE_NOTSUPPORTED;
+}
+
+uint64_t TEEAPI TeeStatsBucketBound(IN uint32_t bucket)
+{
+	UNREFERENCED_PARAMETER(bucket);
+
+	return 0;
+}
+
+TEESTATUS TEEAPI TeeStatsFormatOpenMetrics(OUT char *buf, IN size_t len,
+					   OUT OPTIONAL size_t *written)
+{
+	UNREFERENCED_PARAMETER(buf);
+	UNREFERENCED_PARAMETER(len);
+	UNREFERENCED_PARAMETER(written);
+
+	return TEE_NOTSUPPORTED;
+}
+
+TEESTATUS TEEAPI TeeCaptureStart(IN const char *path, IN size_t max_file_size,
+				 IN uint32_t max_files)
+{
+	UNREFERENCED_PARAMETER(path);
+	UNREFERENCED_PARAMETER(max_file_size);
+	UNREFERENCED_PARAMETER(max_files);
+
+	return TEE_NOTSUPPORTED;
+}
+
+TEESTATUS TEEAPI TeeCaptureStop(OUT OPTIONAL uint64_t *dropped)
+{
+	UNREFERENCED_PARAMETER(dropped);
+
+	return TEE_NOTSUPPORTED;
+}
+
+TEESTATUS TEEAPI TeeLoopbackRegister(IN const GUID *guid, IN uint32_t maxMsgLen,
+				     IN uint8_t protocolVersion,
+				     IN TeeLoopbackResponder responder,
+				     IN OPTIONAL void *ctx)
+{
+	UNREFERENCED_PARAMETER(guid);
+	UNREFERENCED_PARAMETER(maxMsgLen);
+	UNREFERENCED_PARAMETER(protocolVersion);
+	UNREFERENCED_PARAMETER(responder);
+	UNREFERENCED_PARAMETER(ctx);
+
+	return TEE_NOTSUPPORTED;
+}
+
+TEESTATUS TEEAPI TeeLoopbackUnregister(IN const GUID *guid)
+{
+	UNREFERENCED_PARAMETER(guid);
+
+	return TEE_NOTSUPPORTED;
+}
+
+TEESTATUS TEEAPI TeeLoopbackSetLatency(IN const GUID *guid, IN uint64_t latency)
+{
+	UNREFERENCED_PARAMETER(guid);
+	UNREFERENCED_PARAMETER(latency);
+
+	return TEE_NOTSUPPORTED;
+}
+
+TEESTATUS TEEAPI TeeLoopbackSetFWStatus(IN uint32_t fwStatusNum, IN uint32_t fwStatus)
+{
+	UNREFERENCED_PARAMETER(fwStatusNum);
+	UNREFERENCED_PARAMETER(fwStatus);
+
+	return TEE_NOTSUPPORTED;
+}
+
+TEESTATUS TEEAPI TeeFaultInjectSet(IN OPTIONAL const char *schedule)
+{
+	UNREFERENCED_PARAMETER(schedule);
+
+	return TEE_NOTSUPPORTED;
+}
+
+TEESTATUS TEEAPI TeeFaultInjectCount(OUT uint64_t *count)
+{
+	UNREFERENCED_PARAMETER(count);
+
+	return TEE_NOTSUPPORTED;
+}
+
+TEESTATUS TEEAPI TeeClockVirtualStart(IN uint64_t start)
+{
+	UNREFERENCED_PARAMETER(start);
+
+	return TEE_NOTSUPPORTED;
+}
+
+void TEEAPI TeeClockVirtualStop(void)
+{
+}
+
+TEESTATUS TEEAPI TeeClockVirtualAdvance(IN uint64_t ns)
+{
+	UNREFERENCED_PARAMETER(ns);
+
+	return TEE_NOTSUPPORTED;
+}
+
+uint64_t TEEAPI TeeClockNow(void)
+{
+	return 0;
+}
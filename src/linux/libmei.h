@@ -13,6 +13,7 @@
 
 #include <linux/uuid.h>
 #include <linux/mei.h>
+#include <stdarg.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <unistd.h>
@@ -70,6 +71,7 @@ struct mei {
 	bool close_on_exit;     /**< close handle on deinit */
 	char *device;           /**< device name */
 	uint8_t vtag;           /**< vtag used in communication */
+	bool device_static;     /**< device name is not owned by the handle */
 };
 
 /*! Default name of mei device
@@ -124,6 +126,19 @@ void mei_free(struct mei *me);
 int mei_init(struct mei *me, const char *device, const uuid_le *guid,
 		unsigned char req_protocol_version, bool verbose);
 
+/*! Initializes a mei connection without copying the device path
+ *
+ *  \param me A handle to the mei device. All subsequent calls to the lib's functions
+ *         must be with this handle
+ *  \param device device path, must stay valid until mei_deinit() is called
+ *  \param guid UUID/GUID of associated mei client
+ *  \param req_protocol_version minimal required protocol version, 0 for any
+ *  \param verbose print verbose output to a console
+ *  \return 0 if successful, otherwise error code
+ */
+int mei_init_static_device(struct mei *me, const char *device, const uuid_le *guid,
+		unsigned char req_protocol_version, bool verbose);
+
 /*! Initializes a mei connection
  *
  *  \param me A handle to the mei device. All subsequent calls to the lib's functions
@@ -228,6 +243,13 @@ int mei_notification_get(struct mei *me);
  */
 int mei_fwstatus(struct mei *me, uint32_t fwsts_num, uint32_t *fwsts);
 
+/*! Root of the sysfs tree holding the device attributes
+ *
+ *  \return METEE_SYSFS_ROOT if set and the program is not setuid
+ *          or setgid, otherwise "/sys"
+ */
+const char *mei_sysfs_root(void);
+
 /*! Set log level
  *
  *  \param me The mei handle
@@ -243,6 +265,27 @@ uint32_t mei_set_log_level(struct mei *me, uint32_t log_level);
  */
 uint32_t mei_get_log_level(const struct mei *me);
 
+/*! Log callback
+ *
+ *  \param ctx context provided to mei_set_log_callback
+ *  \param is_error the message is an error
+ *  \param file source file of the message
+ *  \param line source line of the message
+ *  \param func function that issued the message
+ *  \param fmt printf-style format
+ *  \param args format arguments
+ */
+typedef void (*mei_log_callback)(void *ctx, bool is_error,
+				 const char *file, int line, const char *func,
+				 const char *fmt, va_list args);
+
+/*! Set process-wide log callback instead of syslog/stderr output
+ *
+ *  \param log_callback log callback, NULL to restore the default output
+ *  \param ctx context to pass to the callback
+ */
+void mei_set_log_callback(mei_log_callback log_callback, void *ctx);
+
 #ifdef __cplusplus
 }
 #endif /*  __cplusplus */
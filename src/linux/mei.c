@@ -22,6 +22,15 @@
 /*****************************************************************************
  * Intel Management Engine Interface
  *****************************************************************************/
+static mei_log_callback __mei_log_callback;
+static void *__mei_log_ctx;
+
+void mei_set_log_callback(mei_log_callback log_callback, void *ctx)
+{
+	__atomic_store_n(&__mei_log_ctx, ctx, __ATOMIC_RELAXED);
+	__atomic_store_n(&__mei_log_callback, log_callback, __ATOMIC_RELEASE);
+}
+
 #ifdef ANDROID
 #define LOG_TAG "libmei"
 #include <cutils/log.h>
@@ -33,29 +42,60 @@ static inline void __dump_buffer(const char *buf)
 }
 
 #else /* ! ANDROID */
+#include <stdarg.h>
 #ifdef SYSLOG
 	#include <syslog.h>
-	#define __mei_msg(fmt, ...) syslog(LOG_DEBUG, fmt, ##__VA_ARGS__)
-	#define __mei_err(fmt, ...) syslog(LOG_ERR, fmt, ##__VA_ARGS__)
+#endif /* SYSLOG */
+
+static void __mei_log(bool is_error, const char *file, int line,
+		      const char *func, const char *fmt, ...)
+	__attribute__((format(printf, 5, 6)));
+
+static void __mei_log(bool is_error, const char *file, int line,
+		      const char *func, const char *fmt, ...)
+{
+	mei_log_callback log_callback;
+	va_list args;
+
+	va_start(args, fmt);
+	log_callback = __atomic_load_n(&__mei_log_callback, __ATOMIC_ACQUIRE);
+	if (log_callback) {
+		log_callback(__atomic_load_n(&__mei_log_ctx, __ATOMIC_RELAXED),
+			     is_error, file, line, func, fmt, args);
+		va_end(args);
+		return;
+	}
+#ifdef SYSLOG
+	{
+		char msg[1024];
+
+		vsnprintf(msg, sizeof(msg), fmt, args);
+		if (is_error)
+			syslog(LOG_ERR, "me: error: %s", msg);
+		else
+			syslog(LOG_DEBUG, "%s", msg);
+	}
 #else
-	#include <stdlib.h>
-	#define __mei_msg(fmt, ...) fprintf(stderr, fmt, ##__VA_ARGS__)
-	#define __mei_err(fmt, ...) fprintf(stderr, fmt, ##__VA_ARGS__)
+	if (is_error)
+		fprintf(stderr, "me: error: ");
+	vfprintf(stderr, fmt, args);
 #endif /* SYSLOG */
+	va_end(args);
+}
 
 #define mei_msg(_me, fmt, ARGS...) do {                \
 	if ((_me)->log_level >= MEI_LOG_LEVEL_VERBOSE) \
-		__mei_msg(fmt, ##ARGS);                \
+		__mei_log(false, __FILE__, __LINE__, __func__, fmt, ##ARGS); \
 } while (0)
 
 #define mei_err(_me, fmt, ARGS...) do {               \
 	if ((_me)->log_level > MEI_LOG_LEVEL_QUIET)   \
-		__mei_err("me: error: " fmt, ##ARGS); \
+		__mei_log(true, __FILE__, __LINE__, __func__, fmt, ##ARGS); \
 } while (0)
 
 static inline void __dump_buffer(const char *buf)
 {
-	__mei_msg("%s\n", buf);
+	__mei_log(false, __FILE__, __LINE__, __func__, "%s\n", buf);
 }
 #endif /* ANDROID */
 
@@ -63,19 +103,24 @@ static void dump_hex_buffer(const unsigned char *buf, size_t len)
 {
 #define LINE_LEN 16
 #define PBUFSZ (sizeof("00") * LINE_LEN)
+	static const char hex[] = "0123456789ABCDEF";
 	char pbuf[PBUFSZ];
 	int j = 0;
 
 	while (len-- > 0) {
-		snprintf(&pbuf[j], PBUFSZ - j, "%02X ", *buf++);
-		j += 3;
+		pbuf[j++] = hex[*buf >> 4];
+		pbuf[j++] = hex[*buf++ & 0xF];
+		pbuf[j++] = ' ';
 		if (j == PBUFSZ) {
+			pbuf[j - 1] = '\0';
 			__dump_buffer(pbuf);
 			j = 0;
 		}
 	}
-	if (j)
+	if (j) {
+		pbuf[j - 1] = '\0';
 		__dump_buffer(pbuf);
+	}
 #undef PBUFSZ
 #undef LINE_LEN
 }
@@ -101,8 +146,10 @@ void mei_deinit(struct mei *me)
 	me->prot_ver = 0;
 	me->state = MEI_CL_STATE_ZERO;
 	me->last_err = 0;
-	free(me->device);
+	if (!me->device_static)
+		free(me->device);
 	me->device = NULL;
+	me->device_static = false;
 }
 
 static inline int __mei_errno_to_state(struct mei *me)
@@ -214,10 +261,24 @@ static inline ssize_t __mei_write(struct mei *me, const unsigned char *buf, size
 	return rc <= 0 ? -me->last_err : rc;
 }
 
+/*
+ * METEE_SYSFS_ROOT replaces /sys, so an emulated device can provide
+ * its own attributes, ignored in setuid and setgid programs
+ */
+const char *mei_sysfs_root(void)
+{
+	const char *root = NULL;
+
+	if (getuid() == geteuid() && getgid() == getegid())
+		root = getenv("METEE_SYSFS_ROOT");
+
+	return (root && root[0]) ? root : "/sys";
+}
+
 static inline int __mei_fwsts(struct mei *me, const char *device,
 			      uint32_t fwsts_num, uint32_t *fwsts)
 {
-#define FWSTS_FILENAME_LEN 33
+#define FWSTS_FILENAME_LEN PATH_MAX
 #define FWSTS_LEN 9
 #define CONV_BASE 16
 	char path[FWSTS_FILENAME_LEN];
@@ -225,11 +286,12 @@ static inline int __mei_fwsts(struct mei *me, const char *device,
 	char line[FWSTS_LEN];
 	unsigned long cnv;
 	ssize_t len;
+	int rc;
 
-	if (snprintf(path, FWSTS_FILENAME_LEN,
-		     "/sys/class/mei/%s/fw_status", device) < 0)
+	rc = snprintf(path, FWSTS_FILENAME_LEN, "%s/class/mei/%s/fw_status",
+		      mei_sysfs_root(), device);
+	if (rc < 0 || rc >= FWSTS_FILENAME_LEN)
 		return -EINVAL;
-	path[FWSTS_FILENAME_LEN - 1] = '\0';
 
 	errno = 0;
 	fd = open(path, O_CLOEXEC, O_RDONLY);
@@ -263,8 +325,9 @@ static inline int __mei_fwsts(struct mei *me, const char *device,
 	return 0;
 }
 
-int mei_init(struct mei *me, const char *device, const uuid_le *guid,
-		unsigned char req_protocol_version, bool verbose)
+static int __mei_init(struct mei *me, const char *device, const uuid_le *guid,
+		      unsigned char req_protocol_version, bool verbose,
+		      bool device_static)
 {
 	int rc;
 
@@ -275,6 +338,7 @@ int mei_init(struct mei *me, const char *device, const uuid_le *guid,
 	me->fd = -1;
 	me->close_on_exit = true;
 	me->device = NULL;
+	me->device_static = false;
 	mei_deinit(me);
 
 	me->log_level = verbose ? MEI_LOG_LEVEL_VERBOSE : MEI_LOG_LEVEL_ERROR;
@@ -294,10 +358,15 @@ int mei_init(struct mei *me, const char *device, const uuid_le *guid,
 
 	memcpy(&me->guid, guid, sizeof(*guid));
 	me->prot_ver = req_protocol_version;
-	me->device = strdup(device);
-	if (!me->device) {
-		mei_deinit(me);
-		return -ENOMEM;
+	if (device_static) {
+		me->device = (char *)device;
+		me->device_static = true;
+	} else {
+		me->device = strdup(device);
+		if (!me->device) {
+			mei_deinit(me);
+			return -ENOMEM;
+		}
 	}
 
 	me->state = MEI_CL_STATE_INITIALIZED;
@@ -305,6 +374,18 @@ int mei_init(struct mei *me, const char *device, const uuid_le *guid,
 	return 0;
 }
 
+int mei_init(struct mei *me, const char *device, const uuid_le *guid,
+		unsigned char req_protocol_version, bool verbose)
+{
+	return __mei_init(me, device, guid, req_protocol_version, verbose, false);
+}
+
+int mei_init_static_device(struct mei *me, const char *device, const uuid_le *guid,
+		unsigned char req_protocol_version, bool verbose)
+{
+	return __mei_init(me, device, guid, req_protocol_version, verbose, true);
+}
+
 static int __mei_fd_to_devname(struct mei *me, int fd)
 {
 	char name[PATH_MAX];
@@ -355,6 +436,7 @@ int mei_init_fd(struct mei *me, int fd, const uuid_le *guid,
 	/* if me is uninitialized it will close wrong file descriptor */
 	me->close_on_exit = false;
 	me->device = NULL;
+	me->device_static = false;
 	mei_deinit(me);
 	me->fd = fd;
 
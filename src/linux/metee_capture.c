@@ -0,0 +1,390 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2023 Intel Corporation
+ */
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "metee.h"
+#include "helpers.h"
+#include "metee_capture.h"
+
+/* number of ring slots, must be power of two */
+#define TEE_CAPTURE_RING_SIZE 512
+#define TEE_CAPTURE_RING_MASK (TEE_CAPTURE_RING_SIZE - 1)
+
+/* writer thread sleep when the ring is empty */
+#define TEE_CAPTURE_IDLE_NS 1000000
+
+/* number of producer counters, must be power of two */
+#define TEE_CAPTURE_USERS 64
+#define TEE_CAPTURE_USERS_MASK (TEE_CAPTURE_USERS - 1)
+
+#define NSEC_IN_SEC 1000000000ULL
+
+#define PCAPNG_SHB 0x0A0D0D0AU
+#define PCAPNG_IDB 0x00000001U
+#define PCAPNG_EPB 0x00000006U
+#define PCAPNG_BYTE_ORDER_MAGIC 0x1A2B3C4DU
+#define PCAPNG_OPT_ENDOFOPT 0
+#define PCAPNG_OPT_IF_TSRESOL 9
+
+/*
+ * Bounded multi-producer ring with per-slot sequence numbers.
+ * A slot is free for position pos when seq == pos,
+ * and holds a record for the writer when seq == pos + 1.
+ */
+struct tee_capture_slot {
+	uint64_t seq;                 /**< slot sequence */
+	uint64_t ns;                  /**< CLOCK_REALTIME timestamp */
+	uint32_t caplen;              /**< captured payload length */
+	struct tee_capture_hdr hdr;   /**< record header */
+	uint8_t data[TEE_CAPTURE_SNAPLEN]; /**< payload */
+};
+
+/*
+ * Counter of producers inside the ring, one per cache line.
+ * A thread always counts itself in the same counter, so producers
+ * on different threads do not bounce a shared line per message.
+ */
+struct tee_capture_users {
+	unsigned int n;       /**< producers inside the ring */
+} __attribute__((aligned(64)));
+
+struct tee_capture {
+	struct tee_capture_slot *slots; /**< ring slots */
+	uint64_t enqueue;     /**< next position for producers */
+	uint64_t dequeue;     /**< next position for the writer */
+	uint64_t dropped;     /**< records dropped on full ring */
+	bool running;         /**< writer thread should continue */
+	pthread_t thread;     /**< writer thread */
+	FILE *fp;             /**< current file */
+	char path[PATH_MAX];  /**< file name */
+	size_t max_file_size; /**< rotation threshold, 0 for no limit */
+	uint32_t max_files;   /**< number of files to keep */
+	size_t file_size;     /**< bytes in the current file */
+};
+
+bool tee_capture_enabled;
+
+static struct tee_capture tee_capture;
+static struct tee_capture_users tee_capture_users[TEE_CAPTURE_USERS];
+static __thread struct tee_capture_users *tee_capture_user;
+static unsigned int tee_capture_threads;
+static pthread_mutex_t tee_capture_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void __tee_capture(const void *handle, const GUID *guid, uint8_t direction,
+		   const void *data, size_t len)
+{
+	struct tee_capture *c = &tee_capture;
+	struct tee_capture_users *user = tee_capture_user;
+	struct tee_capture_slot *slot;
+	struct timespec ts;
+	uint64_t pos, seq;
+
+	if (!user) {
+		user = &tee_capture_users[__atomic_fetch_add(&tee_capture_threads, 1,
+							     __ATOMIC_RELAXED) &
+					  TEE_CAPTURE_USERS_MASK];
+		tee_capture_user = user;
+	}
+
+	__atomic_add_fetch(&user->n, 1, __ATOMIC_SEQ_CST);
+	if (!__atomic_load_n(&tee_capture_enabled, __ATOMIC_SEQ_CST))
+		goto out;
+
+	pos = __atomic_load_n(&c->enqueue, __ATOMIC_RELAXED);
+	for (;;) {
+		slot = &c->slots[pos & TEE_CAPTURE_RING_MASK];
+		seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+		if (seq == pos) {
+			if (__atomic_compare_exchange_n(&c->enqueue, &pos, pos + 1, true,
+							__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		} else if ((int64_t)(seq - pos) < 0) {
+			__atomic_add_fetch(&c->dropped, 1, __ATOMIC_RELAXED);
+			goto out;
+		} else {
+			pos = __atomic_load_n(&c->enqueue, __ATOMIC_RELAXED);
+		}
+	}
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	slot->ns = (uint64_t)ts.tv_sec * NSEC_IN_SEC + ts.tv_nsec;
+	slot->caplen = (len > TEE_CAPTURE_SNAPLEN) ? TEE_CAPTURE_SNAPLEN : (uint32_t)len;
+	slot->hdr.version = TEE_CAPTURE_VERSION;
+	slot->hdr.direction = direction;
+	slot->hdr.reserved = 0;
+	slot->hdr.length = (len > UINT32_MAX) ? UINT32_MAX : (uint32_t)len;
+	slot->hdr.handle = (uintptr_t)handle;
+	memcpy(slot->hdr.guid, guid, sizeof(slot->hdr.guid));
+	if (slot->caplen)
+		memcpy(slot->data, data, slot->caplen);
+	__atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+
+out:
+	__atomic_sub_fetch(&user->n, 1, __ATOMIC_RELEASE);
+}
+
+static int tee_capture_put(struct tee_capture *c, const void *data, size_t len)
+{
+	if (fwrite(data, 1, len, c->fp) != len)
+		return -1;
+	c->file_size += len;
+	return 0;
+}
+
+#pragma pack(push, 1)
+struct pcapng_shb {
+	uint32_t type;         /**< PCAPNG_SHB */
+	uint32_t len;          /**< block length */
+	uint32_t magic;        /**< PCAPNG_BYTE_ORDER_MAGIC */
+	uint16_t major;        /**< format major version */
+	uint16_t minor;        /**< format minor version */
+	int64_t section_len;   /**< section length, -1 for unknown */
+	uint32_t len2;         /**< block length */
+};
+
+struct pcapng_idb {
+	uint32_t type;         /**< PCAPNG_IDB */
+	uint32_t len;          /**< block length */
+	uint16_t linktype;     /**< link type */
+	uint16_t reserved;     /**< zero */
+	uint32_t snaplen;      /**< maximal packet length */
+	uint16_t tsresol_code; /**< PCAPNG_OPT_IF_TSRESOL */
+	uint16_t tsresol_len;  /**< option length */
+	uint8_t tsresol;       /**< timestamp resolution, power of 10 */
+	uint8_t pad[3];        /**< option padding */
+	uint16_t end_code;     /**< PCAPNG_OPT_ENDOFOPT */
+	uint16_t end_len;      /**< zero */
+	uint32_t len2;         /**< block length */
+};
+#pragma pack(pop)
+
+static int tee_capture_header(struct tee_capture *c)
+{
+	const struct pcapng_shb shb = {
+		.type = PCAPNG_SHB,
+		.len = sizeof(shb),
+		.magic = PCAPNG_BYTE_ORDER_MAGIC,
+		.major = 1,
+		.minor = 0,
+		.section_len = -1,
+		.len2 = sizeof(shb),
+	};
+	const struct pcapng_idb idb = {
+		.type = PCAPNG_IDB,
+		.len = sizeof(idb),
+		.linktype = TEE_CAPTURE_LINKTYPE,
+		.snaplen = TEE_CAPTURE_SNAPLEN + sizeof(struct tee_capture_hdr),
+		.tsresol_code = PCAPNG_OPT_IF_TSRESOL,
+		.tsresol_len = 1,
+		.tsresol = 9, /* nanoseconds */
+		.end_code = PCAPNG_OPT_ENDOFOPT,
+		.len2 = sizeof(idb),
+	};
+
+	if (tee_capture_put(c, &shb, sizeof(shb)) ||
+	    tee_capture_put(c, &idb, sizeof(idb)))
+		return -1;
+	return 0;
+}
+
+static int tee_capture_open(struct tee_capture *c)
+{
+	c->fp = fopen(c->path, "we");
+	if (!c->fp)
+		return -errno;
+	c->file_size = 0;
+	if (tee_capture_header(c)) {
+		fclose(c->fp);
+		c->fp = NULL;
+		return -EIO;
+	}
+	return 0;
+}
+
+static int tee_capture_rotate(struct tee_capture *c)
+{
+	char from[PATH_MAX + 16], to[PATH_MAX + 16];
+	uint32_t i;
+
+	fclose(c->fp);
+	c->fp = NULL;
+
+	for (i = c->max_files - 1; i > 0; i--) {
+		if (i == 1)
+			snprintf(from, sizeof(from), "%s", c->path);
+		else
+			snprintf(from, sizeof(from), "%s.%u", c->path, i - 1);
+		snprintf(to, sizeof(to), "%s.%u", c->path, i);
+		rename(from, to);
+	}
+
+	return tee_capture_open(c);
+}
+
+static int tee_capture_write(struct tee_capture *c, struct tee_capture_slot *slot)
+{
+	static const uint8_t pad[4] = { 0 };
+	uint32_t caplen = sizeof(slot->hdr) + slot->caplen;
+	uint32_t padded = (caplen + 3) & ~3U;
+	uint32_t total = 32 + padded;
+	uint32_t epb[7];
+
+	if (c->max_file_size && c->file_size + total > c->max_file_size &&
+	    tee_capture_rotate(c))
+		return -1;
+
+	epb[0] = PCAPNG_EPB;
+	epb[1] = total;
+	epb[2] = 0; /* interface */
+	epb[3] = (uint32_t)(slot->ns >> 32);
+	epb[4] = (uint32_t)slot->ns;
+	epb[5] = caplen;
+	epb[6] = sizeof(slot->hdr) + slot->hdr.length;
+
+	if (tee_capture_put(c, epb, sizeof(epb)) ||
+	    tee_capture_put(c, &slot->hdr, sizeof(slot->hdr)) ||
+	    tee_capture_put(c, slot->data, slot->caplen) ||
+	    tee_capture_put(c, pad, padded - caplen) ||
+	    tee_capture_put(c, &total, sizeof(total)))
+		return -1;
+	return 0;
+}
+
+/* write out all published records, returns number of records */
+static unsigned int tee_capture_drain(struct tee_capture *c)
+{
+	struct tee_capture_slot *slot;
+	unsigned int n = 0;
+
+	for (;;) {
+		slot = &c->slots[c->dequeue & TEE_CAPTURE_RING_MASK];
+		if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != c->dequeue + 1)
+			break;
+		if (c->fp)
+			tee_capture_write(c, slot);
+		__atomic_store_n(&slot->seq, c->dequeue + TEE_CAPTURE_RING_SIZE,
+				 __ATOMIC_RELEASE);
+		c->dequeue++;
+		n++;
+	}
+	return n;
+}
+
+static void *tee_capture_thread(void *arg)
+{
+	struct tee_capture *c = arg;
+	const struct timespec idle = { 0, TEE_CAPTURE_IDLE_NS };
+
+	while (__atomic_load_n(&c->running, __ATOMIC_ACQUIRE)) {
+		if (!tee_capture_drain(c)) {
+			if (c->fp)
+				fflush(c->fp);
+			nanosleep(&idle, NULL);
+		}
+	}
+	tee_capture_drain(c);
+
+	return NULL;
+}
+
+TEESTATUS TEEAPI TeeCaptureStart(IN const char *path, IN size_t max_file_size,
+				 IN uint32_t max_files)
+{
+	struct tee_capture *c = &tee_capture;
+	TEESTATUS status;
+	uint64_t i;
+	int rc;
+
+	if (!path || strlen(path) >= sizeof(c->path))
+		return TEE_INVALID_PARAMETER;
+
+	pthread_mutex_lock(&tee_capture_lock);
+	if (c->slots) {
+		status = TEE_BUSY;
+		goto out;
+	}
+
+	c->slots = calloc(TEE_CAPTURE_RING_SIZE, sizeof(*c->slots));
+	if (!c->slots) {
+		status = TEE_INTERNAL_ERROR;
+		goto out;
+	}
+	for (i = 0; i < TEE_CAPTURE_RING_SIZE; i++)
+		c->slots[i].seq = i;
+	c->enqueue = 0;
+	c->dequeue = 0;
+	c->dropped = 0;
+	c->max_file_size = max_file_size;
+	c->max_files = max_files ? max_files : 1;
+	strcpy(c->path, path);
+
+	rc = tee_capture_open(c);
+	if (rc) {
+		status = (rc == -EACCES) ? TEE_PERMISSION_DENIED : TEE_UNABLE_TO_COMPLETE_OPERATION;
+		goto err;
+	}
+
+	c->running = true;
+	if (pthread_create(&c->thread, NULL, tee_capture_thread, c)) {
+		status = TEE_INTERNAL_ERROR;
+		fclose(c->fp);
+		c->fp = NULL;
+		goto err;
+	}
+
+	__atomic_store_n(&tee_capture_enabled, true, __ATOMIC_SEQ_CST);
+	status = TEE_SUCCESS;
+	goto out;
+
+err:
+	free(c->slots);
+	c->slots = NULL;
+out:
+	pthread_mutex_unlock(&tee_capture_lock);
+	return status;
+}
+
+TEESTATUS TEEAPI TeeCaptureStop(OUT OPTIONAL uint64_t *dropped)
+{
+	struct tee_capture *c = &tee_capture;
+	TEESTATUS status = TEE_SUCCESS;
+	unsigned int i;
+
+	pthread_mutex_lock(&tee_capture_lock);
+	if (!c->slots) {
+		status = TEE_INVALID_PARAMETER;
+		goto out;
+	}
+
+	/* wait for producers that have seen the recorder enabled */
+	__atomic_store_n(&tee_capture_enabled, false, __ATOMIC_SEQ_CST);
+	for (i = 0; i < TEE_CAPTURE_USERS; i++)
+		while (__atomic_load_n(&tee_capture_users[i].n, __ATOMIC_SEQ_CST))
+			sched_yield();
+
+	__atomic_store_n(&c->running, false, __ATOMIC_RELEASE);
+	pthread_join(c->thread, NULL);
+
+	if (c->fp && fclose(c->fp))
+		status = TEE_UNABLE_TO_COMPLETE_OPERATION;
+	c->fp = NULL;
+	free(c->slots);
+	c->slots = NULL;
+
+	if (dropped)
+		*dropped = c->dropped;
+out:
+	pthread_mutex_unlock(&tee_capture_lock);
+	return status;
+}
@@ -0,0 +1,24 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2023 Intel Corporation
+ */
+#ifndef __METEE_CAPTURE_H
+#define __METEE_CAPTURE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "metee.h"
+
+extern bool tee_capture_enabled;
+
+void __tee_capture(const void *handle, const GUID *guid, uint8_t direction,
+		   const void *data, size_t len);
+
+/* record the payload when the recorder runs */
+#define TEE_CAPTURE(h, guid, dir, data, len) do {                      \
+	if (__atomic_load_n(&tee_capture_enabled, __ATOMIC_RELAXED))   \
+		__tee_capture((h), (guid), (dir), (data), (len));      \
+} while (0)
+
+#endif /* __METEE_CAPTURE_H */
@@ -0,0 +1,102 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2023 Intel Corporation
+ */
+/*
+ * Time source of the library: the timestamps of the statistics and the
+ * waits of the emulated devices. Tests replace it with a virtual clock
+ * moved by TeeClockVirtualAdvance and by the waits themselves, so the
+ * timeout paths complete instantly.
+ */
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "metee.h"
+#include "metee_clock.h"
+
+#define NSEC_IN_SEC 1000000000ULL
+
+static bool tee_clock_virtual;
+static uint64_t tee_clock_virtual_ns;
+
+static uint64_t tee_clock_real(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * NSEC_IN_SEC + ts.tv_nsec;
+}
+
+bool tee_clock_is_virtual(void)
+{
+	return __atomic_load_n(&tee_clock_virtual, __ATOMIC_ACQUIRE);
+}
+
+uint64_t tee_clock_now(void)
+{
+	if (tee_clock_is_virtual())
+		return __atomic_load_n(&tee_clock_virtual_ns, __ATOMIC_ACQUIRE);
+	return tee_clock_real();
+}
+
+/* concurrent waiters leave the clock at the latest deadline */
+static void tee_clock_virtual_advance_to(uint64_t deadline)
+{
+	uint64_t cur = __atomic_load_n(&tee_clock_virtual_ns, __ATOMIC_RELAXED);
+
+	while (cur < deadline &&
+	       !__atomic_compare_exchange_n(&tee_clock_virtual_ns, &cur, deadline, false,
+					    __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+		;
+}
+
+void tee_clock_wait_until(uint64_t deadline)
+{
+	struct timespec ts;
+
+	if (tee_clock_is_virtual()) {
+		tee_clock_virtual_advance_to(deadline);
+		return;
+	}
+
+	/* sleeping to a past deadline still pays the timer slack */
+	if (tee_clock_real() >= deadline)
+		return;
+
+	ts.tv_sec = deadline / NSEC_IN_SEC;
+	ts.tv_nsec = deadline % NSEC_IN_SEC;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+		;
+}
+
+TEESTATUS TEEAPI TeeClockVirtualStart(IN uint64_t start)
+{
+	if (tee_clock_is_virtual())
+		return TEE_BUSY;
+
+	__atomic_store_n(&tee_clock_virtual_ns, start ? start : tee_clock_real(),
+			 __ATOMIC_RELAXED);
+	__atomic_store_n(&tee_clock_virtual, true, __ATOMIC_RELEASE);
+	return TEE_SUCCESS;
+}
+
+void TEEAPI TeeClockVirtualStop(void)
+{
+	__atomic_store_n(&tee_clock_virtual, false, __ATOMIC_RELEASE);
+}
+
+TEESTATUS TEEAPI TeeClockVirtualAdvance(IN uint64_t ns)
+{
+	if (!tee_clock_is_virtual())
+		return TEE_NOTSUPPORTED;
+
+	__atomic_fetch_add(&tee_clock_virtual_ns, ns, __ATOMIC_ACQ_REL);
+	return TEE_SUCCESS;
+}
+
+uint64_t TEEAPI TeeClockNow(void)
+{
+	return tee_clock_now();
+}
@@ -0,0 +1,20 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2023 Intel Corporation
+ */
+#ifndef __METEE_CLOCK_H
+#define __METEE_CLOCK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* nanoseconds of CLOCK_MONOTONIC or of the virtual clock */
+uint64_t tee_clock_now(void);
+
+/* the virtual clock replaces CLOCK_MONOTONIC */
+bool tee_clock_is_virtual(void);
+
+/* sleep until the deadline, the virtual clock just advances to it */
+void tee_clock_wait_until(uint64_t deadline);
+
+#endif /* __METEE_CLOCK_H */
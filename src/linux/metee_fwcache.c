@@ -0,0 +1,455 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2023 Intel Corporation
+ */
+/*
+ * Process shared cache of the firmware version, a small file mapped by
+ * every process that asks for the version.
+ * An entry is keyed by the device and by what identifies the running
+ * firmware: the kernel boot id, the fw_ver attribute that the driver
+ * reads on every reset, and the reset fields of the first firmware
+ * status register. A reset or an update changes the key and the next
+ * caller refetches.
+ * A lookup takes no lock: every entry has a sequence count that is odd
+ * while the entry is stored, the reader copies the entry word by word
+ * and takes it only if the count is even and did not change meanwhile.
+ * Stores are serialized by a byte-range lock and take no longer than
+ * the copy. On a miss the caller takes the query lock of the device, a
+ * byte-range lock of its own, looks again and queries MKHI holding it,
+ * so callers that miss together wait for one query instead of each
+ * sending their own. The wait is bounded: a caller that does not get
+ * the query lock in time queries for itself without storing the result.
+ * The locks are open file description locks, so threads of a process
+ * exclude each other as processes do, and they go away with the process.
+ * A process that cannot open the file does not use the cache and queries
+ * every time.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <libmei.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "metee.h"
+#include "metee_mkhi.h"
+#include "metee_fwcache.h"
+
+#define TEE_FWCACHE_PATH "/run/metee-fwcache"
+#define TEE_FWCACHE_BOOT_ID "/proc/sys/kernel/random/boot_id"
+#define TEE_FWCACHE_MAGIC 0x43465754 /* "TWFC" */
+#define TEE_FWCACHE_VERSION 3
+#define TEE_FWCACHE_ENTRIES 16
+
+/* byte-range locks: the store lock, then the query locks of the devices */
+#define TEE_FWCACHE_LOCK_STORE 0
+#define TEE_FWCACHE_LOCK_QUERY 1
+#define TEE_FWCACHE_QUERY_LOCKS 64
+
+/* waiting for the query of another caller, when the caller has no timeout */
+#define TEE_FWCACHE_WAIT_MS 1000
+#define TEE_FWCACHE_POLL_NS 1000000L
+
+/* reads of an entry racing with stores before the entry counts as a miss */
+#define TEE_FWCACHE_READ_TRIES 16
+
+/*
+ * fields of the first status register that change on a reset: the
+ * operation mode and the reset count; the working and operation state,
+ * the init complete and update in progress bits change while the
+ * firmware runs
+ */
+#define TEE_FWCACHE_FWSTS_MASK 0x00FF0000
+
+/* attributes are short, longer ones are truncated */
+#define TEE_FWCACHE_ATTR_LEN 256
+
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+struct tee_fwcache_record {
+	struct tee_fwcache_key key;
+	struct tee_mkhi_fw_version version;
+	uint32_t valid;  /* entry is used */
+	uint32_t stamp;  /* order of the stores, the oldest entry is replaced */
+};
+
+struct tee_fwcache_entry {
+	uint32_t seq;    /* odd while the record is stored */
+	uint32_t reserved;
+	struct tee_fwcache_record record;
+};
+
+#define TEE_FWCACHE_RECORD_WORDS (sizeof(struct tee_fwcache_record) / sizeof(uint32_t))
+
+/* a record as the words it is copied in */
+union tee_fwcache_copy {
+	struct tee_fwcache_record record;
+	uint32_t words[TEE_FWCACHE_RECORD_WORDS];
+};
+
+struct tee_fwcache_file {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t stamp;  /* stamp of the last store */
+	uint32_t reserved;
+	struct tee_fwcache_entry entries[TEE_FWCACHE_ENTRIES];
+};
+
+/* METEE_FWCACHE replaces the path, ignored in setuid and setgid programs */
+static const char *tee_fwcache_path(void)
+{
+	const char *path = NULL;
+
+	if (getuid() == geteuid() && getgid() == getegid())
+		path = getenv("METEE_FWCACHE");
+
+	return (path && path[0]) ? path : TEE_FWCACHE_PATH;
+}
+
+static int tee_fwcache_read_attr(const char *path, char *buf, size_t size)
+{
+	ssize_t len;
+	int fd;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		return -errno;
+	len = read(fd, buf, size - 1);
+	close(fd);
+	if (len < 0)
+		return -EIO;
+	buf[len] = '\0';
+	return (int)len;
+}
+
+static int tee_fwcache_read_sysfs(const char *name, const char *attr,
+				  char *buf, size_t size)
+{
+	char path[PATH_MAX];
+	int rc;
+
+	rc = snprintf(path, sizeof(path), "%s/class/mei/%s/%s",
+		      mei_sysfs_root(), name, attr);
+	if (rc < 0 || rc >= (int)sizeof(path))
+		return -EINVAL;
+	return tee_fwcache_read_attr(path, buf, size);
+}
+
+/* the boot id does not change while the process runs */
+static char tee_fwcache_boot_id[TEE_FWCACHE_BOOT_ID_LEN];
+static pthread_once_t tee_fwcache_boot_id_once = PTHREAD_ONCE_INIT;
+
+static void tee_fwcache_boot_id_read(void)
+{
+	char buf[TEE_FWCACHE_ATTR_LEN];
+	int len;
+
+	len = tee_fwcache_read_attr(TEE_FWCACHE_BOOT_ID, buf, sizeof(buf));
+	if (len <= 0)
+		return;
+	len = (int)strcspn(buf, "\n");
+	if (len >= (int)sizeof(tee_fwcache_boot_id))
+		len = sizeof(tee_fwcache_boot_id) - 1;
+	memcpy(tee_fwcache_boot_id, buf, len);
+}
+
+bool tee_fwcache_key(PTEEHANDLE handle, struct tee_fwcache_key *key)
+{
+	char buf[TEE_FWCACHE_ATTR_LEN];
+	const char *device = tee_handle_device(handle);
+	const char *name;
+	uint64_t hash;
+	int len;
+	int i;
+
+	if (!device || strlen(device) >= sizeof(key->device))
+		return false;
+
+	memset(key, 0, sizeof(*key));
+	strcpy(key->device, device);
+	name = strrchr(device, '/');
+	name = (name) ? name + 1 : device;
+
+	/* the driver is resetting or the device is gone */
+	len = tee_fwcache_read_sysfs(name, "dev_state", buf, sizeof(buf));
+	if (len >= 0 && strcmp(buf, "ENABLED\n") && strcmp(buf, "ENABLED"))
+		return false;
+
+	if (TeeFWStatus(handle, 0, &key->fwsts) != TEE_SUCCESS)
+		return false;
+	key->fwsts &= TEE_FWCACHE_FWSTS_MASK;
+
+	len = tee_fwcache_read_sysfs(name, "fw_ver", buf, sizeof(buf));
+	if (len >= 0) {
+		hash = FNV_OFFSET;
+		for (i = 0; i < len; i++)
+			hash = (hash ^ (uint8_t)buf[i]) * FNV_PRIME;
+		key->fw_ver = hash;
+	}
+
+	pthread_once(&tee_fwcache_boot_id_once, tee_fwcache_boot_id_read);
+	memcpy(key->boot_id, tee_fwcache_boot_id, sizeof(key->boot_id));
+	return true;
+}
+
+static uint64_t tee_fwcache_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* exclusive lock of one byte, F_UNLCK drops it */
+static int tee_fwcache_setlk(int fd, off_t start, short type, bool wait)
+{
+	struct flock fl;
+	int rc;
+
+	memset(&fl, 0, sizeof(fl));
+	fl.l_type = type;
+	fl.l_whence = SEEK_SET;
+	fl.l_start = start;
+	fl.l_len = 1;
+	do {
+		rc = fcntl(fd, (wait) ? F_OFD_SETLKW : F_OFD_SETLK, &fl);
+	} while (rc == -1 && wait && errno == EINTR);
+	return rc;
+}
+
+/* the record is copied word by word, another process may store it meanwhile */
+static bool tee_fwcache_read(const struct tee_fwcache_entry *e,
+			     union tee_fwcache_copy *copy)
+{
+	const uint32_t *src = (const uint32_t *)&e->record;
+	uint32_t seq;
+	size_t i;
+	int tries;
+
+	for (tries = 0; tries < TEE_FWCACHE_READ_TRIES; tries++) {
+		seq = __atomic_load_n(&e->seq, __ATOMIC_ACQUIRE);
+		if (seq & 1)
+			continue;
+		for (i = 0; i < TEE_FWCACHE_RECORD_WORDS; i++)
+			copy->words[i] = __atomic_load_n(&src[i], __ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&e->seq, __ATOMIC_RELAXED) == seq)
+			return true;
+	}
+	return false;
+}
+
+/* under the store lock; an odd count is left by a process that died storing */
+static void tee_fwcache_write(struct tee_fwcache_entry *e,
+			      const struct tee_fwcache_record *record)
+{
+	const uint32_t *src = (const uint32_t *)record;
+	uint32_t *dst = (uint32_t *)&e->record;
+	uint32_t seq = __atomic_load_n(&e->seq, __ATOMIC_RELAXED) | 1;
+	size_t i;
+
+	/* release orders the odd count before the words, acquire in the reader
+	 * orders the words before the second look at the count */
+	__atomic_store_n(&e->seq, seq, __ATOMIC_RELAXED);
+	for (i = 0; i < TEE_FWCACHE_RECORD_WORDS; i++)
+		__atomic_store_n(&dst[i], src[i], __ATOMIC_RELEASE);
+	__atomic_store_n(&e->seq, seq + 1, __ATOMIC_RELEASE);
+}
+
+static bool tee_fwcache_valid(const struct tee_fwcache_file *file)
+{
+	return __atomic_load_n(&file->magic, __ATOMIC_ACQUIRE) == TEE_FWCACHE_MAGIC &&
+	       __atomic_load_n(&file->version, __ATOMIC_RELAXED) == TEE_FWCACHE_VERSION;
+}
+
+/* a file of another layout is reset under the store lock */
+static bool tee_fwcache_init(struct tee_fwcache_file *file, int fd)
+{
+	struct tee_fwcache_record empty;
+	int i;
+
+	if (tee_fwcache_valid(file))
+		return true;
+	if (tee_fwcache_setlk(fd, TEE_FWCACHE_LOCK_STORE, F_WRLCK, true))
+		return false;
+	if (!tee_fwcache_valid(file)) {
+		__atomic_store_n(&file->magic, 0, __ATOMIC_RELAXED);
+		memset(&empty, 0, sizeof(empty));
+		for (i = 0; i < TEE_FWCACHE_ENTRIES; i++)
+			tee_fwcache_write(&file->entries[i], &empty);
+		file->stamp = 0;
+		__atomic_store_n(&file->version, TEE_FWCACHE_VERSION, __ATOMIC_RELAXED);
+		__atomic_store_n(&file->magic, TEE_FWCACHE_MAGIC, __ATOMIC_RELEASE);
+	}
+	tee_fwcache_setlk(fd, TEE_FWCACHE_LOCK_STORE, F_UNLCK, false);
+	return true;
+}
+
+static struct tee_fwcache_file *tee_fwcache_map(int fd, bool write)
+{
+	struct tee_fwcache_file *file;
+	struct stat st;
+	int prot = (write) ? PROT_READ | PROT_WRITE : PROT_READ;
+
+	if (fstat(fd, &st))
+		return NULL;
+	if (st.st_size < (off_t)sizeof(*file) &&
+	    (!write || ftruncate(fd, sizeof(*file))))
+		return NULL;
+
+	file = mmap(NULL, sizeof(*file), prot, MAP_SHARED, fd, 0);
+	if (file == MAP_FAILED)
+		return NULL;
+
+	if ((write) ? !tee_fwcache_init(file, fd) : !tee_fwcache_valid(file)) {
+		munmap(file, sizeof(*file));
+		return NULL;
+	}
+	return file;
+}
+
+static bool tee_fwcache_lookup(const struct tee_fwcache_file *file,
+			       const struct tee_fwcache_key *key,
+			       struct tee_mkhi_fw_version *version)
+{
+	union tee_fwcache_copy copy;
+	int i;
+
+	for (i = 0; i < TEE_FWCACHE_ENTRIES; i++) {
+		if (tee_fwcache_read(&file->entries[i], &copy) && copy.record.valid &&
+		    !memcmp(&copy.record.key, key, sizeof(*key))) {
+			*version = copy.record.version;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool tee_fwcache_get(const struct tee_fwcache_key *key,
+		     struct tee_mkhi_fw_version *version)
+{
+	struct tee_fwcache_file *file;
+	bool found;
+	int fd;
+
+	fd = open(tee_fwcache_path(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+	if (fd == -1)
+		return false;
+	file = tee_fwcache_map(fd, false);
+	close(fd);
+	if (!file)
+		return false;
+
+	found = tee_fwcache_lookup(file, key, version);
+	munmap(file, sizeof(*file));
+	return found;
+}
+
+/* query lock of the device, devices sharing one only wait longer */
+static off_t tee_fwcache_query_lock(const struct tee_fwcache_key *key)
+{
+	uint64_t hash = FNV_OFFSET;
+	size_t i;
+
+	for (i = 0; i < sizeof(key->device) && key->device[i]; i++)
+		hash = (hash ^ (uint8_t)key->device[i]) * FNV_PRIME;
+	return TEE_FWCACHE_LOCK_QUERY + (off_t)(hash % TEE_FWCACHE_QUERY_LOCKS);
+}
+
+enum tee_fwcache_state tee_fwcache_lock(struct tee_fwcache *cache,
+					const struct tee_fwcache_key *key,
+					struct tee_mkhi_fw_version *version,
+					uint32_t timeout)
+{
+	const struct timespec poll = { 0, TEE_FWCACHE_POLL_NS };
+	off_t lock = tee_fwcache_query_lock(key);
+	uint64_t deadline;
+
+	cache->file = NULL;
+	cache->fd = open(tee_fwcache_path(), O_RDWR | O_CREAT | O_CLOEXEC | O_NOFOLLOW, 0644);
+	if (cache->fd == -1)
+		return TEE_FWCACHE_BYPASS;
+
+	/* another caller is querying the device, its result is expected soon */
+	deadline = tee_fwcache_now() +
+		   (uint64_t)((timeout) ? timeout : TEE_FWCACHE_WAIT_MS) * 1000000ULL;
+	while (tee_fwcache_setlk(cache->fd, lock, F_WRLCK, false)) {
+		if ((errno != EAGAIN && errno != EACCES) || tee_fwcache_now() >= deadline)
+			goto bypass;
+		nanosleep(&poll, NULL);
+		if (tee_fwcache_get(key, version)) {
+			close(cache->fd);
+			cache->fd = -1;
+			return TEE_FWCACHE_HIT;
+		}
+	}
+
+	cache->file = tee_fwcache_map(cache->fd, true);
+	if (!cache->file)
+		goto bypass;
+	if (tee_fwcache_lookup(cache->file, key, version)) {
+		tee_fwcache_unlock(cache);
+		return TEE_FWCACHE_HIT;
+	}
+	return TEE_FWCACHE_LOCKED;
+
+bypass:
+	close(cache->fd);
+	cache->fd = -1;
+	return TEE_FWCACHE_BYPASS;
+}
+
+/* closing the descriptor drops the query lock */
+void tee_fwcache_unlock(struct tee_fwcache *cache)
+{
+	if (cache->file)
+		munmap(cache->file, sizeof(*cache->file));
+	close(cache->fd);
+	cache->file = NULL;
+	cache->fd = -1;
+}
+
+void tee_fwcache_put(struct tee_fwcache *cache,
+		     const struct tee_fwcache_key *key,
+		     const struct tee_mkhi_fw_version *version)
+{
+	struct tee_fwcache_file *file = cache->file;
+	struct tee_fwcache_entry *slot = NULL;
+	struct tee_fwcache_record *e;
+	struct tee_fwcache_record record;
+	int i;
+
+	if (tee_fwcache_setlk(cache->fd, TEE_FWCACHE_LOCK_STORE, F_WRLCK, true))
+		return;
+
+	/* the entry of the device, else a free one, else the oldest */
+	for (i = 0; i < TEE_FWCACHE_ENTRIES; i++) {
+		e = &file->entries[i].record;
+		if (e->valid && !strncmp(e->key.device, key->device, sizeof(key->device))) {
+			slot = &file->entries[i];
+			break;
+		}
+		if (!slot || (slot->record.valid && (!e->valid ||
+		    (uint32_t)(file->stamp - e->stamp) >
+		    (uint32_t)(file->stamp - slot->record.stamp))))
+			slot = &file->entries[i];
+	}
+
+	memset(&record, 0, sizeof(record));
+	record.key = *key;
+	record.version = *version;
+	record.valid = 1;
+	record.stamp = ++file->stamp;
+	tee_fwcache_write(slot, &record);
+
+	tee_fwcache_setlk(cache->fd, TEE_FWCACHE_LOCK_STORE, F_UNLCK, false);
+}
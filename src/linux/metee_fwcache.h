@@ -0,0 +1,66 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2023 Intel Corporation
+ */
+#ifndef __METEE_FWCACHE_H
+#define __METEE_FWCACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "metee.h"
+#include "metee_mkhi.h"
+
+#define TEE_FWCACHE_DEVICE_LEN 128
+#define TEE_FWCACHE_BOOT_ID_LEN 40
+
+/* identity of the firmware a cached version belongs to, compared as bytes */
+struct tee_fwcache_key {
+	char device[TEE_FWCACHE_DEVICE_LEN];   /* device path */
+	char boot_id[TEE_FWCACHE_BOOT_ID_LEN]; /* kernel boot id, empty if unknown */
+	uint64_t fw_ver;                       /* hash of the fw_ver attribute, 0 if missing */
+	uint32_t fwsts;                        /* reset fields of the first firmware status register */
+	uint32_t reserved;                     /* zero */
+};
+
+/* interned device path of the handle, NULL if not known */
+const char *tee_handle_device(PTEEHANDLE handle);
+
+/* key of the running firmware, false if the device is not in a state to cache */
+bool tee_fwcache_key(PTEEHANDLE handle, struct tee_fwcache_key *key);
+
+struct tee_fwcache_file;
+
+/* cache held under the query lock of a device */
+struct tee_fwcache {
+	struct tee_fwcache_file *file;
+	int fd;
+};
+
+/* result of tee_fwcache_lock */
+enum tee_fwcache_state {
+	TEE_FWCACHE_BYPASS, /* the cache is not usable now, query without it */
+	TEE_FWCACHE_HIT,    /* another caller stored the version */
+	TEE_FWCACHE_LOCKED, /* query and store the version, then unlock */
+};
+
+/* cached version of the key, false on a miss or if the cache is not readable; never waits */
+bool tee_fwcache_get(const struct tee_fwcache_key *key,
+		     struct tee_mkhi_fw_version *version);
+
+/* take the query lock of the key device after a miss, waiting for the query
+ * of another caller at most timeout milliseconds */
+enum tee_fwcache_state tee_fwcache_lock(struct tee_fwcache *cache,
+					const struct tee_fwcache_key *key,
+					struct tee_mkhi_fw_version *version,
+					uint32_t timeout);
+
+/* drop the query lock */
+void tee_fwcache_unlock(struct tee_fwcache *cache);
+
+/* store the version of the key in the locked cache, replaces the entry of the device */
+void tee_fwcache_put(struct tee_fwcache *cache,
+		     const struct tee_fwcache_key *key,
+		     const struct tee_mkhi_fw_version *version);
+
+#endif /* __METEE_FWCACHE_H */
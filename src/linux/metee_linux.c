@@ -4,45 +4,186 @@
  */
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <libmei.h>
 #include <linux/mei.h>
+#include <pthread.h>
+#include <stdarg.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
-#include <sys/poll.h>
 #include <unistd.h>
+#ifdef SYSLOG
+#include <syslog.h>
+#endif /* SYSLOG */
 
 #include "metee.h"
 #include "helpers.h"
+#include "metee_trace.h"
+#include "metee_stats.h"
+#include "metee_probes.h"
+#include "metee_capture.h"
+#include "metee_fwcache.h"
+#include "metee_transport.h"
 
 #define MAX_FW_STATUS_NUM 5
 
-#define MILISEC_IN_SEC 1000
+#define DEBUG_MSG_LEN 1024
+
+#define TEE_DEVICE_TABLE_SIZE 16
+#define TEE_DEVICE_PATH_LEN 128
+
+TEE_PROBE_SEMAPHORES
+
+struct metee_linux_intl {
+	const struct tee_transport_ops *ops; /**< transport backend */
+	union tee_transport_state t; /**< transport session */
+	GUID guid;      /**< client GUID */
+	const char *device; /**< interned device path, NULL if not known */
+	bool in_place;  /**< storage is provided by the caller */
+	struct tee_stats_session stats; /**< performance counters */
+};
+
+_Static_assert(sizeof(struct metee_linux_intl) <= TEE_HANDLE_STORAGE_SIZE,
+	       "TEE_HANDLE_STORAGE_SIZE is too small for the internal structure");
+_Static_assert(__alignof__(struct metee_linux_intl) <= TEE_HANDLE_STORAGE_ALIGN,
+	       "TEE_HANDLE_STORAGE_ALIGN is too small for the internal structure");
+
+/*
+ * Process wide table of device paths, entries are never removed,
+ * so the handles can reference them without a private copy.
+ * Readers scan the published entries without taking the lock.
+ */
+static char tee_device_table[TEE_DEVICE_TABLE_SIZE][TEE_DEVICE_PATH_LEN];
+static unsigned int tee_device_count;
+static pthread_mutex_t tee_device_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const char *__tee_device_lookup(const char *device, unsigned int count)
+{
+	unsigned int i;
+
+	for (i = 0; i < count; i++) {
+		if (!strcmp(tee_device_table[i], device))
+			return tee_device_table[i];
+	}
+	return NULL;
+}
+
+/* returns NULL when the path cannot be interned */
+static const char *tee_device_intern(const char *device)
+{
+	const char *entry;
+	unsigned int count;
+
+	count = __atomic_load_n(&tee_device_count, __ATOMIC_ACQUIRE);
+	entry = __tee_device_lookup(device, count);
+	if (entry)
+		return entry;
+
+	if (strlen(device) >= TEE_DEVICE_PATH_LEN)
+		return NULL;
+
+	pthread_mutex_lock(&tee_device_lock);
+	count = __atomic_load_n(&tee_device_count, __ATOMIC_RELAXED);
+	entry = __tee_device_lookup(device, count);
+	if (!entry && count < TEE_DEVICE_TABLE_SIZE) {
+		strcpy(tee_device_table[count], device);
+		entry = tee_device_table[count];
+		__atomic_store_n(&tee_device_count, count + 1, __ATOMIC_RELEASE);
+	}
+	pthread_mutex_unlock(&tee_device_lock);
+
+	return entry;
+}
+
+static TeeLogCallback tee_log_callback;
+static void *tee_log_ctx;
+
+void __tee_log(enum tee_log_level level, const char *file, int line,
+	       const char *func, const char *fmt, ...)
+{
+	TeeLogCallback log_callback;
+	char msg[DEBUG_MSG_LEN];
+	va_list args;
+
+	va_start(args, fmt);
+	log_callback = __atomic_load_n(&tee_log_callback, __ATOMIC_ACQUIRE);
+	if (log_callback) {
+		log_callback(__atomic_load_n(&tee_log_ctx, __ATOMIC_RELAXED),
+			     level, file, line, func, fmt, args);
+		va_end(args);
+		return;
+	}
+	vsnprintf(msg, sizeof(msg), fmt, args);
+	va_end(args);
+
+#ifdef SYSLOG
+	syslog((level == TEE_LOG_LEVEL_ERROR) ? LOG_ERR : LOG_DEBUG,
+	       "TEELIB: (%s:%s():%d) %s", file, func, line, msg);
+#else
+	fprintf(stderr, "TEELIB: (%s:%s():%d) %s", file, func, line, msg);
+#endif /* SYSLOG */
+}
+
+static void tee_mei_log(void *ctx, bool is_error, const char *file, int line,
+			const char *func, const char *fmt, va_list args)
+{
+	TeeLogCallback log_callback;
+
+	log_callback = __atomic_load_n(&tee_log_callback, __ATOMIC_ACQUIRE);
+	if (log_callback)
+		log_callback(ctx, is_error ? TEE_LOG_LEVEL_ERROR : TEE_LOG_LEVEL_VERBOSE,
+			     file, line, func, fmt, args);
+}
 
 /* use inline function instead of macro to avoid -Waddress warning in GCC */
-static inline struct mei *to_mei(PTEEHANDLE _h) __attribute__((always_inline));
-static inline struct mei *to_mei(PTEEHANDLE _h)
+static inline struct metee_linux_intl *to_intl(PTEEHANDLE _h) __attribute__((always_inline));
+static inline struct metee_linux_intl *to_intl(PTEEHANDLE _h)
 {
-	return _h ? (struct mei *)_h->handle : NULL;
+	return _h ? (struct metee_linux_intl *)_h->handle : NULL;
 }
 
-static inline int __mei_select(struct mei *me, bool on_read, unsigned long timeout)
+static inline struct tee_stats_session *to_stats(PTEEHANDLE _h) __attribute__((always_inline));
+static inline struct tee_stats_session *to_stats(PTEEHANDLE _h)
+{
+	struct metee_linux_intl *intl = to_intl(_h);
+
+	return intl ? &intl->stats : NULL;
+}
+
+const char *tee_handle_device(PTEEHANDLE handle)
+{
+	struct metee_linux_intl *intl = to_intl(handle);
+
+	return intl ? intl->device : NULL;
+}
+
+static inline int __tee_select(struct metee_linux_intl *intl,
+			       bool on_read, unsigned long timeout)
 {
 	int rv;
-	struct pollfd pfd;
-	pfd.fd = me->fd;
-	pfd.events = (on_read) ? POLLIN : POLLOUT;
-
-	errno = 0;
-	rv = poll(&pfd, 1, (int)(timeout * MILISEC_IN_SEC));
-	if (rv < 0)
-		return -errno;
-	if (rv == 0)
-		return -ETIME;
-	return 0;
+	int fd = intl->ops->fd(&intl->t);
+	uint64_t start = tee_stats_now();
+
+	TEE_PROBE(poll_wait_entry, fd, on_read, timeout);
+	rv = intl->ops->poll(&intl->t, on_read, (timeout > INT_MAX) ? INT_MAX : (int)timeout);
+	tee_stats_poll_wait(&intl->stats, start);
+	TEE_PROBE(poll_wait_exit, fd, rv, tee_stats_now() - start);
+	return rv;
+}
+
+/* "loopback" and "loopback:<name>" select the in-process transport */
+static const struct tee_transport_ops *tee_transport_select(const char *device)
+{
+	size_t len = strlen(TEE_LOOPBACK_DEVICE);
+
+	if (!strncmp(device, TEE_LOOPBACK_DEVICE, len) &&
+	    (device[len] == '\0' || device[len] == ':'))
+		return &tee_transport_loopback;
+	return &tee_transport_mei;
 }
 
 static inline TEESTATUS errno2status(int err)
@@ -72,10 +213,11 @@ static inline TEESTATUS errno2status_init(int err)
 	}
 }
 
-TEESTATUS TEEAPI TeeInit(IN OUT PTEEHANDLE handle, IN const GUID *guid, IN OPTIONAL const char *device)
+static TEESTATUS __tee_init(PTEEHANDLE handle, struct metee_linux_intl *intl,
+			    const GUID *guid, const char *device)
 {
-	struct mei *me;
-	TEESTATUS  status;
+	const char *interned;
+	uint64_t start = TEE_PROBE_START(init_exit);
 	int rc;
 #if defined(DEBUG) && !defined(SYSLOG)
 	bool verbose = true;
@@ -83,36 +225,87 @@ TEESTATUS TEEAPI TeeInit(IN OUT PTEEHANDLE handle, IN const GUID *guid, IN OPTIO
 	bool verbose = false;
 #endif // DEBUG and !SYSLOG
 
+	if (!device)
+		device = MEI_DEFAULT_DEVICE;
+	TEE_PROBE(init_entry, handle, guid, device);
+
+	intl->ops = tee_transport_fault(tee_transport_select(device));
+	interned = tee_device_intern(device);
+	if (interned)
+		rc = intl->ops->open(&intl->t, interned, guid, true, verbose);
+	else
+		rc = intl->ops->open(&intl->t, device, guid, false, verbose);
+	if (rc) {
+		ERRPRINT(handle, "Cannot init %s, rc = %d\n", intl->ops->name, rc);
+		TEE_TRACE_LEAVE(TEE_TRACE_OP_INIT, handle, 0, errno2status_init(rc));
+		TEE_PROBE(init_exit, handle, guid, errno2status_init(rc),
+			  TEE_PROBE_ELAPSED(start));
+		return errno2status_init(rc);
+	}
+	memcpy(&intl->guid, guid, sizeof(intl->guid));
+	intl->device = interned;
+	tee_stats_session_init(&intl->stats, device, guid);
+	handle->handle = intl;
+	TEE_TRACE_LEAVE(TEE_TRACE_OP_INIT, handle, 0, TEE_SUCCESS);
+	TEE_PROBE(init_exit, handle, guid, TEE_SUCCESS, TEE_PROBE_ELAPSED(start));
+
+	return TEE_SUCCESS;
+}
+
+TEESTATUS TEEAPI TeeInit(IN OUT PTEEHANDLE handle, IN const GUID *guid, IN OPTIONAL const char *device)
+{
+	struct metee_linux_intl *intl;
+	TEESTATUS  status;
+
 	if (guid == NULL || handle == NULL) {
 		return TEE_INVALID_PARAMETER;
 	}
 
 	__tee_init_handle(handle);
-	me = malloc(sizeof(struct mei));
-	if (!me) {
+	intl = malloc(sizeof(*intl));
+	if (!intl) {
 		ERRPRINT(handle, "Cannot alloc mei structure\n");
 		status = TEE_INTERNAL_ERROR;
 		goto End;
 	}
-	rc = mei_init(me, device ? device : MEI_DEFAULT_DEVICE, guid, 0, verbose);
-	if (rc) {
-		free(me);
-		ERRPRINT(handle, "Cannot init mei, rc = %d\n", rc);
-		status = errno2status_init(rc);
-		goto End;
-	}
-	handle->handle = me;
-	status = TEE_SUCCESS;
+	intl->in_place = false;
+
+	status = __tee_init(handle, intl, guid, device);
+	if (status)
+		free(intl);
 
 End:
 	return status;
 }
 
+TEESTATUS TEEAPI TeeInitInPlace(IN OUT PTEEHANDLE handle, IN const GUID *guid,
+				IN OPTIONAL const char *device,
+				IN void *storage, IN size_t storage_size)
+{
+	struct metee_linux_intl *intl = storage;
+
+	if (guid == NULL || handle == NULL || storage == NULL) {
+		return TEE_INVALID_PARAMETER;
+	}
+
+	/* the contract is the public size, so the structure can grow within it */
+	if (storage_size < TEE_HANDLE_STORAGE_SIZE ||
+	    (uintptr_t)storage % TEE_HANDLE_STORAGE_ALIGN) {
+		return TEE_INVALID_PARAMETER;
+	}
+
+	__tee_init_handle(handle);
+	intl->in_place = true;
+
+	return __tee_init(handle, intl, guid, device);
+}
+
 TEESTATUS TEEAPI TeeInitHandle(IN OUT PTEEHANDLE handle, IN const GUID *guid,
 			       IN const TEE_DEVICE_HANDLE device_handle)
 {
-	struct mei *me;
+	struct metee_linux_intl *intl;
 	TEESTATUS  status;
+	uint64_t start = TEE_PROBE_START(init_exit);
 	int rc;
 #if defined(DEBUG) && !defined(SYSLOG)
 	bool verbose = true;
@@ -123,32 +316,43 @@ TEESTATUS TEEAPI TeeInitHandle(IN OUT PTEEHANDLE handle, IN const GUID *guid,
 	if (guid == NULL || handle == NULL) {
 		return TEE_INVALID_PARAMETER;
 	}
+	TEE_PROBE(init_entry, handle, guid, NULL);
 
 	__tee_init_handle(handle);
-	me = malloc(sizeof(struct mei));
-	if (!me) {
+	intl = malloc(sizeof(*intl));
+	if (!intl) {
 		ERRPRINT(handle, "Cannot alloc mei structure\n");
 		status = TEE_INTERNAL_ERROR;
 		goto End;
 	}
-	rc = mei_init_fd(me, device_handle, guid, 0, verbose);
+	intl->in_place = false;
+	intl->ops = tee_transport_fault(&tee_transport_mei);
+	rc = mei_init_fd(&intl->t.me, device_handle, guid, 0, verbose);
 	if (rc) {
-		free(me);
+		free(intl);
 		ERRPRINT(handle, "Cannot init mei, rc = %d\n", rc);
 		status = errno2status_init(rc);
 		goto End;
 	}
-	handle->handle = me;
+	memcpy(&intl->guid, guid, sizeof(intl->guid));
+	intl->device = NULL;
+	tee_stats_session_init(&intl->stats, intl->t.me.device, guid);
+	handle->handle = intl;
 	status = TEE_SUCCESS;
 
 End:
+	TEE_TRACE_LEAVE(TEE_TRACE_OP_INIT, handle, 0, status);
+	TEE_PROBE(init_exit, handle, guid, status, TEE_PROBE_ELAPSED(start));
 	return status;
 }
 
 TEESTATUS TEEAPI TeeConnect(IN OUT PTEEHANDLE handle)
 {
-	struct mei *me = to_mei(handle);
+	struct metee_linux_intl *intl = to_intl(handle);
 	TEESTATUS  status;
+	uint64_t   start = TEE_PROBE_START(connect_exit);
+	uint32_t   max_msg_len;
+	uint8_t    prot_ver;
 	int        rc;
 
 	if (!handle) {
@@ -156,26 +360,34 @@ TEESTATUS TEEAPI TeeConnect(IN OUT PTEEHANDLE handle)
 	}
 
 	FUNC_ENTRY(handle);
+	TEE_TRACE_ENTER(TEE_TRACE_OP_CONNECT, handle, 0);
+	TEE_PROBE(connect_entry, handle, intl ? &intl->guid : NULL);
 
-	if (!me) {
+	if (!intl) {
 		ERRPRINT(handle, "One of the parameters was illegal");
 		status = TEE_INVALID_PARAMETER;
 		goto End;
 	}
 
-	rc = mei_connect(me);
+	rc = intl->ops->connect(&intl->t, &max_msg_len, &prot_ver);
 	if (rc) {
 		ERRPRINT(handle, "Cannot establish a handle to the Intel MEI driver\n");
 		status = errno2status(rc);
 		goto End;
 	}
 
-	handle->maxMsgLen = me->buf_size;
-	handle->protcolVer = me->prot_ver;
+	handle->maxMsgLen = max_msg_len;
+	handle->protcolVer = prot_ver;
 
+	TEE_CAPTURE(handle, &intl->guid, TEE_CAPTURE_DIR_CONNECT, NULL, 0);
 	status = TEE_SUCCESS;
 
 End:
+	if (intl)
+		tee_stats_connect(&intl->stats, status);
+	TEE_TRACE_LEAVE(TEE_TRACE_OP_CONNECT, handle, handle->maxMsgLen, status);
+	TEE_PROBE(connect_exit, handle, intl ? &intl->guid : NULL, handle->maxMsgLen,
+		  status, TEE_PROBE_ELAPSED(start));
 	FUNC_EXIT(handle, status);
 	return status;
 }
@@ -183,23 +395,27 @@ End:
 TEESTATUS TEEAPI TeeRead(IN PTEEHANDLE handle, IN OUT void *buffer, IN size_t bufferSize,
 			 OUT OPTIONAL size_t *pNumOfBytesRead, IN OPTIONAL uint32_t timeout)
 {
-	struct mei *me = to_mei(handle);
+	struct metee_linux_intl *intl = to_intl(handle);
 	TEESTATUS status;
-	ssize_t rc;
+	ssize_t rc = 0;
+	uint64_t start;
 
 	if (!handle) {
 		return TEE_INVALID_PARAMETER;
 	}
 
 	FUNC_ENTRY(handle);
+	TEE_TRACE_ENTER(TEE_TRACE_OP_READ, handle, bufferSize);
+	TEE_PROBE(read_entry, handle, intl ? &intl->guid : NULL, bufferSize, timeout);
+	start = tee_stats_now();
 
-	if (!me || !buffer || !bufferSize) {
+	if (!intl || !buffer || !bufferSize) {
 		ERRPRINT(handle, "One of the parameters was illegal");
 		status = TEE_INVALID_PARAMETER;
 		goto End;
 	}
 
-	if (me->state != MEI_CL_STATE_CONNECTED) {
+	if (!intl->ops->connected(&intl->t)) {
 		ERRPRINT(handle, "The client is not connected\n");
 		status = TEE_DISCONNECTED;
 		goto End;
@@ -207,14 +423,14 @@ TEESTATUS TEEAPI TeeRead(IN PTEEHANDLE handle, IN OUT void *buffer, IN size_t bu
 
 	DBGPRINT(handle, "call read length = %zd\n", bufferSize);
 
-	if (timeout && (rc = __mei_select(me, true, timeout))) {
+	if (timeout && (rc = __tee_select(intl, true, timeout))) {
 		status = errno2status(rc);
 		ERRPRINT(handle, "select failed with status %zd %s\n",
 				rc, strerror(-rc));
 		goto End;
 	}
 
-	rc = mei_recv_msg(me, buffer, bufferSize);
+	rc = intl->ops->read(&intl->t, buffer, bufferSize);
 	if (rc < 0) {
 		status = errno2status(rc);
 		ERRPRINT(handle, "read failed with status %zd %s\n",
@@ -224,10 +440,17 @@ TEESTATUS TEEAPI TeeRead(IN PTEEHANDLE handle, IN OUT void *buffer, IN size_t bu
 
 	status = TEE_SUCCESS;
 	DBGPRINT(handle, "read succeeded with result %zd\n", rc);
+	TEE_CAPTURE(handle, &intl->guid, TEE_CAPTURE_DIR_READ, buffer, rc);
 	if (pNumOfBytesRead)
 		*pNumOfBytesRead = rc;
 
 End:
+	if (intl)
+		tee_stats_read(&intl->stats, status,
+			       (status == TEE_SUCCESS) ? rc : 0, start);
+	TEE_TRACE_LEAVE(TEE_TRACE_OP_READ, handle, (status == TEE_SUCCESS) ? rc : 0, status);
+	TEE_PROBE(read_exit, handle, intl ? &intl->guid : NULL,
+		  (status == TEE_SUCCESS) ? rc : 0, status, tee_stats_now() - start);
 	FUNC_EXIT(handle, status);
 	return status;
 }
@@ -235,23 +458,27 @@ End:
 TEESTATUS TEEAPI TeeWrite(IN PTEEHANDLE handle, IN const void *buffer, IN size_t bufferSize,
 			  OUT OPTIONAL size_t *numberOfBytesWritten, IN OPTIONAL uint32_t timeout)
 {
-	struct mei *me  =  to_mei(handle);
+	struct metee_linux_intl *intl = to_intl(handle);
 	TEESTATUS status;
-	ssize_t rc;
+	ssize_t rc = 0;
+	uint64_t start;
 
 	if (!handle) {
 		return TEE_INVALID_PARAMETER;
 	}
 
 	FUNC_ENTRY(handle);
+	TEE_TRACE_ENTER(TEE_TRACE_OP_WRITE, handle, bufferSize);
+	TEE_PROBE(write_entry, handle, intl ? &intl->guid : NULL, bufferSize, timeout);
+	start = tee_stats_now();
 
-	if (!me || !buffer || !bufferSize) {
+	if (!intl || !buffer || !bufferSize) {
 		ERRPRINT(handle, "One of the parameters was illegal");
 		status = TEE_INVALID_PARAMETER;
 		goto End;
 	}
 
-	if (me->state != MEI_CL_STATE_CONNECTED) {
+	if (!intl->ops->connected(&intl->t)) {
 		ERRPRINT(handle, "The client is not connected\n");
 		status = TEE_DISCONNECTED;
 		goto End;
@@ -259,25 +486,32 @@ TEESTATUS TEEAPI TeeWrite(IN PTEEHANDLE handle, IN const void *buffer, IN size_t
 
 	DBGPRINT(handle, "call write length = %zd\n", bufferSize);
 
-	if (timeout && (rc = __mei_select(me, false, timeout))) {
+	if (timeout && (rc = __tee_select(intl, false, timeout))) {
 		status = errno2status(rc);
 		ERRPRINT(handle, "select failed with status %zd %s\n",
 				rc, strerror(-rc));
 		goto End;
 	}
 
-	rc  = mei_send_msg(me, buffer, bufferSize);
+	rc = intl->ops->write(&intl->t, buffer, bufferSize);
 	if (rc < 0) {
 		status = errno2status(rc);
 		ERRPRINT(handle, "write failed with status %zd %s\n", rc, strerror(-rc));
 		goto End;
 	}
 
+	TEE_CAPTURE(handle, &intl->guid, TEE_CAPTURE_DIR_WRITE, buffer, rc);
 	if (numberOfBytesWritten)
 		*numberOfBytesWritten = rc;
 
 	status = TEE_SUCCESS;
 End:
+	if (intl)
+		tee_stats_write(&intl->stats, status,
+				(status == TEE_SUCCESS) ? rc : 0, start);
+	TEE_TRACE_LEAVE(TEE_TRACE_OP_WRITE, handle, (status == TEE_SUCCESS) ? rc : 0, status);
+	TEE_PROBE(write_exit, handle, intl ? &intl->guid : NULL,
+		  (status == TEE_SUCCESS) ? rc : 0, status, tee_stats_now() - start);
 	FUNC_EXIT(handle, status);
 	return status;
 }
@@ -285,9 +519,10 @@ End:
 TEESTATUS TEEAPI TeeFWStatus(IN PTEEHANDLE handle,
 			     IN uint32_t fwStatusNum, OUT uint32_t *fwStatus)
 {
-	struct mei *me = to_mei(handle);
+	struct metee_linux_intl *intl = to_intl(handle);
 	TEESTATUS status;
         uint32_t fwsts;
+	uint64_t start = TEE_PROBE_START(fwstatus_exit);
 	int rc;
 
 	if (!handle) {
@@ -295,8 +530,10 @@ TEESTATUS TEEAPI TeeFWStatus(IN PTEEHANDLE handle,
 	}
 
 	FUNC_ENTRY(handle);
+	TEE_TRACE_ENTER(TEE_TRACE_OP_FWSTATUS, handle, fwStatusNum);
+	TEE_PROBE(fwstatus_entry, handle, intl ? &intl->guid : NULL, fwStatusNum);
 
-	if (!me || !fwStatus) {
+	if (!intl || !fwStatus) {
 		status = TEE_INVALID_PARAMETER;
 		ERRPRINT(handle, "One of the parameters was illegal");
 		goto End;
@@ -307,7 +544,7 @@ TEESTATUS TEEAPI TeeFWStatus(IN PTEEHANDLE handle,
 		goto End;
 	}
 
-	rc  = mei_fwstatus(me, fwStatusNum, &fwsts);
+	rc = intl->ops->fwstatus(&intl->t, fwStatusNum, &fwsts);
 	if (rc < 0) {
 		status = errno2status(rc);
 		ERRPRINT(handle, "fw status failed with status %d %s\n", rc, strerror(-rc));
@@ -318,46 +555,57 @@ TEESTATUS TEEAPI TeeFWStatus(IN PTEEHANDLE handle,
 	status = TEE_SUCCESS;
 
 End:
+	if (intl)
+		tee_stats_fwstatus(&intl->stats, status);
+	TEE_TRACE_LEAVE(TEE_TRACE_OP_FWSTATUS, handle, fwStatusNum, status);
+	TEE_PROBE(fwstatus_exit, handle, intl ? &intl->guid : NULL, fwStatusNum,
+		  status, TEE_PROBE_ELAPSED(start));
 	FUNC_EXIT(handle, status);
 	return status;
 }
 
 void TEEAPI TeeDisconnect(PTEEHANDLE handle)
 {
-	struct mei *me  =  to_mei(handle);
+	struct metee_linux_intl *intl = to_intl(handle);
 
 	if (!handle) {
 		return;
 	}
 
 	FUNC_ENTRY(handle);
-	if (me) {
-		mei_free(me);
+	TEE_TRACE_ENTER(TEE_TRACE_OP_DISCONNECT, handle, 0);
+	TEE_PROBE(disconnect_entry, handle, intl ? &intl->guid : NULL);
+	if (intl) {
+		intl->ops->close(&intl->t);
+		if (!intl->in_place)
+			free(intl);
 		handle->handle = NULL;
 	}
+	TEE_TRACE_LEAVE(TEE_TRACE_OP_DISCONNECT, handle, 0, TEE_SUCCESS);
+	TEE_PROBE(disconnect_exit, handle);
 
 	FUNC_EXIT(handle, TEE_SUCCESS);
 }
 
 TEE_DEVICE_HANDLE TEEAPI TeeGetDeviceHandle(IN PTEEHANDLE handle)
 {
-	struct mei *me = to_mei(handle);
+	struct metee_linux_intl *intl = to_intl(handle);
 
 	if (!handle) {
 		return TEE_INVALID_PARAMETER;
 	}
 
-	if (!me) {
+	if (!intl) {
 		ERRPRINT(handle, "One of the parameters was illegal");
 		return TEE_INVALID_DEVICE_HANDLE;
 	}
 	
-	return me->fd;
+	return intl->ops->fd(&intl->t);
 }
 
 TEESTATUS TEEAPI GetDriverVersion(IN PTEEHANDLE handle, IN OUT teeDriverVersion_t *driverVersion)
 {
-	struct mei *me = to_mei(handle);
+	struct metee_linux_intl *intl = to_intl(handle);
 	TEESTATUS status;
 
 	if (!handle) {
@@ -366,7 +614,7 @@ TEESTATUS TEEAPI GetDriverVersion(IN PTEEHANDLE handle, IN OUT teeDriverVersion_
 
 	FUNC_ENTRY(handle);
 
-	if (!me || !driverVersion) {
+	if (!intl || !driverVersion) {
 		ERRPRINT(handle, "One of the parameters was illegal");
 		status = TEE_INVALID_PARAMETER;
 		goto End;
@@ -380,7 +628,7 @@ End:
 
 uint32_t TEEAPI TeeSetLogLevel(IN PTEEHANDLE handle, IN uint32_t log_level)
 {
-	struct mei *me = to_mei(handle);
+	struct metee_linux_intl *intl = to_intl(handle);
 	uint32_t prev_log_level = TEE_LOG_LEVEL_ERROR;
 
 	if (!handle) {
@@ -389,7 +637,7 @@ uint32_t TEEAPI TeeSetLogLevel(IN PTEEHANDLE handle, IN uint32_t log_level)
 
 	FUNC_ENTRY(handle);
 
-	if (!me) {
+	if (!intl) {
 		ERRPRINT(handle, "Illegal handle\n");
 		goto End;
 	}
@@ -397,7 +645,7 @@ uint32_t TEEAPI TeeSetLogLevel(IN PTEEHANDLE handle, IN uint32_t log_level)
 	prev_log_level = handle->log_level;
 	handle->log_level = (log_level > TEE_LOG_LEVEL_VERBOSE) ? TEE_LOG_LEVEL_VERBOSE : log_level;
 
-	mei_set_log_level(me, handle->log_level);
+	intl->ops->set_log_level(&intl->t, handle->log_level);
 
 End:
 	FUNC_EXIT(handle, prev_log_level);
@@ -420,3 +668,28 @@ uint32_t TEEAPI TeeGetLogLevel(IN const PTEEHANDLE handle)
 
 	return prev_log_level;
 }
+
+TEESTATUS TEEAPI TeeSetLogCallback(IN OPTIONAL TeeLogCallback callback,
+				   IN OPTIONAL void *ctx)
+{
+	__atomic_store_n(&tee_log_ctx, ctx, __ATOMIC_RELAXED);
+	__atomic_store_n(&tee_log_callback, callback, __ATOMIC_RELEASE);
+	mei_set_log_callback(callback ? tee_mei_log : NULL, ctx);
+
+	return TEE_SUCCESS;
+}
+
+TEESTATUS TEEAPI TeeGetStats(IN PTEEHANDLE handle,
+			     OUT OPTIONAL struct tee_stats_counters *session,
+			     OUT OPTIONAL struct tee_stats *client)
+{
+	struct tee_stats_session *stats = to_stats(handle);
+
+	if (!stats) {
+		return TEE_INVALID_PARAMETER;
+	}
+
+	tee_stats_session_get(stats, session, client);
+
+	return TEE_SUCCESS;
+}
@@ -0,0 +1,87 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2023 Intel Corporation
+ */
+#ifndef __METEE_PROBES_H
+#define __METEE_PROBES_H
+
+/*
+ * USDT (sys/sdt.h) probes of provider "metee".
+ * Every probe has a semaphore that the tracer increments on attach,
+ * the probe arguments are evaluated only while a tracer is attached.
+ * Without sys/sdt.h the probes compile out.
+ *
+ *   init_entry        (handle, guid, device)
+ *   init_exit         (handle, guid, status, elapsed_ns)
+ *   connect_entry     (handle, guid)
+ *   connect_exit      (handle, guid, max_msg_len, status, elapsed_ns)
+ *   read_entry        (handle, guid, length, timeout)
+ *   read_exit         (handle, guid, length, status, elapsed_ns)
+ *   write_entry       (handle, guid, length, timeout)
+ *   write_exit        (handle, guid, length, status, elapsed_ns)
+ *   fwstatus_entry    (handle, guid, index)
+ *   fwstatus_exit     (handle, guid, index, status, elapsed_ns)
+ *   disconnect_entry  (handle, guid)
+ *   disconnect_exit   (handle)
+ *   poll_wait_entry   (fd, on_read, timeout)
+ *   poll_wait_exit    (fd, rc, elapsed_ns)
+ */
+#define TEE_PROBE_LIST(X) \
+	X(init_entry)       \
+	X(init_exit)        \
+	X(connect_entry)    \
+	X(connect_exit)     \
+	X(read_entry)       \
+	X(read_exit)        \
+	X(write_entry)      \
+	X(write_exit)       \
+	X(fwstatus_entry)   \
+	X(fwstatus_exit)    \
+	X(disconnect_entry) \
+	X(disconnect_exit)  \
+	X(poll_wait_entry)  \
+	X(poll_wait_exit)
+
+#ifdef HAVE_SYS_SDT_H
+
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+
+/* to be placed once in the file that fires the probes */
+#define TEE_PROBE_SEMAPHORE(name) \
+	__extension__ volatile unsigned short metee_##name##_semaphore \
+	__attribute__((unused)) __attribute__((section(".probes")));
+#define TEE_PROBE_SEMAPHORES TEE_PROBE_LIST(TEE_PROBE_SEMAPHORE)
+
+#define TEE_PROBE_ENABLED(name) __builtin_expect(metee_##name##_semaphore, 0)
+
+#define TEE_PROBE(name, ...) do {                       \
+	if (TEE_PROBE_ENABLED(name))                     \
+		STAP_PROBEV(metee, name, __VA_ARGS__);   \
+} while (0)
+
+#else /* HAVE_SYS_SDT_H */
+
+static inline void tee_probe_unused(int dummy, ...)
+{
+	(void)dummy;
+}
+
+#define TEE_PROBE_SEMAPHORES
+#define TEE_PROBE_ENABLED(name) 0
+/* keep the arguments referenced, the call is never made */
+#define TEE_PROBE(name, ...) do {                       \
+	if (0)                                           \
+		tee_probe_unused(0, __VA_ARGS__);        \
+} while (0)
+
+#endif /* HAVE_SYS_SDT_H */
+
+/*
+ * Start time for the elapsed argument of the exit probe,
+ * zero when nobody listens.
+ */
+#define TEE_PROBE_START(name) (TEE_PROBE_ENABLED(name) ? tee_stats_now() : 0)
+#define TEE_PROBE_ELAPSED(start) ((start) ? tee_stats_now() - (start) : 0)
+
+#endif /* __METEE_PROBES_H */
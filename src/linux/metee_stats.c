@@ -0,0 +1,479 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2023 Intel Corporation
+ */
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "metee.h"
+#include "helpers.h"
+#include "metee_stats.h"
+#include "metee_clock.h"
+
+#define TEE_STATS_GROUPS_MAX 32
+
+#define NSEC_IN_SEC 1000000000ULL
+
+#define STAT_INC(x) __atomic_fetch_add(&(x), 1, __ATOMIC_RELAXED)
+#define STAT_ADD(x, v) __atomic_fetch_add(&(x), (v), __ATOMIC_RELAXED)
+#define STAT_GET(x) __atomic_load_n(&(x), __ATOMIC_RELAXED)
+
+/*
+ * Groups are only appended, readers scan the published entries
+ * without taking the lock.
+ */
+static struct tee_stats_group tee_stats_groups[TEE_STATS_GROUPS_MAX];
+static unsigned int tee_stats_groups_count;
+static pthread_mutex_t tee_stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* copy of all groups taken by the exporter, guarded by the format lock */
+static struct tee_stats_client tee_stats_snapshot[TEE_STATS_GROUPS_MAX];
+static pthread_mutex_t tee_stats_format_lock = PTHREAD_MUTEX_INITIALIZER;
+
+uint64_t tee_stats_now(void)
+{
+	return tee_clock_now();
+}
+
+static inline unsigned int tee_stats_bucket(uint64_t ns)
+{
+	unsigned int e, idx;
+
+	if (ns < (1ULL << TEE_STATS_HIST_MIN_SHIFT))
+		return 0;
+
+	e = 63 - __builtin_clzll(ns);
+	idx = ((e - TEE_STATS_HIST_MIN_SHIFT) << TEE_STATS_HIST_SUB_SHIFT) +
+	      ((ns >> (e - TEE_STATS_HIST_SUB_SHIFT)) &
+	       ((1U << TEE_STATS_HIST_SUB_SHIFT) - 1)) + 1;
+
+	return (idx < TEE_STATS_HIST_BUCKETS) ? idx : TEE_STATS_HIST_BUCKETS - 1;
+}
+
+uint64_t TEEAPI TeeStatsBucketBound(IN uint32_t bucket)
+{
+	unsigned int e, sub;
+
+	if (bucket >= TEE_STATS_HIST_BUCKETS - 1)
+		return UINT64_MAX;
+	if (bucket == 0)
+		return 1ULL << TEE_STATS_HIST_MIN_SHIFT;
+
+	bucket--;
+	e = TEE_STATS_HIST_MIN_SHIFT + (bucket >> TEE_STATS_HIST_SUB_SHIFT);
+	sub = bucket & ((1U << TEE_STATS_HIST_SUB_SHIFT) - 1);
+
+	return (1ULL << e) + (uint64_t)(sub + 1) * (1ULL << (e - TEE_STATS_HIST_SUB_SHIFT));
+}
+
+static void tee_stats_hist_add(struct tee_stats_histogram *h, uint64_t ns)
+{
+	STAT_INC(h->count);
+	STAT_ADD(h->sum_ns, ns);
+	STAT_INC(h->buckets[tee_stats_bucket(ns)]);
+}
+
+static struct tee_stats_group *__tee_stats_group_lookup(const char *device,
+							const GUID *guid,
+							unsigned int count)
+{
+	unsigned int i;
+
+	for (i = 0; i < count; i++) {
+		if (!memcmp(&tee_stats_groups[i].guid, guid, sizeof(*guid)) &&
+		    !strncmp(tee_stats_groups[i].device, device, TEE_STATS_DEVICE_LEN - 1))
+			return &tee_stats_groups[i];
+	}
+	return NULL;
+}
+
+static struct tee_stats_group *tee_stats_group_get(const char *device,
+						   const GUID *guid)
+{
+	struct tee_stats_group *group;
+	unsigned int count;
+
+	count = __atomic_load_n(&tee_stats_groups_count, __ATOMIC_ACQUIRE);
+	group = __tee_stats_group_lookup(device, guid, count);
+	if (group)
+		return group;
+
+	pthread_mutex_lock(&tee_stats_lock);
+	count = __atomic_load_n(&tee_stats_groups_count, __ATOMIC_RELAXED);
+	group = __tee_stats_group_lookup(device, guid, count);
+	if (!group && count < TEE_STATS_GROUPS_MAX) {
+		group = &tee_stats_groups[count];
+		strncpy(group->device, device, TEE_STATS_DEVICE_LEN - 1);
+		memcpy(&group->guid, guid, sizeof(*guid));
+		__atomic_store_n(&tee_stats_groups_count, count + 1, __ATOMIC_RELEASE);
+	}
+	pthread_mutex_unlock(&tee_stats_lock);
+
+	return group;
+}
+
+void tee_stats_session_init(struct tee_stats_session *s,
+			    const char *device, const GUID *guid)
+{
+	memset(s, 0, sizeof(*s));
+	s->group = tee_stats_group_get(device ? device : "", guid);
+}
+
+static void tee_stats_error(struct tee_stats_session *s, TEESTATUS status)
+{
+	if (status >= TEE_STATS_STATUS_NUM)
+		status = TEE_INTERNAL_ERROR;
+
+	STAT_INC(s->counters.errors[status]);
+	if (s->group)
+		STAT_INC(s->group->stats.counters.errors[status]);
+}
+
+void tee_stats_connect(struct tee_stats_session *s, TEESTATUS status)
+{
+	bool reconnect = STAT_GET(s->counters.connects) != 0;
+
+	STAT_INC(s->counters.connects);
+	if (reconnect)
+		STAT_INC(s->counters.reconnects);
+	if (s->group) {
+		STAT_INC(s->group->stats.counters.connects);
+		if (reconnect)
+			STAT_INC(s->group->stats.counters.reconnects);
+	}
+	if (status != TEE_SUCCESS)
+		tee_stats_error(s, status);
+}
+
+void tee_stats_write(struct tee_stats_session *s, TEESTATUS status,
+		     size_t bytes, uint64_t start)
+{
+	STAT_INC(s->counters.writes);
+	if (s->group)
+		STAT_INC(s->group->stats.counters.writes);
+	if (status != TEE_SUCCESS) {
+		s->write_start = 0;
+		tee_stats_error(s, status);
+		return;
+	}
+
+	s->write_start = start;
+	STAT_ADD(s->counters.bytes_written, bytes);
+	if (s->group) {
+		STAT_ADD(s->group->stats.counters.bytes_written, bytes);
+		tee_stats_hist_add(&s->group->stats.hist[TEE_STATS_HIST_WRITE],
+				   tee_stats_now() - start);
+	}
+}
+
+void tee_stats_read(struct tee_stats_session *s, TEESTATUS status,
+		    size_t bytes, uint64_t start)
+{
+	uint64_t now;
+
+	STAT_INC(s->counters.reads);
+	if (s->group)
+		STAT_INC(s->group->stats.counters.reads);
+	if (status != TEE_SUCCESS) {
+		tee_stats_error(s, status);
+		return;
+	}
+
+	STAT_ADD(s->counters.bytes_read, bytes);
+	if (!s->group)
+		return;
+
+	now = tee_stats_now();
+	STAT_ADD(s->group->stats.counters.bytes_read, bytes);
+	tee_stats_hist_add(&s->group->stats.hist[TEE_STATS_HIST_READ_WAIT],
+			   now - start);
+	if (s->write_start) {
+		tee_stats_hist_add(&s->group->stats.hist[TEE_STATS_HIST_TRANSACT],
+				   now - s->write_start);
+		s->write_start = 0;
+	}
+}
+
+void tee_stats_poll_wait(struct tee_stats_session *s, uint64_t start)
+{
+	if (s->group)
+		tee_stats_hist_add(&s->group->stats.hist[TEE_STATS_HIST_POLL_WAIT],
+				   tee_stats_now() - start);
+}
+
+void tee_stats_fwstatus(struct tee_stats_session *s, TEESTATUS status)
+{
+	STAT_INC(s->counters.fwstatus);
+	if (s->group)
+		STAT_INC(s->group->stats.counters.fwstatus);
+	if (status != TEE_SUCCESS)
+		tee_stats_error(s, status);
+}
+
+static void tee_stats_copy_counters(struct tee_stats_counters *dst,
+				    struct tee_stats_counters *src)
+{
+	unsigned int i;
+
+	dst->connects = STAT_GET(src->connects);
+	dst->reconnects = STAT_GET(src->reconnects);
+	dst->writes = STAT_GET(src->writes);
+	dst->reads = STAT_GET(src->reads);
+	dst->fwstatus = STAT_GET(src->fwstatus);
+	dst->bytes_written = STAT_GET(src->bytes_written);
+	dst->bytes_read = STAT_GET(src->bytes_read);
+	for (i = 0; i < TEE_STATS_STATUS_NUM; i++)
+		dst->errors[i] = STAT_GET(src->errors[i]);
+}
+
+static void tee_stats_copy(struct tee_stats *dst, struct tee_stats *src)
+{
+	unsigned int i, j;
+
+	tee_stats_copy_counters(&dst->counters, &src->counters);
+	for (i = 0; i < TEE_STATS_HIST_NUM; i++) {
+		dst->hist[i].count = STAT_GET(src->hist[i].count);
+		dst->hist[i].sum_ns = STAT_GET(src->hist[i].sum_ns);
+		for (j = 0; j < TEE_STATS_HIST_BUCKETS; j++)
+			dst->hist[i].buckets[j] = STAT_GET(src->hist[i].buckets[j]);
+	}
+}
+
+void tee_stats_session_get(struct tee_stats_session *s,
+			   struct tee_stats_counters *session,
+			   struct tee_stats *client)
+{
+	if (session)
+		tee_stats_copy_counters(session, &s->counters);
+	if (client) {
+		if (s->group)
+			tee_stats_copy(client, &s->group->stats);
+		else
+			memset(client, 0, sizeof(*client));
+	}
+}
+
+TEESTATUS TEEAPI TeeGetStatsClient(IN uint32_t index, OUT struct tee_stats_client *client)
+{
+	struct tee_stats_group *group;
+
+	if (!client)
+		return TEE_INVALID_PARAMETER;
+
+	if (index >= __atomic_load_n(&tee_stats_groups_count, __ATOMIC_ACQUIRE))
+		return TEE_CLIENT_NOT_FOUND;
+
+	group = &tee_stats_groups[index];
+	memcpy(client->device, group->device, sizeof(client->device));
+	memcpy(&client->guid, &group->guid, sizeof(client->guid));
+	tee_stats_copy(&client->stats, &group->stats);
+
+	return TEE_SUCCESS;
+}
+
+/*
+ * OpenMetrics text exposition
+ */
+struct tee_om_buf {
+	char *buf;     /**< output buffer */
+	size_t len;    /**< buffer size */
+	size_t pos;    /**< characters written */
+	bool overflow; /**< output was truncated */
+};
+
+static void tee_om_printf(struct tee_om_buf *b, const char *fmt, ...)
+	__attribute__((format(printf, 2, 3)));
+
+static void tee_om_printf(struct tee_om_buf *b, const char *fmt, ...)
+{
+	va_list args;
+	int n;
+
+	if (b->overflow)
+		return;
+
+	va_start(args, fmt);
+	n = vsnprintf(b->buf + b->pos, b->len - b->pos, fmt, args);
+	va_end(args);
+
+	if (n < 0 || (size_t)n >= b->len - b->pos) {
+		b->overflow = true;
+		return;
+	}
+	b->pos += n;
+}
+
+static const char *tee_om_status_names[TEE_STATS_STATUS_NUM] = {
+	[TEE_SUCCESS] = "success",
+	[TEE_INTERNAL_ERROR] = "internal_error",
+	[TEE_DEVICE_NOT_FOUND] = "device_not_found",
+	[TEE_DEVICE_NOT_READY] = "device_not_ready",
+	[TEE_INVALID_PARAMETER] = "invalid_parameter",
+	[TEE_UNABLE_TO_COMPLETE_OPERATION] = "unable_to_complete_operation",
+	[TEE_TIMEOUT] = "timeout",
+	[TEE_NOTSUPPORTED] = "not_supported",
+	[TEE_CLIENT_NOT_FOUND] = "client_not_found",
+	[TEE_BUSY] = "busy",
+	[TEE_DISCONNECTED] = "disconnected",
+	[TEE_INSUFFICIENT_BUFFER] = "insufficient_buffer",
+	[TEE_PERMISSION_DENIED] = "permission_denied",
+};
+
+static const struct {
+	const char *name; /**< metric family name */
+	const char *help; /**< family description */
+} tee_om_hists[TEE_STATS_HIST_NUM] = {
+	[TEE_STATS_HIST_WRITE] = {
+		"metee_write_duration_seconds", "Duration of TeeWrite."},
+	[TEE_STATS_HIST_READ_WAIT] = {
+		"metee_read_wait_seconds", "Duration of TeeRead including the wait for data."},
+	[TEE_STATS_HIST_TRANSACT] = {
+		"metee_transaction_duration_seconds", "Time from TeeWrite start to TeeRead completion."},
+	[TEE_STATS_HIST_POLL_WAIT] = {
+		"metee_poll_wait_seconds", "Wait for the device in TeeRead and TeeWrite with timeout."},
+};
+
+/* label set of the entry: device and GUID, escaped per the text format */
+static void tee_om_labels(char *labels, size_t len, const struct tee_stats_client *c)
+{
+	const uint8_t *g = (const uint8_t *)&c->guid;
+	size_t pos, i;
+
+	pos = snprintf(labels, len, "device=\"");
+	for (i = 0; c->device[i] && i < TEE_STATS_DEVICE_LEN && pos + 2 < len; i++) {
+		switch (c->device[i]) {
+		case '\\':
+		case '"':
+			labels[pos++] = '\\';
+			labels[pos++] = c->device[i];
+			break;
+		case '\n':
+			labels[pos++] = '\\';
+			labels[pos++] = 'n';
+			break;
+		default:
+			labels[pos++] = c->device[i];
+			break;
+		}
+	}
+	snprintf(labels + pos, len - pos,
+		 "\",guid=\"%02x%02x%02x%02x-%02x%02x-%02x%02x-%02x%02x-"
+		 "%02x%02x%02x%02x%02x%02x\"",
+		 g[3], g[2], g[1], g[0], g[5], g[4], g[7], g[6],
+		 g[8], g[9], g[10], g[11], g[12], g[13], g[14], g[15]);
+}
+
+static void tee_om_hist(struct tee_om_buf *b, const char *name, const char *labels,
+			const struct tee_stats_histogram *h)
+{
+	uint64_t cumulative = 0;
+	uint32_t i;
+
+	/* the count is derived from the buckets to keep them consistent */
+	for (i = 0; i < TEE_STATS_HIST_BUCKETS - 1; i++) {
+		cumulative += h->buckets[i];
+		tee_om_printf(b, "%s_bucket{%s,le=\"%.9g\"} %llu\n", name, labels,
+			      (double)TeeStatsBucketBound(i) / NSEC_IN_SEC,
+			      (unsigned long long)cumulative);
+	}
+	cumulative += h->buckets[i];
+	tee_om_printf(b, "%s_bucket{%s,le=\"+Inf\"} %llu\n", name, labels,
+		      (unsigned long long)cumulative);
+	tee_om_printf(b, "%s_count{%s} %llu\n", name, labels,
+		      (unsigned long long)cumulative);
+	tee_om_printf(b, "%s_sum{%s} %.9g\n", name, labels,
+		      (double)h->sum_ns / NSEC_IN_SEC);
+}
+
+TEESTATUS TEEAPI TeeStatsFormatOpenMetrics(OUT char *buf, IN size_t len,
+					   OUT OPTIONAL size_t *written)
+{
+	struct tee_om_buf b = { buf, len, 0, false };
+	struct tee_stats_counters *c;
+	char labels[2 * TEE_STATS_DEVICE_LEN + 64];
+	unsigned int count, i, j;
+
+	if (!buf || !len)
+		return TEE_INVALID_PARAMETER;
+
+	pthread_mutex_lock(&tee_stats_format_lock);
+
+	count = __atomic_load_n(&tee_stats_groups_count, __ATOMIC_ACQUIRE);
+	for (i = 0; i < count; i++)
+		TeeGetStatsClient(i, &tee_stats_snapshot[i]);
+
+	tee_om_printf(&b, "# TYPE metee_operations counter\n"
+		      "# HELP metee_operations Number of operations.\n");
+	for (i = 0; i < count; i++) {
+		c = &tee_stats_snapshot[i].stats.counters;
+		tee_om_labels(labels, sizeof(labels), &tee_stats_snapshot[i]);
+		tee_om_printf(&b, "metee_operations_total{%s,op=\"connect\"} %llu\n"
+			      "metee_operations_total{%s,op=\"write\"} %llu\n"
+			      "metee_operations_total{%s,op=\"read\"} %llu\n"
+			      "metee_operations_total{%s,op=\"fwstatus\"} %llu\n",
+			      labels, (unsigned long long)c->connects,
+			      labels, (unsigned long long)c->writes,
+			      labels, (unsigned long long)c->reads,
+			      labels, (unsigned long long)c->fwstatus);
+	}
+
+	tee_om_printf(&b, "# TYPE metee_reconnects counter\n"
+		      "# HELP metee_reconnects Connect attempts after the first one of the session.\n");
+	for (i = 0; i < count; i++) {
+		c = &tee_stats_snapshot[i].stats.counters;
+		tee_om_labels(labels, sizeof(labels), &tee_stats_snapshot[i]);
+		tee_om_printf(&b, "metee_reconnects_total{%s} %llu\n",
+			      labels, (unsigned long long)c->reconnects);
+	}
+
+	tee_om_printf(&b, "# TYPE metee_bytes counter\n"
+		      "# UNIT metee_bytes bytes\n"
+		      "# HELP metee_bytes Bytes transferred.\n");
+	for (i = 0; i < count; i++) {
+		c = &tee_stats_snapshot[i].stats.counters;
+		tee_om_labels(labels, sizeof(labels), &tee_stats_snapshot[i]);
+		tee_om_printf(&b, "metee_bytes_total{%s,direction=\"write\"} %llu\n"
+			      "metee_bytes_total{%s,direction=\"read\"} %llu\n",
+			      labels, (unsigned long long)c->bytes_written,
+			      labels, (unsigned long long)c->bytes_read);
+	}
+
+	tee_om_printf(&b, "# TYPE metee_errors counter\n"
+		      "# HELP metee_errors Failed operations by status.\n");
+	for (i = 0; i < count; i++) {
+		c = &tee_stats_snapshot[i].stats.counters;
+		tee_om_labels(labels, sizeof(labels), &tee_stats_snapshot[i]);
+		for (j = TEE_SUCCESS + 1; j < TEE_STATS_STATUS_NUM; j++)
+			tee_om_printf(&b, "metee_errors_total{%s,status=\"%s\"} %llu\n",
+				      labels, tee_om_status_names[j],
+				      (unsigned long long)c->errors[j]);
+	}
+
+	for (j = 0; j < TEE_STATS_HIST_NUM; j++) {
+		tee_om_printf(&b, "# TYPE %s histogram\n# UNIT %s seconds\n# HELP %s %s\n",
+			      tee_om_hists[j].name, tee_om_hists[j].name,
+			      tee_om_hists[j].name, tee_om_hists[j].help);
+		for (i = 0; i < count; i++) {
+			tee_om_labels(labels, sizeof(labels), &tee_stats_snapshot[i]);
+			tee_om_hist(&b, tee_om_hists[j].name, labels,
+				    &tee_stats_snapshot[i].stats.hist[j]);
+		}
+	}
+
+	tee_om_printf(&b, "# EOF\n");
+
+	pthread_mutex_unlock(&tee_stats_format_lock);
+
+	if (written)
+		*written = b.pos;
+	if (b.overflow) {
+		buf[b.pos] = '\0';
+		return TEE_INSUFFICIENT_BUFFER;
+	}
+
+	return TEE_SUCCESS;
+}
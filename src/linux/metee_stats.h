@@ -0,0 +1,56 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2023 Intel Corporation
+ */
+#ifndef __METEE_STATS_H
+#define __METEE_STATS_H
+
+#include <stdint.h>
+
+#include "metee.h"
+
+/* first histogram bucket covers latencies below 2^10 ns */
+#define TEE_STATS_HIST_MIN_SHIFT 10
+/* every power of two is split into 2^2 linear sub-buckets */
+#define TEE_STATS_HIST_SUB_SHIFT 2
+
+/*
+ * Aggregated statistics of all sessions with the same (device, GUID)
+ */
+struct tee_stats_group {
+	char device[TEE_STATS_DEVICE_LEN]; /**< device path */
+	GUID guid;                         /**< client GUID */
+	struct tee_stats stats;            /**< counters and histograms */
+};
+
+/*
+ * Per-session statistics, part of the session structure
+ */
+struct tee_stats_session {
+	struct tee_stats_counters counters; /**< session counters */
+	struct tee_stats_group *group;      /**< aggregate, NULL if table is full */
+	uint64_t write_start;               /**< start of the pending transaction */
+};
+
+uint64_t tee_stats_now(void);
+
+void tee_stats_session_init(struct tee_stats_session *s,
+			    const char *device, const GUID *guid);
+
+void tee_stats_connect(struct tee_stats_session *s, TEESTATUS status);
+
+void tee_stats_write(struct tee_stats_session *s, TEESTATUS status,
+		     size_t bytes, uint64_t start);
+
+void tee_stats_read(struct tee_stats_session *s, TEESTATUS status,
+		    size_t bytes, uint64_t start);
+
+void tee_stats_poll_wait(struct tee_stats_session *s, uint64_t start);
+
+void tee_stats_fwstatus(struct tee_stats_session *s, TEESTATUS status);
+
+void tee_stats_session_get(struct tee_stats_session *s,
+			   struct tee_stats_counters *session,
+			   struct tee_stats *client);
+
+#endif /* __METEE_STATS_H */
@@ -0,0 +1,204 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2023 Intel Corporation
+ */
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "metee.h"
+#include "helpers.h"
+#include "metee_trace.h"
+
+/* number of events per thread, must be power of two */
+#define TEE_TRACE_RING_SIZE 1024
+#define TEE_TRACE_RING_MASK (TEE_TRACE_RING_SIZE - 1)
+
+#define NSEC_IN_SEC 1000000000ULL
+
+/*
+ * Per-thread ring of events.
+ * Only the owner thread writes into the ring, the dumper reads it
+ * concurrently and drops events that were overwritten while copied.
+ * Rings are never freed, a ring of exited thread is reused by the next one.
+ */
+struct tee_trace_ring {
+	struct tee_trace_ring *next; /**< next ring in the registry */
+	uint32_t owned;              /**< ring is used by a live thread */
+	uint32_t thread;             /**< owner thread sequence number */
+	uint64_t head;               /**< number of recorded events */
+	struct tee_trace_event ev[TEE_TRACE_RING_SIZE]; /**< events */
+};
+
+bool tee_trace_enabled;
+
+static struct tee_trace_ring *tee_trace_rings;
+static __thread struct tee_trace_ring *tee_trace_ring;
+static pthread_key_t tee_trace_key;
+static pthread_once_t tee_trace_once = PTHREAD_ONCE_INIT;
+static bool tee_trace_key_valid;
+static uint32_t tee_trace_threads;
+
+/* time stamp counter and monotonic clock at enable, for conversion */
+static uint64_t tee_trace_base_tsc;
+static uint64_t tee_trace_base_ns;
+
+static const char *tee_trace_op_names[TEE_TRACE_OP_MAX] = {
+	[TEE_TRACE_OP_INIT] = "init",
+	[TEE_TRACE_OP_CONNECT] = "connect",
+	[TEE_TRACE_OP_READ] = "read",
+	[TEE_TRACE_OP_WRITE] = "write",
+	[TEE_TRACE_OP_FWSTATUS] = "fwstatus",
+	[TEE_TRACE_OP_DISCONNECT] = "disconnect",
+};
+
+static inline uint64_t tee_trace_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * NSEC_IN_SEC + ts.tv_nsec;
+}
+
+static inline uint64_t tee_trace_tsc(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return tee_trace_ns();
+#endif
+}
+
+static void tee_trace_ring_release(void *data)
+{
+	struct tee_trace_ring *ring = data;
+
+	__atomic_store_n(&ring->owned, 0, __ATOMIC_RELEASE);
+}
+
+static void tee_trace_key_init(void)
+{
+	tee_trace_key_valid = !pthread_key_create(&tee_trace_key,
+						  tee_trace_ring_release);
+}
+
+static struct tee_trace_ring *tee_trace_ring_get(void)
+{
+	struct tee_trace_ring *ring;
+	uint32_t expected;
+
+	pthread_once(&tee_trace_once, tee_trace_key_init);
+	if (!tee_trace_key_valid)
+		return NULL;
+
+	for (ring = __atomic_load_n(&tee_trace_rings, __ATOMIC_ACQUIRE);
+	     ring; ring = ring->next) {
+		expected = 0;
+		if (__atomic_compare_exchange_n(&ring->owned, &expected, 1, false,
+						__ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+			goto found;
+	}
+
+	ring = calloc(1, sizeof(*ring));
+	if (!ring)
+		return NULL;
+	ring->owned = 1;
+	ring->next = __atomic_load_n(&tee_trace_rings, __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(&tee_trace_rings, &ring->next, ring,
+					    true, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+		;
+
+found:
+	ring->thread = __atomic_add_fetch(&tee_trace_threads, 1, __ATOMIC_RELAXED);
+	pthread_setspecific(tee_trace_key, ring);
+	tee_trace_ring = ring;
+	return ring;
+}
+
+void __tee_trace(uint8_t op, uint8_t phase, const void *handle,
+		 size_t len, TEESTATUS status)
+{
+	struct tee_trace_ring *ring = tee_trace_ring;
+	struct tee_trace_event *ev;
+	uint64_t head;
+
+	if (!ring) {
+		ring = tee_trace_ring_get();
+		if (!ring)
+			return;
+	}
+
+	head = ring->head;
+	ev = &ring->ev[head & TEE_TRACE_RING_MASK];
+	ev->tsc = tee_trace_tsc();
+	ev->handle = handle;
+	ev->len = (len > UINT32_MAX) ? UINT32_MAX : (uint32_t)len;
+	ev->status = status;
+	ev->op = op;
+	ev->phase = phase;
+	__atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+uint32_t TEEAPI TeeTraceEnable(IN uint32_t enable)
+{
+	bool prev;
+
+	if (enable && !__atomic_load_n(&tee_trace_enabled, __ATOMIC_RELAXED)) {
+		tee_trace_base_ns = tee_trace_ns();
+		tee_trace_base_tsc = tee_trace_tsc();
+	}
+	prev = __atomic_exchange_n(&tee_trace_enabled, !!enable, __ATOMIC_RELAXED);
+
+	return prev;
+}
+
+TEESTATUS TEEAPI TeeTraceDump(IN int fd)
+{
+	struct tee_trace_ring *ring;
+	struct tee_trace_event ev;
+	uint64_t head, first, i;
+	uint64_t now_tsc, now_ns;
+	double ns_per_tick = 1.0;
+	double ns;
+
+	if (fd < 0)
+		return TEE_INVALID_PARAMETER;
+
+	now_ns = tee_trace_ns();
+	now_tsc = tee_trace_tsc();
+	if (now_tsc > tee_trace_base_tsc && now_ns > tee_trace_base_ns)
+		ns_per_tick = (double)(now_ns - tee_trace_base_ns) /
+			      (double)(now_tsc - tee_trace_base_tsc);
+
+	for (ring = __atomic_load_n(&tee_trace_rings, __ATOMIC_ACQUIRE);
+	     ring; ring = ring->next) {
+		head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+		first = (head > TEE_TRACE_RING_SIZE) ? head - TEE_TRACE_RING_SIZE : 0;
+		for (i = first; i < head; i++) {
+			memcpy(&ev, &ring->ev[i & TEE_TRACE_RING_MASK], sizeof(ev));
+			/* the owner has overwritten the slot while it was copied */
+			if (__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) >=
+			    i + TEE_TRACE_RING_SIZE)
+				continue;
+			if (ev.op >= TEE_TRACE_OP_MAX)
+				continue;
+			ns = (double)(int64_t)(ev.tsc - tee_trace_base_tsc) * ns_per_tick;
+			if (dprintf(fd, "%u %.3f us %s %s handle=%p len=%u status=%u\n",
+				    ring->thread, ns / 1000.0, tee_trace_op_names[ev.op],
+				    ev.phase == TEE_TRACE_ENTRY ? "entry" : "exit",
+				    ev.handle, ev.len, ev.status) < 0)
+				return TEE_UNABLE_TO_COMPLETE_OPERATION;
+		}
+	}
+
+	return TEE_SUCCESS;
+}
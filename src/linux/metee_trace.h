@@ -0,0 +1,75 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2023 Intel Corporation
+ */
+#ifndef __METEE_TRACE_H
+#define __METEE_TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "metee.h"
+
+/*
+ * Compile-time minimum trace level, trace points with higher level
+ * are removed by the compiler.
+ * Uses TEE_LOG_LEVEL_* values: QUIET removes all trace points,
+ * ERROR keeps only failures, VERBOSE keeps all operations.
+ */
+#ifndef METEE_TRACE_LEVEL
+#define METEE_TRACE_LEVEL TEE_LOG_LEVEL_VERBOSE
+#endif /* METEE_TRACE_LEVEL */
+
+/*! Traced operations
+ */
+enum tee_trace_op {
+	TEE_TRACE_OP_INIT = 0,     /**< TeeInit* */
+	TEE_TRACE_OP_CONNECT,      /**< TeeConnect */
+	TEE_TRACE_OP_READ,         /**< TeeRead */
+	TEE_TRACE_OP_WRITE,        /**< TeeWrite */
+	TEE_TRACE_OP_FWSTATUS,     /**< TeeFWStatus */
+	TEE_TRACE_OP_DISCONNECT,   /**< TeeDisconnect */
+	TEE_TRACE_OP_MAX
+};
+
+/*! Phase of the traced operation
+ */
+enum tee_trace_phase {
+	TEE_TRACE_ENTRY = 0, /**< operation started, length is the request */
+	TEE_TRACE_EXIT = 1,  /**< operation ended, length is the result */
+};
+
+/*! Fixed size binary trace event
+ */
+struct tee_trace_event {
+	uint64_t tsc;        /**< time stamp counter */
+	const void *handle;  /**< session handle */
+	uint32_t len;        /**< data length */
+	uint16_t status;     /**< TEESTATUS on exit */
+	uint8_t op;          /**< enum tee_trace_op */
+	uint8_t phase;       /**< enum tee_trace_phase */
+};
+
+extern bool tee_trace_enabled;
+
+void __tee_trace(uint8_t op, uint8_t phase, const void *handle,
+		 size_t len, TEESTATUS status);
+
+/*
+ * Record trace event, the level is compared against the compile-time
+ * minimum so the whole call site vanishes when it is not needed.
+ */
+#define TEE_TRACE(level, op, phase, h, len, status) do {                   \
+	if ((level) <= METEE_TRACE_LEVEL &&                                 \
+	    __atomic_load_n(&tee_trace_enabled, __ATOMIC_RELAXED))         \
+		__tee_trace((op), (phase), (h), (len), (status));          \
+} while (0)
+
+#define TEE_TRACE_ENTER(op, h, len) \
+	TEE_TRACE(TEE_LOG_LEVEL_VERBOSE, op, TEE_TRACE_ENTRY, h, len, TEE_SUCCESS)
+
+#define TEE_TRACE_LEAVE(op, h, len, status) \
+	TEE_TRACE(((status) == TEE_SUCCESS) ? TEE_LOG_LEVEL_VERBOSE : TEE_LOG_LEVEL_ERROR, \
+		  op, TEE_TRACE_EXIT, h, len, status)
+
+#endif /* __METEE_TRACE_H */
@@ -0,0 +1,94 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2023 Intel Corporation
+ */
+#ifndef __METEE_TRANSPORT_H
+#define __METEE_TRANSPORT_H
+
+#include <errno.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <libmei.h>
+
+#include "metee.h"
+
+/* queued response of the loopback transport */
+struct tee_loopback_msg {
+	size_t len;             /**< response length */
+	uint64_t ready;         /**< library clock time the response becomes ready */
+	unsigned char *data;    /**< response buffer, allocated on first use */
+};
+
+/* session of the loopback transport */
+struct tee_loopback_client;
+
+struct tee_loopback {
+	GUID guid;              /**< client GUID */
+	const struct tee_loopback_client *client; /**< client slot, set on connect */
+	uint32_t generation;    /**< generation of the slot on connect */
+	TeeLoopbackResponder responder; /**< responder of the client on connect */
+	void *ctx;              /**< responder context */
+	int fd;                 /**< eventfd, readable while responses are queued */
+	bool connected;         /**< connection state */
+	uint32_t log_level;     /**< log level */
+	uint32_t max_msg_len;   /**< maximal message length of the client */
+	unsigned int head;      /**< oldest queued response */
+	unsigned int count;     /**< number of queued responses */
+	struct tee_loopback_msg *queue; /**< TEE_LOOPBACK_QUEUE_LEN responses, allocated on connect */
+};
+
+/* per session state of the transports */
+union tee_transport_state {
+	struct mei me;          /**< libmei handle */
+	struct tee_loopback lb; /**< loopback session */
+};
+
+/*
+ * Operations of a transport, functions return 0 or negative errno
+ * as libmei does, the caller maps them to TEESTATUS.
+ */
+struct tee_transport_ops {
+	const char *name;
+	int (*open)(union tee_transport_state *t, const char *device,
+		    const GUID *guid, bool device_static, bool verbose);
+	int (*connect)(union tee_transport_state *t,
+		       uint32_t *max_msg_len, uint8_t *prot_ver);
+	bool (*connected)(union tee_transport_state *t);
+	/* drop the connection as a firmware reset does, the handle stays open for connect,
+	 * -EOPNOTSUPP if the session cannot be dropped */
+	int (*disconnect)(union tee_transport_state *t);
+	ssize_t (*read)(union tee_transport_state *t, void *buffer, size_t len);
+	ssize_t (*write)(union tee_transport_state *t, const void *buffer, size_t len);
+	/* wait until read or write would not block, 0, -ETIME or -errno */
+	int (*poll)(union tee_transport_state *t, bool on_read, int timeout);
+	int (*fwstatus)(union tee_transport_state *t, uint32_t num, uint32_t *value);
+	int (*fd)(union tee_transport_state *t);
+	uint32_t (*set_log_level)(union tee_transport_state *t, uint32_t log_level);
+	void (*close)(union tee_transport_state *t);
+};
+
+extern const struct tee_transport_ops tee_transport_mei;
+extern const struct tee_transport_ops tee_transport_loopback;
+
+/* fault injection decorator of the transport, ops itself when no schedule is set */
+const struct tee_transport_ops *tee_transport_fault(const struct tee_transport_ops *ops);
+
+static inline int tee_transport_poll_fd(int fd, bool on_read, int timeout)
+{
+	struct pollfd pfd;
+	int rv;
+
+	pfd.fd = fd;
+	pfd.events = (on_read) ? POLLIN : POLLOUT;
+	errno = 0;
+	rv = poll(&pfd, 1, timeout);
+	if (rv < 0)
+		return -errno;
+	if (rv == 0)
+		return -ETIME;
+	return 0;
+}
+
+#endif /* __METEE_TRANSPORT_H */
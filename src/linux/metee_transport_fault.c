@@ -0,0 +1,385 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2023 Intel Corporation
+ */
+/*
+ * Fault injection: a decorator of the transports failing connect, read
+ * and write by a probabilistic or scripted schedule set by TeeFaultInjectSet
+ * or the METEE_FAULTS environment variable.
+ * Only the handles initialized while a schedule is set use the decorator,
+ * the other handles do not pay for it.
+ */
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "metee.h"
+#include "metee_transport.h"
+
+#define TEE_FAULT_RULES 16
+#define TEE_FAULT_SCHEDULE_LEN 1024
+#define TEE_FAULT_DEFAULT_SEED 0x9E3779B97F4A7C15ULL
+
+enum tee_fault_op {
+	TEE_FAULT_OP_CONNECT = 0,
+	TEE_FAULT_OP_READ,
+	TEE_FAULT_OP_WRITE,
+	TEE_FAULT_OP_NUM
+};
+
+enum tee_fault_kind {
+	TEE_FAULT_NONE = 0,
+	TEE_FAULT_EBUSY,
+	TEE_FAULT_ENODEV,
+	TEE_FAULT_ETIME,
+	TEE_FAULT_EINTR,
+	TEE_FAULT_SHORT,
+};
+
+enum tee_fault_trigger {
+	TEE_FAULT_ALWAYS = 0,
+	TEE_FAULT_PROBABILITY,
+	TEE_FAULT_EVERY,
+	TEE_FAULT_ONCE,
+};
+
+struct tee_fault_rule {
+	enum tee_fault_op op;
+	enum tee_fault_kind kind;
+	enum tee_fault_trigger trigger;
+	double probability;
+	uint64_t n;
+};
+
+struct tee_fault_schedule {
+	unsigned int count;
+	struct tee_fault_rule rules[TEE_FAULT_RULES];
+	uint64_t seed;
+};
+
+static struct tee_fault_schedule tee_fault_schedule;
+static uint64_t tee_fault_calls[TEE_FAULT_OP_NUM];
+static uint64_t tee_fault_rng;
+static uint64_t tee_fault_injected;
+static bool tee_fault_enabled;
+static pthread_mutex_t tee_fault_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t tee_fault_env_once = PTHREAD_ONCE_INIT;
+
+static const char *const tee_fault_op_names[TEE_FAULT_OP_NUM] = {
+	[TEE_FAULT_OP_CONNECT] = "connect",
+	[TEE_FAULT_OP_READ]    = "read",
+	[TEE_FAULT_OP_WRITE]   = "write",
+};
+
+static const struct {
+	const char *name;
+	enum tee_fault_kind kind;
+} tee_fault_kinds[] = {
+	{ "ebusy",  TEE_FAULT_EBUSY },
+	{ "enodev", TEE_FAULT_ENODEV },
+	{ "etime",  TEE_FAULT_ETIME },
+	{ "eintr",  TEE_FAULT_EINTR },
+	{ "short",  TEE_FAULT_SHORT },
+};
+
+/* <op>:<fault>[@<probability>|%<n>|#<n>] */
+static int tee_fault_parse_rule(char *str, struct tee_fault_rule *rule)
+{
+	char *fault, *trigger, *end;
+	unsigned int i;
+	char tc;
+
+	fault = strchr(str, ':');
+	if (!fault)
+		return -EINVAL;
+	*fault++ = '\0';
+
+	for (i = 0; i < TEE_FAULT_OP_NUM; i++) {
+		if (!strcmp(str, tee_fault_op_names[i]))
+			break;
+	}
+	if (i == TEE_FAULT_OP_NUM)
+		return -EINVAL;
+	rule->op = i;
+
+	trigger = fault + strcspn(fault, "@%#");
+	tc = *trigger;
+	*trigger = '\0';
+	for (i = 0; i < sizeof(tee_fault_kinds) / sizeof(tee_fault_kinds[0]); i++) {
+		if (!strcmp(fault, tee_fault_kinds[i].name))
+			break;
+	}
+	if (i == sizeof(tee_fault_kinds) / sizeof(tee_fault_kinds[0]))
+		return -EINVAL;
+	rule->kind = tee_fault_kinds[i].kind;
+	if (rule->kind == TEE_FAULT_SHORT && rule->op != TEE_FAULT_OP_WRITE)
+		return -EINVAL;
+
+	rule->trigger = TEE_FAULT_ALWAYS;
+	if (!tc)
+		return 0;
+
+	errno = 0;
+	if (tc == '@') {
+		rule->trigger = TEE_FAULT_PROBABILITY;
+		rule->probability = strtod(trigger + 1, &end);
+		if (rule->probability < 0.0 || rule->probability > 1.0)
+			return -EINVAL;
+	} else {
+		rule->trigger = (tc == '%') ? TEE_FAULT_EVERY : TEE_FAULT_ONCE;
+		rule->n = strtoull(trigger + 1, &end, 10);
+		if (!rule->n)
+			return -EINVAL;
+	}
+	if (errno || end == trigger + 1 || *end)
+		return -EINVAL;
+
+	return 0;
+}
+
+static int tee_fault_parse(const char *schedule, struct tee_fault_schedule *s)
+{
+	char buf[TEE_FAULT_SCHEDULE_LEN];
+	char *tok, *save = NULL, *end;
+	int rc;
+
+	memset(s, 0, sizeof(*s));
+	s->seed = TEE_FAULT_DEFAULT_SEED;
+	if (!schedule)
+		return 0;
+	if (strlen(schedule) >= sizeof(buf))
+		return -EINVAL;
+	strcpy(buf, schedule);
+
+	for (tok = strtok_r(buf, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+		if (!strncmp(tok, "seed=", 5)) {
+			errno = 0;
+			s->seed = strtoull(tok + 5, &end, 0);
+			if (errno || end == tok + 5 || *end)
+				return -EINVAL;
+			/* xorshift never leaves zero */
+			if (!s->seed)
+				s->seed = TEE_FAULT_DEFAULT_SEED;
+			continue;
+		}
+		if (s->count == TEE_FAULT_RULES)
+			return -EINVAL;
+		rc = tee_fault_parse_rule(tok, &s->rules[s->count]);
+		if (rc)
+			return rc;
+		s->count++;
+	}
+
+	return 0;
+}
+
+static void __tee_fault_set(const struct tee_fault_schedule *s)
+{
+	pthread_mutex_lock(&tee_fault_lock);
+	tee_fault_schedule = *s;
+	memset(tee_fault_calls, 0, sizeof(tee_fault_calls));
+	tee_fault_rng = s->seed;
+	tee_fault_injected = 0;
+	__atomic_store_n(&tee_fault_enabled, s->count > 0, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&tee_fault_lock);
+}
+
+/* an invalid schedule in the environment is ignored */
+static void tee_fault_env_init(void)
+{
+	struct tee_fault_schedule s;
+	const char *env = NULL;
+
+	if (getuid() == geteuid() && getgid() == getegid())
+		env = getenv("METEE_FAULTS");
+	if (env && env[0] && !tee_fault_parse(env, &s))
+		__tee_fault_set(&s);
+}
+
+/* xorshift64*, called with tee_fault_lock held */
+static double __tee_fault_random(void)
+{
+	tee_fault_rng ^= tee_fault_rng >> 12;
+	tee_fault_rng ^= tee_fault_rng << 25;
+	tee_fault_rng ^= tee_fault_rng >> 27;
+	return ((tee_fault_rng * 0x2545F4914F6CDD1DULL) >> 11) * 0x1.0p-53;
+}
+
+/* the first rule of the operation that fires wins,
+ * short rules apply to the emulated clients only */
+static enum tee_fault_kind tee_fault_check(enum tee_fault_op op, bool emulated)
+{
+	enum tee_fault_kind kind = TEE_FAULT_NONE;
+	const struct tee_fault_rule *rule;
+	uint64_t call;
+	unsigned int i;
+	bool fire;
+
+	pthread_mutex_lock(&tee_fault_lock);
+	call = ++tee_fault_calls[op];
+	for (i = 0; i < tee_fault_schedule.count && kind == TEE_FAULT_NONE; i++) {
+		rule = &tee_fault_schedule.rules[i];
+		if (rule->op != op || (rule->kind == TEE_FAULT_SHORT && !emulated))
+			continue;
+		switch (rule->trigger) {
+		case TEE_FAULT_PROBABILITY:
+			fire = __tee_fault_random() < rule->probability;
+			break;
+		case TEE_FAULT_EVERY:
+			fire = (call % rule->n) == 0;
+			break;
+		case TEE_FAULT_ONCE:
+			fire = call == rule->n;
+			break;
+		default:
+			fire = true;
+			break;
+		}
+		if (fire)
+			kind = rule->kind;
+	}
+	if (kind != TEE_FAULT_NONE)
+		tee_fault_injected++;
+	pthread_mutex_unlock(&tee_fault_lock);
+
+	return kind;
+}
+
+static int tee_fault_errno(enum tee_fault_kind kind)
+{
+	switch (kind) {
+	case TEE_FAULT_EBUSY : return -EBUSY;
+	case TEE_FAULT_ENODEV: return -ENODEV;
+	case TEE_FAULT_ETIME : return -ETIME;
+	case TEE_FAULT_EINTR : return -EINTR;
+	default              : return 0;
+	}
+}
+
+/* enodev emulates the firmware reset, a session that cannot be reset is not failed */
+static enum tee_fault_kind tee_fault_reset(const struct tee_transport_ops *ops,
+					   union tee_transport_state *t,
+					   enum tee_fault_kind kind)
+{
+	if (kind != TEE_FAULT_ENODEV || !ops->disconnect(t))
+		return kind;
+
+	pthread_mutex_lock(&tee_fault_lock);
+	tee_fault_injected--;
+	pthread_mutex_unlock(&tee_fault_lock);
+	return TEE_FAULT_NONE;
+}
+
+static int tee_fault_connect(const struct tee_transport_ops *ops,
+			     union tee_transport_state *t,
+			     uint32_t *max_msg_len, uint8_t *prot_ver)
+{
+	int rc = tee_fault_errno(tee_fault_check(TEE_FAULT_OP_CONNECT, false));
+
+	if (rc)
+		return rc;
+	return ops->connect(t, max_msg_len, prot_ver);
+}
+
+/* after enodev the session is gone but the handle stays open */
+static ssize_t tee_fault_read(const struct tee_transport_ops *ops,
+			      union tee_transport_state *t, void *buffer, size_t len)
+{
+	enum tee_fault_kind kind = tee_fault_check(TEE_FAULT_OP_READ, false);
+
+	kind = tee_fault_reset(ops, t, kind);
+	if (kind != TEE_FAULT_NONE)
+		return tee_fault_errno(kind);
+	return ops->read(t, buffer, len);
+}
+
+static ssize_t tee_fault_write(const struct tee_transport_ops *ops,
+			       union tee_transport_state *t, const void *buffer, size_t len)
+{
+	enum tee_fault_kind kind;
+
+	/* a short message would reach the real firmware */
+	kind = tee_fault_check(TEE_FAULT_OP_WRITE, ops == &tee_transport_loopback);
+	if (kind == TEE_FAULT_SHORT)
+		return ops->write(t, buffer, (len > 1) ? len / 2 : len);
+	kind = tee_fault_reset(ops, t, kind);
+	if (kind != TEE_FAULT_NONE)
+		return tee_fault_errno(kind);
+	return ops->write(t, buffer, len);
+}
+
+#define TEE_TRANSPORT_FAULT(backend)                                                  \
+static int tee_fault_##backend##_connect(union tee_transport_state *t,              \
+					 uint32_t *max_msg_len, uint8_t *prot_ver)  \
+{                                                                                     \
+	return tee_fault_connect(&tee_transport_##backend, t, max_msg_len, prot_ver); \
+}                                                                                     \
+static ssize_t tee_fault_##backend##_read(union tee_transport_state *t,             \
+					  void *buffer, size_t len)                  \
+{                                                                                     \
+	return tee_fault_read(&tee_transport_##backend, t, buffer, len);              \
+}                                                                                     \
+static ssize_t tee_fault_##backend##_write(union tee_transport_state *t,            \
+					   const void *buffer, size_t len)           \
+{                                                                                     \
+	return tee_fault_write(&tee_transport_##backend, t, buffer, len);             \
+}                                                                                     \
+static struct tee_transport_ops tee_transport_fault_##backend;                       \
+static void tee_transport_fault_##backend##_init(void)                               \
+{                                                                                     \
+	tee_transport_fault_##backend = tee_transport_##backend;                      \
+	tee_transport_fault_##backend.name = #backend "+fault";                       \
+	tee_transport_fault_##backend.connect = tee_fault_##backend##_connect;        \
+	tee_transport_fault_##backend.read = tee_fault_##backend##_read;              \
+	tee_transport_fault_##backend.write = tee_fault_##backend##_write;            \
+}
+
+TEE_TRANSPORT_FAULT(mei)
+TEE_TRANSPORT_FAULT(loopback)
+
+static void tee_transport_fault_init(void)
+{
+	tee_transport_fault_mei_init();
+	tee_transport_fault_loopback_init();
+	tee_fault_env_init();
+}
+
+const struct tee_transport_ops *tee_transport_fault(const struct tee_transport_ops *ops)
+{
+	pthread_once(&tee_fault_env_once, tee_transport_fault_init);
+
+	if (!__atomic_load_n(&tee_fault_enabled, __ATOMIC_ACQUIRE))
+		return ops;
+	if (ops == &tee_transport_mei)
+		return &tee_transport_fault_mei;
+	if (ops == &tee_transport_loopback)
+		return &tee_transport_fault_loopback;
+	return ops;
+}
+
+TEESTATUS TEEAPI TeeFaultInjectSet(IN OPTIONAL const char *schedule)
+{
+	struct tee_fault_schedule s;
+
+	pthread_once(&tee_fault_env_once, tee_transport_fault_init);
+
+	if (tee_fault_parse(schedule, &s))
+		return TEE_INVALID_PARAMETER;
+	__tee_fault_set(&s);
+	return TEE_SUCCESS;
+}
+
+TEESTATUS TEEAPI TeeFaultInjectCount(OUT uint64_t *count)
+{
+	if (!count)
+		return TEE_INVALID_PARAMETER;
+
+	pthread_mutex_lock(&tee_fault_lock);
+	*count = tee_fault_injected;
+	pthread_mutex_unlock(&tee_fault_lock);
+	return TEE_SUCCESS;
+}
@@ -0,0 +1,415 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2023 Intel Corporation
+ */
+/*
+ * In-process transport: the firmware clients are emulated by responders
+ * registered with TeeLoopbackRegister, the response is produced
+ * synchronously in TeeWrite and queued until TeeRead.
+ * A queued response becomes ready after the latency of the client,
+ * TeeRead waits for it on the library clock.
+ * A handle is not used from several threads at once, so an empty queue
+ * cannot be filled while TeeRead waits and poll does not sleep for it,
+ * only the virtual clock is moved by the timeout.
+ * Registration takes the global lock, the sessions do not: a session
+ * takes the responder of its client slot on connect and a write only
+ * checks that the slot generation did not change since, so handles
+ * running in parallel do not contend in the transport.
+ */
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "metee.h"
+#include "metee_transport.h"
+#include "metee_clock.h"
+
+#define TEE_LOOPBACK_CLIENTS 32
+#define TEE_LOOPBACK_FW_STATUS_NUM 6
+
+#define NSEC_IN_MSEC 1000000ULL
+
+/*
+ * Slots do not move, a register or unregister bumps the generation,
+ * which disconnects the sessions of the previous registration.
+ */
+struct tee_loopback_client {
+	GUID guid;
+	bool used;
+	uint32_t generation;
+	uint32_t max_msg_len;
+	uint8_t prot_ver;
+	TeeLoopbackResponder responder;
+	void *ctx;
+	uint64_t latency;
+};
+
+static struct tee_loopback_client tee_loopback_clients[TEE_LOOPBACK_CLIENTS];
+static pthread_mutex_t tee_loopback_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t tee_loopback_fwsts[TEE_LOOPBACK_FW_STATUS_NUM];
+
+/* called with tee_loopback_lock held */
+static struct tee_loopback_client *__tee_loopback_find(const GUID *guid)
+{
+	unsigned int i;
+
+	for (i = 0; i < TEE_LOOPBACK_CLIENTS; i++) {
+		if (tee_loopback_clients[i].used &&
+		    !memcmp(&tee_loopback_clients[i].guid, guid, sizeof(*guid)))
+			return &tee_loopback_clients[i];
+	}
+	return NULL;
+}
+
+/* called with tee_loopback_lock held */
+static void __tee_loopback_bump(struct tee_loopback_client *cl)
+{
+	__atomic_store_n(&cl->generation, cl->generation + 1, __ATOMIC_RELEASE);
+}
+
+static bool tee_loopback_valid(const struct tee_loopback *lb)
+{
+	return __atomic_load_n(&lb->client->generation, __ATOMIC_ACQUIRE) == lb->generation;
+}
+
+static int status2errno(TEESTATUS status)
+{
+	switch (status) {
+		case TEE_SUCCESS          : return 0;
+		case TEE_CLIENT_NOT_FOUND : return -ENOTTY;
+		case TEE_BUSY             : return -EBUSY;
+		case TEE_DISCONNECTED     : return -ENODEV;
+		case TEE_TIMEOUT          : return -ETIME;
+		case TEE_PERMISSION_DENIED: return -EACCES;
+		default                   : return -EIO;
+	}
+}
+
+static void tee_loopback_free_queue(struct tee_loopback *lb)
+{
+	unsigned int i;
+
+	if (!lb->queue)
+		return;
+	for (i = 0; i < TEE_LOOPBACK_QUEUE_LEN; i++)
+		free(lb->queue[i].data);
+	free(lb->queue);
+	lb->queue = NULL;
+	lb->head = 0;
+	lb->count = 0;
+}
+
+static int tee_loopback_open(union tee_transport_state *t, const char *device,
+			     const GUID *guid, bool device_static, bool verbose)
+{
+	struct tee_loopback *lb = &t->lb;
+
+	(void)device;
+	(void)device_static;
+
+	memset(lb, 0, sizeof(*lb));
+	lb->fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK | EFD_SEMAPHORE);
+	if (lb->fd < 0)
+		return -errno;
+	memcpy(&lb->guid, guid, sizeof(lb->guid));
+	lb->log_level = verbose ? TEE_LOG_LEVEL_VERBOSE : TEE_LOG_LEVEL_ERROR;
+
+	return 0;
+}
+
+static int tee_loopback_connect(union tee_transport_state *t,
+				uint32_t *max_msg_len, uint8_t *prot_ver)
+{
+	struct tee_loopback *lb = &t->lb;
+	struct tee_loopback_client *cl;
+
+	if (lb->connected)
+		return -EINVAL;
+
+	if (!lb->queue) {
+		lb->queue = calloc(TEE_LOOPBACK_QUEUE_LEN, sizeof(*lb->queue));
+		if (!lb->queue)
+			return -ENOMEM;
+	}
+
+	pthread_mutex_lock(&tee_loopback_lock);
+	cl = __tee_loopback_find(&lb->guid);
+	if (cl) {
+		lb->client = cl;
+		lb->generation = cl->generation;
+		lb->responder = cl->responder;
+		lb->ctx = cl->ctx;
+		lb->max_msg_len = cl->max_msg_len;
+		*max_msg_len = cl->max_msg_len;
+		*prot_ver = cl->prot_ver;
+	}
+	pthread_mutex_unlock(&tee_loopback_lock);
+	if (!cl)
+		return -ENOTTY;
+
+	lb->connected = true;
+	return 0;
+}
+
+static bool tee_loopback_connected(union tee_transport_state *t)
+{
+	return t->lb.connected;
+}
+
+/* the responses queued before the reset are lost */
+static int tee_loopback_disconnect(union tee_transport_state *t)
+{
+	struct tee_loopback *lb = &t->lb;
+	uint64_t cnt;
+
+	while (lb->count) {
+		if (read(lb->fd, &cnt, sizeof(cnt)) != sizeof(cnt))
+			break;
+		lb->count--;
+	}
+	lb->head = 0;
+	lb->count = 0;
+	lb->connected = false;
+	return 0;
+}
+
+static ssize_t tee_loopback_read(union tee_transport_state *t, void *buffer, size_t len)
+{
+	struct tee_loopback *lb = &t->lb;
+	struct tee_loopback_msg *msg;
+	uint64_t cnt;
+	ssize_t rc;
+
+	if (!lb->connected)
+		return -ENODEV;
+	if (!lb->count)
+		return -ETIME;
+
+	msg = &lb->queue[lb->head];
+	tee_clock_wait_until(msg->ready);
+	if (len < msg->len) {
+		rc = -EMSGSIZE;
+	} else {
+		memcpy(buffer, msg->data, msg->len);
+		rc = (ssize_t)msg->len;
+	}
+	lb->head = (lb->head + 1) % TEE_LOOPBACK_QUEUE_LEN;
+	lb->count--;
+	if (read(lb->fd, &cnt, sizeof(cnt)) != sizeof(cnt))
+		return -EIO;
+
+	return rc;
+}
+
+static ssize_t tee_loopback_write(union tee_transport_state *t, const void *buffer, size_t len)
+{
+	struct tee_loopback *lb = &t->lb;
+	struct tee_loopback_msg *msg;
+	size_t resp_len;
+	uint64_t cnt = 1;
+	TEESTATUS status;
+
+	if (!lb->connected)
+		return -ENODEV;
+	if (len > lb->max_msg_len)
+		return -EFBIG;
+	if (lb->count == TEE_LOOPBACK_QUEUE_LEN)
+		return -EBUSY;
+
+	if (!tee_loopback_valid(lb)) {
+		tee_loopback_disconnect(t);
+		return -ENODEV;
+	}
+
+	msg = &lb->queue[(lb->head + lb->count) % TEE_LOOPBACK_QUEUE_LEN];
+	if (!msg->data) {
+		msg->data = malloc(lb->max_msg_len);
+		if (!msg->data)
+			return -ENOMEM;
+	}
+
+	resp_len = lb->max_msg_len;
+	status = lb->responder(lb->ctx, &lb->guid, buffer, len,
+			       msg->data, &resp_len);
+	if (status)
+		return status2errno(status);
+	if (resp_len > lb->max_msg_len)
+		return -EIO;
+
+	if (resp_len) {
+		msg->len = resp_len;
+		msg->ready = tee_clock_now() +
+			     __atomic_load_n(&lb->client->latency, __ATOMIC_RELAXED);
+		lb->count++;
+		if (write(lb->fd, &cnt, sizeof(cnt)) != sizeof(cnt))
+			return -EIO;
+	}
+
+	return (ssize_t)len;
+}
+
+/* nothing changes while the caller waits, the real clock does not pay the timeout */
+static int tee_loopback_poll_timeout(int timeout)
+{
+	if (tee_clock_is_virtual() && timeout > 0)
+		tee_clock_wait_until(tee_clock_now() + (uint64_t)timeout * NSEC_IN_MSEC);
+	return -ETIME;
+}
+
+static int tee_loopback_poll(union tee_transport_state *t, bool on_read, int timeout)
+{
+	struct tee_loopback *lb = &t->lb;
+	uint64_t now, ready;
+
+	if (!on_read)
+		return (lb->count < TEE_LOOPBACK_QUEUE_LEN) ? 0 : tee_loopback_poll_timeout(timeout);
+	if (!lb->count)
+		return tee_loopback_poll_timeout(timeout);
+
+	now = tee_clock_now();
+	ready = lb->queue[lb->head].ready;
+	if (ready <= now)
+		return 0;
+	if (timeout >= 0 && ready - now > (uint64_t)timeout * NSEC_IN_MSEC) {
+		tee_clock_wait_until(now + (uint64_t)timeout * NSEC_IN_MSEC);
+		return -ETIME;
+	}
+	tee_clock_wait_until(ready);
+	return 0;
+}
+
+static int tee_loopback_fwstatus(union tee_transport_state *t, uint32_t num, uint32_t *value)
+{
+	(void)t;
+
+	if (num >= TEE_LOOPBACK_FW_STATUS_NUM)
+		return -EINVAL;
+	*value = __atomic_load_n(&tee_loopback_fwsts[num], __ATOMIC_RELAXED);
+	return 0;
+}
+
+static int tee_loopback_fd(union tee_transport_state *t)
+{
+	return t->lb.fd;
+}
+
+static uint32_t tee_loopback_set_log_level(union tee_transport_state *t, uint32_t log_level)
+{
+	uint32_t prev_log_level = t->lb.log_level;
+
+	t->lb.log_level = log_level;
+	return prev_log_level;
+}
+
+static void tee_loopback_close(union tee_transport_state *t)
+{
+	struct tee_loopback *lb = &t->lb;
+
+	tee_loopback_free_queue(lb);
+	if (lb->fd >= 0)
+		close(lb->fd);
+	lb->fd = -1;
+	lb->connected = false;
+}
+
+const struct tee_transport_ops tee_transport_loopback = {
+	.name = "loopback",
+	.open = tee_loopback_open,
+	.connect = tee_loopback_connect,
+	.connected = tee_loopback_connected,
+	.disconnect = tee_loopback_disconnect,
+	.read = tee_loopback_read,
+	.write = tee_loopback_write,
+	.poll = tee_loopback_poll,
+	.fwstatus = tee_loopback_fwstatus,
+	.fd = tee_loopback_fd,
+	.set_log_level = tee_loopback_set_log_level,
+	.close = tee_loopback_close,
+};
+
+TEESTATUS TEEAPI TeeLoopbackRegister(IN const GUID *guid, IN uint32_t maxMsgLen,
+				     IN uint8_t protocolVersion,
+				     IN TeeLoopbackResponder responder,
+				     IN OPTIONAL void *ctx)
+{
+	struct tee_loopback_client *cl;
+	TEESTATUS status = TEE_SUCCESS;
+	unsigned int i;
+
+	if (!guid || !responder || !maxMsgLen)
+		return TEE_INVALID_PARAMETER;
+
+	pthread_mutex_lock(&tee_loopback_lock);
+	cl = __tee_loopback_find(guid);
+	for (i = 0; !cl && i < TEE_LOOPBACK_CLIENTS; i++)
+		if (!tee_loopback_clients[i].used)
+			cl = &tee_loopback_clients[i];
+	if (cl) {
+		memcpy(&cl->guid, guid, sizeof(cl->guid));
+		cl->used = true;
+		cl->max_msg_len = maxMsgLen;
+		cl->prot_ver = protocolVersion;
+		cl->responder = responder;
+		cl->ctx = ctx;
+		__atomic_store_n(&cl->latency, 0, __ATOMIC_RELAXED);
+		__tee_loopback_bump(cl);
+	} else {
+		status = TEE_INTERNAL_ERROR;
+	}
+	pthread_mutex_unlock(&tee_loopback_lock);
+
+	return status;
+}
+
+TEESTATUS TEEAPI TeeLoopbackUnregister(IN const GUID *guid)
+{
+	struct tee_loopback_client *cl;
+	TEESTATUS status = TEE_SUCCESS;
+
+	if (!guid)
+		return TEE_INVALID_PARAMETER;
+
+	pthread_mutex_lock(&tee_loopback_lock);
+	cl = __tee_loopback_find(guid);
+	if (cl) {
+		cl->used = false;
+		__tee_loopback_bump(cl);
+	} else
+		status = TEE_CLIENT_NOT_FOUND;
+	pthread_mutex_unlock(&tee_loopback_lock);
+
+	return status;
+}
+
+TEESTATUS TEEAPI TeeLoopbackSetLatency(IN const GUID *guid, IN uint64_t latency)
+{
+	struct tee_loopback_client *cl;
+	TEESTATUS status = TEE_SUCCESS;
+
+	if (!guid)
+		return TEE_INVALID_PARAMETER;
+
+	pthread_mutex_lock(&tee_loopback_lock);
+	cl = __tee_loopback_find(guid);
+	if (cl)
+		__atomic_store_n(&cl->latency, latency, __ATOMIC_RELAXED);
+	else
+		status = TEE_CLIENT_NOT_FOUND;
+	pthread_mutex_unlock(&tee_loopback_lock);
+
+	return status;
+}
+
+TEESTATUS TEEAPI TeeLoopbackSetFWStatus(IN uint32_t fwStatusNum, IN uint32_t fwStatus)
+{
+	if (fwStatusNum >= TEE_LOOPBACK_FW_STATUS_NUM)
+		return TEE_INVALID_PARAMETER;
+
+	__atomic_store_n(&tee_loopback_fwsts[fwStatusNum], fwStatus, __ATOMIC_RELAXED);
+	return TEE_SUCCESS;
+}
@@ -0,0 +1,115 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2023 Intel Corporation
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <libmei.h>
+
+#include "metee_transport.h"
+
+static int tee_mei_open(union tee_transport_state *t, const char *device,
+			const GUID *guid, bool device_static, bool verbose)
+{
+	if (device_static)
+		return mei_init_static_device(&t->me, device, guid, 0, verbose);
+	return mei_init(&t->me, device, guid, 0, verbose);
+}
+
+static int tee_mei_connect(union tee_transport_state *t,
+			   uint32_t *max_msg_len, uint8_t *prot_ver)
+{
+	int rc;
+
+	rc = mei_connect(&t->me);
+	if (rc)
+		return rc;
+
+	*max_msg_len = t->me.buf_size;
+	*prot_ver = t->me.prot_ver;
+	return 0;
+}
+
+static bool tee_mei_connected(union tee_transport_state *t)
+{
+	return t->me.state == MEI_CL_STATE_CONNECTED;
+}
+
+/*
+ * The reset drops the session in the driver too: a new open file takes
+ * the place of the descriptor, so its number stays valid for the pollers.
+ * The descriptor of TeeInitHandle belongs to the caller and is not replaced,
+ * its session stays connected in the driver.
+ */
+static int tee_mei_disconnect(union tee_transport_state *t)
+{
+	struct mei *me = &t->me;
+	int fd;
+
+	if (me->state != MEI_CL_STATE_CONNECTED)
+		return 0;
+	if (!me->close_on_exit || !me->device)
+		return -EOPNOTSUPP;
+
+	fd = open(me->device, O_RDWR | O_CLOEXEC);
+	if (fd < 0)
+		return -errno;
+	if (dup3(fd, me->fd, O_CLOEXEC) < 0) {
+		close(fd);
+		return -errno;
+	}
+	close(fd);
+	me->state = MEI_CL_STATE_DISCONNECTED;
+	return 0;
+}
+
+static ssize_t tee_mei_read(union tee_transport_state *t, void *buffer, size_t len)
+{
+	return mei_recv_msg(&t->me, buffer, len);
+}
+
+static ssize_t tee_mei_write(union tee_transport_state *t, const void *buffer, size_t len)
+{
+	return mei_send_msg(&t->me, buffer, len);
+}
+
+static int tee_mei_poll(union tee_transport_state *t, bool on_read, int timeout)
+{
+	return tee_transport_poll_fd(t->me.fd, on_read, timeout);
+}
+
+static int tee_mei_fwstatus(union tee_transport_state *t, uint32_t num, uint32_t *value)
+{
+	return mei_fwstatus(&t->me, num, value);
+}
+
+static int tee_mei_fd(union tee_transport_state *t)
+{
+	return t->me.fd;
+}
+
+static uint32_t tee_mei_set_log_level(union tee_transport_state *t, uint32_t log_level)
+{
+	return mei_set_log_level(&t->me, log_level);
+}
+
+static void tee_mei_close(union tee_transport_state *t)
+{
+	mei_deinit(&t->me);
+}
+
+const struct tee_transport_ops tee_transport_mei = {
+	.name = "mei",
+	.open = tee_mei_open,
+	.connect = tee_mei_connect,
+	.connected = tee_mei_connected,
+	.disconnect = tee_mei_disconnect,
+	.read = tee_mei_read,
+	.write = tee_mei_write,
+	.poll = tee_mei_poll,
+	.fwstatus = tee_mei_fwstatus,
+	.fd = tee_mei_fd,
+	.set_log_level = tee_mei_set_log_level,
+	.close = tee_mei_close,
+};
@@ -0,0 +1,195 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2023 Intel Corporation
+ */
+/*
+ * AMTHI client on top of TeeWrite/TeeRead, common to all platforms.
+ * Requests are constant pre-encoded headers. The code versions response
+ * is about 2KB of fixed size strings, it is read into the caller buffer
+ * and left there: the view keeps a pointer to it, an entry is checked
+ * and turned into pointer and length only when it is asked for, and the
+ * lookup compares the descriptions in place.
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "metee.h"
+#include "metee_amthi.h"
+#include "amthi_schema.h"
+
+/* the public constants and layouts are the ones of schema/amthi.heci */
+HECI_SCHEMA_STATIC_ASSERT(TEE_AMTHI_CODE_VERSIONS == AMTHI_GET_CODE_VERSIONS_REQ_HEADER_COMMAND_VAL,
+			  "code versions command");
+HECI_SCHEMA_STATIC_ASSERT((TEE_AMTHI_CODE_VERSIONS | TEE_AMTHI_RESPONSE) ==
+			  AMTHI_GET_CODE_VERSIONS_RSP_HEADER_COMMAND_VAL, "response bit");
+HECI_SCHEMA_STATIC_ASSERT(TEE_AMTHI_VERSION_MAJOR == AMTHI_GET_CODE_VERSIONS_REQ_HEADER_VERSION_MAJOR &&
+			  TEE_AMTHI_VERSION_MINOR == AMTHI_GET_CODE_VERSIONS_REQ_HEADER_VERSION_MINOR,
+			  "interface version");
+HECI_SCHEMA_STATIC_ASSERT(sizeof(struct tee_amthi_hdr) == sizeof(struct amthi_hdr), "header");
+HECI_SCHEMA_STATIC_ASSERT(sizeof(struct tee_amthi_rsp_hdr) ==
+			  offsetof(struct amthi_get_code_versions_rsp, bios_version), "response header");
+HECI_SCHEMA_STATIC_ASSERT(TEE_AMTHI_CODE_VERSIONS_LEN == AMTHI_GET_CODE_VERSIONS_RSP_MAX_LEN,
+			  "code versions length");
+
+static const struct amthi_get_code_versions_req tee_amthi_code_versions_req = {
+	{ { AMTHI_GET_CODE_VERSIONS_REQ_HEADER_VERSION_MAJOR,
+	    AMTHI_GET_CODE_VERSIONS_REQ_HEADER_VERSION_MINOR }, 0,
+	  { AMTHI_GET_CODE_VERSIONS_REQ_HEADER_COMMAND_VAL }, 0 }
+};
+
+/* the response without the entries */
+#define TEE_AMTHI_CODE_VERSIONS_MIN_LEN \
+	offsetof(struct amthi_get_code_versions_rsp, versions)
+
+TEESTATUS TEEAPI TeeAmthiTransact(IN PTEEHANDLE handle,
+				  IN const void *request, IN size_t requestSize,
+				  OUT void *buffer, IN size_t bufferSize,
+				  OUT const struct tee_amthi_rsp_hdr **response,
+				  OUT size_t *responseSize, IN uint32_t timeout)
+{
+	const struct tee_amthi_hdr *req = request;
+	const struct tee_amthi_rsp_hdr *rsp = buffer;
+	size_t written = 0;
+	size_t received = 0;
+	TEESTATUS status;
+
+	if (!handle || !request || requestSize < sizeof(*req) ||
+	    !buffer || bufferSize < sizeof(*rsp) || !response || !responseSize)
+		return TEE_INVALID_PARAMETER;
+
+	*response = NULL;
+	*responseSize = 0;
+
+	status = TeeWrite(handle, request, requestSize, &written, timeout);
+	if (status != TEE_SUCCESS)
+		return status;
+	if (written != requestSize)
+		return TEE_UNABLE_TO_COMPLETE_OPERATION;
+
+	status = TeeRead(handle, buffer, bufferSize, &received, timeout);
+	if (status != TEE_SUCCESS)
+		return status;
+
+	if (received < sizeof(*rsp) ||
+	    rsp->hdr.command != (req->command | TEE_AMTHI_RESPONSE))
+		return TEE_INTERNAL_ERROR;
+	/* the device truncates a longer message to the buffer and keeps the rest queued */
+	if (received == bufferSize && rsp->hdr.length > received - sizeof(rsp->hdr))
+		return TEE_INSUFFICIENT_BUFFER;
+	if (rsp->hdr.length != received - sizeof(rsp->hdr))
+		return TEE_INTERNAL_ERROR;
+
+	*response = rsp;
+	*responseSize = received;
+
+	return (rsp->status == 0) ? TEE_SUCCESS : TEE_UNABLE_TO_COMPLETE_OPERATION;
+}
+
+TEESTATUS TEEAPI TeeAmthiGetCodeVersions(IN PTEEHANDLE handle,
+					 OUT void *buffer, IN size_t bufferSize,
+					 OUT struct tee_amthi_code_versions *versions,
+					 IN uint32_t timeout)
+{
+	const struct amthi_get_code_versions_rsp *cv = buffer;
+	const struct tee_amthi_rsp_hdr *rsp;
+	size_t len;
+	TEESTATUS status;
+
+	if (!buffer || !versions)
+		return TEE_INVALID_PARAMETER;
+	if (bufferSize < sizeof(*cv))
+		return TEE_INSUFFICIENT_BUFFER;
+
+	versions->rsp = NULL;
+	versions->count = 0;
+
+	status = TeeAmthiTransact(handle, &tee_amthi_code_versions_req,
+				  sizeof(tee_amthi_code_versions_req),
+				  buffer, bufferSize, &rsp, &len, timeout);
+	if (status != TEE_SUCCESS)
+		return status;
+	if (len < TEE_AMTHI_CODE_VERSIONS_MIN_LEN ||
+	    cv->versions_count > AMTHI_VERSIONS_NUMBER ||
+	    len < TEE_AMTHI_CODE_VERSIONS_MIN_LEN +
+		  cv->versions_count * sizeof(cv->versions[0]))
+		return TEE_INTERNAL_ERROR;
+
+	versions->rsp = cv;
+	versions->count = cv->versions_count;
+	return TEE_SUCCESS;
+}
+
+TEESTATUS TEEAPI TeeAmthiCodeVersionsBios(IN const struct tee_amthi_code_versions *versions,
+					  OUT struct tee_amthi_string_view *bios)
+{
+	const struct amthi_get_code_versions_rsp *cv;
+	const uint8_t *end;
+
+	if (!versions || !versions->rsp || !bios)
+		return TEE_INVALID_PARAMETER;
+
+	cv = versions->rsp;
+	end = memchr(cv->bios_version, 0, sizeof(cv->bios_version));
+	bios->data = (const char *)cv->bios_version;
+	bios->length = (end) ? (size_t)(end - cv->bios_version) : sizeof(cv->bios_version);
+	return TEE_SUCCESS;
+}
+
+static TEESTATUS tee_amthi_string(const struct amthi_unicode_string *str,
+				  struct tee_amthi_string_view *view)
+{
+	if (str->length > sizeof(str->string))
+		return TEE_INTERNAL_ERROR;
+	if (view) {
+		view->data = (const char *)str->string;
+		view->length = str->length;
+	}
+	return TEE_SUCCESS;
+}
+
+TEESTATUS TEEAPI TeeAmthiCodeVersionsAt(IN const struct tee_amthi_code_versions *versions,
+					IN size_t index,
+					OUT OPTIONAL struct tee_amthi_string_view *description,
+					OUT OPTIONAL struct tee_amthi_string_view *version)
+{
+	const struct amthi_get_code_versions_rsp *cv;
+	const struct amthi_version_type *entry;
+	TEESTATUS status;
+
+	if (!versions || !versions->rsp || index >= versions->count)
+		return TEE_INVALID_PARAMETER;
+
+	cv = versions->rsp;
+	entry = &cv->versions[index];
+	status = tee_amthi_string(&entry->description, description);
+	if (status != TEE_SUCCESS)
+		return status;
+	return tee_amthi_string(&entry->version, version);
+}
+
+TEESTATUS TEEAPI TeeAmthiCodeVersionsFind(IN const struct tee_amthi_code_versions *versions,
+					  IN const char *description,
+					  OUT struct tee_amthi_string_view *version)
+{
+	const struct amthi_get_code_versions_rsp *cv;
+	const struct amthi_version_type *entry;
+	size_t len;
+	size_t i;
+
+	if (!versions || !versions->rsp || !description || !version)
+		return TEE_INVALID_PARAMETER;
+
+	len = strlen(description);
+	if (len > AMTHI_UNICODE_STRING_LEN)
+		return TEE_NOTSUPPORTED;
+
+	cv = versions->rsp;
+	for (i = 0; i < versions->count; i++) {
+		entry = &cv->versions[i];
+		if (entry->description.length == len &&
+		    !memcmp(entry->description.string, description, len))
+			return tee_amthi_string(&entry->version, version);
+	}
+	return TEE_NOTSUPPORTED;
+}
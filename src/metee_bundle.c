@@ -0,0 +1,442 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2023 Intel Corporation
+ */
+/*
+ * metee bundle: a header, a directory of partitions and the partition
+ * images, in one file; a container of metee, not a firmware format.
+ * The file is mapped read-only and the directory is indexed in place,
+ * a partition is a pointer into the mapping that is handed to the
+ * update pipeline as is.
+ * The verification splits the selected partitions into the hash blocks
+ * and numbers them globally; workers take the next block number from a
+ * shared index and store the block hash in its slot, so the result does
+ * not depend on the number of threads. The waiting thread combines the
+ * block hashes of every partition, the same way TeeFwuImageHash does.
+ * TeeBundleCreate maps the partition images, hashes them and writes the
+ * header, the directory and the images one after the other.
+ */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif /* _WIN32 */
+
+#include "metee.h"
+#include "metee_fwu.h"
+#include "metee_bundle.h"
+#include "metee_fwu_int.h"
+
+/* verification in progress */
+struct tee_bundle_verify {
+	const struct tee_bundle *bundle;
+	uint32_t payload_type;
+	size_t *first;          /**< first block of every partition, count + 1 entries */
+	uint64_t *hashes;       /**< hash of every block */
+	size_t blocks;          /**< number of blocks */
+	tee_fwu_index_t next;   /**< next block to hash */
+	struct tee_fwu_thread *threads;
+	size_t started;
+};
+
+struct tee_bundle {
+	struct tee_fwu_image image;
+	struct tee_bundle_partition *partitions;
+	size_t count;
+	struct tee_bundle_verify *verify;
+};
+
+static TEESTATUS tee_bundle_index(struct tee_bundle *bundle)
+{
+	const uint8_t *data = bundle->image.data;
+	uint64_t size = bundle->image.size;
+	struct tee_bundle_hdr hdr;
+	struct tee_bundle_entry entry;
+	size_t i;
+
+	if (size < sizeof(hdr))
+		return TEE_INVALID_PARAMETER;
+	memcpy(&hdr, data, sizeof(hdr));
+	if (hdr.magic != TEE_BUNDLE_MAGIC || hdr.version != TEE_BUNDLE_VERSION ||
+	    hdr.header_length < sizeof(hdr) || hdr.entry_length < sizeof(entry) ||
+	    hdr.partitions == 0 ||
+	    hdr.header_length + (uint64_t)hdr.partitions * hdr.entry_length > size)
+		return TEE_INVALID_PARAMETER;
+
+	bundle->partitions = calloc(hdr.partitions, sizeof(*bundle->partitions));
+	if (!bundle->partitions)
+		return TEE_INTERNAL_ERROR;
+	bundle->count = hdr.partitions;
+
+	for (i = 0; i < bundle->count; i++) {
+		memcpy(&entry, data + hdr.header_length + i * hdr.entry_length, sizeof(entry));
+		if (entry.length == 0 || (uint64_t)entry.offset + entry.length > size)
+			return TEE_INVALID_PARAMETER;
+		bundle->partitions[i].payload_type = entry.payload_type;
+		bundle->partitions[i].data = data + entry.offset;
+		bundle->partitions[i].size = entry.length;
+		bundle->partitions[i].hash = entry.hash;
+	}
+	return TEE_SUCCESS;
+}
+
+TEESTATUS TEEAPI TeeBundleOpen(IN const char *path,
+			       OUT struct tee_bundle **bundle)
+{
+	struct tee_bundle *p;
+	TEESTATUS status;
+
+	if (!path || !bundle)
+		return TEE_INVALID_PARAMETER;
+
+	p = calloc(1, sizeof(*p));
+	if (!p)
+		return TEE_INTERNAL_ERROR;
+
+	status = tee_fwu_map(path, &p->image);
+	if (status != TEE_SUCCESS) {
+		free(p);
+		return status;
+	}
+
+	status = tee_bundle_index(p);
+	if (status != TEE_SUCCESS) {
+		TeeBundleClose(p);
+		return status;
+	}
+
+	*bundle = p;
+	return TEE_SUCCESS;
+}
+
+void TEEAPI TeeBundleClose(IN struct tee_bundle *bundle)
+{
+	if (!bundle)
+		return;
+	if (bundle->verify)
+		TeeBundleVerifyWait(bundle);
+	tee_fwu_unmap(&bundle->image);
+	free(bundle->partitions);
+	free(bundle);
+}
+
+TEESTATUS TEEAPI TeeBundlePartitions(IN const struct tee_bundle *bundle,
+				     OUT const struct tee_bundle_partition **partitions,
+				     OUT size_t *count)
+{
+	if (!bundle || !partitions || !count)
+		return TEE_INVALID_PARAMETER;
+	*partitions = bundle->partitions;
+	*count = bundle->count;
+	return TEE_SUCCESS;
+}
+
+TEESTATUS TEEAPI TeeBundleFind(IN const struct tee_bundle *bundle,
+			       IN uint32_t payloadType,
+			       OUT const struct tee_bundle_partition **partition)
+{
+	size_t i;
+
+	if (!bundle || !partition)
+		return TEE_INVALID_PARAMETER;
+	for (i = 0; i < bundle->count; i++) {
+		if (bundle->partitions[i].payload_type == payloadType) {
+			*partition = &bundle->partitions[i];
+			return TEE_SUCCESS;
+		}
+	}
+	return TEE_NOTSUPPORTED;
+}
+
+static bool tee_bundle_verify_selected(const struct tee_bundle_verify *v, size_t i)
+{
+	return v->payload_type == 0 ||
+	       v->bundle->partitions[i].payload_type == v->payload_type;
+}
+
+static void tee_bundle_verify_worker(void *arg)
+{
+	struct tee_bundle_verify *v = arg;
+	const struct tee_bundle_partition *part;
+	size_t block;
+	size_t i;
+
+	for (;;) {
+		block = tee_fwu_index_next(&v->next);
+		if (block >= v->blocks)
+			break;
+		for (i = 0; block >= v->first[i + 1]; i++)
+			;
+		part = &v->bundle->partitions[i];
+		v->hashes[block] = tee_fwu_block_hash(part->data, part->size,
+						      block - v->first[i]);
+	}
+}
+
+static void tee_bundle_verify_free(struct tee_bundle_verify *v)
+{
+	free(v->threads);
+	free(v->hashes);
+	free(v->first);
+	free(v);
+}
+
+TEESTATUS TEEAPI TeeBundleVerifyStart(IN struct tee_bundle *bundle,
+				      IN uint32_t payloadType,
+				      IN unsigned int threads)
+{
+	const struct tee_bundle_partition *part;
+	struct tee_bundle_verify *v;
+	TEESTATUS status;
+	size_t i;
+
+	if (!bundle)
+		return TEE_INVALID_PARAMETER;
+	if (bundle->verify)
+		return TEE_BUSY;
+	if (payloadType) {
+		status = TeeBundleFind(bundle, payloadType, &part);
+		if (status != TEE_SUCCESS)
+			return status;
+	}
+
+	v = calloc(1, sizeof(*v));
+	if (!v)
+		return TEE_INTERNAL_ERROR;
+	v->bundle = bundle;
+	v->payload_type = payloadType;
+
+	v->first = calloc(bundle->count + 1, sizeof(*v->first));
+	if (!v->first)
+		goto nomem;
+	for (i = 0; i < bundle->count; i++)
+		v->first[i + 1] = v->first[i] + ((tee_bundle_verify_selected(v, i)) ?
+				  tee_fwu_hash_blocks(bundle->partitions[i].size) : 0);
+	v->blocks = v->first[bundle->count];
+
+	v->hashes = calloc(v->blocks, sizeof(*v->hashes));
+	if (!v->hashes)
+		goto nomem;
+
+	/* the thread waiting for the result is one more worker */
+	if (threads == 0)
+		threads = tee_fwu_cpus();
+	if (threads > v->blocks)
+		threads = (unsigned int)v->blocks;
+	v->threads = calloc(threads, sizeof(*v->threads));
+	if (v->threads)
+		while (v->started < threads &&
+		       tee_fwu_thread_start(&v->threads[v->started], tee_bundle_verify_worker, v))
+			v->started++;
+
+	bundle->verify = v;
+	return TEE_SUCCESS;
+
+nomem:
+	tee_bundle_verify_free(v);
+	return TEE_INTERNAL_ERROR;
+}
+
+TEESTATUS TEEAPI TeeBundleVerifyWait(IN struct tee_bundle *bundle)
+{
+	struct tee_bundle_verify *v;
+	TEESTATUS status = TEE_SUCCESS;
+	size_t i;
+
+	if (!bundle || !bundle->verify)
+		return TEE_INVALID_PARAMETER;
+	v = bundle->verify;
+
+	tee_bundle_verify_worker(v);
+	for (i = 0; i < v->started; i++)
+		tee_fwu_thread_join(&v->threads[i]);
+
+	for (i = 0; i < bundle->count; i++) {
+		const struct tee_bundle_partition *part = &bundle->partitions[i];
+
+		if (tee_bundle_verify_selected(v, i) &&
+		    tee_fwu_hash_combine(v->hashes + v->first[i], part->size) != part->hash)
+			status = TEE_INVALID_PARAMETER;
+	}
+
+	bundle->verify = NULL;
+	tee_bundle_verify_free(v);
+	return status;
+}
+
+TEESTATUS TEEAPI TeeBundleUpdate(IN PTEEHANDLE handle,
+				 IN struct tee_bundle *bundle,
+				 IN uint32_t payloadType,
+				 IN OPTIONAL const void *metadata, IN size_t metadataSize,
+				 IN OPTIONAL TeeFwuProgressCallback progress,
+				 IN OPTIONAL void *ctx,
+				 OUT OPTIONAL struct tee_fwu_stats *stats,
+				 IN uint32_t timeout)
+{
+	const struct tee_bundle_partition *part;
+	TEESTATUS status = TEE_SUCCESS;
+	TEESTATUS verified;
+
+	if (!handle || payloadType == 0)
+		return TEE_INVALID_PARAMETER;
+	status = TeeBundleFind(bundle, payloadType, &part);
+	if (status != TEE_SUCCESS)
+		return status;
+
+	verified = TeeBundleVerifyStart(bundle, payloadType, 0);
+	if (verified != TEE_SUCCESS)
+		return verified;
+	if (handle->maxMsgLen == 0)
+		status = TeeConnect(handle);
+	verified = TeeBundleVerifyWait(bundle);
+	if (status != TEE_SUCCESS)
+		return status;
+	if (verified != TEE_SUCCESS)
+		return verified;
+
+	return TeeFwuUpdate(handle, payloadType, part->data, part->size,
+			    metadata, metadataSize, progress, ctx, stats, timeout);
+}
+
+#ifdef _WIN32
+typedef HANDLE tee_bundle_file_t;
+#define TEE_BUNDLE_FILE_INVALID INVALID_HANDLE_VALUE
+
+static tee_bundle_file_t tee_bundle_file_create(const char *path)
+{
+	return CreateFileA(path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+			   FILE_ATTRIBUTE_NORMAL, NULL);
+}
+
+static bool tee_bundle_file_write(tee_bundle_file_t file, const uint8_t *data, size_t size)
+{
+	DWORD written;
+
+	while (size) {
+		DWORD len = (size > MAXDWORD) ? MAXDWORD : (DWORD)size;
+
+		if (!WriteFile(file, data, len, &written, NULL) || written == 0)
+			return false;
+		data += written;
+		size -= written;
+	}
+	return true;
+}
+
+static void tee_bundle_file_close(tee_bundle_file_t file, const char *path, bool remove)
+{
+	CloseHandle(file);
+	if (remove)
+		DeleteFileA(path);
+}
+#else
+typedef int tee_bundle_file_t;
+#define TEE_BUNDLE_FILE_INVALID (-1)
+
+static tee_bundle_file_t tee_bundle_file_create(const char *path)
+{
+	return open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+}
+
+static bool tee_bundle_file_write(tee_bundle_file_t file, const uint8_t *data, size_t size)
+{
+	ssize_t written;
+
+	while (size) {
+		written = write(file, data, size);
+		if (written < 0 && errno == EINTR)
+			continue;
+		if (written <= 0)
+			return false;
+		data += written;
+		size -= (size_t)written;
+	}
+	return true;
+}
+
+static void tee_bundle_file_close(tee_bundle_file_t file, const char *path, bool remove)
+{
+	close(file);
+	if (remove)
+		unlink(path);
+}
+#endif /* _WIN32 */
+
+TEESTATUS TEEAPI TeeBundleCreate(IN const char *path,
+				 IN const struct tee_bundle_source *sources,
+				 IN size_t count)
+{
+	struct tee_fwu_image *images;
+	struct tee_bundle_hdr hdr;
+	struct tee_bundle_entry *dir;
+	tee_bundle_file_t file;
+	uint64_t offset;
+	size_t mapped = 0;
+	size_t i;
+	TEESTATUS status = TEE_SUCCESS;
+
+	if (!path || !sources || count == 0 || count > UINT32_MAX / sizeof(*dir))
+		return TEE_INVALID_PARAMETER;
+	for (i = 0; i < count; i++)
+		if (!sources[i].path || sources[i].payload_type == 0)
+			return TEE_INVALID_PARAMETER;
+
+	images = calloc(count, sizeof(*images));
+	dir = calloc(count, sizeof(*dir));
+	if (!images || !dir) {
+		status = TEE_INTERNAL_ERROR;
+		goto out;
+	}
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic = TEE_BUNDLE_MAGIC;
+	hdr.version = TEE_BUNDLE_VERSION;
+	hdr.header_length = sizeof(hdr);
+	hdr.partitions = (uint32_t)count;
+	hdr.entry_length = sizeof(*dir);
+
+	/* the images follow the directory in the order of the sources */
+	offset = sizeof(hdr) + count * sizeof(*dir);
+	for (mapped = 0; mapped < count; mapped++) {
+		status = tee_fwu_map(sources[mapped].path, &images[mapped]);
+		if (status != TEE_SUCCESS)
+			goto out;
+		if (offset + images[mapped].size > UINT32_MAX) {
+			tee_fwu_unmap(&images[mapped]);
+			status = TEE_INVALID_PARAMETER;
+			goto out;
+		}
+		dir[mapped].payload_type = sources[mapped].payload_type;
+		dir[mapped].offset = (uint32_t)offset;
+		dir[mapped].length = (uint32_t)images[mapped].size;
+		dir[mapped].hash = tee_fwu_image_hash(images[mapped].data, images[mapped].size);
+		offset += images[mapped].size;
+	}
+
+	file = tee_bundle_file_create(path);
+	if (file == TEE_BUNDLE_FILE_INVALID) {
+		status = TEE_PERMISSION_DENIED;
+		goto out;
+	}
+	if (!tee_bundle_file_write(file, (const uint8_t *)&hdr, sizeof(hdr)) ||
+	    !tee_bundle_file_write(file, (const uint8_t *)dir, count * sizeof(*dir)))
+		status = TEE_INTERNAL_ERROR;
+	for (i = 0; i < count && status == TEE_SUCCESS; i++)
+		if (!tee_bundle_file_write(file, images[i].data, images[i].size))
+			status = TEE_INTERNAL_ERROR;
+	tee_bundle_file_close(file, path, status != TEE_SUCCESS);
+
+out:
+	for (i = 0; i < mapped; i++)
+		tee_fwu_unmap(&images[i]);
+	free(images);
+	free(dir);
+	return status;
+}
@@ -0,0 +1,609 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2023 Intel Corporation
+ */
+/*
+ * GSC firmware update pipeline on top of TeeWrite/TeeRead, common to all
+ * platforms.
+ * The device takes a message in one write, so a data message is gathered
+ * into a contiguous buffer: the header and the image slice copied straight
+ * from the caller memory or the file mapping, with no intermediate read()
+ * buffer. Two buffers of the client maximal message length alternate:
+ * after a chunk is written the next one is assembled in the other buffer
+ * while the firmware processes the first, the buffer of the chunk in
+ * flight is not touched until it is acknowledged.
+ * The fan-out maps the image once and runs a pool of workers, each takes
+ * the next device from a shared index and runs a whole session on it.
+ */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif /* _WIN32 */
+
+#include "metee.h"
+#include "metee_fwu.h"
+#include "metee_fwu_int.h"
+
+#define TEE_FWU_NSEC_PER_SEC 1000000000ULL
+
+static uint64_t tee_fwu_now(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER freq;
+	LARGE_INTEGER count;
+
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&count);
+	return (uint64_t)(count.QuadPart / freq.QuadPart) * TEE_FWU_NSEC_PER_SEC +
+	       (uint64_t)(count.QuadPart % freq.QuadPart) * TEE_FWU_NSEC_PER_SEC /
+	       (uint64_t)freq.QuadPart;
+#else
+	return TeeClockNow();
+#endif /* _WIN32 */
+}
+
+static TEESTATUS tee_fwu_write(PTEEHANDLE handle, const void *msg, size_t len,
+			       uint32_t timeout)
+{
+	size_t written = 0;
+	TEESTATUS status;
+
+	status = TeeWrite(handle, msg, len, &written, timeout);
+	if (status != TEE_SUCCESS)
+		return status;
+	return (written == len) ? TEE_SUCCESS : TEE_UNABLE_TO_COMPLETE_OPERATION;
+}
+
+static TEESTATUS tee_fwu_ack(PTEEHANDLE handle, uint8_t command, uint32_t timeout,
+			     struct tee_fwu_stats *stats)
+{
+	struct tee_fwu_rsp rsp;
+	size_t received = 0;
+	uint64_t start = tee_fwu_now();
+	TEESTATUS status;
+
+	status = TeeRead(handle, &rsp, sizeof(rsp), &received, timeout);
+	stats->wait += tee_fwu_now() - start;
+	if (status != TEE_SUCCESS)
+		return status;
+
+	if (received != sizeof(rsp) ||
+	    rsp.header.command_id != command ||
+	    !(rsp.header.flags & TEE_FWU_RESPONSE))
+		return TEE_INTERNAL_ERROR;
+
+	return (rsp.status == 0) ? TEE_SUCCESS : TEE_UNABLE_TO_COMPLETE_OPERATION;
+}
+
+/* assemble the data message at offset, return the message length */
+static size_t tee_fwu_chunk(uint8_t *buf, const uint8_t *image, size_t imageSize,
+			    size_t offset, size_t chunkSize)
+{
+	struct tee_fwu_data_req *req = (struct tee_fwu_data_req *)buf;
+	size_t len = imageSize - offset;
+
+	if (len > chunkSize)
+		len = chunkSize;
+
+	memset(req, 0, sizeof(*req));
+	req->header.command_id = TEE_FWU_DATA;
+	req->data_length = (uint32_t)len;
+	memcpy(buf + sizeof(*req), image + offset, len);
+
+	return sizeof(*req) + len;
+}
+
+static void tee_fwu_update_stats(struct tee_fwu_stats *stats, uint64_t start)
+{
+	stats->elapsed = tee_fwu_now() - start;
+	stats->throughput = (stats->elapsed) ?
+		stats->sent * TEE_FWU_NSEC_PER_SEC / stats->elapsed : 0;
+}
+
+TEESTATUS TEEAPI TeeFwuUpdate(IN PTEEHANDLE handle, IN uint32_t payloadType,
+			      IN const void *image, IN size_t imageSize,
+			      IN OPTIONAL const void *metadata, IN size_t metadataSize,
+			      IN OPTIONAL TeeFwuProgressCallback progress,
+			      IN OPTIONAL void *ctx,
+			      OUT OPTIONAL struct tee_fwu_stats *stats,
+			      IN uint32_t timeout)
+{
+	struct tee_fwu_stats st;
+	struct tee_fwu_start_req *start_req;
+	struct tee_fwu_end_req end_req;
+	uint8_t *buf[2] = { NULL, NULL };
+	size_t len[2] = { 0, 0 };
+	size_t max_len;
+	size_t offset;
+	unsigned int cur;
+	uint64_t start;
+	TEESTATUS status;
+
+	if (!handle || !image || imageSize == 0 || imageSize > UINT32_MAX ||
+	    (!metadata && metadataSize))
+		return TEE_INVALID_PARAMETER;
+
+	max_len = handle->maxMsgLen;
+	if (max_len == 0)
+		return TEE_DISCONNECTED;
+	if (max_len <= sizeof(struct tee_fwu_data_req) ||
+	    metadataSize > max_len - sizeof(*start_req))
+		return TEE_INVALID_PARAMETER;
+
+	buf[0] = malloc(2 * max_len);
+	if (!buf[0])
+		return TEE_INTERNAL_ERROR;
+	buf[1] = buf[0] + max_len;
+
+	memset(&st, 0, sizeof(st));
+	st.total = imageSize;
+	st.chunk_size = (uint32_t)(max_len - sizeof(struct tee_fwu_data_req));
+
+	/* the first chunk goes to buffer 0 while the start request is in flight */
+	start_req = (struct tee_fwu_start_req *)buf[1];
+	memset(start_req, 0, sizeof(*start_req));
+	start_req->header.command_id = TEE_FWU_START;
+	start_req->update_img_length = (uint32_t)imageSize;
+	start_req->payload_type = payloadType;
+	if (metadataSize)
+		memcpy(buf[1] + sizeof(*start_req), metadata, metadataSize);
+
+	start = tee_fwu_now();
+	status = tee_fwu_write(handle, start_req, sizeof(*start_req) + metadataSize, timeout);
+	if (status != TEE_SUCCESS)
+		goto out;
+
+	cur = 0;
+	len[cur] = tee_fwu_chunk(buf[cur], image, imageSize, 0, st.chunk_size);
+	offset = len[cur] - sizeof(struct tee_fwu_data_req);
+
+	status = tee_fwu_ack(handle, TEE_FWU_START, timeout, &st);
+	if (status != TEE_SUCCESS)
+		goto out;
+
+	for (;;) {
+		status = tee_fwu_write(handle, buf[cur], len[cur], timeout);
+		if (status != TEE_SUCCESS)
+			goto out;
+
+		if (offset < imageSize) {
+			len[cur ^ 1] = tee_fwu_chunk(buf[cur ^ 1], image, imageSize,
+						     offset, st.chunk_size);
+			offset += len[cur ^ 1] - sizeof(struct tee_fwu_data_req);
+		}
+
+		status = tee_fwu_ack(handle, TEE_FWU_DATA, timeout, &st);
+		if (status != TEE_SUCCESS)
+			goto out;
+
+		st.sent += len[cur] - sizeof(struct tee_fwu_data_req);
+		st.chunks++;
+		tee_fwu_update_stats(&st, start);
+		if (progress)
+			progress(ctx, &st);
+
+		if (st.sent == imageSize)
+			break;
+		cur ^= 1;
+	}
+
+	memset(&end_req, 0, sizeof(end_req));
+	end_req.header.command_id = TEE_FWU_END;
+	status = tee_fwu_write(handle, &end_req, sizeof(end_req), timeout);
+	if (status != TEE_SUCCESS)
+		goto out;
+	status = tee_fwu_ack(handle, TEE_FWU_END, timeout, &st);
+
+out:
+	tee_fwu_update_stats(&st, start);
+	if (stats)
+		*stats = st;
+	free(buf[0]);
+	return status;
+}
+
+TEESTATUS tee_fwu_map(const char *path, struct tee_fwu_image *image)
+{
+#ifdef _WIN32
+	HANDLE file;
+	HANDLE mapping;
+	LARGE_INTEGER size;
+	void *data;
+
+	file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+			   FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return TEE_INVALID_PARAMETER;
+	if (!GetFileSizeEx(file, &size) || size.QuadPart == 0 ||
+	    (uint64_t)size.QuadPart > UINT32_MAX) {
+		CloseHandle(file);
+		return TEE_INVALID_PARAMETER;
+	}
+
+	mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle(file);
+	if (!mapping)
+		return TEE_INTERNAL_ERROR;
+	data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(mapping);
+	if (!data)
+		return TEE_INTERNAL_ERROR;
+
+	image->data = data;
+	image->size = (size_t)size.QuadPart;
+#else
+	struct stat st;
+	void *data;
+	int fd;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return TEE_INVALID_PARAMETER;
+	if (fstat(fd, &st) || st.st_size <= 0 || (uint64_t)st.st_size > UINT32_MAX) {
+		close(fd);
+		return TEE_INVALID_PARAMETER;
+	}
+
+	data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED)
+		return TEE_INTERNAL_ERROR;
+	posix_madvise(data, (size_t)st.st_size, POSIX_MADV_SEQUENTIAL);
+
+	image->data = data;
+	image->size = (size_t)st.st_size;
+#endif /* _WIN32 */
+	return TEE_SUCCESS;
+}
+
+void tee_fwu_unmap(struct tee_fwu_image *image)
+{
+#ifdef _WIN32
+	UnmapViewOfFile(image->data);
+#else
+	munmap((void *)image->data, image->size);
+#endif /* _WIN32 */
+}
+
+TEESTATUS TEEAPI TeeFwuUpdateFile(IN PTEEHANDLE handle, IN uint32_t payloadType,
+				  IN const char *path,
+				  IN OPTIONAL const void *metadata, IN size_t metadataSize,
+				  IN OPTIONAL TeeFwuProgressCallback progress,
+				  IN OPTIONAL void *ctx,
+				  OUT OPTIONAL struct tee_fwu_stats *stats,
+				  IN uint32_t timeout)
+{
+	struct tee_fwu_image image;
+	TEESTATUS status;
+
+	if (!path)
+		return TEE_INVALID_PARAMETER;
+
+	status = tee_fwu_map(path, &image);
+	if (status != TEE_SUCCESS)
+		return status;
+
+	status = TeeFwuUpdate(handle, payloadType, image.data, image.size,
+			      metadata, metadataSize, progress, ctx, stats, timeout);
+	tee_fwu_unmap(&image);
+	return status;
+}
+
+/* 64-bit hash of the xxHash64 construction, little-endian input */
+#define TEE_FWU_PRIME1 11400714785074694791ULL
+#define TEE_FWU_PRIME2 14029467366897019727ULL
+#define TEE_FWU_PRIME3 1609587929392839161ULL
+#define TEE_FWU_PRIME4 9650029242287828579ULL
+#define TEE_FWU_PRIME5 2870177450012600261ULL
+
+static inline uint64_t tee_fwu_rotl(uint64_t x, unsigned int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t tee_fwu_read64(const uint8_t *p)
+{
+	uint64_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline uint64_t tee_fwu_round(uint64_t acc, uint64_t input)
+{
+	acc += input * TEE_FWU_PRIME2;
+	acc = tee_fwu_rotl(acc, 31);
+	return acc * TEE_FWU_PRIME1;
+}
+
+static inline uint64_t tee_fwu_merge(uint64_t acc, uint64_t val)
+{
+	acc ^= tee_fwu_round(0, val);
+	return acc * TEE_FWU_PRIME1 + TEE_FWU_PRIME4;
+}
+
+static uint64_t tee_fwu_hash64(const uint8_t *p, size_t len, uint64_t seed)
+{
+	const uint8_t *end = p + len;
+	uint64_t h;
+
+	if (len >= 32) {
+		uint64_t v1 = seed + TEE_FWU_PRIME1 + TEE_FWU_PRIME2;
+		uint64_t v2 = seed + TEE_FWU_PRIME2;
+		uint64_t v3 = seed;
+		uint64_t v4 = seed - TEE_FWU_PRIME1;
+
+		do {
+			v1 = tee_fwu_round(v1, tee_fwu_read64(p));
+			v2 = tee_fwu_round(v2, tee_fwu_read64(p + 8));
+			v3 = tee_fwu_round(v3, tee_fwu_read64(p + 16));
+			v4 = tee_fwu_round(v4, tee_fwu_read64(p + 24));
+			p += 32;
+		} while (p + 32 <= end);
+
+		h = tee_fwu_rotl(v1, 1) + tee_fwu_rotl(v2, 7) +
+		    tee_fwu_rotl(v3, 12) + tee_fwu_rotl(v4, 18);
+		h = tee_fwu_merge(h, v1);
+		h = tee_fwu_merge(h, v2);
+		h = tee_fwu_merge(h, v3);
+		h = tee_fwu_merge(h, v4);
+	} else {
+		h = seed + TEE_FWU_PRIME5;
+	}
+
+	h += len;
+	for (; p + 8 <= end; p += 8) {
+		h ^= tee_fwu_round(0, tee_fwu_read64(p));
+		h = tee_fwu_rotl(h, 27) * TEE_FWU_PRIME1 + TEE_FWU_PRIME4;
+	}
+	if (p + 4 <= end) {
+		uint32_t v;
+
+		memcpy(&v, p, sizeof(v));
+		h ^= v * TEE_FWU_PRIME1;
+		h = tee_fwu_rotl(h, 23) * TEE_FWU_PRIME2 + TEE_FWU_PRIME3;
+		p += 4;
+	}
+	for (; p < end; p++) {
+		h ^= *p * TEE_FWU_PRIME5;
+		h = tee_fwu_rotl(h, 11) * TEE_FWU_PRIME1;
+	}
+
+	h ^= h >> 33;
+	h *= TEE_FWU_PRIME2;
+	h ^= h >> 29;
+	h *= TEE_FWU_PRIME3;
+	h ^= h >> 32;
+	return h;
+}
+
+uint64_t tee_fwu_block_hash(const uint8_t *data, size_t size, size_t index)
+{
+	size_t off = index * TEE_FWU_HASH_BLOCK;
+	size_t len = size - off;
+
+	if (len > TEE_FWU_HASH_BLOCK)
+		len = TEE_FWU_HASH_BLOCK;
+	return tee_fwu_hash64(data + off, len, 0);
+}
+
+/* hash of the block hashes, seeded with the image length */
+uint64_t tee_fwu_hash_combine(const uint64_t *blocks, size_t size)
+{
+	uint64_t h = size + TEE_FWU_PRIME5;
+	size_t i;
+
+	for (i = 0; i < tee_fwu_hash_blocks(size); i++)
+		h = tee_fwu_merge(h, blocks[i]);
+	return tee_fwu_hash64((const uint8_t *)&h, sizeof(h), size);
+}
+
+uint64_t tee_fwu_image_hash(const uint8_t *data, size_t size)
+{
+	uint64_t h = size + TEE_FWU_PRIME5;
+	size_t i;
+
+	for (i = 0; i < tee_fwu_hash_blocks(size); i++)
+		h = tee_fwu_merge(h, tee_fwu_block_hash(data, size, i));
+	return tee_fwu_hash64((const uint8_t *)&h, sizeof(h), size);
+}
+
+uint64_t TEEAPI TeeFwuImageHash(IN const void *data, IN size_t size)
+{
+	return tee_fwu_image_hash(data, size);
+}
+
+/* state shared by the workers of a fan-out */
+struct tee_fwu_fanout {
+	const GUID *guid;
+	uint32_t payload_type;
+	struct tee_fwu_image image;
+	const void *metadata;
+	size_t metadata_size;
+	struct tee_fwu_device *devices;
+	size_t count;
+	TeeFwuDeviceProgressCallback progress;
+	void *ctx;
+	uint32_t timeout;
+	tee_fwu_index_t next;   /**< next device to update */
+};
+
+/* progress context of a device */
+struct tee_fwu_fanout_target {
+	struct tee_fwu_fanout *fanout;
+	size_t index;
+};
+
+static void tee_fwu_fanout_progress(void *ctx, const struct tee_fwu_stats *stats)
+{
+	struct tee_fwu_fanout_target *target = ctx;
+
+	target->fanout->progress(target->fanout->ctx, target->index, stats);
+}
+
+static void tee_fwu_fanout_device(struct tee_fwu_fanout *f, size_t index)
+{
+	struct tee_fwu_device *dev = &f->devices[index];
+	struct tee_fwu_fanout_target target;
+	TEEHANDLE handle = TEEHANDLE_ZERO;
+
+	target.fanout = f;
+	target.index = index;
+
+#ifdef _WIN32
+	if (!dev->device && dev->device_class)
+		dev->status = TeeInitGUID(&handle, f->guid, dev->device_class);
+	else
+#endif /* _WIN32 */
+		dev->status = TeeInit(&handle, f->guid, dev->device);
+	if (dev->status != TEE_SUCCESS)
+		return;
+	dev->status = TeeConnect(&handle);
+	if (dev->status == TEE_SUCCESS)
+		dev->status = TeeFwuUpdate(&handle, f->payload_type,
+					   f->image.data, f->image.size,
+					   f->metadata, f->metadata_size,
+					   (f->progress) ? tee_fwu_fanout_progress : NULL,
+					   &target, &dev->stats, f->timeout);
+	TeeDisconnect(&handle);
+}
+
+static void tee_fwu_fanout_worker(void *arg)
+{
+	struct tee_fwu_fanout *f = arg;
+	size_t index;
+
+	for (;;) {
+		index = tee_fwu_index_next(&f->next);
+		if (index >= f->count)
+			break;
+		tee_fwu_fanout_device(f, index);
+	}
+}
+
+#ifdef _WIN32
+static DWORD WINAPI tee_fwu_thread_main(LPVOID arg)
+{
+	struct tee_fwu_thread *thread = arg;
+
+	thread->fn(thread->arg);
+	return 0;
+}
+
+bool tee_fwu_thread_start(struct tee_fwu_thread *thread, void (*fn)(void *arg), void *arg)
+{
+	thread->fn = fn;
+	thread->arg = arg;
+	thread->id = CreateThread(NULL, 0, tee_fwu_thread_main, thread, 0, NULL);
+	return thread->id != NULL;
+}
+
+void tee_fwu_thread_join(struct tee_fwu_thread *thread)
+{
+	WaitForSingleObject(thread->id, INFINITE);
+	CloseHandle(thread->id);
+}
+
+unsigned int tee_fwu_cpus(void)
+{
+	SYSTEM_INFO info;
+
+	GetSystemInfo(&info);
+	return (info.dwNumberOfProcessors) ? info.dwNumberOfProcessors : 1;
+}
+#else
+static void *tee_fwu_thread_main(void *arg)
+{
+	struct tee_fwu_thread *thread = arg;
+
+	thread->fn(thread->arg);
+	return NULL;
+}
+
+bool tee_fwu_thread_start(struct tee_fwu_thread *thread, void (*fn)(void *arg), void *arg)
+{
+	thread->fn = fn;
+	thread->arg = arg;
+	return pthread_create(&thread->id, NULL, tee_fwu_thread_main, thread) == 0;
+}
+
+void tee_fwu_thread_join(struct tee_fwu_thread *thread)
+{
+	pthread_join(thread->id, NULL);
+}
+
+unsigned int tee_fwu_cpus(void)
+{
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+	return (n > 0) ? (unsigned int)n : 1;
+}
+#endif /* _WIN32 */
+
+TEESTATUS TEEAPI TeeFwuUpdateDevices(IN const GUID *guid, IN uint32_t payloadType,
+				     IN const char *path,
+				     IN OPTIONAL const void *metadata, IN size_t metadataSize,
+				     IN OUT struct tee_fwu_device *devices, IN size_t count,
+				     IN unsigned int concurrency,
+				     IN OPTIONAL TeeFwuDeviceProgressCallback progress,
+				     IN OPTIONAL void *ctx, IN uint32_t timeout)
+{
+	struct tee_fwu_fanout f;
+	struct tee_fwu_thread *threads;
+	size_t workers;
+	size_t started;
+	size_t i;
+	TEESTATUS status;
+
+	if (!guid || !path || !devices || count == 0)
+		return TEE_INVALID_PARAMETER;
+
+	memset(&f, 0, sizeof(f));
+	status = tee_fwu_map(path, &f.image);
+	if (status != TEE_SUCCESS)
+		return status;
+	f.guid = guid;
+	f.payload_type = payloadType;
+	f.metadata = metadata;
+	f.metadata_size = metadataSize;
+	f.devices = devices;
+	f.count = count;
+	f.progress = progress;
+	f.ctx = ctx;
+	f.timeout = timeout;
+
+	for (i = 0; i < count; i++) {
+		devices[i].status = TEE_UNABLE_TO_COMPLETE_OPERATION;
+		memset(&devices[i].stats, 0, sizeof(devices[i].stats));
+	}
+
+	/* the calling thread is one of the workers */
+	workers = (concurrency == 0 || concurrency > count) ? count : concurrency;
+	threads = calloc(workers, sizeof(*threads));
+	started = 0;
+	if (threads) {
+		while (started < workers - 1 &&
+		       tee_fwu_thread_start(&threads[started], tee_fwu_fanout_worker, &f))
+			started++;
+	}
+	tee_fwu_fanout_worker(&f);
+	for (i = 0; i < started; i++)
+		tee_fwu_thread_join(&threads[i]);
+	free(threads);
+	tee_fwu_unmap(&f.image);
+
+	for (i = 0; i < count; i++)
+		if (devices[i].status != TEE_SUCCESS)
+			return TEE_UNABLE_TO_COMPLETE_OPERATION;
+	return TEE_SUCCESS;
+}
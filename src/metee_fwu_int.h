@@ -0,0 +1,79 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2023 Intel Corporation
+ */
+#ifndef __METEE_FWU_INT_H
+#define __METEE_FWU_INT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif /* _WIN32 */
+
+#include "metee.h"
+
+/* read-only mapping of an image file */
+struct tee_fwu_image {
+	const uint8_t *data;
+	size_t size;
+};
+
+TEESTATUS tee_fwu_map(const char *path, struct tee_fwu_image *image);
+void tee_fwu_unmap(struct tee_fwu_image *image);
+
+/* the image hash is combined from hashes of blocks of this length */
+#define TEE_FWU_HASH_BLOCK (1024 * 1024)
+
+/* number of hash blocks in size bytes */
+static inline size_t tee_fwu_hash_blocks(size_t size)
+{
+	return (size + TEE_FWU_HASH_BLOCK - 1) / TEE_FWU_HASH_BLOCK;
+}
+
+/* hash of the block at index of data */
+uint64_t tee_fwu_block_hash(const uint8_t *data, size_t size, size_t index);
+
+/* image hash from the hashes of all its blocks */
+uint64_t tee_fwu_hash_combine(const uint64_t *blocks, size_t size);
+
+/* image hash computed in the calling thread */
+uint64_t tee_fwu_image_hash(const uint8_t *data, size_t size);
+
+/* shared work index, taken by the workers one item at a time */
+#ifdef _WIN32
+typedef volatile LONG tee_fwu_index_t;
+#else
+typedef size_t tee_fwu_index_t;
+#endif /* _WIN32 */
+
+static inline size_t tee_fwu_index_next(tee_fwu_index_t *index)
+{
+#ifdef _WIN32
+	return (size_t)(InterlockedIncrement(index) - 1);
+#else
+	return __atomic_fetch_add(index, 1, __ATOMIC_RELAXED);
+#endif /* _WIN32 */
+}
+
+/* worker thread */
+struct tee_fwu_thread {
+#ifdef _WIN32
+	HANDLE id;
+#else
+	pthread_t id;
+#endif /* _WIN32 */
+	void (*fn)(void *arg);
+	void *arg;
+};
+
+bool tee_fwu_thread_start(struct tee_fwu_thread *thread, void (*fn)(void *arg), void *arg);
+void tee_fwu_thread_join(struct tee_fwu_thread *thread);
+
+/* number of online processors */
+unsigned int tee_fwu_cpus(void);
+
+#endif /* __METEE_FWU_INT_H */
@@ -0,0 +1,279 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2023 Intel Corporation
+ */
+/*
+ * MKHI client on top of TeeWrite/TeeRead, common to all platforms.
+ * Requests are constant pre-encoded templates, the typed calls read the
+ * response into stack storage sized for the largest response of all
+ * commands and take the values from it in place.
+ * A response that does not fit is dropped by the device and reported
+ * as an error, which is the right outcome for a malformed one.
+ * On Linux the firmware version is also kept in a process shared cache,
+ * Windows always asks the firmware.
+ */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "metee.h"
+#include "metee_mkhi.h"
+#include "mkhi_schema.h"
+#ifndef _WIN32
+#include "metee_fwcache.h"
+#endif /* _WIN32 */
+
+/* the public constants and layouts are the ones of schema/mkhi.heci */
+HECI_SCHEMA_STATIC_ASSERT(TEE_MKHI_GROUP_CBM == MKHI_GROUP_CBM, "CBM group");
+HECI_SCHEMA_STATIC_ASSERT(TEE_MKHI_GROUP_FWCAPS == MKHI_GROUP_FWCAPS, "FWCAPS group");
+HECI_SCHEMA_STATIC_ASSERT(TEE_MKHI_GROUP_FWUPDATE == MKHI_GROUP_FWUPDATE, "FWUPDATE group");
+HECI_SCHEMA_STATIC_ASSERT(TEE_MKHI_GROUP_GEN == MKHI_GROUP_GEN, "GEN group");
+HECI_SCHEMA_STATIC_ASSERT(TEE_MKHI_GEN_GET_MKHI_VERSION == MKHI_GEN_GET_MKHI_VERSION, "MKHI version");
+HECI_SCHEMA_STATIC_ASSERT(TEE_MKHI_GEN_GET_FW_VERSION == MKHI_GEN_GET_FW_VERSION, "FW version");
+HECI_SCHEMA_STATIC_ASSERT(TEE_MKHI_FWCAPS_GET_RULE == MKHI_FWCAPS_GET_RULE, "get rule");
+HECI_SCHEMA_STATIC_ASSERT(TEE_MKHI_FWUPDATE_GET_STATUS == MKHI_FWUPDATE_GET_STATUS, "update status");
+HECI_SCHEMA_STATIC_ASSERT(sizeof(struct tee_mkhi_hdr) == sizeof(struct mkhi_hdr), "header");
+HECI_SCHEMA_STATIC_ASSERT(TEE_MKHI_RESPONSE << 8 == MKHI_HDR_WORD_IS_RESPONSE_MASK << MKHI_HDR_WORD_IS_RESPONSE_SHIFT,
+			  "response bit");
+
+/* storage of the typed calls, fits error responses longer than the expected one */
+union tee_mkhi_rsp {
+	struct mkhi_hdr hdr;
+	struct mkhi_gen_get_fw_version_rsp fw_version;
+	struct mkhi_gen_get_mkhi_version_rsp if_version;
+	struct mkhi_fwupdate_get_status_rsp fwupdate;
+	uint8_t rule[MKHI_FWCAPS_GET_RULE_RSP_MIN_LEN + TEE_MKHI_RULE_DATA_MAX];
+};
+
+/* a byte longer than every response, so a response filling it was truncated */
+struct tee_mkhi_rsp_buf {
+	union tee_mkhi_rsp rsp;
+	uint8_t spare;
+};
+
+static const struct mkhi_gen_get_fw_version_req tee_mkhi_get_fw_version_req = {
+	{ MKHI_GEN_GET_FW_VERSION_REQ_HEADER_WORD }
+};
+
+static const struct mkhi_gen_get_mkhi_version_req tee_mkhi_get_mkhi_version_req = {
+	{ MKHI_GEN_GET_MKHI_VERSION_REQ_HEADER_WORD }
+};
+
+static const struct mkhi_fwupdate_get_status_req tee_mkhi_fwupdate_status_req = {
+	{ MKHI_FWUPDATE_GET_STATUS_REQ_HEADER_WORD }
+};
+
+static void tee_mkhi_version_get(struct tee_mkhi_version *version,
+				 const struct mkhi_version *v)
+{
+	version->minor = v->minor;
+	version->major = v->major;
+	version->buildNo = v->build_no;
+	version->hotFix = v->hot_fix;
+}
+
+TEESTATUS TEEAPI TeeMkhiTransact(IN PTEEHANDLE handle,
+				 IN const void *request, IN size_t requestSize,
+				 OUT void *buffer, IN size_t bufferSize,
+				 OUT const struct tee_mkhi_hdr **response,
+				 OUT size_t *responseSize, IN uint32_t timeout)
+{
+	const struct tee_mkhi_hdr *req = request;
+	const struct tee_mkhi_hdr *rsp = buffer;
+	size_t written = 0;
+	size_t received = 0;
+	TEESTATUS status;
+
+	if (!handle || !request || requestSize < sizeof(*req) ||
+	    !buffer || bufferSize < sizeof(*rsp) || !response || !responseSize)
+		return TEE_INVALID_PARAMETER;
+
+	*response = NULL;
+	*responseSize = 0;
+
+	status = TeeWrite(handle, request, requestSize, &written, timeout);
+	if (status != TEE_SUCCESS)
+		return status;
+	if (written != requestSize)
+		return TEE_UNABLE_TO_COMPLETE_OPERATION;
+
+	status = TeeRead(handle, buffer, bufferSize, &received, timeout);
+	if (status != TEE_SUCCESS)
+		return status;
+
+	/* the device truncates a longer message to the buffer and keeps the rest queued */
+	if (received == bufferSize && bufferSize < handle->maxMsgLen)
+		return TEE_INSUFFICIENT_BUFFER;
+	if (received < sizeof(*rsp) ||
+	    rsp->group != req->group ||
+	    rsp->command != (req->command | TEE_MKHI_RESPONSE))
+		return TEE_INTERNAL_ERROR;
+
+	*response = rsp;
+	*responseSize = received;
+
+	return (rsp->result == 0) ? TEE_SUCCESS : TEE_UNABLE_TO_COMPLETE_OPERATION;
+}
+
+TEESTATUS TEEAPI TeeMkhiGetFwVersion(IN PTEEHANDLE handle,
+				     OUT struct tee_mkhi_fw_version *version,
+				     IN uint32_t timeout)
+{
+	struct tee_mkhi_rsp_buf buf;
+	const struct tee_mkhi_hdr *rsp;
+	size_t len;
+	TEESTATUS status;
+
+	if (!version)
+		return TEE_INVALID_PARAMETER;
+
+	status = TeeMkhiTransact(handle, &tee_mkhi_get_fw_version_req,
+				 sizeof(tee_mkhi_get_fw_version_req),
+				 &buf, sizeof(buf), &rsp, &len, timeout);
+	if (status != TEE_SUCCESS)
+		return status;
+	if (len < MKHI_GEN_GET_FW_VERSION_RSP_MIN_LEN)
+		return TEE_INTERNAL_ERROR;
+
+	/* FITC is not reported by older firmware */
+	if (len < MKHI_GEN_GET_FW_VERSION_RSP_MAX_LEN)
+		memset(&buf.rsp.fw_version.fitc, 0, sizeof(buf.rsp.fw_version.fitc));
+	tee_mkhi_version_get(&version->code, &buf.rsp.fw_version.code);
+	tee_mkhi_version_get(&version->nftp, &buf.rsp.fw_version.nftp);
+	tee_mkhi_version_get(&version->fitc, &buf.rsp.fw_version.fitc);
+	return TEE_SUCCESS;
+}
+
+TEESTATUS TEEAPI TeeMkhiGetFwVersionCached(IN PTEEHANDLE handle,
+					   OUT struct tee_mkhi_fw_version *version,
+					   IN uint32_t timeout)
+{
+#ifndef _WIN32
+	struct tee_fwcache cache;
+	struct tee_fwcache_key key;
+	struct tee_fwcache_key after;
+	bool locked = false;
+#endif /* _WIN32 */
+	TEESTATUS status;
+
+	if (!handle || !version)
+		return TEE_INVALID_PARAMETER;
+
+#ifndef _WIN32
+	if (tee_fwcache_key(handle, &key)) {
+		if (tee_fwcache_get(&key, version))
+			return TEE_SUCCESS;
+		switch (tee_fwcache_lock(&cache, &key, version, timeout)) {
+		case TEE_FWCACHE_HIT:
+			return TEE_SUCCESS;
+		case TEE_FWCACHE_LOCKED:
+			locked = true;
+			break;
+		case TEE_FWCACHE_BYPASS:
+			break;
+		}
+	}
+#endif /* _WIN32 */
+
+	status = TEE_SUCCESS;
+	if (handle->maxMsgLen == 0)
+		status = TeeConnect(handle);
+	if (status == TEE_SUCCESS)
+		status = TeeMkhiGetFwVersion(handle, version, timeout);
+
+#ifndef _WIN32
+	if (locked) {
+		/* a reset during the query changes the key, the result is not stored then */
+		if (status == TEE_SUCCESS &&
+		    tee_fwcache_key(handle, &after) && !memcmp(&key, &after, sizeof(key)))
+			tee_fwcache_put(&cache, &key, version);
+		tee_fwcache_unlock(&cache);
+	}
+#endif /* _WIN32 */
+	return status;
+}
+
+TEESTATUS TEEAPI TeeMkhiGetMkhiVersion(IN PTEEHANDLE handle,
+				       OUT struct tee_mkhi_if_version *version,
+				       IN uint32_t timeout)
+{
+	struct tee_mkhi_rsp_buf buf;
+	const struct tee_mkhi_hdr *rsp;
+	size_t len;
+	TEESTATUS status;
+
+	if (!version)
+		return TEE_INVALID_PARAMETER;
+
+	status = TeeMkhiTransact(handle, &tee_mkhi_get_mkhi_version_req,
+				 sizeof(tee_mkhi_get_mkhi_version_req),
+				 &buf, sizeof(buf), &rsp, &len, timeout);
+	if (status != TEE_SUCCESS)
+		return status;
+	if (len < MKHI_GEN_GET_MKHI_VERSION_RSP_MIN_LEN)
+		return TEE_INTERNAL_ERROR;
+
+	version->minor = buf.rsp.if_version.minor;
+	version->major = buf.rsp.if_version.major;
+	return TEE_SUCCESS;
+}
+
+TEESTATUS TEEAPI TeeMkhiGetRule(IN PTEEHANDLE handle, IN uint32_t ruleId,
+				OUT void *data, IN OUT size_t *dataSize,
+				IN uint32_t timeout)
+{
+	struct mkhi_fwcaps_get_rule_req req;
+	const struct mkhi_fwcaps_get_rule_rsp *rule;
+	struct tee_mkhi_rsp_buf buf;
+	const struct tee_mkhi_hdr *rsp;
+	size_t len;
+	TEESTATUS status;
+
+	if (!dataSize || (!data && *dataSize))
+		return TEE_INVALID_PARAMETER;
+
+	mkhi_fwcaps_get_rule_req_init(&req);
+	req.rule_id = ruleId;
+	status = TeeMkhiTransact(handle, &req, sizeof(req),
+				 &buf, sizeof(buf), &rsp, &len, timeout);
+	if (status != TEE_SUCCESS)
+		return status;
+	rule = (const struct mkhi_fwcaps_get_rule_rsp *)buf.rsp.rule;
+	if (len < MKHI_FWCAPS_GET_RULE_RSP_MIN_LEN ||
+	    rule->rule_id != ruleId ||
+	    len < MKHI_FWCAPS_GET_RULE_RSP_MIN_LEN + (size_t)rule->length)
+		return TEE_INTERNAL_ERROR;
+
+	if (*dataSize < rule->length) {
+		*dataSize = rule->length;
+		return TEE_INSUFFICIENT_BUFFER;
+	}
+	if (rule->length)
+		memcpy(data, rule->data, rule->length);
+	*dataSize = rule->length;
+	return TEE_SUCCESS;
+}
+
+TEESTATUS TEEAPI TeeMkhiGetFwUpdateState(IN PTEEHANDLE handle,
+					 OUT uint8_t *state, IN uint32_t timeout)
+{
+	struct tee_mkhi_rsp_buf buf;
+	const struct tee_mkhi_hdr *rsp;
+	size_t len;
+	TEESTATUS status;
+
+	if (!state)
+		return TEE_INVALID_PARAMETER;
+
+	status = TeeMkhiTransact(handle, &tee_mkhi_fwupdate_status_req,
+				 sizeof(tee_mkhi_fwupdate_status_req),
+				 &buf, sizeof(buf), &rsp, &len, timeout);
+	if (status != TEE_SUCCESS)
+		return status;
+	if (len < offsetof(struct mkhi_fwupdate_get_status_rsp, reserved))
+		return TEE_INTERNAL_ERROR;
+
+	*state = buf.rsp.fwupdate.state;
+	return TEE_SUCCESS;
+}
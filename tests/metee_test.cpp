@@ -5,9 +5,20 @@
 #include <vector>
 #include <chrono>
 #include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
 #include <climits>
+#include <algorithm>
 #include <fstream>
 #include "metee_test.h"
+#include "metee_mkhi.h"
+#include "metee_amthi.h"
+#include "metee_fwu.h"
+#include "metee_bundle.h"
+#include "metee.hpp"
+#include "mkhi_schema.h"
+#include "amthi_schema.h"
 #ifdef WIN32
 extern "C" {
 #include "public.h"
@@ -113,7 +124,7 @@ TEST_P(MeTeeTEST, PROD_MKHI_SimpleGetVersion)
 	GEN_GET_FW_VERSION_ACK* pResponseMessage; //max length for this client is 2048
 	TEESTATUS status;
 
-	status = TestTeeInitGUID(&Handle, intf.client, intf.device);
+	status = TestTeeInitGUID(&Handle, intf.client, intf);
 	if (status == TEE_DEVICE_NOT_FOUND)
 		GTEST_SKIP();
 	ASSERT_EQ(SUCCESS, status);
@@ -150,7 +161,7 @@ TEST_P(MeTeeTEST, PROD_MKHI_SetLogLevel)
         TEESTATUS status;
 	uint32_t orig_log_level, prev_log_level, new_log_level;
 
-        status = TestTeeInitGUID(&Handle, intf.client, intf.device);
+        status = TestTeeInitGUID(&Handle, intf.client, intf);
         if (status == TEE_DEVICE_NOT_FOUND)
                 GTEST_SKIP();
         ASSERT_EQ(SUCCESS, status);
@@ -192,9 +203,13 @@ TEST_P(MeTeeTEST, PROD_MKHI_1000HandlesGetVersion)
 		FAIL() << "setrlimit() failed with errno=" << errno;
 #endif // __linux__
 	std::vector<std::thread> v;
+	std::mutex lock;
+	std::condition_variable cond;
+	int opened = 0;
+	bool done = false;
 
 	for (int g = 0; g <= 199; g++) {
-		v.push_back(std::thread([g]() {
+		v.push_back(std::thread([g, &lock, &cond, &opened, &done]() {
 			int base = g * 10;
 			int i = 0;
 			std::ofstream file0;
@@ -238,41 +253,55 @@ TEST_P(MeTeeTEST, PROD_MKHI_1000HandlesGetVersion)
 				file7 << "Writing to " << name7 << std::endl;
 				file8 << "Writing to " << name8 << std::endl;
 				file9 << "Writing to " << name9 << std::endl;
-				std::this_thread::sleep_for(std::chrono::seconds(5));
 			}
+			// keep the files open until the handle is done
+			std::unique_lock<std::mutex> l(lock);
+			opened++;
+			cond.notify_all();
+			cond.wait(l, [&done]() { return done; });
 		}));
 	}
-	std::this_thread::sleep_for(std::chrono::seconds(5));
+	{
+		std::unique_lock<std::mutex> l(lock);
+		cond.wait(l, [&opened]() { return opened == 200; });
+	}
 
-	TEEHANDLE Handle = TEEHANDLE_ZERO;
-	size_t NumberOfBytes = 0;
-	struct MeTeeTESTParams intf = GetParam();
-	std::vector <char> MaxResponse;
-	GEN_GET_FW_VERSION_ACK* pResponseMessage; //max length for this client is 2048
-	TEESTATUS status;
+	[this]() {
+		TEEHANDLE Handle = TEEHANDLE_ZERO;
+		size_t NumberOfBytes = 0;
+		struct MeTeeTESTParams intf = GetParam();
+		std::vector <char> MaxResponse;
+		GEN_GET_FW_VERSION_ACK* pResponseMessage; //max length for this client is 2048
+		TEESTATUS status;
 
-	status = TestTeeInitGUID(&Handle, intf.client, intf.device);
-	if (status == TEE_DEVICE_NOT_FOUND)
-		GTEST_SKIP();
-	ASSERT_EQ(SUCCESS, status);
-	ASSERT_NE(TEE_INVALID_DEVICE_HANDLE, TeeGetDeviceHandle(&Handle));
-	ASSERT_EQ(SUCCESS, TeeConnect(&Handle));
+		status = TestTeeInitGUID(&Handle, intf.client, intf);
+		if (status == TEE_DEVICE_NOT_FOUND)
+			GTEST_SKIP();
+		ASSERT_EQ(SUCCESS, status);
+		ASSERT_NE(TEE_INVALID_DEVICE_HANDLE, TeeGetDeviceHandle(&Handle));
+		ASSERT_EQ(SUCCESS, TeeConnect(&Handle));
 
 
-	MaxResponse.resize(Handle.maxMsgLen*sizeof(char));
-	ASSERT_EQ(SUCCESS, TeeWrite(&Handle, &MkhiRequest, sizeof(GEN_GET_FW_VERSION), &NumberOfBytes, 1000));
-	ASSERT_EQ(sizeof(GEN_GET_FW_VERSION), NumberOfBytes);
+		MaxResponse.resize(Handle.maxMsgLen*sizeof(char));
+		ASSERT_EQ(SUCCESS, TeeWrite(&Handle, &MkhiRequest, sizeof(GEN_GET_FW_VERSION), &NumberOfBytes, 1000));
+		ASSERT_EQ(sizeof(GEN_GET_FW_VERSION), NumberOfBytes);
 
-	ASSERT_EQ(SUCCESS, TeeRead(&Handle, &MaxResponse[0], Handle.maxMsgLen, &NumberOfBytes, 1000));
-	pResponseMessage = (GEN_GET_FW_VERSION_ACK*)(&MaxResponse[0]);
+		ASSERT_EQ(SUCCESS, TeeRead(&Handle, &MaxResponse[0], Handle.maxMsgLen, &NumberOfBytes, 1000));
+		pResponseMessage = (GEN_GET_FW_VERSION_ACK*)(&MaxResponse[0]);
 
-	ASSERT_EQ(SUCCESS, pResponseMessage->Header.Fields.Result);
-	EXPECT_NE(0, pResponseMessage->Data.FWVersion.CodeMajor);
-	EXPECT_NE(0, pResponseMessage->Data.FWVersion.CodeBuildNo);
+		ASSERT_EQ(SUCCESS, pResponseMessage->Header.Fields.Result);
+		EXPECT_NE(0, pResponseMessage->Data.FWVersion.CodeMajor);
+		EXPECT_NE(0, pResponseMessage->Data.FWVersion.CodeBuildNo);
 
-	TeeDisconnect(&Handle);
-	EXPECT_EQ(TEE_INVALID_DEVICE_HANDLE, TeeGetDeviceHandle(&Handle));
+		TeeDisconnect(&Handle);
+		EXPECT_EQ(TEE_INVALID_DEVICE_HANDLE, TeeGetDeviceHandle(&Handle));
+	}();
 
+	{
+		std::lock_guard<std::mutex> l(lock);
+		done = true;
+	}
+	cond.notify_all();
 	for (std::vector<std::thread>::iterator it = v.begin(); it != v.end(); it++)
 		it->std::thread::join();
 }
@@ -294,7 +323,7 @@ TEST_P(MeTeeTEST, PROD_MKHI_SimpleGetVersionStress)
 	GEN_GET_FW_VERSION_ACK* pResponseMessage; //max length for this client is 2048
 	TEESTATUS status;
 
-	status = TestTeeInitGUID(&Handle, intf.client, intf.device);
+	status = TestTeeInitGUID(&Handle, intf.client, intf);
 	if (status == TEE_DEVICE_NOT_FOUND)
 		GTEST_SKIP();
 	ASSERT_EQ(SUCCESS, status);
@@ -333,7 +362,7 @@ TEST_P(MeTeeTEST, PROD_MKHI_PendingWriteStress)
 	GEN_GET_FW_VERSION_ACK* pResponseMessage; //max length for this client is 2048
 	TEESTATUS status;
 
-	status = TestTeeInitGUID(&Handle, intf.client, intf.device);
+	status = TestTeeInitGUID(&Handle, intf.client, intf);
 	if (status == TEE_DEVICE_NOT_FOUND)
 		GTEST_SKIP();
 	ASSERT_EQ(SUCCESS, status);
@@ -350,6 +379,48 @@ TEST_P(MeTeeTEST, PROD_MKHI_PendingWriteStress)
 }
 #endif // not WIN32
 
+#ifndef WIN32
+/*
+Send GetVersion Command to MKHI on handle with caller-provided storage
+1) Init handle in place
+2) Send GetVersion Req Command
+3) Receive GetVersion Resp Command
+4) Check for Valid Resp
+5) Close Connection
+*/
+TEST_P(MeTeeTEST, PROD_MKHI_InitInPlaceGetVersion)
+{
+	TEEHANDLE Handle = TEEHANDLE_ZERO;
+	TEE_HANDLE_STORAGE Storage;
+	size_t NumberOfBytes = 0;
+	struct MeTeeTESTParams intf = GetParam();
+	std::vector <char> MaxResponse;
+	GEN_GET_FW_VERSION_ACK* pResponseMessage; //max length for this client is 2048
+	TEESTATUS status;
+
+	status = TeeInitInPlace(&Handle, intf.client, intf.path, &Storage, sizeof(Storage));
+	if (status == TEE_DEVICE_NOT_FOUND)
+		GTEST_SKIP();
+	ASSERT_EQ(SUCCESS, status);
+	ASSERT_EQ((void*)&Storage, Handle.handle);
+	ASSERT_NE(TEE_INVALID_DEVICE_HANDLE, TeeGetDeviceHandle(&Handle));
+	ASSERT_EQ(SUCCESS, TeeConnect(&Handle));
+
+	MaxResponse.resize(Handle.maxMsgLen*sizeof(char));
+	ASSERT_EQ(SUCCESS, TeeWrite(&Handle, &MkhiRequest, sizeof(GEN_GET_FW_VERSION), &NumberOfBytes, 0));
+	ASSERT_EQ(sizeof(GEN_GET_FW_VERSION), NumberOfBytes);
+
+	ASSERT_EQ(SUCCESS, TeeRead(&Handle, &MaxResponse[0], Handle.maxMsgLen, &NumberOfBytes, 0));
+	pResponseMessage = (GEN_GET_FW_VERSION_ACK*)(&MaxResponse[0]);
+
+	ASSERT_EQ(SUCCESS, pResponseMessage->Header.Fields.Result);
+	EXPECT_NE(0, pResponseMessage->Data.FWVersion.CodeMajor);
+
+	TeeDisconnect(&Handle);
+	EXPECT_EQ(TEE_INVALID_DEVICE_HANDLE, TeeGetDeviceHandle(&Handle));
+}
+#endif // not WIN32
+
 TEST_P(MeTeeTEST, PROD_MKHI_SimpleGetVersionNULLReturn)
 {
 	TEEHANDLE Handle = TEEHANDLE_ZERO;
@@ -358,7 +429,7 @@ TEST_P(MeTeeTEST, PROD_MKHI_SimpleGetVersionNULLReturn)
 	GEN_GET_FW_VERSION_ACK* pResponseMessage; //max length for this client is 2048
 	TEESTATUS status;
 
-	status = TestTeeInitGUID(&Handle, intf.client, intf.device);
+	status = TestTeeInitGUID(&Handle, intf.client, intf);
 	if (status == TEE_DEVICE_NOT_FOUND)
 		GTEST_SKIP();
 	ASSERT_EQ(SUCCESS, status);
@@ -394,7 +465,7 @@ TEST_P(MeTeeTEST, PROD_MKHI_TimeoutGetVersion)
 	std::vector <char> MaxResponse;
 	TEESTATUS status;
 
-	status = TestTeeInitGUID(&Handle, intf.client, intf.device);
+	status = TestTeeInitGUID(&Handle, intf.client, intf);
 	if (status == TEE_DEVICE_NOT_FOUND)
 		GTEST_SKIP();
 	ASSERT_EQ(SUCCESS, status);
@@ -422,7 +493,7 @@ TEST_P(MeTeeTEST, PROD_MKHI_GetFWStatus)
 	struct MeTeeTESTParams intf = GetParam();
 	TEESTATUS status;
 
-	status = TestTeeInitGUID(&Handle, intf.client, intf.device);
+	status = TestTeeInitGUID(&Handle, intf.client, intf);
 	if (status == TEE_DEVICE_NOT_FOUND)
 		GTEST_SKIP();
 	ASSERT_EQ(TEE_SUCCESS, status);
@@ -458,7 +529,7 @@ TEST_P(MeTeeTEST, PROD_MKHI_DoubleConnect)
 	struct MeTeeTESTParams intf = GetParam();
 	TEESTATUS status;
 
-	status = TestTeeInitGUID(&Handle, intf.client, intf.device);
+	status = TestTeeInitGUID(&Handle, intf.client, intf);
 	if (status == TEE_DEVICE_NOT_FOUND)
 		GTEST_SKIP();
 	ASSERT_EQ(SUCCESS, status);
@@ -478,7 +549,7 @@ TEST_P(MeTeeTEST, PROD_MKHI_WriteReadNoConnect)
 	std::vector <char> MaxResponse;
 	TEESTATUS status;
 
-	status = TestTeeInitGUID(&Handle, intf.client, intf.device);
+	status = TestTeeInitGUID(&Handle, intf.client, intf);
 	if (status == TEE_DEVICE_NOT_FOUND)
 		GTEST_SKIP();
 	ASSERT_EQ(SUCCESS, status);
@@ -498,7 +569,7 @@ TEST_P(MeTeeNTEST, PROD_N_TestConnectToNullUuid)
 	TEEHANDLE handle = TEEHANDLE_ZERO;
 	struct MeTeeTESTParams intf = GetParam();
 
-	ASSERT_EQ(TEE_INVALID_PARAMETER, TestTeeInitGUID(&handle, NULL, intf.device));
+	ASSERT_EQ(TEE_INVALID_PARAMETER, TestTeeInitGUID(&handle, NULL, intf));
 }
 
 TEST_P(MeTeeNTEST, PROD_N_TestConnectToNonExistsUuid)
@@ -507,7 +578,7 @@ TEST_P(MeTeeNTEST, PROD_N_TestConnectToNonExistsUuid)
 	struct MeTeeTESTParams intf = GetParam();
 	TEESTATUS status;
 
-	status = TestTeeInitGUID(&handle, &GUID_NON_EXISTS_CLIENT, intf.device);
+	status = TestTeeInitGUID(&handle, &GUID_NON_EXISTS_CLIENT, intf);
 	if (status == TEE_DEVICE_NOT_FOUND)
 		GTEST_SKIP();
 	ASSERT_EQ(TEE_SUCCESS, status);
@@ -530,7 +601,7 @@ TEST_P(MeTeeNTEST, PROD_N_TestLongClientPath)
 	TEESTATUS status;
 	const char *longPath = "Lorem ipsum dolor sit amet, consectetur adipiscing elit, sed do eiusmod tempor incididunt ut labore et dolore magna aliqua. Ut enim ad minim veniam, quis nostrud exercitation ullamco laboris nisi ut aliquip ex ea commodo consequat. Duis aute irure dolor in reprehenderit in voluptate velit esse cillum dolore eu fugiat nulla pariatur. Excepteur sint occaecat cupidatat non proident, sunt in culpa qui officia deserunt mollit anim id est laborum.";
 
-	status = TestTeeInitGUID(&handle, (const GUID*)longPath, intf.device);
+	status = TestTeeInitGUID(&handle, (const GUID*)longPath, intf);
 	if (status == TEE_DEVICE_NOT_FOUND)
 		GTEST_SKIP();
 	ASSERT_EQ(TEE_SUCCESS, status);
@@ -545,7 +616,7 @@ TEST_P(MeTeeNTEST, PROD_N_TestGetDriverVersion)
 	teeDriverVersion_t ver = {0, 0, 0, 0};
 	TEESTATUS status;
 
-	status = TestTeeInitGUID(&handle, &GUID_NON_EXISTS_CLIENT, intf.device);
+	status = TestTeeInitGUID(&handle, &GUID_NON_EXISTS_CLIENT, intf);
 	if (status == TEE_DEVICE_NOT_FOUND)
 		GTEST_SKIP();
 	ASSERT_EQ(TEE_SUCCESS, status);
@@ -568,7 +639,7 @@ TEST_P(MeTeeNTEST, PROD_N_TestGetDriverVersion_NullParam)
 	struct MeTeeTESTParams intf = GetParam();
 	TEESTATUS status;
 
-	status = TestTeeInitGUID(&handle, &GUID_NON_EXISTS_CLIENT, intf.device);
+	status = TestTeeInitGUID(&handle, &GUID_NON_EXISTS_CLIENT, intf);
 	if (status == TEE_DEVICE_NOT_FOUND)
 		GTEST_SKIP();
 	ASSERT_EQ(TEE_SUCCESS, status);
@@ -593,6 +664,1186 @@ TEST_P(MeTeeNTEST, PROD_N_TestConnectByPath)
 }
 #endif // WIN32
 
+#ifndef WIN32
+TEST_F(MeTeeLibTEST, PROD_N_InitInPlaceBadStorage)
+{
+	TEEHANDLE handle = TEEHANDLE_ZERO;
+	TEE_HANDLE_STORAGE storage[2];
+
+	ASSERT_EQ(TEE_INVALID_PARAMETER, TeeInitInPlace(&handle, &GUID_NON_EXISTS_CLIENT, NULL, NULL, sizeof(storage[0])));
+	ASSERT_EQ(TEE_INVALID_PARAMETER, TeeInitInPlace(&handle, &GUID_NON_EXISTS_CLIENT, NULL, &storage[0], 1));
+	ASSERT_EQ(TEE_INVALID_PARAMETER, TeeInitInPlace(&handle, &GUID_NON_EXISTS_CLIENT, NULL,
+							&storage[0], TEE_HANDLE_STORAGE_SIZE - 1));
+	ASSERT_EQ(TEE_INVALID_PARAMETER, TeeInitInPlace(&handle, &GUID_NON_EXISTS_CLIENT, NULL,
+							storage[0].data + 1, sizeof(storage[0])));
+}
+#endif // not WIN32
+
+#ifndef WIN32
+TEST_F(MeTeeLibTEST, PROD_TraceDump)
+{
+	TEEHANDLE handle = TEEHANDLE_ZERO;
+	FILE *out;
+	std::string dump;
+	char line[256];
+
+	out = tmpfile();
+	ASSERT_NE((FILE*)NULL, out);
+
+	TeeTraceEnable(1);
+	ASSERT_EQ(TEE_DEVICE_NOT_FOUND, TeeInit(&handle, &GUID_NON_EXISTS_CLIENT, "/NO_SUCH_DEVICE"));
+	TeeDisconnect(&handle);
+	EXPECT_EQ(1U, TeeTraceEnable(0));
+
+	ASSERT_EQ(TEE_SUCCESS, TeeTraceDump(fileno(out)));
+	rewind(out);
+	while (fgets(line, sizeof(line), out))
+		dump += line;
+	fclose(out);
+
+	EXPECT_NE(std::string::npos, dump.find("init exit"));
+	EXPECT_NE(std::string::npos, dump.find("disconnect entry"));
+	EXPECT_NE(std::string::npos, dump.find("disconnect exit"));
+	EXPECT_EQ(TEE_INVALID_PARAMETER, TeeTraceDump(-1));
+}
+#endif // not WIN32
+
+#ifndef WIN32
+static void TestLogCallback(void *ctx, enum tee_log_level level,
+			    const char *file, int line, const char *func,
+			    const char *fmt, va_list args)
+{
+	unsigned int *errors = (unsigned int *)ctx;
+
+	EXPECT_NE((const char*)NULL, file);
+	EXPECT_NE(0, line);
+	EXPECT_NE((const char*)NULL, func);
+	EXPECT_NE((const char*)NULL, fmt);
+	if (level == TEE_LOG_LEVEL_ERROR)
+		(*errors)++;
+}
+
+TEST_F(MeTeeLibTEST, PROD_LogCallback)
+{
+	TEEHANDLE handle = TEEHANDLE_ZERO;
+	unsigned int errors = 0;
+
+	ASSERT_EQ(TEE_SUCCESS, TeeSetLogCallback(TestLogCallback, &errors));
+	ASSERT_EQ(TEE_DEVICE_NOT_FOUND, TeeInit(&handle, &GUID_NON_EXISTS_CLIENT, "/NO_SUCH_DEVICE"));
+	ASSERT_EQ(TEE_SUCCESS, TeeSetLogCallback(NULL, NULL));
+
+	EXPECT_NE(0U, errors);
+}
+
+TEST_F(MeTeeLibTEST, PROD_Stats)
+{
+	TEEHANDLE handle = TEEHANDLE_ZERO;
+	struct tee_stats_counters session;
+	struct tee_stats_client client;
+	char buf[16];
+	TEESTATUS status;
+	uint32_t i;
+
+	ASSERT_EQ(TEE_SUCCESS, TeeInit(&handle, &GUID_NON_EXISTS_CLIENT, "/dev/null"));
+	EXPECT_NE(TEE_SUCCESS, TeeConnect(&handle));
+	EXPECT_NE(TEE_SUCCESS, TeeConnect(&handle));
+	EXPECT_EQ(TEE_DISCONNECTED, TeeRead(&handle, buf, sizeof(buf), NULL, 0));
+
+	ASSERT_EQ(TEE_SUCCESS, TeeGetStats(&handle, &session, NULL));
+	EXPECT_EQ(2U, session.connects);
+	EXPECT_EQ(1U, session.reconnects);
+	EXPECT_EQ(1U, session.reads);
+	EXPECT_EQ(1U, session.errors[TEE_DISCONNECTED]);
+	EXPECT_EQ(0U, session.bytes_read);
+
+	for (i = 0; (status = TeeGetStatsClient(i, &client)) == TEE_SUCCESS; i++) {
+		if (!strcmp(client.device, "/dev/null") &&
+		    !memcmp(&client.guid, &GUID_NON_EXISTS_CLIENT, sizeof(GUID)))
+			break;
+	}
+	ASSERT_EQ(TEE_SUCCESS, status);
+	EXPECT_LE(2U, client.stats.counters.connects);
+	EXPECT_EQ(0U, client.stats.hist[TEE_STATS_HIST_TRANSACT].count);
+	TeeDisconnect(&handle);
+
+	EXPECT_EQ(TEE_INVALID_PARAMETER, TeeGetStats(&handle, &session, NULL));
+	for (i = 1; i < TEE_STATS_HIST_BUCKETS; i++)
+		EXPECT_LT(TeeStatsBucketBound(i - 1), TeeStatsBucketBound(i));
+}
+
+TEST_F(MeTeeLibTEST, PROD_StatsOpenMetrics)
+{
+	TEEHANDLE handle = TEEHANDLE_ZERO;
+	std::vector<char> buf(1024 * 1024);
+	char small[64];
+	size_t written = 0;
+
+	ASSERT_EQ(TEE_SUCCESS, TeeInit(&handle, &GUID_NON_EXISTS_CLIENT, "/dev/null"));
+	EXPECT_NE(TEE_SUCCESS, TeeConnect(&handle));
+	TeeDisconnect(&handle);
+
+	ASSERT_EQ(TEE_SUCCESS, TeeStatsFormatOpenMetrics(buf.data(), buf.size(), &written));
+	std::string text(buf.data(), written);
+	EXPECT_NE(std::string::npos, text.find("metee_operations_total{device=\"/dev/null\""));
+	EXPECT_NE(std::string::npos, text.find("metee_poll_wait_seconds_bucket{"));
+	EXPECT_EQ(text.size() - 6, text.rfind("# EOF\n"));
+
+	EXPECT_EQ(TEE_INSUFFICIENT_BUFFER, TeeStatsFormatOpenMetrics(small, sizeof(small), &written));
+	EXPECT_GT(sizeof(small), written);
+	EXPECT_EQ(written, strlen(small));
+}
+
+TEST_F(MeTeeLibTEST, PROD_Capture)
+{
+	static const uint8_t directions[] = {
+		TEE_CAPTURE_DIR_CONNECT, TEE_CAPTURE_DIR_WRITE, TEE_CAPTURE_DIR_READ
+	};
+	std::string path = TempFile("metee_capture");
+	TEEHANDLE handle = TEEHANDLE_ZERO;
+	struct mkhi_gen_get_fw_version_req req;
+	struct mkhi_gen_get_fw_version_rsp ack;
+	struct tee_capture_hdr hdr;
+	std::vector<uint8_t> packet;
+	uint32_t block[7];
+	uint64_t dropped = 1;
+	size_t done = 0;
+	size_t i;
+	FILE *fp;
+
+	ASSERT_FALSE(path.empty());
+	mkhi_gen_get_fw_version_req_init(&req);
+
+	EXPECT_EQ(TEE_INVALID_PARAMETER, TeeCaptureStop(NULL));
+	ASSERT_EQ(TEE_SUCCESS, TeeCaptureStart(path.c_str(), 0, 1));
+	EXPECT_EQ(TEE_BUSY, TeeCaptureStart(path.c_str(), 0, 1));
+	ASSERT_EQ(TEE_SUCCESS, TeeInit(&handle, &GUID_DEVINTERFACE_MKHI, TEE_LOOPBACK_DEVICE));
+	ASSERT_EQ(TEE_SUCCESS, TeeConnect(&handle));
+	EXPECT_EQ(TEE_SUCCESS, TeeWrite(&handle, &req, sizeof(req), &done, 0));
+	EXPECT_EQ(TEE_SUCCESS, TeeRead(&handle, &ack, sizeof(ack), &done, 0));
+	TeeDisconnect(&handle);
+	ASSERT_EQ(TEE_SUCCESS, TeeCaptureStop(&dropped));
+	EXPECT_EQ(0U, dropped);
+
+	fp = fopen(path.c_str(), "rb");
+	ASSERT_NE(nullptr, fp);
+	/* section header, its length then skips the rest of it */
+	ASSERT_EQ(3U, fread(block, sizeof(block[0]), 3, fp));
+	EXPECT_EQ(0x0A0D0D0AU, block[0]);
+	EXPECT_EQ(0x1A2B3C4DU, block[2]);
+	ASSERT_EQ(0, fseek(fp, block[1], SEEK_SET));
+	/* interface description */
+	ASSERT_EQ(2U, fread(block, sizeof(block[0]), 2, fp));
+	EXPECT_EQ(0x00000001U, block[0]);
+	ASSERT_EQ(0, fseek(fp, block[1] - 2 * sizeof(block[0]), SEEK_CUR));
+	/* enhanced packet blocks: connect, request, response */
+	for (i = 0; i < sizeof(directions); i++) {
+		size_t payload = (directions[i] == TEE_CAPTURE_DIR_WRITE) ? sizeof(req) :
+				 (directions[i] == TEE_CAPTURE_DIR_READ) ? sizeof(ack) : 0;
+
+		ASSERT_EQ(7U, fread(block, sizeof(block[0]), 7, fp));
+		EXPECT_EQ(0x00000006U, block[0]);
+		EXPECT_EQ(sizeof(hdr) + payload, block[5]);
+		EXPECT_EQ(block[5], block[6]);
+		/* packet data, padding and the trailing block length */
+		ASSERT_LT(sizeof(block) + sizeof(hdr), block[1]);
+		packet.resize(block[1] - sizeof(block));
+		ASSERT_EQ(1U, fread(packet.data(), packet.size(), 1, fp));
+		memcpy(&hdr, packet.data(), sizeof(hdr));
+		EXPECT_EQ(TEE_CAPTURE_VERSION, hdr.version);
+		EXPECT_EQ(directions[i], hdr.direction);
+		EXPECT_EQ(payload, hdr.length);
+		EXPECT_EQ((uintptr_t)&handle, hdr.handle);
+		EXPECT_EQ(0, memcmp(hdr.guid, &GUID_DEVINTERFACE_MKHI, sizeof(hdr.guid)));
+		if (directions[i] == TEE_CAPTURE_DIR_WRITE)
+			EXPECT_EQ(0, memcmp(packet.data() + sizeof(hdr), &req, sizeof(req)));
+	}
+	fclose(fp);
+}
+
+TEST_F(MeTeeLibTEST, PROD_SysfsRoot)
+{
+	TEEHANDLE handle = TEEHANDLE_ZERO;
+	char root[] = "/tmp/metee_sysfs_XXXXXX";
+	std::string dir;
+	uint32_t fwStatus = 0;
+	FILE *fp;
+
+	ASSERT_NE(nullptr, mkdtemp(root));
+	dir = std::string(root) + "/class";
+	ASSERT_EQ(0, mkdir(dir.c_str(), 0700));
+	dir += "/mei";
+	ASSERT_EQ(0, mkdir(dir.c_str(), 0700));
+	dir += "/null";
+	ASSERT_EQ(0, mkdir(dir.c_str(), 0700));
+	fp = fopen((dir + "/fw_status").c_str(), "w");
+	ASSERT_NE(nullptr, fp);
+	fputs("90000255\n89110126\n", fp);
+	fclose(fp);
+
+	setenv("METEE_SYSFS_ROOT", root, 1);
+	ASSERT_EQ(TEE_SUCCESS, TeeInit(&handle, &GUID_NON_EXISTS_CLIENT, "/dev/null"));
+	EXPECT_EQ(TEE_SUCCESS, TeeFWStatus(&handle, 1, &fwStatus));
+	EXPECT_EQ(0x89110126U, fwStatus);
+	TeeDisconnect(&handle);
+	unsetenv("METEE_SYSFS_ROOT");
+
+	unlink((dir + "/fw_status").c_str());
+	rmdir(dir.c_str());
+	rmdir((std::string(root) + "/class/mei").c_str());
+	rmdir((std::string(root) + "/class").c_str());
+	rmdir(root);
+}
+
+DEFINE_GUID(GUID_LOOPBACK_ECHO, 0x5d3a3f0e, 0x2c1b, 0x4a77,
+	    0x9b, 0x4e, 0x61, 0x0d, 0x8a, 0x2f, 0x3c, 0x95);
+
+static TEESTATUS LoopbackEchoResponder(void *ctx, const GUID *guid,
+				       const void *request, size_t request_size,
+				       void *response, size_t *response_size)
+{
+	(void)ctx;
+	(void)guid;
+	if (request_size > *response_size)
+		return TEE_INSUFFICIENT_BUFFER;
+	memcpy(response, request, request_size);
+	*response_size = request_size;
+	return TEE_SUCCESS;
+}
+
+TEST_F(MeTeeLibTEST, PROD_FaultInject)
+{
+	TEEHANDLE handle = TEEHANDLE_ZERO;
+	struct mkhi_gen_get_fw_version_req req;
+	struct mkhi_gen_get_fw_version_rsp ack;
+	size_t done = 0;
+	uint64_t count = 0;
+
+	EXPECT_EQ(TEE_INVALID_PARAMETER, TeeFaultInjectSet("read:short"));
+	EXPECT_EQ(TEE_INVALID_PARAMETER, TeeFaultInjectSet("write:ebusy@2"));
+	EXPECT_EQ(TEE_INVALID_PARAMETER, TeeFaultInjectSet("poll:etime"));
+	ASSERT_EQ(TEE_SUCCESS,
+		  TeeFaultInjectSet("connect:ebusy#1,write:eintr#1,read:etime#1,read:enodev#3"));
+
+	mkhi_gen_get_fw_version_req_init(&req);
+
+	ASSERT_EQ(TEE_SUCCESS, TeeInit(&handle, &GUID_DEVINTERFACE_MKHI, TEE_LOOPBACK_DEVICE));
+	EXPECT_EQ(TEE_BUSY, TeeConnect(&handle));
+	ASSERT_EQ(TEE_SUCCESS, TeeConnect(&handle));
+	EXPECT_EQ(TEE_INTERNAL_ERROR, TeeWrite(&handle, &req, sizeof(req), &done, 0));
+	EXPECT_EQ(TEE_SUCCESS, TeeWrite(&handle, &req, sizeof(req), &done, 0));
+	EXPECT_EQ(TEE_TIMEOUT, TeeRead(&handle, &ack, sizeof(ack), &done, 0));
+	EXPECT_EQ(TEE_SUCCESS, TeeRead(&handle, &ack, sizeof(ack), &done, 0));
+	EXPECT_EQ(sizeof(ack), done);
+	EXPECT_EQ(TEE_SUCCESS, TeeWrite(&handle, &req, sizeof(req), &done, 0));
+	EXPECT_EQ(TEE_DISCONNECTED, TeeRead(&handle, &ack, sizeof(ack), &done, 0));
+	EXPECT_EQ(TEE_DISCONNECTED, TeeWrite(&handle, &req, sizeof(req), &done, 0));
+	/* the reset drops the session, not the handle */
+	ASSERT_EQ(TEE_SUCCESS, TeeConnect(&handle));
+	EXPECT_EQ(TEE_SUCCESS, TeeWrite(&handle, &req, sizeof(req), &done, 0));
+	EXPECT_EQ(TEE_SUCCESS, TeeRead(&handle, &ack, sizeof(ack), &done, 0));
+	EXPECT_EQ(sizeof(ack), done);
+	TeeDisconnect(&handle);
+
+	/* the emulated client takes the first half of the message */
+	ASSERT_EQ(TEE_SUCCESS, LoopbackRegister(&GUID_LOOPBACK_ECHO, 64, LoopbackEchoResponder, NULL));
+	ASSERT_EQ(TEE_SUCCESS, TeeFaultInjectSet("write:short#1"));
+	ASSERT_EQ(TEE_SUCCESS, TeeInit(&handle, &GUID_LOOPBACK_ECHO, TEE_LOOPBACK_DEVICE));
+	ASSERT_EQ(TEE_SUCCESS, TeeConnect(&handle));
+	EXPECT_EQ(TEE_SUCCESS, TeeWrite(&handle, &req, sizeof(req), &done, 0));
+	EXPECT_EQ(sizeof(req) / 2, done);
+	EXPECT_EQ(TEE_SUCCESS, TeeRead(&handle, &ack, sizeof(ack), &done, 0));
+	EXPECT_EQ(sizeof(req) / 2, done);
+	TeeDisconnect(&handle);
+
+	EXPECT_EQ(TEE_SUCCESS, TeeFaultInjectCount(&count));
+	EXPECT_EQ(1U, count);
+	EXPECT_EQ(TEE_SUCCESS, TeeFaultInjectSet(NULL));
+}
+
+TEST_F(MeTeeLibTEST, PROD_VirtualClock)
+{
+	const uint64_t ms = 1000000ULL;
+	TEEHANDLE handle = TEEHANDLE_ZERO;
+	struct mkhi_gen_get_fw_version_rsp ack;
+	size_t done = 0;
+	uint64_t start;
+
+	EXPECT_EQ(TEE_NOTSUPPORTED, TeeClockVirtualAdvance(ms));
+	ASSERT_EQ(TEE_SUCCESS, TeeClockVirtualStart(1000 * ms));
+	EXPECT_EQ(TEE_BUSY, TeeClockVirtualStart(0));
+	EXPECT_EQ(1000 * ms, TeeClockNow());
+	EXPECT_EQ(TEE_CLIENT_NOT_FOUND, TeeLoopbackSetLatency(&GUID_NON_EXISTS_CLIENT, ms));
+	ASSERT_EQ(TEE_SUCCESS, TeeLoopbackSetLatency(&GUID_DEVINTERFACE_MKHI, 500 * ms));
+
+	ASSERT_EQ(TEE_SUCCESS, TeeInit(&handle, &GUID_DEVINTERFACE_MKHI, TEE_LOOPBACK_DEVICE));
+	ASSERT_EQ(TEE_SUCCESS, TeeConnect(&handle));
+
+	start = TeeClockNow();
+	EXPECT_EQ(TEE_TIMEOUT, TeeRead(&handle, &ack, sizeof(ack), &done, 1000));
+	EXPECT_EQ(start + 1000 * ms, TeeClockNow());
+
+	start = TeeClockNow();
+	ASSERT_EQ(TEE_SUCCESS, TeeWrite(&handle, &MkhiRequest, sizeof(MkhiRequest), &done, 0));
+	EXPECT_EQ(TEE_TIMEOUT, TeeRead(&handle, &ack, sizeof(ack), &done, 100));
+	EXPECT_EQ(start + 100 * ms, TeeClockNow());
+	EXPECT_EQ(TEE_SUCCESS, TeeRead(&handle, &ack, sizeof(ack), &done, 1000));
+	EXPECT_EQ(start + 500 * ms, TeeClockNow());
+
+	start = TeeClockNow();
+	ASSERT_EQ(TEE_SUCCESS, TeeWrite(&handle, &MkhiRequest, sizeof(MkhiRequest), &done, 0));
+	EXPECT_EQ(TEE_SUCCESS, TeeClockVirtualAdvance(200 * ms));
+	EXPECT_EQ(TEE_SUCCESS, TeeRead(&handle, &ack, sizeof(ack), &done, 0));
+	EXPECT_EQ(start + 500 * ms, TeeClockNow());
+	EXPECT_EQ(TEE_SUCCESS, mkhi_hdr_word_result(ack.header.word));
+	TeeDisconnect(&handle);
+
+	EXPECT_EQ(TEE_SUCCESS, TeeLoopbackSetLatency(&GUID_DEVINTERFACE_MKHI, 0));
+	TeeClockVirtualStop();
+	EXPECT_EQ(TEE_NOTSUPPORTED, TeeClockVirtualAdvance(ms));
+}
+
+TEST_F(MeTeeLibTEST, PROD_MkhiTypedCalls)
+{
+	static const struct tee_mkhi_hdr req = {
+		TEE_MKHI_GROUP_GEN, TEE_MKHI_GEN_GET_FW_VERSION, 0, 0
+	};
+	TEEHANDLE handle = TEEHANDLE_ZERO;
+	struct tee_mkhi_fw_version version;
+	const struct tee_mkhi_hdr *rsp = NULL;
+	uint8_t buf[64];
+	uint8_t rule[4];
+	size_t len = 0;
+	uint8_t state = 0;
+
+	ASSERT_EQ(TEE_SUCCESS, TeeInit(&handle, &GUID_DEVINTERFACE_MKHI, TEE_LOOPBACK_DEVICE));
+	ASSERT_EQ(TEE_SUCCESS, TeeConnect(&handle));
+
+	memset(&version, 0xFF, sizeof(version));
+	ASSERT_EQ(TEE_SUCCESS, TeeMkhiGetFwVersion(&handle, &version, 1000));
+	EXPECT_EQ(16, version.code.major);
+	EXPECT_EQ(1, version.code.minor);
+	EXPECT_EQ(10, version.code.hotFix);
+	EXPECT_EQ(1000, version.code.buildNo);
+	EXPECT_EQ(0, version.nftp.major);
+	EXPECT_EQ(16, version.fitc.major);
+
+	/* the response is validated in the caller buffer */
+	ASSERT_EQ(TEE_SUCCESS, TeeMkhiTransact(&handle, &req, sizeof(req), buf, sizeof(buf),
+					       &rsp, &len, 1000));
+	EXPECT_EQ((const void *)buf, (const void *)rsp);
+	EXPECT_EQ(sizeof(struct mkhi_gen_get_fw_version_rsp), len);
+	EXPECT_EQ(TEE_MKHI_GEN_GET_FW_VERSION | TEE_MKHI_RESPONSE, rsp->command);
+
+	/* a response filling a buffer shorter than the client maximum may be truncated */
+	EXPECT_EQ(TEE_INSUFFICIENT_BUFFER,
+		  TeeMkhiTransact(&handle, &req, sizeof(req), buf,
+				  sizeof(struct mkhi_gen_get_fw_version_rsp), &rsp, &len, 1000));
+	EXPECT_EQ(nullptr, rsp);
+
+	/* the emulation fails other commands */
+	len = sizeof(rule);
+	EXPECT_EQ(TEE_UNABLE_TO_COMPLETE_OPERATION,
+		  TeeMkhiGetRule(&handle, TEE_MKHI_RULE_FEATURE_STATE, rule, &len, 1000));
+	EXPECT_EQ(TEE_UNABLE_TO_COMPLETE_OPERATION, TeeMkhiGetFwUpdateState(&handle, &state, 1000));
+
+	EXPECT_EQ(TEE_INVALID_PARAMETER, TeeMkhiGetFwVersion(&handle, NULL, 1000));
+	EXPECT_EQ(TEE_INVALID_PARAMETER, TeeMkhiTransact(&handle, &req, 2, buf, sizeof(buf),
+							 &rsp, &len, 1000));
+	TeeDisconnect(&handle);
+}
+
+/* version through the cache, the number of MKHI queries it took */
+static uint64_t MkhiFwVersionCached(struct tee_mkhi_fw_version *version,
+				    uint32_t timeout = 1000)
+{
+	TEEHANDLE handle = TEEHANDLE_ZERO;
+	struct tee_stats_counters session;
+
+	memset(version, 0, sizeof(*version));
+	EXPECT_EQ(TEE_SUCCESS, TeeInit(&handle, &GUID_DEVINTERFACE_MKHI, "loopback:fwcache"));
+	EXPECT_EQ(TEE_SUCCESS, TeeMkhiGetFwVersionCached(&handle, version, timeout));
+	EXPECT_EQ(TEE_SUCCESS, TeeGetStats(&handle, &session, NULL));
+	TeeDisconnect(&handle);
+	return session.writes;
+}
+
+static void WriteAttr(const std::string &path, const char *value)
+{
+	FILE *fp = fopen(path.c_str(), "w");
+
+	ASSERT_NE(nullptr, fp);
+	fputs(value, fp);
+	fclose(fp);
+}
+
+TEST_F(MeTeeLibTEST, PROD_MkhiFwVersionCached)
+{
+	struct tee_mkhi_fw_version version;
+	char root[] = "/tmp/metee_fwcache_XXXXXX";
+	std::string cache;
+	std::string dir;
+
+	ASSERT_NE(nullptr, mkdtemp(root));
+	cache = std::string(root) + "/cache";
+	dir = std::string(root) + "/class";
+	ASSERT_EQ(0, mkdir(dir.c_str(), 0700));
+	dir += "/mei";
+	ASSERT_EQ(0, mkdir(dir.c_str(), 0700));
+	dir += "/loopback:fwcache";
+	ASSERT_EQ(0, mkdir(dir.c_str(), 0700));
+	WriteAttr(dir + "/dev_state", "ENABLED\n");
+	WriteAttr(dir + "/fw_ver", "0:16.1.10.1000\n");
+	setenv("METEE_SYSFS_ROOT", root, 1);
+	setenv("METEE_FWCACHE", cache.c_str(), 1);
+
+	/* the first process asks, the next ones do not connect */
+	EXPECT_EQ(1U, MkhiFwVersionCached(&version));
+	EXPECT_EQ(16, version.code.major);
+	EXPECT_EQ(0U, MkhiFwVersionCached(&version));
+	EXPECT_EQ(16, version.code.major);
+	EXPECT_EQ(1000, version.code.buildNo);
+
+	/* a change of the running state does not invalidate it, a reset does */
+	ASSERT_EQ(TEE_SUCCESS, TeeLoopbackSetFWStatus(0, 0x90000245));
+	EXPECT_EQ(0U, MkhiFwVersionCached(&version));
+	ASSERT_EQ(TEE_SUCCESS, TeeLoopbackSetFWStatus(0, 0x90100255));
+	EXPECT_EQ(1U, MkhiFwVersionCached(&version));
+	EXPECT_EQ(0U, MkhiFwVersionCached(&version));
+	ASSERT_EQ(TEE_SUCCESS, TeeLoopbackSetFWStatus(0, 0x90000255));
+	EXPECT_EQ(1U, MkhiFwVersionCached(&version));
+
+	/* callers missing together wait for one query */
+	ASSERT_EQ(TEE_SUCCESS, TeeLoopbackSetFWStatus(0, 0x90200255));
+	std::vector<std::thread> threads;
+	std::atomic<uint64_t> queries(0);
+	for (int i = 0; i < 8; i++)
+		threads.emplace_back([&queries]() {
+			struct tee_mkhi_fw_version v;
+
+			queries += MkhiFwVersionCached(&v);
+		});
+	for (auto &t : threads)
+		t.join();
+	EXPECT_EQ(1U, queries.load());
+	ASSERT_EQ(TEE_SUCCESS, TeeLoopbackSetFWStatus(0, 0x90000255));
+	EXPECT_EQ(1U, MkhiFwVersionCached(&version));
+
+	/* a hit does not wait for the locks, a miss waits at most the timeout */
+	struct flock fl;
+	int fd = open(cache.c_str(), O_RDWR | O_CLOEXEC);
+	ASSERT_NE(-1, fd);
+	memset(&fl, 0, sizeof(fl));
+	fl.l_type = F_WRLCK;
+	fl.l_whence = SEEK_SET;
+	ASSERT_EQ(0, fcntl(fd, F_OFD_SETLK, &fl));
+	EXPECT_EQ(0U, MkhiFwVersionCached(&version, 50));
+	ASSERT_EQ(TEE_SUCCESS, TeeLoopbackSetFWStatus(0, 0x90300255));
+	EXPECT_EQ(1U, MkhiFwVersionCached(&version, 50));
+	EXPECT_EQ(1U, MkhiFwVersionCached(&version, 50));
+	EXPECT_EQ(16, version.code.major);
+	close(fd);
+	EXPECT_EQ(1U, MkhiFwVersionCached(&version));
+	EXPECT_EQ(0U, MkhiFwVersionCached(&version));
+	ASSERT_EQ(TEE_SUCCESS, TeeLoopbackSetFWStatus(0, 0x90000255));
+	EXPECT_EQ(1U, MkhiFwVersionCached(&version));
+
+	/* an update changes fw_ver */
+	WriteAttr(dir + "/fw_ver", "0:16.1.12.1100\n");
+	EXPECT_EQ(1U, MkhiFwVersionCached(&version));
+	EXPECT_EQ(0U, MkhiFwVersionCached(&version));
+
+	/* nothing is cached while the device is not enabled */
+	WriteAttr(dir + "/dev_state", "RESETTING\n");
+	EXPECT_EQ(1U, MkhiFwVersionCached(&version));
+	EXPECT_EQ(1U, MkhiFwVersionCached(&version));
+	WriteAttr(dir + "/dev_state", "ENABLED\n");
+	EXPECT_EQ(0U, MkhiFwVersionCached(&version));
+
+	/* without the cache file every call asks */
+	setenv("METEE_FWCACHE", (std::string(root) + "/none/cache").c_str(), 1);
+	EXPECT_EQ(1U, MkhiFwVersionCached(&version));
+	EXPECT_EQ(16, version.code.major);
+	unsetenv("METEE_FWCACHE");
+	unsetenv("METEE_SYSFS_ROOT");
+
+	EXPECT_EQ(TEE_INVALID_PARAMETER, TeeMkhiGetFwVersionCached(NULL, &version, 1000));
+
+	unlink(cache.c_str());
+	unlink((dir + "/dev_state").c_str());
+	unlink((dir + "/fw_ver").c_str());
+	rmdir(dir.c_str());
+	rmdir((std::string(root) + "/class/mei").c_str());
+	rmdir((std::string(root) + "/class").c_str());
+	rmdir(root);
+}
+
+/* 12f80028-b4b7-4b2d-aca8-46e0ff65814c */
+DEFINE_GUID(GUID_LOOPBACK_AMTHI, 0x12f80028, 0xb4b7, 0x4b2d,
+	    0xac, 0xa8, 0x46, 0xe0, 0xff, 0x65, 0x81, 0x4c);
+
+/* code versions of the emulated AMTHI client */
+struct LoopbackAmthi {
+	std::vector<std::pair<std::string, std::string>> versions;
+	uint32_t status = 0;
+	uint32_t count = 0;     /* reported count, 0 - versions.size() */
+	uint16_t badLength = 0; /* description length of the last entry, 0 - correct */
+	bool shortLength = false; /* header length one byte short */
+	bool longLength = false;  /* header length one byte long, as a truncated read */
+};
+
+static void AmthiString(struct amthi_unicode_string *str, const std::string &s)
+{
+	str->length = (uint16_t)s.size();
+	memcpy(str->string, s.data(), s.size());
+}
+
+static TEESTATUS LoopbackAmthiResponder(void *ctx, const GUID *guid,
+					const void *request, size_t request_size,
+					void *response, size_t *response_size)
+{
+	LoopbackAmthi *amthi = (LoopbackAmthi *)ctx;
+	struct amthi_get_code_versions_rsp rsp;
+	size_t len;
+
+	(void)guid;
+	if (request_size < sizeof(rsp.header))
+		return TEE_INVALID_PARAMETER;
+
+	memset(&rsp, 0, sizeof(rsp));
+	memcpy(&rsp.header, request, sizeof(rsp.header));
+	rsp.header.command.val = amthi_command_val_set_is_response(rsp.header.command.val, 1);
+	rsp.status = amthi->status;
+	if (!amthi_get_code_versions_req_valid(request, request_size) || amthi->status) {
+		len = offsetof(struct amthi_get_code_versions_rsp, bios_version);
+	} else {
+		memcpy(rsp.bios_version, "BIOS 1.2.3", 10);
+		for (size_t i = 0; i < amthi->versions.size(); i++) {
+			AmthiString(&rsp.versions[i].description, amthi->versions[i].first);
+			AmthiString(&rsp.versions[i].version, amthi->versions[i].second);
+		}
+		if (amthi->badLength)
+			rsp.versions[amthi->versions.size() - 1].description.length = amthi->badLength;
+		rsp.versions_count = (amthi->count) ? amthi->count : (uint32_t)amthi->versions.size();
+		len = sizeof(rsp);
+	}
+	rsp.header.length = (uint32_t)(len - sizeof(rsp.header) - amthi->shortLength +
+				       amthi->longLength);
+
+	if (len > *response_size)
+		return TEE_INSUFFICIENT_BUFFER;
+	memcpy(response, &rsp, len);
+	*response_size = len;
+	return TEE_SUCCESS;
+}
+
+static std::string AmthiView(const struct tee_amthi_string_view &view)
+{
+	return std::string(view.data, view.length);
+}
+
+TEST_F(MeTeeLibTEST, PROD_AmthiCodeVersions)
+{
+	TEEHANDLE handle = TEEHANDLE_ZERO;
+	LoopbackAmthi amthi;
+	struct amthi_get_code_versions_rsp buf;
+	struct tee_amthi_code_versions versions;
+	struct tee_amthi_string_view desc, ver;
+
+	amthi.versions = { { "Flash", "16.1.25.2049" }, { "Netstack", "16.1.25.2049" },
+			   { "AMTApps", "16.1.25.2049" }, { "AMT", "16.1" },
+			   { "Sku", "16392" }, { "VendorID", "8086" } };
+	ASSERT_EQ(TEE_SUCCESS, LoopbackRegister(&GUID_LOOPBACK_AMTHI, 4160,
+					       LoopbackAmthiResponder, &amthi));
+	ASSERT_EQ(TEE_SUCCESS, TeeInit(&handle, &GUID_LOOPBACK_AMTHI, TEE_LOOPBACK_DEVICE));
+	ASSERT_EQ(TEE_SUCCESS, TeeConnect(&handle));
+
+	/* the views point into the response buffer */
+	ASSERT_EQ(TEE_SUCCESS, TeeAmthiGetCodeVersions(&handle, &buf, sizeof(buf), &versions, 1000));
+	EXPECT_EQ((const void *)&buf, versions.rsp);
+	ASSERT_EQ(amthi.versions.size(), versions.count);
+	ASSERT_EQ(TEE_SUCCESS, TeeAmthiCodeVersionsBios(&versions, &ver));
+	EXPECT_EQ("BIOS 1.2.3", AmthiView(ver));
+	for (size_t i = 0; i < versions.count; i++) {
+		ASSERT_EQ(TEE_SUCCESS, TeeAmthiCodeVersionsAt(&versions, i, &desc, &ver));
+		EXPECT_EQ(amthi.versions[i].first, AmthiView(desc));
+		EXPECT_EQ(amthi.versions[i].second, AmthiView(ver));
+		EXPECT_GE(desc.data, (const char *)&buf);
+		EXPECT_LT(ver.data, (const char *)(&buf + 1));
+	}
+	EXPECT_EQ(TEE_INVALID_PARAMETER, TeeAmthiCodeVersionsAt(&versions, versions.count, &desc, &ver));
+
+	/* the lookup matches the whole description */
+	ASSERT_EQ(TEE_SUCCESS, TeeAmthiCodeVersionsFind(&versions, "AMT", &ver));
+	EXPECT_EQ("16.1", AmthiView(ver));
+	ASSERT_EQ(TEE_SUCCESS, TeeAmthiCodeVersionsFind(&versions, "VendorID", &ver));
+	EXPECT_EQ("8086", AmthiView(ver));
+	EXPECT_EQ(TEE_NOTSUPPORTED, TeeAmthiCodeVersionsFind(&versions, "AM", &ver));
+	EXPECT_EQ(TEE_NOTSUPPORTED, TeeAmthiCodeVersionsFind(&versions, "a description longer than 20", &ver));
+
+	/* a malformed entry fails on access only */
+	amthi.badLength = AMTHI_UNICODE_STRING_LEN + 1;
+	ASSERT_EQ(TEE_SUCCESS, TeeAmthiGetCodeVersions(&handle, &buf, sizeof(buf), &versions, 1000));
+	EXPECT_EQ(TEE_SUCCESS, TeeAmthiCodeVersionsAt(&versions, 0, &desc, NULL));
+	EXPECT_EQ(TEE_INTERNAL_ERROR, TeeAmthiCodeVersionsAt(&versions, versions.count - 1, &desc, &ver));
+	EXPECT_EQ(TEE_SUCCESS, TeeAmthiCodeVersionsFind(&versions, "Sku", &ver));
+	EXPECT_EQ(TEE_NOTSUPPORTED, TeeAmthiCodeVersionsFind(&versions, "VendorID", &ver));
+	amthi.badLength = 0;
+
+	/* malformed responses */
+	amthi.count = AMTHI_VERSIONS_NUMBER + 1;
+	EXPECT_EQ(TEE_INTERNAL_ERROR, TeeAmthiGetCodeVersions(&handle, &buf, sizeof(buf), &versions, 1000));
+	EXPECT_EQ(nullptr, versions.rsp);
+	amthi.count = 0;
+	amthi.shortLength = true;
+	EXPECT_EQ(TEE_INTERNAL_ERROR, TeeAmthiGetCodeVersions(&handle, &buf, sizeof(buf), &versions, 1000));
+	amthi.shortLength = false;
+	/* the rest of a response longer than the buffer stays queued in the device */
+	amthi.longLength = true;
+	EXPECT_EQ(TEE_INSUFFICIENT_BUFFER,
+		  TeeAmthiGetCodeVersions(&handle, &buf, sizeof(buf), &versions, 1000));
+	amthi.longLength = false;
+	amthi.status = 1;
+	EXPECT_EQ(TEE_UNABLE_TO_COMPLETE_OPERATION,
+		  TeeAmthiGetCodeVersions(&handle, &buf, sizeof(buf), &versions, 1000));
+	amthi.status = 0;
+
+	EXPECT_EQ(TEE_INSUFFICIENT_BUFFER,
+		  TeeAmthiGetCodeVersions(&handle, &buf, sizeof(buf) - 1, &versions, 1000));
+	EXPECT_EQ(TEE_INVALID_PARAMETER, TeeAmthiGetCodeVersions(&handle, &buf, sizeof(buf), NULL, 1000));
+	TeeDisconnect(&handle);
+}
+
+TEST_F(MeTeeLibTEST, PROD_TypedTransact)
+{
+	using namespace intel::security;
+
+	static_assert(is_tee_message<struct mkhi_gen_get_fw_version_req, 2048>::value, "MKHI request");
+	static_assert(is_tee_message<struct mkhi_gen_get_fw_version_rsp, 2048>::value, "MKHI response");
+	static_assert(!is_tee_message<struct mkhi_gen_get_fw_version_rsp, 16>::value, "exceeds the MTU");
+	static_assert(!is_tee_message<uint32_t, 2048>::value, "not packed");
+	static_assert(!is_tee_message<std::string, 2048>::value, "not trivially copyable");
+
+	basic_metee<2048> tee(GUID_DEVINTERFACE_MKHI, TEE_LOOPBACK_DEVICE);
+	tee.connect();
+	EXPECT_EQ(2048U, tee.max_msg_len());
+
+	struct mkhi_gen_get_fw_version_rsp ack =
+		tee.transact<struct mkhi_gen_get_fw_version_req, struct mkhi_gen_get_fw_version_rsp>(MkhiRequest, 1000);
+	EXPECT_EQ(1U, mkhi_hdr_word_is_response(ack.header.word));
+	EXPECT_EQ(0U, mkhi_hdr_word_result(ack.header.word));
+	EXPECT_EQ(16U, ack.code.major);
+
+	/* the emulation answers with the full acknowledge, not the header only */
+	try {
+		tee.transact<struct mkhi_gen_get_fw_version_req, struct mkhi_hdr>(MkhiRequest, 1000);
+		ADD_FAILURE() << "longer response accepted";
+	} catch (const metee_exception &e) {
+		EXPECT_EQ(TEE_UNABLE_TO_COMPLETE_OPERATION, e.code().value());
+	}
+	/* the longer response was consumed whole, no tail is left queued */
+	ack = tee.transact<struct mkhi_gen_get_fw_version_req, struct mkhi_gen_get_fw_version_rsp>(MkhiRequest, 1000);
+	EXPECT_EQ(16U, ack.code.major);
+
+	/* fits the declared MTU, not the connected client */
+#pragma pack(1)
+	struct {
+		struct mkhi_gen_get_fw_version_req req;
+		uint8_t pad[2048];
+	} big_req = {};
+#pragma pack()
+	basic_metee<4096> big(GUID_DEVINTERFACE_MKHI, TEE_LOOPBACK_DEVICE);
+	big.connect();
+	try {
+		big.transact<decltype(big_req), struct mkhi_gen_get_fw_version_rsp>(big_req, 1000);
+		ADD_FAILURE() << "request longer than the client accepts written";
+	} catch (const metee_exception &e) {
+		EXPECT_EQ(TEE_INVALID_PARAMETER, e.code().value());
+	}
+
+	std::vector<uint8_t> req((uint8_t *)&MkhiRequest, (uint8_t *)&MkhiRequest + sizeof(MkhiRequest));
+	EXPECT_EQ(sizeof(MkhiRequest), tee.write(req, 1000));
+	EXPECT_EQ(sizeof(struct mkhi_gen_get_fw_version_rsp), tee.read(1000).size());
+
+	EXPECT_THROW(metee(GUID_NON_EXISTS_CLIENT, TEE_LOOPBACK_DEVICE).connect(), metee_exception);
+}
+
+/* the generated layouts match the hand written ones of the hardware tests */
+static_assert(sizeof(struct mkhi_hdr) == sizeof(MKHI_MESSAGE_HEADER), "MKHI header");
+static_assert(sizeof(struct mkhi_gen_get_fw_version_req) == sizeof(GEN_GET_FW_VERSION), "MKHI request");
+static_assert(MKHI_GEN_GET_FW_VERSION_RSP_MIN_LEN == sizeof(GEN_GET_FW_VERSION_ACK), "MKHI response");
+static_assert(MKHI_GEN_GET_FW_VERSION == GEN_GET_FW_VERSION_CMD, "MKHI command");
+
+/* the generated encoders agree with the wire values */
+static_assert(sizeof(struct mkhi_gen_get_fw_version_rsp) == MKHI_GEN_GET_FW_VERSION_RSP_MAX_LEN,
+	      "MKHI response");
+static_assert(MKHI_GEN_GET_FW_VERSION_REQ_HEADER_WORD ==
+	      MKHI_HDR_WORD_ENCODE(MKHI_GROUP_GEN, MKHI_GEN_GET_FW_VERSION, 0, 0, 0), "MKHI encoder");
+static_assert(MKHI_GEN_GET_FW_VERSION_REQ_HEADER_WORD == 0x000002FF, "MKHI request");
+static_assert(mkhi_hdr_word_command(MKHI_GEN_GET_FW_VERSION_RSP_HEADER_WORD) == MKHI_GEN_GET_FW_VERSION,
+	      "MKHI decoder");
+static_assert(AMTHI_GET_CODE_VERSIONS_REQ_HEADER_COMMAND_VAL == 0x0400001A, "AMTHI command");
+static_assert(sizeof(struct amthi_get_code_versions_rsp) == TEE_AMTHI_CODE_VERSIONS_LEN,
+	      "AMTHI code versions");
+
+TEST_F(MeTeeLibTEST, PROD_SchemaValidators)
+{
+	TEEHANDLE handle = TEEHANDLE_ZERO;
+	struct mkhi_gen_get_fw_version_req req;
+	struct mkhi_gen_get_fw_version_rsp rsp;
+	size_t len = 0;
+
+	mkhi_gen_get_fw_version_req_init(&req);
+	EXPECT_TRUE(mkhi_gen_get_fw_version_req_valid(&req, sizeof(req)));
+	EXPECT_TRUE(mkhi_gen_get_fw_version_req_valid(&MkhiRequest, sizeof(MkhiRequest)));
+	EXPECT_EQ(0U, mkhi_hdr_word_result(req.header.word));
+
+	ASSERT_EQ(TEE_SUCCESS, TeeInit(&handle, &GUID_DEVINTERFACE_MKHI, TEE_LOOPBACK_DEVICE));
+	ASSERT_EQ(TEE_SUCCESS, TeeConnect(&handle));
+	ASSERT_EQ(TEE_SUCCESS, TeeWrite(&handle, &req, sizeof(req), &len, 1000));
+	ASSERT_EQ(TEE_SUCCESS, TeeRead(&handle, &rsp, sizeof(rsp), &len, 1000));
+	TeeDisconnect(&handle);
+
+	/* the emulation reports FITC, older firmware does not */
+	EXPECT_EQ((size_t)MKHI_GEN_GET_FW_VERSION_RSP_MAX_LEN, len);
+	EXPECT_TRUE(mkhi_gen_get_fw_version_rsp_valid(&rsp, len));
+	EXPECT_EQ(16, rsp.code.major);
+	EXPECT_EQ(1000, rsp.code.build_no);
+	EXPECT_EQ(0U, mkhi_hdr_word_result(rsp.header.word));
+
+	EXPECT_TRUE(mkhi_gen_get_fw_version_rsp_valid(&rsp, MKHI_GEN_GET_FW_VERSION_RSP_MIN_LEN));
+	EXPECT_FALSE(mkhi_gen_get_fw_version_rsp_valid(&rsp, MKHI_GEN_GET_FW_VERSION_RSP_MIN_LEN - 1));
+	EXPECT_FALSE(mkhi_gen_get_fw_version_rsp_valid(&rsp, sizeof(rsp) + 1));
+	EXPECT_FALSE(mkhi_gen_get_fw_version_req_valid(&rsp, sizeof(req)));
+	rsp.header.word = mkhi_hdr_word_set_is_response(rsp.header.word, 0);
+	EXPECT_FALSE(mkhi_gen_get_fw_version_rsp_valid(&rsp, len));
+}
+
+DEFINE_GUID(GUID_LOOPBACK_FWU, 0x87d90ca5, 0x3495, 0x4559,
+	    0x81, 0x05, 0x3f, 0xbf, 0xa3, 0x7b, 0x8b, 0x79);
+
+/* GSC firmware update emulation, collects the image */
+struct LoopbackFwu {
+	std::vector<uint8_t> image;
+	std::vector<uint8_t> metadata;
+	uint32_t length = 0;
+	uint32_t payload = 0;
+	unsigned int messages = 0;
+	unsigned int failAt = 0; /* message to fail, 0 - none */
+	bool ended = false;
+};
+
+static TEESTATUS LoopbackFwuResponder(void *ctx, const GUID *guid,
+				      const void *request, size_t request_size,
+				      void *response, size_t *response_size)
+{
+	LoopbackFwu *fwu = (LoopbackFwu *)ctx;
+	const uint8_t *req = (const uint8_t *)request;
+	struct tee_fwu_rsp rsp;
+
+	if (request_size < sizeof(struct tee_fwu_hdr) || *response_size < sizeof(rsp))
+		return TEE_INVALID_PARAMETER;
+
+	memset(&rsp, 0, sizeof(rsp));
+	memcpy(&rsp.header, req, sizeof(rsp.header));
+	rsp.header.flags = TEE_FWU_RESPONSE;
+	if (++fwu->messages == fwu->failAt) {
+		rsp.status = 0x9E;
+		goto out;
+	}
+	switch (rsp.header.command_id) {
+	case TEE_FWU_START: {
+		struct tee_fwu_start_req start;
+
+		memcpy(&start, req, sizeof(start));
+		fwu->length = start.update_img_length;
+		fwu->payload = start.payload_type;
+		fwu->metadata.assign(req + sizeof(start), req + request_size);
+		fwu->image.clear();
+		/* bit 0 forces the update, the rest is reserved */
+		if (start.flags)
+			rsp.status = 1;
+		for (size_t i = 0; i < sizeof(start.reserved) / sizeof(start.reserved[0]); i++)
+			if (start.reserved[i])
+				rsp.status = 1;
+		break;
+	}
+	case TEE_FWU_DATA: {
+		struct tee_fwu_data_req data;
+
+		memcpy(&data, req, sizeof(data));
+		if (sizeof(data) + data.data_length != request_size)
+			rsp.status = 1;
+		fwu->image.insert(fwu->image.end(), req + sizeof(data), req + request_size);
+		break;
+	}
+	case TEE_FWU_END:
+		fwu->ended = true;
+		break;
+	default:
+		rsp.status = 1;
+	}
+
+out:
+	memcpy(response, &rsp, sizeof(rsp));
+	*response_size = sizeof(rsp);
+	return TEE_SUCCESS;
+}
+
+static void FwuProgress(void *ctx, const struct tee_fwu_stats *stats)
+{
+	std::vector<uint64_t> *progress = (std::vector<uint64_t> *)ctx;
+
+	progress->push_back(stats->sent);
+}
+
+static void FwuWriteFile(const char *path, const std::vector<uint8_t> &data)
+{
+	int fd = open(path, O_WRONLY | O_TRUNC);
+
+	ASSERT_NE(-1, fd);
+	ASSERT_EQ((ssize_t)data.size(), write(fd, data.data(), data.size()));
+	close(fd);
+}
+
+TEST_F(MeTeeLibTEST, PROD_FwuUpdate)
+{
+	TEEHANDLE handle = TEEHANDLE_ZERO;
+	LoopbackFwu fwu;
+	struct tee_fwu_stats stats;
+	std::vector<uint64_t> progress;
+	std::vector<uint8_t> image(10000);
+	const uint8_t metadata[] = { 1, 2, 3, 4 };
+	std::string path;
+	uint32_t chunk = 1024 - sizeof(struct tee_fwu_data_req);
+
+	for (size_t i = 0; i < image.size(); i++)
+		image[i] = (uint8_t)(i * 7 + i / 251);
+
+	ASSERT_EQ(TEE_SUCCESS, LoopbackRegister(&GUID_LOOPBACK_FWU, 1024,
+					       LoopbackFwuResponder, &fwu));
+	ASSERT_EQ(TEE_SUCCESS, TeeInit(&handle, &GUID_LOOPBACK_FWU, TEE_LOOPBACK_DEVICE));
+	ASSERT_EQ(TEE_DISCONNECTED, TeeFwuUpdate(&handle, TEE_FWU_PAYLOAD_GFX_FW,
+						 image.data(), image.size(),
+						 NULL, 0, NULL, NULL, NULL, 1000));
+	ASSERT_EQ(TEE_SUCCESS, TeeConnect(&handle));
+
+	ASSERT_EQ(TEE_SUCCESS, TeeFwuUpdate(&handle, TEE_FWU_PAYLOAD_GFX_FW,
+					    image.data(), image.size(),
+					    metadata, sizeof(metadata),
+					    FwuProgress, &progress, &stats, 1000));
+	EXPECT_TRUE(fwu.ended);
+	EXPECT_EQ(image.size(), fwu.length);
+	EXPECT_EQ((uint32_t)TEE_FWU_PAYLOAD_GFX_FW, fwu.payload);
+	EXPECT_EQ(std::vector<uint8_t>(metadata, metadata + sizeof(metadata)), fwu.metadata);
+	EXPECT_EQ(image, fwu.image);
+	EXPECT_EQ(chunk, stats.chunk_size);
+	EXPECT_EQ((image.size() + chunk - 1) / chunk, stats.chunks);
+	EXPECT_EQ(image.size(), stats.sent);
+	EXPECT_EQ(image.size(), stats.total);
+	EXPECT_LE(stats.wait, stats.elapsed);
+	ASSERT_EQ(stats.chunks, progress.size());
+	EXPECT_EQ(chunk, progress.front());
+	EXPECT_EQ(image.size(), progress.back());
+
+	/* the same image from a file */
+	path = TempFile("metee_fwu", image);
+	ASSERT_FALSE(path.empty());
+	fwu = LoopbackFwu();
+	EXPECT_EQ(TEE_SUCCESS, TeeFwuUpdateFile(&handle, TEE_FWU_PAYLOAD_OPROM_CODE, path.c_str(),
+						NULL, 0, NULL, NULL, &stats, 1000));
+	EXPECT_EQ(image, fwu.image);
+	EXPECT_EQ((uint32_t)TEE_FWU_PAYLOAD_OPROM_CODE, fwu.payload);
+	EXPECT_TRUE(fwu.metadata.empty());
+
+	/* firmware fails the third data message */
+	fwu = LoopbackFwu();
+	fwu.failAt = 4;
+	EXPECT_EQ(TEE_UNABLE_TO_COMPLETE_OPERATION,
+		  TeeFwuUpdateFile(&handle, TEE_FWU_PAYLOAD_GFX_FW, path.c_str(),
+				   NULL, 0, NULL, NULL, &stats, 1000));
+	EXPECT_EQ(2U, stats.chunks);
+	EXPECT_FALSE(fwu.ended);
+	unlink(path.c_str());
+
+	EXPECT_EQ(TEE_INVALID_PARAMETER, TeeFwuUpdateFile(&handle, TEE_FWU_PAYLOAD_GFX_FW, path.c_str(),
+							  NULL, 0, NULL, NULL, NULL, 1000));
+	EXPECT_EQ(TEE_INVALID_PARAMETER, TeeFwuUpdate(&handle, TEE_FWU_PAYLOAD_GFX_FW,
+						      image.data(), 0,
+						      NULL, 0, NULL, NULL, NULL, 1000));
+	EXPECT_EQ(TEE_INVALID_PARAMETER, TeeFwuUpdate(&handle, TEE_FWU_PAYLOAD_GFX_FW,
+						      image.data(), image.size(),
+						      image.data(), 1024, NULL, NULL, NULL, 1000));
+	TeeDisconnect(&handle);
+}
+
+static std::vector<uint8_t> MakeBundle(const std::vector<std::pair<uint32_t, std::vector<uint8_t>>> &parts)
+{
+	struct tee_bundle_hdr hdr;
+	struct tee_bundle_entry entry;
+	std::vector<uint8_t> pkg(sizeof(hdr) + parts.size() * sizeof(entry));
+	size_t offset = pkg.size();
+	size_t pos = sizeof(hdr);
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic = TEE_BUNDLE_MAGIC;
+	hdr.version = TEE_BUNDLE_VERSION;
+	hdr.header_length = sizeof(hdr);
+	hdr.partitions = (uint32_t)parts.size();
+	hdr.entry_length = sizeof(entry);
+	memcpy(pkg.data(), &hdr, sizeof(hdr));
+	for (const auto &part : parts) {
+		memset(&entry, 0, sizeof(entry));
+		entry.payload_type = part.first;
+		entry.offset = (uint32_t)offset;
+		entry.length = (uint32_t)part.second.size();
+		entry.hash = TeeFwuImageHash(part.second.data(), part.second.size());
+		memcpy(pkg.data() + pos, &entry, sizeof(entry));
+		pos += sizeof(entry);
+		offset += part.second.size();
+	}
+	for (const auto &part : parts)
+		pkg.insert(pkg.end(), part.second.begin(), part.second.end());
+	return pkg;
+}
+
+static std::vector<uint8_t> FwuReadFile(const char *path)
+{
+	std::vector<uint8_t> data;
+	uint8_t buf[4096];
+	FILE *fp = fopen(path, "rb");
+	size_t n;
+
+	if (!fp)
+		return data;
+	while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+		data.insert(data.end(), buf, buf + n);
+	fclose(fp);
+	return data;
+}
+
+TEST_F(MeTeeLibTEST, PROD_Bundle)
+{
+	TEEHANDLE handle = TEEHANDLE_ZERO;
+	LoopbackFwu fwu;
+	struct tee_bundle *bundle = NULL;
+	const struct tee_bundle_partition *parts;
+	const struct tee_bundle_partition *part;
+	size_t count;
+	std::vector<uint8_t> gfx(3 * 1024 * 1024 + 100);
+	std::vector<uint8_t> data(1000, 0xda);
+	std::vector<uint8_t> code(4096, 0xc0);
+	std::vector<uint8_t> pkg;
+	std::string path;
+
+	for (size_t i = 0; i < gfx.size(); i++)
+		gfx[i] = (uint8_t)(i * 13 + i / 4093);
+	pkg = MakeBundle({ { TEE_FWU_PAYLOAD_GFX_FW, gfx },
+			   { TEE_FWU_PAYLOAD_OPROM_DATA, data },
+			   { TEE_FWU_PAYLOAD_OPROM_CODE, code } });
+
+	/* created from the partition image files */
+	std::string gfxPath = TempFile("metee_gfx_fw", gfx);
+	std::string dataPath = TempFile("metee_oprom_data", data);
+	std::string codePath = TempFile("metee_oprom_code", code);
+	ASSERT_FALSE(gfxPath.empty() || dataPath.empty() || codePath.empty());
+	const struct tee_bundle_source sources[] = {
+		{ TEE_FWU_PAYLOAD_GFX_FW, gfxPath.c_str() },
+		{ TEE_FWU_PAYLOAD_OPROM_DATA, dataPath.c_str() },
+		{ TEE_FWU_PAYLOAD_OPROM_CODE, codePath.c_str() },
+	};
+	path = TempFile("metee_bundle");
+	ASSERT_FALSE(path.empty());
+	ASSERT_EQ(TEE_SUCCESS, TeeBundleCreate(path.c_str(), sources, 3));
+	EXPECT_EQ(pkg, FwuReadFile(path.c_str()));
+	EXPECT_EQ(TEE_INVALID_PARAMETER, TeeBundleCreate(path.c_str(), sources, 0));
+	const struct tee_bundle_source missing = { TEE_FWU_PAYLOAD_GFX_FW, "/nonexistent/gfx_fw.bin" };
+	EXPECT_EQ(TEE_INVALID_PARAMETER, TeeBundleCreate(path.c_str(), &missing, 1));
+	EXPECT_EQ(TEE_PERMISSION_DENIED, TeeBundleCreate("/nonexistent/metee.bundle", sources, 3));
+
+	/* the partitions point into the mapping */
+	ASSERT_EQ(TEE_SUCCESS, TeeBundleOpen(path.c_str(), &bundle));
+	ASSERT_EQ(TEE_SUCCESS, TeeBundlePartitions(bundle, &parts, &count));
+	ASSERT_EQ(3U, count);
+	EXPECT_EQ((uint32_t)TEE_FWU_PAYLOAD_OPROM_DATA, parts[1].payload_type);
+	EXPECT_EQ(data, std::vector<uint8_t>(parts[1].data, parts[1].data + parts[1].size));
+	ASSERT_EQ(TEE_SUCCESS, TeeBundleFind(bundle, TEE_FWU_PAYLOAD_GFX_FW, &part));
+	EXPECT_EQ(&parts[0], part);
+	EXPECT_EQ(gfx.size(), part->size);
+	EXPECT_EQ(0, memcmp(gfx.data(), part->data, gfx.size()));
+	EXPECT_EQ(TEE_NOTSUPPORTED, TeeBundleFind(bundle, 7, &part));
+
+	/* the result does not depend on the number of threads */
+	EXPECT_EQ(TEE_INVALID_PARAMETER, TeeBundleVerifyWait(bundle));
+	for (unsigned int threads = 0; threads <= 8; threads += 4) {
+		ASSERT_EQ(TEE_SUCCESS, TeeBundleVerifyStart(bundle, 0, threads));
+		EXPECT_EQ(TEE_BUSY, TeeBundleVerifyStart(bundle, 0, threads));
+		EXPECT_EQ(TEE_SUCCESS, TeeBundleVerifyWait(bundle));
+	}
+	EXPECT_EQ(TEE_NOTSUPPORTED, TeeBundleVerifyStart(bundle, 7, 0));
+
+	/* the session is connected while the partition is verified */
+	ASSERT_EQ(TEE_SUCCESS, LoopbackRegister(&GUID_LOOPBACK_FWU, 1024,
+					       LoopbackFwuResponder, &fwu));
+	ASSERT_EQ(TEE_SUCCESS, TeeInit(&handle, &GUID_LOOPBACK_FWU, TEE_LOOPBACK_DEVICE));
+	EXPECT_EQ(TEE_SUCCESS, TeeBundleUpdate(&handle, bundle, TEE_FWU_PAYLOAD_GFX_FW,
+					       NULL, 0, NULL, NULL, NULL, 1000));
+	EXPECT_TRUE(fwu.ended);
+	EXPECT_EQ(gfx, fwu.image);
+	fwu = LoopbackFwu();
+	EXPECT_EQ(TEE_SUCCESS, TeeBundleUpdate(&handle, bundle, TEE_FWU_PAYLOAD_OPROM_CODE,
+					       NULL, 0, NULL, NULL, NULL, 1000));
+	EXPECT_EQ(code, fwu.image);
+	EXPECT_EQ((uint32_t)TEE_FWU_PAYLOAD_OPROM_CODE, fwu.payload);
+	TeeBundleClose(bundle);
+	bundle = NULL;
+
+	/* a corrupted partition fails only its own verification */
+	pkg[pkg.size() - code.size() - 1] ^= 0x01;
+	FwuWriteFile(path.c_str(), pkg);
+	ASSERT_EQ(TEE_SUCCESS, TeeBundleOpen(path.c_str(), &bundle));
+	ASSERT_EQ(TEE_SUCCESS, TeeBundleVerifyStart(bundle, TEE_FWU_PAYLOAD_GFX_FW, 2));
+	EXPECT_EQ(TEE_SUCCESS, TeeBundleVerifyWait(bundle));
+	ASSERT_EQ(TEE_SUCCESS, TeeBundleVerifyStart(bundle, 0, 2));
+	EXPECT_EQ(TEE_INVALID_PARAMETER, TeeBundleVerifyWait(bundle));
+	fwu = LoopbackFwu();
+	EXPECT_EQ(TEE_INVALID_PARAMETER,
+		  TeeBundleUpdate(&handle, bundle, TEE_FWU_PAYLOAD_OPROM_DATA,
+				  NULL, 0, NULL, NULL, NULL, 1000));
+	EXPECT_EQ(0U, fwu.length);
+	/* closed while verifying */
+	ASSERT_EQ(TEE_SUCCESS, TeeBundleVerifyStart(bundle, 0, 2));
+	TeeBundleClose(bundle);
+	bundle = NULL;
+
+	/* malformed bundles */
+	pkg = MakeBundle({ { TEE_FWU_PAYLOAD_OPROM_CODE, code } });
+	pkg.resize(pkg.size() - 1);
+	FwuWriteFile(path.c_str(), pkg);
+	EXPECT_EQ(TEE_INVALID_PARAMETER, TeeBundleOpen(path.c_str(), &bundle));
+	pkg = MakeBundle({ { TEE_FWU_PAYLOAD_OPROM_CODE, code } });
+	pkg[0] ^= 0xff;
+	FwuWriteFile(path.c_str(), pkg);
+	EXPECT_EQ(TEE_INVALID_PARAMETER, TeeBundleOpen(path.c_str(), &bundle));
+	pkg = MakeBundle({});
+	FwuWriteFile(path.c_str(), pkg);
+	EXPECT_EQ(TEE_INVALID_PARAMETER, TeeBundleOpen(path.c_str(), &bundle));
+	EXPECT_EQ(nullptr, bundle);
+	unlink(path.c_str());
+	EXPECT_EQ(TEE_INVALID_PARAMETER, TeeBundleOpen(path.c_str(), &bundle));
+
+	TeeDisconnect(&handle);
+}
+
+/* GSC firmware update emulation shared by concurrent sessions */
+struct LoopbackFwuFanout {
+	std::mutex lock;
+	uint64_t bytes = 0;
+	unsigned int starts = 0;
+	unsigned int ends = 0;
+	unsigned int active = 0;
+	unsigned int maxActive = 0;
+	std::vector<uint64_t> progress;
+};
+
+static TEESTATUS LoopbackFwuFanoutResponder(void *ctx, const GUID *guid,
+					    const void *request, size_t request_size,
+					    void *response, size_t *response_size)
+{
+	LoopbackFwuFanout *fwu = (LoopbackFwuFanout *)ctx;
+	struct tee_fwu_rsp rsp;
+
+	if (request_size < sizeof(struct tee_fwu_hdr) || *response_size < sizeof(rsp))
+		return TEE_INVALID_PARAMETER;
+
+	memset(&rsp, 0, sizeof(rsp));
+	memcpy(&rsp.header, request, sizeof(rsp.header));
+	rsp.header.flags = TEE_FWU_RESPONSE;
+	{
+		std::lock_guard<std::mutex> guard(fwu->lock);
+		switch (rsp.header.command_id) {
+		case TEE_FWU_START:
+			fwu->starts++;
+			fwu->maxActive = std::max(fwu->maxActive, ++fwu->active);
+			break;
+		case TEE_FWU_DATA:
+			fwu->bytes += request_size - sizeof(struct tee_fwu_data_req);
+			break;
+		case TEE_FWU_END:
+			fwu->ends++;
+			fwu->active--;
+			break;
+		}
+	}
+	memcpy(response, &rsp, sizeof(rsp));
+	*response_size = sizeof(rsp);
+	return TEE_SUCCESS;
+}
+
+static void FwuFanoutProgress(void *ctx, size_t index, const struct tee_fwu_stats *stats)
+{
+	LoopbackFwuFanout *fwu = (LoopbackFwuFanout *)ctx;
+	std::lock_guard<std::mutex> guard(fwu->lock);
+
+	fwu->progress[index] = stats->sent;
+}
+
+TEST_F(MeTeeLibTEST, PROD_FwuUpdateDevices)
+{
+	LoopbackFwuFanout fwu;
+	std::vector<uint8_t> image(5000, 0xA5);
+	struct tee_fwu_device devices[6];
+	const char *paths[6] = {
+		"loopback:gpu0", "loopback:gpu1", "loopback:gpu2",
+		"/dev/metee-nonexistent", "loopback:gpu4", "loopback:gpu5"
+	};
+	std::string path = TempFile("metee_fwu", image);
+
+	ASSERT_FALSE(path.empty());
+
+	memset(devices, 0, sizeof(devices));
+	for (size_t i = 0; i < 6; i++)
+		devices[i].device = paths[i];
+	fwu.progress.resize(6);
+	ASSERT_EQ(TEE_SUCCESS, LoopbackRegister(&GUID_LOOPBACK_FWU, 1024,
+					       LoopbackFwuFanoutResponder, &fwu));
+
+	EXPECT_EQ(TEE_UNABLE_TO_COMPLETE_OPERATION,
+		  TeeFwuUpdateDevices(&GUID_LOOPBACK_FWU, TEE_FWU_PAYLOAD_GFX_FW, path.c_str(),
+				      NULL, 0, devices, 6, 2,
+				      FwuFanoutProgress, &fwu, 1000));
+	for (size_t i = 0; i < 6; i++) {
+		if (i == 3) {
+			EXPECT_NE(TEE_SUCCESS, devices[i].status);
+			EXPECT_EQ(0U, devices[i].stats.sent);
+			EXPECT_EQ(0U, fwu.progress[i]);
+			continue;
+		}
+		EXPECT_EQ(TEE_SUCCESS, devices[i].status) << paths[i];
+		EXPECT_EQ(image.size(), devices[i].stats.sent) << paths[i];
+		EXPECT_EQ(image.size(), fwu.progress[i]) << paths[i];
+	}
+	EXPECT_EQ(5U, fwu.starts);
+	EXPECT_EQ(5U, fwu.ends);
+	EXPECT_EQ(5 * image.size(), fwu.bytes);
+	EXPECT_LE(fwu.maxActive, 2U);
+
+	/* all at once */
+	devices[3].device = "loopback:gpu3";
+	EXPECT_EQ(TEE_SUCCESS, TeeFwuUpdateDevices(&GUID_LOOPBACK_FWU, TEE_FWU_PAYLOAD_GFX_FW,
+						   path.c_str(), NULL, 0, devices, 6, 0,
+						   NULL, NULL, 1000));
+	EXPECT_EQ(11U, fwu.ends);
+	unlink(path.c_str());
+
+	EXPECT_EQ(TEE_INVALID_PARAMETER,
+		  TeeFwuUpdateDevices(&GUID_LOOPBACK_FWU, TEE_FWU_PAYLOAD_GFX_FW, path.c_str(),
+				      NULL, 0, devices, 6, 0, NULL, NULL, 1000));
+	EXPECT_EQ(TEE_INVALID_PARAMETER,
+		  TeeFwuUpdateDevices(&GUID_LOOPBACK_FWU, TEE_FWU_PAYLOAD_GFX_FW, path.c_str(),
+				      NULL, 0, devices, 0, 0, NULL, NULL, 1000));
+}
+#endif // not WIN32
+
 TEST_P(MeTeeNTEST, PROD_N_TestConnectByWrongPath)
 {
 	TEEHANDLE handle = TEEHANDLE_ZERO;
@@ -670,6 +1921,33 @@ TEST_P(MeTeeFDTEST, PROD_MKHI_SimpleGetVersion)
 	EXPECT_EQ(TEE_INVALID_DEVICE_HANDLE, TeeGetDeviceHandle(&Handle));
 }
 
+#ifndef WIN32
+/* the session on the caller descriptor is not reset nor sent a short message */
+TEST_P(MeTeeFDTEST, PROD_MKHI_FaultInjectHandle)
+{
+	TEEHANDLE Handle = TEEHANDLE_ZERO;
+	size_t NumberOfBytes = 0;
+	struct MeTeeTESTParams intf = GetParam();
+	std::vector <char> MaxResponse;
+	uint64_t count = 1;
+
+	ASSERT_EQ(TEE_SUCCESS, TeeFaultInjectSet("write:enodev#1,write:short,read:enodev#1"));
+	EXPECT_EQ(SUCCESS, TeeInitHandle(&Handle, intf.client, deviceHandle));
+	if (TeeConnect(&Handle) == SUCCESS) {
+		MaxResponse.resize(Handle.maxMsgLen);
+		EXPECT_EQ(SUCCESS, TeeWrite(&Handle, &MkhiRequest, sizeof(GEN_GET_FW_VERSION), &NumberOfBytes, 0));
+		EXPECT_EQ(sizeof(GEN_GET_FW_VERSION), NumberOfBytes);
+		EXPECT_EQ(SUCCESS, TeeRead(&Handle, &MaxResponse[0], Handle.maxMsgLen, &NumberOfBytes, 0));
+		EXPECT_EQ(TEE_SUCCESS, TeeFaultInjectCount(&count));
+		EXPECT_EQ(0U, count);
+	} else {
+		ADD_FAILURE() << "connect failed";
+	}
+	TeeDisconnect(&Handle);
+	EXPECT_EQ(TEE_SUCCESS, TeeFaultInjectSet(NULL));
+}
+#endif // WIN32
+
 TEST_P(MeTeeFDTEST, PROD_MKHI_GetFWStatus)
 {
 	TEEHANDLE Handle = TEEHANDLE_ZERO;
@@ -692,8 +1970,63 @@ TEST_P(MeTeeFDTEST, PROD_MKHI_GetFWStatus)
 }
 
 
+#ifdef WIN32
 struct MeTeeTESTParams interfaces[1] = {
-	{"PCH", NULL, &GUID_DEVINTERFACE_MKHI}};
+	{"PCH", NULL, &GUID_DEVINTERFACE_MKHI, NULL}};
+#else // WIN32
+/*
+MKHI emulation for the loopback instance
+Answers GetVersion, other commands get non-zero result
+*/
+static TEESTATUS LoopbackMkhiResponder(void *ctx, const GUID *guid,
+				       const void *request, size_t request_size,
+				       void *response, size_t *response_size)
+{
+	const struct mkhi_hdr *req = (const struct mkhi_hdr *)request;
+	struct mkhi_gen_get_fw_version_rsp ack;
+
+	if (request_size < sizeof(*req) || *response_size < sizeof(ack))
+		return TEE_INVALID_PARAMETER;
+
+	memset(&ack, 0, sizeof(ack));
+	/* the firmware answers with the group and command of the request only */
+	ack.header.word = MKHI_HDR_WORD_ENCODE(mkhi_hdr_word_group(req->word),
+					       mkhi_hdr_word_command(req->word), 1, 0, 0);
+	if (mkhi_gen_get_fw_version_req_valid(request, request_size)) {
+		ack.code.major = 16;
+		ack.code.minor = 1;
+		ack.code.build_no = 1000;
+		ack.code.hot_fix = 10;
+		ack.fitc = ack.code;
+	} else {
+		ack.header.word = mkhi_hdr_word_set_result(ack.header.word, 1);
+	}
+	memcpy(response, &ack, sizeof(ack));
+	*response_size = sizeof(ack);
+	return TEE_SUCCESS;
+}
+
+class LoopbackEnvironment : public ::testing::Environment {
+public:
+	void SetUp() override {
+		ASSERT_EQ(TEE_SUCCESS, TeeLoopbackRegister(&GUID_DEVINTERFACE_MKHI, 2048, 1,
+							   LoopbackMkhiResponder, NULL));
+		ASSERT_EQ(TEE_SUCCESS, TeeLoopbackSetFWStatus(0, 0x90000255));
+		ASSERT_EQ(TEE_SUCCESS, TeeLoopbackSetFWStatus(1, 0x89110126));
+	}
+
+	void TearDown() override {
+		TeeLoopbackUnregister(&GUID_DEVINTERFACE_MKHI);
+	}
+};
+
+static ::testing::Environment *const loopbackEnv =
+	::testing::AddGlobalTestEnvironment(new LoopbackEnvironment);
+
+struct MeTeeTESTParams interfaces[2] = {
+	{"PCH", NULL, &GUID_DEVINTERFACE_MKHI, NULL},
+	{"Loopback", NULL, &GUID_DEVINTERFACE_MKHI, TEE_LOOPBACK_DEVICE}};
+#endif // WIN32
 
 INSTANTIATE_TEST_SUITE_P(MeTeeTESTInstance, MeTeeTEST,
 		testing::ValuesIn(interfaces),
@@ -18,6 +18,7 @@
 #define INVALID_HANDLE_VALUE ((void*)0)
 #endif // WIN32
 #include "MKHI.h"
+#include "mkhi_schema.h"
 
 std::string GetErrorString(unsigned long LastError);
 
@@ -30,26 +31,39 @@ namespace testing {
 	}
 }
 
+struct MeTeeTESTParams {
+	const char *name;
+	const GUID *device;
+	const GUID *client;
+	const char *path;
+};
+
 #ifdef _WIN32
-inline TEESTATUS TestTeeInitGUID(PTEEHANDLE handle, const GUID *guid, const GUID *device)
+inline TEESTATUS TestTeeInitGUID(PTEEHANDLE handle, const GUID *guid, const struct MeTeeTESTParams &intf)
 {
-	if (device != NULL)
-		return TeeInitGUID(handle, guid, device);
+	if (intf.device != NULL)
+		return TeeInitGUID(handle, guid, intf.device);
 	else
-		return TeeInit(handle, guid, NULL);
+		return TeeInit(handle, guid, intf.path);
 }
 #else /* _WIN32 */
-inline TEESTATUS TestTeeInitGUID(PTEEHANDLE handle, const GUID *guid, const GUID *device)
+inline TEESTATUS TestTeeInitGUID(PTEEHANDLE handle, const GUID *guid, const struct MeTeeTESTParams &intf)
 {
-	return TeeInit(handle, guid, NULL);
+	return TeeInit(handle, guid, intf.path);
 }
 #endif /* _WIN32 */
 
-struct MeTeeTESTParams {
-	const char *name;
-	const GUID *device;
-	const GUID *client;
-};
+/*
+Give a real device time to settle between the tests,
+emulated devices and skipped tests do not wait
+*/
+inline void TestSettle(const struct MeTeeTESTParams &intf)
+{
+	if (::testing::Test::IsSkipped() ||
+	    (intf.path && !strncmp(intf.path, TEE_LOOPBACK_DEVICE, strlen(TEE_LOOPBACK_DEVICE))))
+		return;
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+}
 
 class MeTeeTEST : public ::testing::TestWithParam<struct MeTeeTESTParams>{
 public:
@@ -74,7 +88,7 @@ public:
 		printf("Enter ProdTests TearDown\n");
 #endif
 
-		std::this_thread::sleep_for(std::chrono::milliseconds(100)); //Is it helping?
+		TestSettle(GetParam());
 #ifdef _DEBUG
 		printf("Exit ProdTests TearDown\n");
 #endif
@@ -109,7 +123,7 @@ public:
 		printf("Enter ProdTests TearDown\n");
 #endif
 
-		std::this_thread::sleep_for(std::chrono::milliseconds(100)); //Is it helping?
+		TestSettle(GetParam());
 #ifdef _DEBUG
 		printf("Exit ProdTests TearDown\n");
 #endif
@@ -138,7 +152,7 @@ public:
 
 	void TearDown() {
 		CloseMEI();
-		std::this_thread::sleep_for(std::chrono::milliseconds(100)); //Is it helping?
+		TestSettle(GetParam());
 	}
 
 	~MeTeeFDTEST() {
@@ -168,7 +182,7 @@ public:
 #endif
 		_handle.handle = NULL;
 
-		status = TestTeeInitGUID(&_handle, intf.client, intf.device);
+		status = TestTeeInitGUID(&_handle, intf.client, intf);
 		if (status == TEE_DEVICE_NOT_FOUND)
 			GTEST_SKIP();
 		ASSERT_EQ(TEE_SUCCESS, status);
@@ -187,8 +201,7 @@ public:
 		printf("Enter ProdTests TearDown\n");
 #endif
 		TeeDisconnect(&_handle);
-		//Is this helping?
-		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		TestSettle(GetParam());
 #ifdef _DEBUG
 		printf("Exit ProdTests TearDown\n");
 #endif
@@ -200,3 +213,55 @@ public:
 	TEEHANDLE _handle;
 	GEN_GET_FW_VERSION MkhiRequest;
 };
+
+#ifndef WIN32
+#include <vector>
+#include <unistd.h>
+
+/*
+Library tests on the emulated clients, they do not depend on the interface
+and run once; temporary files and loopback clients are removed in TearDown
+*/
+class MeTeeLibTEST : public ::testing::Test {
+public:
+	void SetUp() {
+		mkhi_gen_get_fw_version_req_init(&MkhiRequest);
+	}
+
+	void TearDown() {
+		for (const GUID *guid : clients)
+			TeeLoopbackUnregister(guid);
+		for (const std::string &path : files)
+			unlink(path.c_str());
+	}
+
+	/* temporary file holding the data */
+	std::string TempFile(const char *prefix, const std::vector<uint8_t> &data = {}) {
+		std::string path = std::string("/tmp/") + prefix + "_XXXXXX";
+		int fd = mkstemp(&path[0]);
+
+		EXPECT_NE(-1, fd) << path;
+		if (fd == -1)
+			return std::string();
+		files.push_back(path);
+		EXPECT_EQ((ssize_t)data.size(), write(fd, data.data(), data.size()));
+		close(fd);
+		return path;
+	}
+
+	/* loopback client answered by the responder */
+	TEESTATUS LoopbackRegister(const GUID *guid, uint32_t maxMsgLen,
+				   TeeLoopbackResponder responder, void *ctx) {
+		TEESTATUS status = TeeLoopbackRegister(guid, maxMsgLen, 1, responder, ctx);
+
+		if (status == TEE_SUCCESS)
+			clients.push_back(guid);
+		return status;
+	}
+
+	struct mkhi_gen_get_fw_version_req MkhiRequest;
+private:
+	std::vector<std::string> files;
+	std::vector<const GUID *> clients;
+};
+#endif // not WIN32
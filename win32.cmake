@@ -4,6 +4,10 @@
 set(TEE_SOURCES
     src/Windows/metee_win.c
     src/Windows/metee_winhelpers.c
+    src/metee_mkhi.c
+    src/metee_amthi.c
+    src/metee_fwu.c
+    src/metee_bundle.c
 )
 
 add_library(${PROJECT_NAME} ${TEE_SOURCES})